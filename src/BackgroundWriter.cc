@@ -0,0 +1,79 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+// For documentation, see BackgroundWriter.h
+#include "BackgroundWriter.h"
+
+// C libraries
+#include <assert.h>
+
+
+
+
+BackgroundWriter::BackgroundWriter( const size_t max_pending )
+  : _max_pending( max_pending ),
+    _stop( false )
+{
+  assert( max_pending > 0 );
+  _thread = thread( &BackgroundWriter::WriterLoop, this );
+}
+
+
+
+void
+BackgroundWriter::Push( const function<void()> & job )
+{
+  {
+    unique_lock<mutex> lock( _mutex );
+    assert( !_stop ); // if this fails, Finish() has already been called
+    while ( _jobs.size() >= _max_pending ) _not_full.wait( lock );
+    _jobs.push( job );
+  }
+  _not_empty.notify_one();
+}
+
+
+
+void
+BackgroundWriter::Finish()
+{
+  {
+    lock_guard<mutex> lock( _mutex );
+    _stop = true;
+  }
+  _not_empty.notify_one();
+  if ( _thread.joinable() ) _thread.join();
+}
+
+
+
+void
+BackgroundWriter::WriterLoop()
+{
+  while ( 1 ) {
+    function<void()> job;
+    {
+      unique_lock<mutex> lock( _mutex );
+      while ( !_stop && _jobs.empty() ) _not_empty.wait( lock );
+      if ( _jobs.empty() ) return; // _stop is set and there's nothing left to do
+      job = _jobs.front();
+      _jobs.pop();
+    }
+    _not_full.notify_all();
+    job(); // the job's captures (and whatever they keep alive) are released when it goes out of scope
+  }
+}
@@ -0,0 +1,82 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * BackgroundWriter.h
+ *
+ * BackgroundWriter: A single background thread that runs output jobs (typically, writing a file from an object in memory) in the order they're pushed, so
+ * the disk I/O overlaps whatever the pushing threads do next.  Lachesis uses it to write freshly built ChromLinkMatrix files while the same matrices are
+ * being ordered (see LachesisOrdering in Lachesis.cc.)
+ *
+ * The queue is bounded: Push() blocks while max_pending jobs are waiting, so the objects that the queued jobs keep alive (e.g., via shared_ptr) never add up
+ * to more than max_pending (plus the one being written.)  Finish() waits for the queue to drain; the destructor calls it.
+ *
+ * The writer thread is outside the ThreadPool, and isn't counted in THREADS: it spends most of its time waiting on the disk.  Jobs must be thread-safe with
+ * respect to whatever the other threads are doing to the same objects - in practice, a job should only read its object, and the other threads should only
+ * modify data that the job doesn't read.
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _BACKGROUND_WRITER__H
+#define _BACKGROUND_WRITER__H
+
+
+#include <queue>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+using namespace std;
+
+
+
+
+class BackgroundWriter
+{
+ public:
+
+  BackgroundWriter( const size_t max_pending );
+  ~BackgroundWriter() { Finish(); }
+
+  // Push: Queue a job for the writer thread.  Blocks while the queue is full.
+  void Push( const function<void()> & job );
+
+  // Finish: Wait until every queued job has run, then stop the writer thread.  No more jobs can be pushed afterwards.
+  void Finish();
+
+ private:
+
+  BackgroundWriter( const BackgroundWriter & );             // not copyable
+  BackgroundWriter & operator=( const BackgroundWriter & ); // not assignable
+
+  void WriterLoop();
+
+  const size_t _max_pending;
+  queue< function<void()> > _jobs;
+  thread _thread;
+  mutex _mutex;
+  condition_variable _not_empty, _not_full;
+  bool _stop;
+};
+
+
+#endif
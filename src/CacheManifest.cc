@@ -0,0 +1,188 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+// For documentation, see CacheManifest.h
+#include "CacheManifest.h"
+
+// C libraries
+#include <assert.h>
+#include <stdio.h> // snprintf
+
+// STL declarations
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+// Modules in ~/include (must add -L~/include and -lJ<module> to link)
+#include "gtools/SAMStepper.h" // TargetNames, TargetLengths
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+#include <boost/lexical_cast.hpp>
+
+
+
+
+// FNV-1a hash of a string, rendered in hex.  Used to fingerprint SAM headers and cluster membership.
+string
+FingerprintHash( const string & s )
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for ( size_t i = 0; i < s.size(); i++ ) {
+    hash ^= (unsigned char) s[i];
+    hash *= 1099511628211ULL;
+  }
+
+  char buf[17];
+  snprintf( buf, 17, "%016llx", (unsigned long long) hash );
+  return buf;
+}
+
+
+
+
+void
+CacheManifest::AddParam( const string & key, const string & value )
+{
+  _entries.push_back( make_pair( key, value ) );
+}
+
+
+
+// AddFile: Fingerprint a file by its size and modification time.  A missing file gets the value "missing", which will never match an existing file.
+void
+CacheManifest::AddFile( const string & key, const string & file )
+{
+  if ( !boost::filesystem::is_regular_file( file ) ) { AddParam( key, file + " missing" ); return; }
+
+  AddParam( key, file
+	    + " size=" + boost::lexical_cast<string>( boost::filesystem::file_size( file ) )
+	    + " mtime=" + boost::lexical_cast<string>( boost::filesystem::last_write_time( file ) ) );
+}
+
+
+
+// AddSAMFiles: Fingerprint each SAM/BAM file by its size, modification time, and a hash of the target names and lengths in its header.
+// The header hash catches the case of a SAM file regenerated against a different draft assembly.
+void
+CacheManifest::AddSAMFiles( const vector<string> & SAM_files )
+{
+  AddParam( "N_SAM_files", boost::lexical_cast<string>( SAM_files.size() ) );
+
+  for ( size_t i = 0; i < SAM_files.size(); i++ ) {
+    AddFile( "SAM_file", SAM_files[i] );
+
+    vector<string> names = TargetNames  ( SAM_files[i] );
+    vector<int>    lens  = TargetLengths( SAM_files[i] );
+    assert( names.size() == lens.size() );
+
+    ostringstream header;
+    for ( size_t j = 0; j < names.size(); j++ )
+      header << names[j] << '\t' << lens[j] << '\n';
+
+    AddParam( "SAM_header", boost::lexical_cast<string>( names.size() ) + " targets, hash=" + FingerprintHash( header.str() ) );
+  }
+}
+
+
+
+// AddCluster: Fingerprint the membership of a cluster.  A CLM's local contig IDs are the positions of its contigs in this (sorted) set, so the set itself is
+// what determines the CLM's contents.
+void
+CacheManifest::AddCluster( const set<int> & cluster )
+{
+  ostringstream IDs;
+  for ( set<int>::const_iterator it = cluster.begin(); it != cluster.end(); ++it )
+    IDs << *it << ',';
+
+  AddParam( "cluster", boost::lexical_cast<string>( cluster.size() ) + " contigs, hash=" + FingerprintHash( IDs.str() ) );
+}
+
+
+
+// A single hash of all the entries in this manifest.
+string
+CacheManifest::Fingerprint() const
+{
+  string s;
+  for ( size_t i = 0; i < _entries.size(); i++ )
+    s += _entries[i].first + " = " + _entries[i].second + '\n';
+  return FingerprintHash( s );
+}
+
+
+
+// Remove <cached_file>.manifest, if it exists.  Call this before (re)writing cached_file, so that a partially written file is never taken as valid.
+void
+CacheManifest::Invalidate( const string & cached_file )
+{
+  boost::filesystem::remove( ManifestFilename( cached_file ) );
+}
+
+
+
+// Write this manifest to <cached_file>.manifest.  Call this only after cached_file has been completely written.
+void
+CacheManifest::WriteFile( const string & cached_file ) const
+{
+  string manifest_file = ManifestFilename( cached_file );
+  ofstream out( ( manifest_file + ".tmp" ).c_str(), ios::out );
+
+  out << "# Lachesis cache manifest for " << cached_file << endl;
+  out << "# If any of these fingerprints changes, Lachesis will regenerate the cached file." << endl;
+  for ( size_t i = 0; i < _entries.size(); i++ )
+    out << _entries[i].first << " = " << _entries[i].second << endl;
+
+  out.close();
+  boost::filesystem::rename( manifest_file + ".tmp", manifest_file );
+}
+
+
+
+// Return true if cached_file and <cached_file>.manifest both exist, and the manifest is identical to this one.  If not, print the reason.
+bool
+CacheManifest::MatchesCache( const string & cached_file ) const
+{
+  if ( !boost::filesystem::is_regular_file( cached_file ) ) return false;
+
+  string manifest_file = ManifestFilename( cached_file );
+  if ( !boost::filesystem::is_regular_file( manifest_file ) ) {
+    cout << "CacheManifest: No manifest for cached file " << cached_file << "; it will be regenerated." << endl;
+    return false;
+  }
+
+  // Read the manifest file, skipping the commented header lines, and compare it line-by-line to this manifest.
+  ifstream in( manifest_file.c_str(), ios::in );
+  string line;
+  size_t i = 0;
+  while ( getline( in, line ) ) {
+    if ( line.empty() || line[0] == '#' ) continue;
+
+    if ( i == _entries.size() || line != _entries[i].first + " = " + _entries[i].second ) {
+      cout << "CacheManifest: Cached file " << cached_file << " is stale; it will be regenerated." << endl;
+      if ( i < _entries.size() ) cout << "\tOLD: " << line << "\n\tNEW: " << _entries[i].first << " = " << _entries[i].second << endl;
+      return false;
+    }
+    i++;
+  }
+
+  if ( i != _entries.size() ) {
+    cout << "CacheManifest: Manifest for cached file " << cached_file << " is incomplete; it will be regenerated." << endl;
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * CacheManifest.h
+ *
+ * A CacheManifest is a list of fingerprints of the inputs that went into a cached data file in <OUTPUT_DIR>/cached_data (all.GLM, group*.CLM.)  Each cached
+ * file <file> gets a companion file <file>.manifest, which is written right after <file> itself.  On a later run, Lachesis builds a CacheManifest from the
+ * current inputs and compares it to the one on disk: if they match, the cached file is reused; if not (or if there is no manifest), the cached file is stale
+ * and gets rebuilt.  This replaces the need to set OVERWRITE_GLM or OVERWRITE_CLMS by hand whenever the inputs change.  (Those flags still force a rebuild.)
+ *
+ * The fingerprints are deliberately cheap to compute: file sizes and modification times, a hash of each SAM/BAM header (target names and lengths), the
+ * relevant parameters, and, for CLMs, a hash of the cluster's contig membership.  The SAM/BAM files themselves are never re-read just to check the cache.
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _CACHE_MANIFEST__H
+#define _CACHE_MANIFEST__H
+
+
+#include <inttypes.h> // uint64_t
+#include <set>
+#include <vector>
+#include <string>
+#include <utility> // pair
+using namespace std;
+
+
+
+
+class CacheManifest
+{
+ public:
+
+  CacheManifest() {}
+
+  /* FINGERPRINTS: Each of these functions adds one or more "key = value" entries.  The order in which they're called matters. */
+  void AddParam( const string & key, const string & value );
+  void AddFile( const string & key, const string & file ); // size and modification time of a file
+  void AddSAMFiles( const vector<string> & SAM_files ); // size, modification time, and header hash of each SAM/BAM file
+  void AddCluster( const set<int> & cluster ); // size and hash of the contig IDs in this cluster
+
+  // A single hash of all the entries in this manifest.  Used by the ProgressJournal to tie a completed step to the inputs it was run on.
+  string Fingerprint() const;
+
+  /* FILE I/O */
+  // The manifest file for a cached data file is always <cached_file>.manifest.
+  static string ManifestFilename( const string & cached_file ) { return cached_file + ".manifest"; }
+
+  // Remove <cached_file>.manifest, if it exists.  Call this before (re)writing cached_file, so that a partially written file is never taken as valid.
+  static void Invalidate( const string & cached_file );
+
+  // Write this manifest to <cached_file>.manifest.  Call this only after cached_file has been completely written.
+  void WriteFile( const string & cached_file ) const;
+
+  // Return true if cached_file and <cached_file>.manifest both exist, and the manifest is identical to this one.  If not, print the reason.
+  bool MatchesCache( const string & cached_file ) const;
+
+ private:
+
+  vector< pair<string,string> > _entries;
+};
+
+
+
+// FNV-1a hash of a string, rendered in hex.  Used to fingerprint SAM headers and cluster membership.
+string FingerprintHash( const string & s );
+
+
+#endif
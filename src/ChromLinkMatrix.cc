@@ -41,7 +41,10 @@
 #include "ClusterVec.h"
 #include "ContigOrdering.h"
 #include "LinkSizeDistribution.h"
+#include "LinkSpill.h" // CLMLink, CLMLinkSpill
+#include "LinkStore.h"
 #include "TextFileParsers.h" // ParseTabDelimFile
+#include "ThreadPool.h"
 #include "TimeMem.h"
 #include "TrueMapping.h"
 
@@ -168,6 +171,169 @@ vector<int> find_longest_path(const vector< vector<int> > &adj_list) {
   return path;
 }  // End of find_longest_path
 
+/*******************************************************************************
+ * TreeShredder: Breaks a tree (given in the form of an adjacency list) into "shreds", by
+ * repeatedly finding the longest path in what's left of the tree and removing it.  Used by
+ * ShredTree(), for ReinsertShreds().
+ * The shreds are exactly the ones that repeated calls to find_longest_path() would find, in the
+ * same order, with the same tie-breaking.  Each path is found in the component containing the
+ * lowest-numbered node that still has a neighbor, by the same two breadth-first searches as in
+ * find_longest_path().  But instead of searching (and editing) the whole adjacency list each
+ * time, this only visits the component being shredded: the components are kept in a queue keyed
+ * by their lowest-numbered node, and removed nodes are marked rather than erased from their
+ * neighbors' lists.  Each search labels its nodes with their distance and parent, instead of
+ * copying a path to every node.  So each shred costs time proportional to the size of its
+ * component, rather than to the size of the whole tree (plus the number of edits to neighbors'
+ * adjacency lists.)  The input tree isn't modified.
+ ******************************************************************************/
+class TreeShredder {
+ public:
+  explicit TreeShredder(const vector< vector<int> > &tree)
+    : _tree(tree),
+      _removed(tree.size(), false),
+      _stamp(tree.size(), 0),
+      _dist(tree.size(), 0),
+      _parent(tree.size(), -1),
+      _current_stamp(0) {}
+
+  // Shred: Return the shreds, in the order in which they are found.  The first shred is the
+  // longest path in the tree, as found by find_longest_path().  Nodes that end up in no shred are
+  // left over as singletons; Removed() tells which nodes are in shreds.
+  vector< vector<int> > Shred() {
+    vector< vector<int> > shreds;
+
+    // Find the initial components.  Only components with at least two nodes can have paths.
+    priority_queue< int, vector<int>, greater<int> > components; // lowest node in each component
+    _current_stamp++;
+    for (int i = 0; i < (int) _tree.size(); i++) {
+      if (_stamp[i] != _current_stamp) {
+        int lowest = i, size = 0;
+        Label(i, lowest, size);
+        if (size > 1) {
+          components.push(lowest);
+        }
+      }
+    }
+
+    while (!components.empty()) {
+      int A = components.top();
+      components.pop();
+
+      // Find the longest path in this component, as find_longest_path() does.
+      vector<int> path;
+      int B = MostDistantNode(A, NULL);
+      MostDistantNode(B, &path);
+      if (path[0] > path.back()) {
+        reverse(path.begin(), path.end());
+      }
+
+      // Remove the path.  What's left of the component falls apart into smaller components, each
+      // of which is attached to the path.
+      for (size_t i = 0; i < path.size(); i++) {
+        _removed[ path[i] ] = true;
+      }
+      _current_stamp++;
+      for (size_t i = 0; i < path.size(); i++) {
+        const vector<int> &adjs = _tree[ path[i] ];
+        for (size_t j = 0; j < adjs.size(); j++) {
+          if (!_removed[ adjs[j] ] && _stamp[ adjs[j] ] != _current_stamp) {
+            int lowest = adjs[j], size = 0;
+            Label(adjs[j], lowest, size);
+            if (size > 1) {
+              components.push(lowest);
+            }
+          }
+        }
+      }
+
+      shreds.push_back(path);
+    }
+
+    return shreds;
+  }
+
+  bool Removed(const int node) const { return _removed[node]; }
+
+ private:
+  // Label: Mark all the nodes in the component containing start with the current stamp, and find
+  // the lowest node in the component and its size.  (The stamp must have been incremented first.)
+  void Label(const int start, int &lowest, int &size) {
+    vector<int> stack(1, start);
+    _stamp[start] = _current_stamp;
+    while (!stack.empty()) {
+      int node = stack.back();
+      stack.pop_back();
+      lowest = min(lowest, node);
+      size++;
+      const vector<int> &adjs = _tree[node];
+      for (size_t i = 0; i < adjs.size(); i++) {
+        if (!_removed[ adjs[i] ] && _stamp[ adjs[i] ] != _current_stamp) {
+          _stamp[ adjs[i] ] = _current_stamp;
+          stack.push_back(adjs[i]);
+        }
+      }
+    }
+  }
+
+  // MostDistantNode: Like most_distant_node(), but only on the nodes that haven't been removed.
+  // Return the node B most distant from A; if path_AB isn't NULL, also fill it with the path from
+  // A to B, inclusive.
+  int MostDistantNode(const int A, vector<int> *path_AB) {
+    _current_stamp++;
+    _stamp[A] = _current_stamp;
+    _dist[A] = 0;
+    _parent[A] = -1;
+    int B = A;
+
+    queue<int> live_nodes;
+    live_nodes.push(A);
+    while (!live_nodes.empty()) {
+      int node = live_nodes.front();
+      live_nodes.pop();
+      if (_dist[node] > _dist[B]) {
+        B = node;
+      }
+      const vector<int> &adjs = _tree[node];
+      for (size_t i = 0; i < adjs.size(); i++) {
+        int node2 = adjs[i];
+        if (!_removed[node2] && _stamp[node2] != _current_stamp) {
+          _stamp[node2] = _current_stamp;
+          _dist[node2] = _dist[node] + 1;
+          _parent[node2] = node;
+          live_nodes.push(node2);
+        }
+      }
+    }
+
+    if (path_AB) {
+      path_AB->clear();
+      for (int node = B; node != -1; node = _parent[node]) {
+        path_AB->push_back(node);
+      }
+      reverse(path_AB->begin(), path_AB->end());
+    }
+    return B;
+  }
+
+  const vector< vector<int> > &_tree;
+  vector<bool> _removed; // nodes that are in a shred already
+  vector<int> _stamp; // the last search to visit each node; this saves clearing the labels between searches
+  vector<int> _dist, _parent; // labels from the last call to MostDistantNode
+  int _current_stamp;
+};
+
+vector< vector<int> > ShredTree(const vector< vector<int> > &tree, vector<bool> *removed) {
+  TreeShredder shredder(tree);
+  vector< vector<int> > shreds = shredder.Shred();
+  if (removed) {
+    removed->resize(tree.size());
+    for (size_t i = 0; i < tree.size(); i++) {
+      (*removed)[i] = shredder.Removed(i);
+    }
+  }
+  return shreds;
+}
+
 /*******************************************************************************
  * AssertFilesExist: Check for the existence of a set of filenames.  It's a good idea to run this on
  * a set of SAM files before loading them in, lest we spend hours loading in six SAM files only to
@@ -193,6 +359,7 @@ ChromLinkMatrix::ChromLinkMatrix() {
   _tree.clear();
   _SAM_files.clear();
   _CP_score_dist = 1e7;
+  _bootstrap_seed = 0;
 }
 
 // Create an empty non-de novo ChromLinkMatrix with a contig size and chromosome length.  This is
@@ -212,9 +379,10 @@ ChromLinkMatrix::ChromLinkMatrix(const string &species,
   _tree.clear();
   _SAM_files.clear();
   _CP_score_dist = 1e7;
+  _bootstrap_seed = 0;
   int N_bins = 2 * _N_contigs;
   cout << "Creating a new ChromLinkMatrix for a chromosome with " << _N_contigs << " contigs of size " << _contig_size << " (matrix size = " << N_bins << "x" << N_bins << ")" << endl;
-  InitMatrix();
+  _links = make_shared<LinkArena>(N_bins); // the matrix is only made when the first link is added
 }
 
 // Create an empty ChromLinkMatrix with a specific number of contigs.  This is designed to be used
@@ -230,8 +398,9 @@ ChromLinkMatrix::ChromLinkMatrix(const string &species,
   _tree.clear();
   _SAM_files.clear();
   _CP_score_dist = 1e7;
+  _bootstrap_seed = 0;
   cout << "Creating a new ChromLinkMatrix for a cluster with " << _N_contigs << " contigs (matrix size = " << N_bins() << "x" << N_bins() << ")" << endl;
-  InitMatrix();
+  _links = make_shared<LinkArena>(N_bins()); // the matrix is only made when the first link is added
 }
 
 // Constructor: Load a de novo ChromLinkMatrix from a set of SAM files, and only include contigs
@@ -252,11 +421,41 @@ ChromLinkMatrix::ChromLinkMatrix(const string &species,
   _tree.clear();
   _SAM_files.clear(); // this vector will be filled by LoadFromSAMDeNovo
   _CP_score_dist = 1e7;
-  InitMatrix();
+  _bootstrap_seed = 0;
+  _links = make_shared<LinkArena>(N_bins());
   LoadFromSAMDeNovo( SAM_files, RE_sites_file, clusters, cluster_ID );
   return;
 }
 
+// Bootstrap replicate: Copy everything but the link data, which is shared with clm.
+ChromLinkMatrix::ChromLinkMatrix(const ChromLinkMatrix &clm,
+                                 const uint64_t bootstrap_seed)
+  : _species(clm._species),
+    _N_contigs(clm._N_contigs),
+    _contig_size(clm._contig_size),
+    _contig_lengths(clm._contig_lengths),
+    _longest_contig(clm._longest_contig),
+    _contig_RE_sites(clm._contig_RE_sites),
+    _most_contig_REs(clm._most_contig_REs),
+    _matrix(NULL),
+    _matrix_init(false),
+    _links(clm._links),
+    _repeat_factors(clm._repeat_factors),
+    _SAM_files(clm._SAM_files),
+    _CP_score_dist(clm._CP_score_dist),
+    _bootstrap_seed(bootstrap_seed),
+    _library_names(clm._library_names),
+    _library_weights(clm._library_weights),
+    _library_RE_sites(clm._library_RE_sites),
+    _most_library_REs(clm._most_library_REs),
+    _library_counts(clm._library_counts),
+    _density_norms(clm._density_norms),
+    _contig_biases(clm._contig_biases),
+    _constraints(clm._constraints) {
+  assert(!clm._matrix_init && clm._links);
+  assert(bootstrap_seed != 0);
+}
+
 // Destructor.
 ChromLinkMatrix::~ChromLinkMatrix() {
   if (_matrix_init) {
@@ -278,10 +477,12 @@ void ChromLinkMatrix::ReadFile(const string &CLM_file) {
   _contig_size = -1;
   _SAM_files.clear();
   _matrix_init = false;
+  _links.reset();
   char line[LINE_LEN];
   vector<string> tokens;
   string contig_lens_file = "";
   string RE_sites_file = "";
+  string libraries_file = ".";
   bool seen_data = false;
   ifstream in(clm_file.c_str(), ios::in);
 
@@ -302,18 +503,15 @@ void ChromLinkMatrix::ReadFile(const string &CLM_file) {
       if (tokens[1] == "Species") {
 	_species = tokens[3];
       } else if (tokens[1] == "N_contigs") { // line: "# N_contigs = 1"
-	if (_matrix_init) {
-          assert(_N_contigs == boost::lexical_cast<int>(tokens[3]));
-        } else {
-	  _N_contigs = boost::lexical_cast<int>(tokens[3]);
-	  InitMatrix();
-	}
+	_N_contigs = boost::lexical_cast<int>(tokens[3]);
       } else if (tokens[1] == "contig_size") { // line: "# contig_size = 1"
 	_contig_size = boost::lexical_cast<int>(tokens[3]);
       } else if (tokens[1] == "contig_lens_file") { // line: "# contig_lens_file = <filename>" or "# contig_lens_file = ."
 	contig_lens_file = tokens[3];
       } else if (tokens[1] == "RE_sites_file") { // line: "# RE_sites_file = <filename>"
 	RE_sites_file = tokens[3];
+      } else if (tokens[1] == "libraries_file") { // line: "# libraries_file = <filename>" or "# libraries_file = ."
+	libraries_file = tokens[3];
       } else if (tokens[0] == "heatmap") { // line: "# heatmap = false"
 	assert(tokens[3] == "false");
       } else if (tokens[1] == "SAM") { // line: "# SAM files used in generating this dataset: test.sam"
@@ -324,8 +522,14 @@ void ChromLinkMatrix::ReadFile(const string &CLM_file) {
       }
     } // End checking that the line is #
 
+    // This is the header line of the matrix itself.  If the file has a link store, read the links from that instead of from the rest of the file.
     else if (line[0] == 'X') {
-      continue; // skip the header line of the matrix itself
+      _links = LinkArena::FromStore(LinkStore::Open(clm_file), N_bins());
+      if (_links) {
+        seen_data = !_links->empty();
+        break;
+      }
+      InitMatrix();
     }
 
     // If this is not a header line, put data in the matrix.
@@ -347,7 +551,7 @@ void ChromLinkMatrix::ReadFile(const string &CLM_file) {
   } // End the while(1) above
 
   in.close();
-  cout << "\tN contigs = " << _N_contigs << endl;
+  cout << "\tN contigs = " << _N_contigs << (_links ? "\t(links from link store)" : "") << endl;
 
   if (_N_contigs > 1) {
     if (!seen_data) {
@@ -359,7 +563,8 @@ void ChromLinkMatrix::ReadFile(const string &CLM_file) {
 
   assert(_contig_size != -1);
   assert(!_SAM_files.empty());
-  assert(_matrix_init);
+  assert(_matrix_init || _links);
+  PackLinks();
   // If this is a de novo CLM, read contig lengths from the contig_lens_file and contig RE sites from the contig_RE_sites file.
   if (DeNovo()) { // this is equivalent to _contig_size == 0
     assert(contig_lens_file != "" && contig_lens_file != ".");
@@ -367,6 +572,10 @@ void ChromLinkMatrix::ReadFile(const string &CLM_file) {
     assert(_N_contigs == (int) _contig_lengths.size()); // if this fails, the contig_lens file has the wrong number of lines
     FindLongestContig();
     LoadRESitesFile(RE_sites_file);
+    if (libraries_file != ".") {
+      ReadLibrariesFile(libraries_file);
+    }
+    FindDensityNorms();
   }
 
   // If this isn't a de novo CLM, the contig_lens_file should have been marked as ".".
@@ -384,6 +593,8 @@ void ChromLinkMatrix::ReadFile(const string &CLM_file) {
  * list of all the integers in bin [X,Y]. This format is designed for easy input to
  * ChromLinkMatrix::ReadFile() (if heatmap = false), or to R (if heatmap = true). If this is a de
  * novo CLM, also write the contig lengths to an auxiliary file.
+ * Each file is written to a temporary file and then renamed into place, so an interrupted run
+ * never leaves a partially written CLM behind.
  ******************************************************************************/
 void ChromLinkMatrix::WriteFile(const string &CLM_file,
                                 const bool heatmap) const {
@@ -392,8 +603,10 @@ void ChromLinkMatrix::WriteFile(const string &CLM_file,
   // If this is a de novo CLM, set filenames for the auxiliary contig lengths and contig RE sites file.
   string contig_lens_file = DeNovo() ? CLM_file + ".lens" : ".";
   string contig_RE_sites_file = DeNovo() ? CLM_file + ".RE_sites" : ".";
+  string libraries_file = DeNovo() && !_library_weights.empty() ? CLM_file + ".libraries" : ".";
   bool seen_data = false;
-  ofstream out(CLM_file.c_str(), ios::out);
+  bool clipped = false; // did any bin have too many links to write on one line?
+  ofstream out((CLM_file + ".tmp").c_str(), ios::out);
 
   // Print a header to file.  The header is for easier human reading and also contains numbers used by ChromLinkMatrix::ReadFile().
   out << "# ChromLinkMatrix file - see ChromLinkMatrix.h for documentation of this object type" << endl;
@@ -403,6 +616,7 @@ void ChromLinkMatrix::WriteFile(const string &CLM_file,
   out << "# contig_size = " << _contig_size << " (ignored if a contig_lens_file is supplied)" << endl;
   out << "# contig_lens_file = " << contig_lens_file << endl;
   out << "# RE_sites_file = " << contig_RE_sites_file << endl;
+  out << "# libraries_file = " << libraries_file << endl;
   out << "# heatmap = " << boolalpha << heatmap << endl;
   out << "# SAM files used in generating this dataset:";
   for (size_t i = 0; i < _SAM_files.size(); i++) {
@@ -413,13 +627,16 @@ void ChromLinkMatrix::WriteFile(const string &CLM_file,
   // Print the table to file.
   out << "X\tY\tZ" << (heatmap ? "" : "\tlink_lengths") << endl;
 
+  vector<int> Ys;
   for (int X = 0; X < 2*_N_contigs; X++) {
-    for (int Y = 0; Y < 2*_N_contigs; Y++) {
+    Links().NonEmptyBins(X, Ys);
+    for (size_t i = 0; i < Ys.size(); i++) {
+      const int Y = Ys[i];
 
-      vector<int> & Z = _matrix[X][Y];
+      const LinkBin Z = Links().Bin(X, Y);
       //PRINT3( X, Y, Z.size() );
       if (Z.empty()) {
-        continue; // this makes the matrix sparse
+        continue; // a bin emptied by ClipToFileFormat(); the matrix is sparse
       }
       seen_data = true;
 
@@ -432,22 +649,34 @@ void ChromLinkMatrix::WriteFile(const string &CLM_file,
       } else {
       // If writing a CLM output file, write the entire vector, and write for all four contig orientations.
 	string s;
-	int Z_size = Z.size();
-	for (size_t i = 0; i < Z.size(); i++) {
+	int Z_size = 0;
+	for (LinkBin::const_iterator it = Z.begin(); it != Z.end(); ++it) {
 	  s += '\t';
-	  s += boost::lexical_cast<string>(Z[i]);
+	  s += boost::lexical_cast<string>(*it);
+	  Z_size++;
 	  // Test the length of the string to make sure it's not so long that it will break the input.
 	  if (s.size() > LINE_LEN - 50) {
-            Z_size = i+1;
             break;
           }
 	}
+	clipped |= (Z_size < Z.size());
 	out << X << '\t' << Y << '\t' << Z_size << s << endl;
       }
     } // End of the inner loop
   } // End of the outer loop
 
   out.close();
+
+  // Write the links to a link store too, unless the file doesn't hold exactly these links.  The link store goes in first, so that a reader never finds the new
+  // CLM file with an old link store.
+  if (!heatmap && !clipped) {
+    LinkStore::Writer writer;
+    Links().AddToStore(writer);
+    writer.Write(CLM_file, CLM_file + ".tmp");
+  } else {
+    LinkStore::Remove(CLM_file);
+  }
+  boost::filesystem::rename(CLM_file + ".tmp", CLM_file);
   if (_N_contigs > 1) {
     if (!seen_data) {
       cerr << "WARNING: ChromLinkMatrix::ReadFile: CLM file '" << CLM_file << "' has multiple contigs but no link data" << endl;
@@ -458,21 +687,137 @@ void ChromLinkMatrix::WriteFile(const string &CLM_file,
 
   // If this is a de novo CLM, also write the contig lengths and RE sites to auxiliary files.
   if (DeNovo()) {
-    ofstream out2(contig_lens_file.c_str(), ios::out);
+    ofstream out2((contig_lens_file + ".tmp").c_str(), ios::out);
     for (int i = 0; i < _N_contigs; i++) {
       out2 << _contig_lengths[i] << endl;
     }
     out2.close();
+    boost::filesystem::rename(contig_lens_file + ".tmp", contig_lens_file);
 
-    ofstream out3(contig_RE_sites_file.c_str(), ios::out);
+    ofstream out3((contig_RE_sites_file + ".tmp").c_str(), ios::out);
     for (int i = 0; i < _N_contigs; i++) {
       out3 << (_contig_RE_sites[i] - 1) << endl; // subtract 1 to make up for the 1 added in
                                                  // LoadRESites()
     }
     out3.close();
+    boost::filesystem::rename(contig_RE_sites_file + ".tmp", contig_RE_sites_file);
+
+    if (libraries_file != ".") {
+      WriteLibrariesFile(libraries_file);
+    }
   }
 } // End of ChromLinkMatrix::WriteFile
 
+// ClipToFileFormat: Cut each bin at the point where WriteFile() stops writing it.  Each link takes
+// at least two characters on a line of a CLM file, so only bins with more than (LINE_LEN-50)/2
+// links can be cut.
+void ChromLinkMatrix::ClipToFileFormat() {
+  assert(!_matrix_init && _links.use_count() == 1); // don't clip a bootstrap replicate's links
+  vector<int> Ys;
+  for (int X = 0; X < 2*_N_contigs; X++) {
+    _links->NonEmptyBins(X, Ys);
+    for (size_t i = 0; i < Ys.size(); i++) {
+      const int Y = Ys[i];
+      const LinkBin Z = _links->Bin(X, Y);
+      if (Z.size() <= int(LINE_LEN - 50) / 2) {
+        continue;
+      }
+      size_t line_len = 0;
+      int N_kept = 0;
+      for (LinkBin::const_iterator it = Z.begin(); it != Z.end(); ++it) {
+        line_len += 1 + boost::lexical_cast<string>(*it).size();
+        N_kept++;
+        if (line_len > LINE_LEN - 50) {
+          _links->Truncate(X, Y, N_kept);
+          break;
+        }
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+ * WriteLibrariesFile, ReadLibrariesFile: Write and read the auxiliary file that describes the
+ * libraries of a de novo CLM whose links are weighted by library.  Each line is tab-separated:
+ *   library   <name> <weight>                  (one line per library, in order)
+ *   RE_sites  <l> <RE sites of each contig>    (only for libraries with their own RE sites)
+ *   links     <contig1> <contig2> <N links from each library>   (for contig1 <= contig2)
+ ******************************************************************************/
+void ChromLinkMatrix::WriteLibrariesFile(const string &libraries_file) const {
+  const int L = N_libraries();
+  ofstream out((libraries_file + ".tmp").c_str(), ios::out);
+  out << setprecision(17);
+  for (int l = 0; l < L; l++) {
+    out << "library\t" << _library_names[l] << '\t' << _library_weights[l] << endl;
+  }
+  for (int l = 0; l < L; l++) {
+    if (_library_RE_sites[l].empty()) {
+      continue;
+    }
+    out << "RE_sites\t" << l;
+    for (int i = 0; i < _N_contigs; i++) {
+      out << '\t' << (_library_RE_sites[l][i] - 1); // subtract 1 to make up for the 1 added in SetLibraries()
+    }
+    out << endl;
+  }
+  for (int i = 0; i < _N_contigs; i++) {
+    for (int j = i; j < _N_contigs; j++) {
+      if (Links().N_links(2*i, 2*j) == 0) {
+        continue;
+      }
+      out << "links\t" << i << '\t' << j;
+      for (int l = 0; l < L; l++) {
+        out << '\t' << _library_counts[(i*_N_contigs+j)*L+l];
+      }
+      out << endl;
+    }
+  }
+  out.close();
+  boost::filesystem::rename(libraries_file + ".tmp", libraries_file);
+}
+
+void ChromLinkMatrix::ReadLibrariesFile(const string &libraries_file) {
+  assert(boost::filesystem::is_regular_file(libraries_file));
+  _library_names.clear();
+  _library_weights.clear();
+  vector< vector<string> > lines;
+  TokenizeFile(libraries_file, lines);
+
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (!lines[i].empty() && lines[i][0] == "library") {
+      assert(lines[i].size() == 3);
+      _library_names.push_back(lines[i][1]);
+      _library_weights.push_back(boost::lexical_cast<double>(lines[i][2]));
+    }
+  }
+  const int L = N_libraries();
+  _library_RE_sites.assign(L, vector<int>());
+  _most_library_REs.assign(L, -1);
+  _library_counts.assign(_N_contigs * _N_contigs * L, 0);
+
+  for (size_t i = 0; i < lines.size(); i++) {
+    const vector<string> &tokens = lines[i];
+    if (tokens.empty()) {
+      continue;
+    }
+    if (tokens[0] == "RE_sites") {
+      assert((int) tokens.size() == 2 + _N_contigs);
+      int l = boost::lexical_cast<int>(tokens[1]);
+      for (int j = 0; j < _N_contigs; j++) {
+        _library_RE_sites[l].push_back(boost::lexical_cast<int>(tokens[2+j]) + 1);
+      }
+      _most_library_REs[l] = *(max_element(_library_RE_sites[l].begin(), _library_RE_sites[l].end()));
+    } else if (tokens[0] == "links") {
+      assert((int) tokens.size() == 3 + L);
+      int c1 = boost::lexical_cast<int>(tokens[1]);
+      int c2 = boost::lexical_cast<int>(tokens[2]);
+      for (int l = 0; l < L; l++) {
+        _library_counts[(c1*_N_contigs+c2)*L+l] = _library_counts[(c2*_N_contigs+c1)*L+l] = boost::lexical_cast<int>(tokens[3+l]);
+      }
+    }
+  }
+}
+
 // DrawHeatmap: Call WriteFile("heatmap.txt"), then run the R script "heatmap.R", which uses R and
 // ggplot2 to make a heatmap image of this ChromLinkMatrix.
 void ChromLinkMatrix::DrawHeatmap(const string &heatmap_file) const {
@@ -544,10 +889,9 @@ void ChromLinkMatrix::LoadFromSAMNonDeNovo(const vector<string> &SAM_files,
 
 bool ChromLinkMatrix::has_links() const {
   for (int i = 0; i < _N_contigs; i++) {
-    for (int j = i+1; j < _N_contigs; j++) {
-      if (!_matrix[ 2*i ][ 2*j ].empty()) {
-	return true;
-      }
+    const vector<int> linked = LinkedContigs(i);
+    if (!linked.empty() && linked.back() > i) {
+      return true;
     }
   }
   return false;
@@ -565,15 +909,8 @@ vector<bool> ChromLinkMatrix::ContigsUsed(const bool flag_adjacent) const {
   vector<bool> used(_N_contigs, true);
   // Loop over all bins in a row.
   for (int i = 0; i < _N_contigs; i++) {
-    bool has_data = false;
-    for (int j = 0; j < _N_contigs; j++) {
-      if (!_matrix[ 2*min(i,j) ][ 2*max(i,j) ].empty()) {
-	has_data = true;
-	break;
-      }
-    }
     // If there's no data in this row, flag it (and maybe its neighbors).
-    if (!has_data) {
+    if (!ContigHasLinks(i)) {
       used[i] = false;
       if (flag_adjacent) {
 	if (i > 0) {
@@ -601,15 +938,37 @@ double ChromLinkMatrix::ContigOrientLogLikelihood(const int c1,
   double log_like = 0;
   // Find the vector of contig distances that represents this pair of contigs with this orientation.
   // For an ASCII illustration of these orientations, see AddLinkToMatrix().
-  const vector<int> & dists = _matrix[ 2*c1 + (rc1?1:0) ][ 2*c2 + (rc2?1:0) ];
+  const LinkBin dists = Links().Bin(2*c1 + (rc1?1:0), 2*c2 + (rc2?1:0));
   // Each link of distance x makes a contribution of 1/x to the likelihood; hence -ln(x) to the log-likelihood.
-  int N_links = dists.size();
-  for (int j = 0; j < N_links; j++) {
-    log_like -= log(double(dists[j]));
+  if (!Weighted()) {
+    for (LinkBin::const_iterator it = dists.begin(); it != dists.end(); ++it) {
+      log_like -= log(double(*it));
+    }
+  } else {
+    int j = 0;
+    for (LinkBin::const_iterator it = dists.begin(); it != dists.end(); ++it, j++) {
+      log_like -= LinkWeight(c1, c2, j) * log(double(*it));
+    }
   }
   return log_like;
 }
 
+// AdjacencyOrientLogLikelihoods: The ContigOrientLogLikelihood() of c1 followed by c2 in each of
+// their four orientations, from _orient_LLs if they've been found already.
+void ChromLinkMatrix::AdjacencyOrientLogLikelihoods(const int c1,
+                                                    const int c2,
+                                                    double *log_likes) const {
+  vector<double> &cached = _orient_LLs[make_pair(c1, c2)];
+  if (cached.empty()) {
+    for (int rc1 = 0; rc1 < 2; rc1++) {
+      for (int rc2 = 0; rc2 < 2; rc2++) {
+        cached.push_back(ContigOrientLogLikelihood(c1, rc1, c2, rc2));
+      }
+    }
+  }
+  copy(cached.begin(), cached.end(), log_likes);
+}
+
 /*******************************************************************************
  * OrderingScore: Find the "score" of this ContigOrdering, indicating how well it matches up with
  * the Hi-C link data. Specifically: This ContigOrdering implies a certain distribution of Hi-C link
@@ -631,56 +990,96 @@ double ChromLinkMatrix::OrderingScore(const ContigOrdering &order,
                                       const int range_start,
                                       const int range_stop) const {
   assert(order.N_contigs() == _N_contigs); // sanity check
+  const vector<int> &data = order.data();
+  const int N = order.N_contigs_used();
+
+  // Convert the range into the set of contig pairs (i1,i2) to score: i1 < i1_stop and i2 >= i2_min.
+  // Note that the contigs at positions before i2_min don't add to the distance between contig1 and
+  // contig2.
+  int i1_stop = N-1, i2_min = 0;
+  if (range_start != -1) {
+    i1_stop = min(i1_stop, range_stop == -1 ? range_start : range_stop);
+    i2_min = range_start;
+  } else if (range_stop != -1) {
+    i1_stop = min(i1_stop, range_stop);
+  }
+
+  // Choose the kernel for this CLM's mode once, so the loops over contig pairs and links don't
+  // have to check it.
   double score = 0;
-  // Loop over all distinct values of contig1 and contig2, such that contig1 < contig2.
-  for (int i1 = 0; i1+1 < order.N_contigs_used(); i1++) {
-    int contig1 = order.contig_ID(i1);
-    int rc1 = order.contig_rc(i1);
+  const bool weighted = Weighted();
+  if (DeNovo()) {
+    if (oriented) {
+      score = weighted ? OrderingScoreRows<true, true, true>(data, N, 0, i1_stop, i2_min, 0) : OrderingScoreRows<true, true, false>(data, N, 0, i1_stop, i2_min, 0);
+    } else {
+      score = weighted ? OrderingScoreRows<true, false, true>(data, N, 0, i1_stop, i2_min, 0) : OrderingScoreRows<true, false, false>(data, N, 0, i1_stop, i2_min, 0);
+    }
+  } else {
+    if (oriented) {
+      score = weighted ? OrderingScoreRows<false, true, true>(data, N, 0, i1_stop, i2_min, 0) : OrderingScoreRows<false, true, false>(data, N, 0, i1_stop, i2_min, 0);
+    } else {
+      score = weighted ? OrderingScoreRows<false, false, true>(data, N, 0, i1_stop, i2_min, 0) : OrderingScoreRows<false, false, false>(data, N, 0, i1_stop, i2_min, 0);
+    }
+  }
+  assert( !isnan(score) );
+  return score;
+}  // End of OrderingScore
+
+/*******************************************************************************
+ * OrderingScoreRows: The kernel of OrderingScore().  Add to score the terms of
+ * OrderingScore() from the contig pairs (i1,i2) of an ordering (given as ContigOrdering::data(),
+ * with N contigs used) with i1 in [i1_start,i1_stop) and i2 >= i2_min, in the same order as
+ * OrderingScore() always has, so the result is the same to the last bit.  The mode of the CLM is
+ * given by the template parameters: DE_NOVO = DeNovo(), ORIENTED as in OrderingScore(), and
+ * WEIGHTED = Weighted().  If !WEIGHTED, every link counts 1.
+ ******************************************************************************/
+template<bool DE_NOVO, bool ORIENTED, bool WEIGHTED>
+double ChromLinkMatrix::OrderingScoreRows(const vector<int> &data,
+                                          const int N,
+                                          const int i1_start,
+                                          const int i1_stop,
+                                          const int i2_min,
+                                          double score) const {
+  const LinkArena &links = Links();
+  for (int i1 = i1_start; i1 < i1_stop; i1++) {
+    const int contig1 = data[i1] >= 0 ? data[i1] : ~data[i1];
+    const int rc1 = data[i1] < 0;
     // Keep track of the distance between contig1 and contig2 (which is occupied by other intervening contigs.)
     int contig_dist = 0;
-    for (int i2 = i1+1; i2 < order.N_contigs_used(); i2++) {
-      if (range_start != -1 && range_stop == -1) {
-	if (i1 >= range_start || i2 < range_start) {
-          continue;
-        }
-      }
-      if (range_stop != -1) {
-	if (i1 >= range_stop || i2 < range_start) {
-          continue;
-        }
-      }
-      int contig2 = order.contig_ID(i2);
-      int rc2 = order.contig_rc(i2);
-
-      // Each oriented pair of contigs points to an element in the ChromLinkMatrix, which is a
-      // vector<int> giving the distance between the reads in those two contigs, assuming the
-      // contigs are immediately adjacent with the specified orientations. For an ASCII illustration
-      // of these distances, see AddLinkToMatrix().
-      const vector<int> &dists = _matrix[ 2*contig1+rc1 ] [ 2*contig2+rc2 ];
-      // If we take orientation into account, we have to do a bunch of computation on the individual links.
-      if (oriented) {
-	// Adjust the distances to account for the space between contig1 and contig2 in this ContigOrdering.
-	// Each link of distance x makes a contribution to the score that is equal to 1/x.
-	for (size_t i = 0; i < dists.size(); i++) {
-	  if (dists[i] == 0) {
-            PRINT4(i1, i2, i, dists[i]);
+    for (int i2 = max(i1+1, i2_min); i2 < N; i2++) {
+      const int contig2 = data[i2] >= 0 ? data[i2] : ~data[i2];
+      const int rc2 = data[i2] < 0;
+
+      // Each oriented pair of contigs points to a bin in the ChromLinkMatrix, which gives the
+      // distance between the reads in those two contigs, assuming the contigs are immediately
+      // adjacent with the specified orientations.  Each link of distance x, adjusted for the space
+      // between the contigs, makes a contribution to the score of 1/x.
+      if (ORIENTED) {
+        const LinkBin dists = links.Bin(2*contig1+rc1, 2*contig2+rc2);
+        if (WEIGHTED) {
+          int k = 0;
+          for (LinkBin::const_iterator it = dists.begin(); it != dists.end(); ++it, k++) {
+            score += LinkWeight(contig1, contig2, k) / double(*it + contig_dist);
+          }
+        } else {
+          for (LinkBin::const_iterator it = dists.begin(); it != dists.end(); ++it) {
+            score += 1.0 / double(*it + contig_dist);
           }
-	  score += 1.0 / double(dists[i] + contig_dist);
         }
       }
-      contig_dist += (_contig_size != 0 ? _contig_size : _contig_lengths[contig2]);
+      contig_dist += DE_NOVO ? _contig_lengths[contig2] : _contig_size;
       if (contig_dist > _CP_score_dist) {
         break;
       }
-      if (!oriented) {
-	// Just count the number of links between the two contigs.
-	score += dists.size() / double(contig_dist);
+      if (!ORIENTED) {
+        // Just count the number of links between the two contigs.
+        const double N_links = WEIGHTED ? LinkCount(contig1, contig2) : double(NLinks(contig1, contig2));
+        score += N_links / double(contig_dist);
       }
     }
   }
-  assert( !isnan(score) );
   return score;
-}  // End of OrderingScore
+}
 
 /*******************************************************************************
  * EnrichmentScore: Find the "enrichment" for this ContigOrdering: the degree to which it causes the
@@ -698,23 +1097,24 @@ double ChromLinkMatrix::EnrichmentScore(const ContigOrdering &order) const {
   // Find the total number of links and the total (squared) distance in which the links occur.  Use
   // these numbers to calculate a link density. Also calculate the null score, which depends on the
   // set of contigs used in the ContigOrdering, but not on their order or orientation.
-  int64_t N_links = 0, total_len = 0, total_len_sq = 0;
-  double null_score = 0;
+  int64_t total_len = 0, total_len_sq = 0;
+  double N_links = 0, null_score = 0;
+  const vector<int> &data = order.data();
 
   for (int i1 = 0; i1 < order.N_contigs_used(); i1++) {
-    int contig1 = order.contig_ID(i1);
+    int contig1 = data[i1] >= 0 ? data[i1] : ~data[i1];
     total_len += _contig_lengths[contig1];
     // Keep track of the distance between contig1 and contig2 (which is occupied by other intervening contigs.)
     int contig_dist = 0;
     for (int i2 = i1+1; i2 < order.N_contigs_used(); i2++) {
-      int contig2 = order.contig_ID(i2);
+      int contig2 = data[i2] >= 0 ? data[i2] : ~data[i2];
       // If the distance is too far, skip this contig pair.
       contig_dist += (_contig_size != 0 ? _contig_size : _contig_lengths[contig2]);
       if (contig_dist > _CP_score_dist) {
         break;
       }
       // Add to the contig length tallies.
-      N_links += _matrix[ 2*contig1 ] [ 2*contig2 ].size();
+      N_links += LinkCount(contig1, contig2);
 
       /* clang-tidy says: "C-style casts are discouraged. Use static_cast."
       int64_t len_sq = (int64_t) _contig_lengths[contig1] * (int64_t) _contig_lengths[contig2];
@@ -734,7 +1134,7 @@ double ChromLinkMatrix::EnrichmentScore(const ContigOrdering &order) const {
 
   // Calculate the average link density per bp of sequence.  Multiply the null score by this to convert it from a measure of length to a density of links.
   if ( total_len_sq == 0 ) return 0; // handle case where all pairs are skipped.
-  double link_density = double( N_links ) / total_len_sq;
+  double link_density = N_links / total_len_sq;
   null_score *= link_density;
   assert(null_score != 0);
   assert(!isnan(null_score));
@@ -744,6 +1144,106 @@ double ChromLinkMatrix::EnrichmentScore(const ContigOrdering &order) const {
   return score / null_score;
 }  //  End of Enrichscore
 
+/*******************************************************************************
+ * EnrichmentScorer: See ChromLinkMatrix.h.
+ ******************************************************************************/
+EnrichmentScorer::EnrichmentScorer(const ChromLinkMatrix &clm, const ContigOrdering &order)
+  : _clm(clm),
+    _N_contigs_used(order.N_contigs_used()),
+    _edit_start(-1),
+    _N_links(0),
+    _score(0),
+    _len_sq(0),
+    _null_score(0) {
+  assert(order.N_contigs() == _clm._N_contigs); // sanity check
+  AddTerms(order, 0, _N_contigs_used, 1);
+}
+
+void EnrichmentScorer::BeginEdit(const ContigOrdering &order, const int start, const int stop) {
+  assert(_edit_start == -1); // the last edit must be finished
+  assert(0 <= start && start <= stop && stop <= order.N_contigs_used());
+  assert(order.N_contigs_used() == _N_contigs_used);
+  AddTerms(order, start, stop, -1);
+  _edit_start = start;
+}
+
+void EnrichmentScorer::EndEdit(const ContigOrdering &order, const int new_stop) {
+  assert(_edit_start != -1);
+  assert(_edit_start <= new_stop && new_stop <= order.N_contigs_used());
+  AddTerms(order, _edit_start, new_stop, 1);
+  _N_contigs_used = order.N_contigs_used();
+  _edit_start = -1;
+}
+
+void EnrichmentScorer::AddTerms(const ContigOrdering &order, const int start, const int stop, const int sign) {
+  const int N = order.N_contigs_used();
+  const int CP_score_dist = _clm._CP_score_dist;
+  const bool weighted = _clm.Weighted();
+  const LinkArena &links = _clm.Links();
+  auto length = [this](const int contig) {
+    return _clm._contig_size != 0 ? _clm._contig_size : _clm._contig_lengths[contig];
+  };
+
+  // Find the first position that can be paired with position 'start': the contigs between them must
+  // be within _CP_score_dist, as in OrderingScoreRows().
+  int first = start;
+  for (int dist = 0; first > 0 && dist <= CP_score_dist; ) {
+    dist += length(order.contig_ID(--first));
+  }
+
+  // The contigs from position 'first' on, read from the ordering as they're needed.
+  vector<int> contigs, rcs;
+  auto read_to = [&](const int i) {
+    for (int j = first + contigs.size(); j <= i; j++) {
+      contigs.push_back(order.contig_ID(j));
+      rcs.push_back(order.contig_rc(j));
+    }
+  };
+
+  // The loops are those of EnrichmentScore() and OrderingScoreRows(), restricted to i2 >= start.
+  for (int i1 = first; i1 < stop && i1 < N; i1++) {
+    read_to(i1);
+    const int contig1 = contigs[i1-first], rc1 = rcs[i1-first];
+    int contig_dist = 0;
+    for (int i2 = i1+1; i2 < N; i2++) {
+      read_to(i2);
+      const int contig2 = contigs[i2-first], rc2 = rcs[i2-first];
+      if (i2 >= start) {
+        const LinkBin dists = links.Bin(2*contig1+rc1, 2*contig2+rc2);
+        double score = 0;
+        int k = 0;
+        for (LinkBin::const_iterator it = dists.begin(); it != dists.end(); ++it, k++) {
+          score += (weighted ? _clm.LinkWeight(contig1, contig2, k) : 1.0) / double(*it + contig_dist);
+        }
+        _score += sign * score;
+      }
+      contig_dist += length(contig2);
+      if (contig_dist > CP_score_dist) {
+        break;
+      }
+      if (i2 >= start) {
+        _N_links += sign * _clm.LinkCount(contig1, contig2);
+        const int64_t len_sq = static_cast<int64_t>(_clm._contig_lengths[contig1]) *
+          static_cast<int64_t>(_clm._contig_lengths[contig2]);
+        _len_sq += sign * len_sq;
+        _null_score += sign * (len_sq / contig_dist);
+      }
+    }
+  }
+}
+
+double EnrichmentScorer::Score() const {
+  // Handle the degenerate cases, as in EnrichmentScore().
+  if (_clm._N_contigs <= 2 || _N_contigs_used <= 1 || _len_sq == 0) {
+    return 0;
+  }
+  const double link_density = _N_links / _len_sq;
+  const double null_score = _null_score * link_density;
+  assert(null_score != 0);
+  assert(!isnan(null_score));
+  return _score / null_score;
+}
+
 /*******************************************************************************
  * PrefilterLinks: Find contig pairs in which the distribution of Hi-C link positions on the contigs
  * suggest long-range rather than short-range contacts. Flag these pairs of contigs and filter them
@@ -782,7 +1282,7 @@ void ChromLinkMatrix::PrefilterLinks(const set<int> &cluster,
   // Loop over all contig pairs.
   for (int contig1 = 0; contig1 < _N_contigs; contig1++) {
     for (int contig2 = contig1+1; contig2 < _N_contigs; contig2++) {
-      const vector<int> &links = _matrix[ 2*contig1 ][ 2*contig2 ];
+      const vector<int> links = Links().Bin(2*contig1, 2*contig2).ToVector();
       int N_links = links.size();
       if (N_links == 0) {
         continue; // no links, so nothing to do
@@ -867,6 +1367,7 @@ void ChromLinkMatrix::PrefilterLinks(const set<int> &cluster,
 ContigOrdering ChromLinkMatrix::MakeTrunkOrder(const int min_N_REs) const {
   cout << "MakeTrunkOrder!" << endl;
   assert (!_contig_RE_sites.empty());
+  _orient_LLs.clear();
   // Handle the trivial case, where there are fewer than two contigs or there are no links between the contigs.
   if (!has_links()) {
     return ContigOrdering(_N_contigs, false);
@@ -912,7 +1413,8 @@ ContigOrdering ChromLinkMatrix::MakeTrunkOrder(const int min_N_REs) const {
 }
 
 ContigOrdering ChromLinkMatrix::MakeFullOrder(const int min_N_REs,
-                                              const bool use_CP_score) const {
+                                              const bool use_CP_score,
+                                              const bool exhaustive) const {
   cout << "MakeFullOrder!" << endl;
   // Handle the trivial case, where there are fewer than two contigs or there are no links between
   // the contigs.
@@ -921,7 +1423,7 @@ ContigOrdering ChromLinkMatrix::MakeFullOrder(const int min_N_REs,
   }
   assert(!_tree.empty()); // if this fails, you need to run MakeTrunkOrder() first
   // Reinsert the pruned contigs into the ordering.
-  ContigOrdering ordering = ReinsertShreds(_tree, min_N_REs, use_CP_score);
+  ContigOrdering ordering = ReinsertShreds(_tree, min_N_REs, use_CP_score, exhaustive);
   // Determine the proper orientation of contigs in this ContigOrdering.
   OrientContigs(ordering);
   ordering.Print();
@@ -961,109 +1463,620 @@ ContigOrdering ChromLinkMatrix::MakeFullOrder(const int min_N_REs,
 }  // End of MakeTrunkOrder
 
 /*******************************************************************************
- * SpaceContigs: No, not contigs in space.  Given an ordering of the contigs in this
- * ChromLinkMatrix, estimate the spacing between them.  Fill the variable _gaps in the
- * ContigOrdering.  Once a ContigOrdering has had its gaps estimated by SpaceContigs, it can be
- * converted into a super-scaffold.  Method: For each pair of adjacent contigs, consider the set of
- * link distances between them.  (Note that their orientations must have already been determined by
- * OrientContigs.)  Determine what number to add to these link distances to make them most
- * concordant with the expectations of the LinkSizeDistribution.
- * ALGORITHM:
- * 1. Loop Steps 2-4 repeatedly until all contigs are merged into a scaffold.
- * 2. Find the longest pair of adjacent contigs in the ContigOrdering.  (A pair's "length" here is
- *    defined as the length of the shorter contig.)
- * 3. Determine the gap size between these two contigs.  Do this by considering the set of link
- *    distances between them (note that their orientations are  determined by OrientContigs) and
- *    determining what number to add to these link distances to make them most concordant with the
- *    expectations of the LinkSizeDistribution.  Call function: FindGapSize().
- * 4. Using the derived gap size, merge these contigs into a scaffold-in-progress.  They are now
- *    measured as a single contig for the purposes of length.
+ * ReorderIncrementally: Instead of ordering from the spanning tree, start from an existing ordering
+ * and re-optimize only the neighbourhood of a curator's edits.  Method:
+ * 1. Take the edited contigs out of old_order, keeping the rest in their old order.
+ * 2. Reinsert the edited contigs as singleton shreds, via InsertShreds(), after
+ *    OrderingConstraints::ConstrainShreds() has joined the pinned ones into chains.
+ * 3. Around each edited contig and each of its old neighbours, try every inversion of a stretch of
+ *    contigs within <window> positions of it, and keep the ones that raise the OrderingScore().
+ *    Repeat until nothing improves.  Inversions that would break a pin or make a forbidden
+ *    adjacency aren't tried.  An EnrichmentScorer follows the kept inversions, so the enrichment
+ *    can be reported after each pass.
+ * 4. Orient the contigs with OrientContigs(), and update the enrichment for the contigs it flips.
+ * The search work (steps 2 and 3) is proportional to the number of edits and the links of the edited
+ * contigs, not to the size of the group: only the edited contigs' rows of the matrix are read.  Steps
+ * 1 and 4 still take O(N) time, to copy the ordering and to orient it, as does the EnrichmentScorer's
+ * first pass over the ordering, which replaces a full EnrichmentScore() for each report.
  ******************************************************************************/
-void ChromLinkMatrix::SpaceContigs(ContigOrdering &order,
-                                   const LinkSizeDistribution &link_size_distribution) const {
-  cout << "SpaceContigs" << endl;
-  // Sanity checks.
-  for (size_t i = 0; i < _SAM_files.size(); i++) {
-    cout << "in CLM: " << _SAM_files[i] << endl;
-  }
-  for (size_t i = 0; i < link_size_distribution.SAM_files().size(); i++) {
-    cout << "in LSD: " << link_size_distribution.SAM_files()[i] << endl;
+ContigOrdering ChromLinkMatrix::ReorderIncrementally(const ContigOrdering &old_order,
+                                                     const vector<int> &edited_contigs,
+                                                     const int min_N_REs,
+                                                     const int window,
+                                                     const bool exhaustive) const {
+  assert(old_order.N_contigs() == _N_contigs);
+  assert(window >= 0);
+  cout << "ReorderIncrementally: " << edited_contigs.size() << " edited contigs, window = " << window << endl;
+  const set<int> edited(edited_contigs.begin(), edited_contigs.end());
+
+  // 1. Take the edited contigs out of the old ordering.  Their old neighbours become seeds for the
+  // local search, along with the edited contigs themselves.
+  set<int> seeds = edited;
+  vector<int> kept;
+  const vector<int> &old_data = old_order.data();
+  for (size_t i = 0; i < old_data.size(); i++) {
+    const int c = old_data[i] >= 0 ? old_data[i] : ~old_data[i];
+    if (!edited.count(c)) {
+      kept.push_back(c);
+      continue;
+    }
+    if (i > 0) {
+      seeds.insert(old_data[i-1] >= 0 ? old_data[i-1] : ~old_data[i-1]);
+    }
+    if (i+1 < old_data.size()) {
+      seeds.insert(old_data[i+1] >= 0 ? old_data[i+1] : ~old_data[i+1]);
+    }
   }
-  assert(_SAM_files == link_size_distribution.SAM_files());
-  assert(order.N_contigs() == _N_contigs);
-  assert(order.has_Q_scores()); // can't space contigs if they're not already oriented
-  if (order.N_contigs_used() < 2) {
-    return; // no spacing is necessary unless there are multiple contigs in the ordering
+
+  // 2. Reinsert the edited contigs.  As in ReinsertShreds(), contigs with no data are left out,
+  // unless they're pinned.
+  vector< vector<int> > shreds(1, kept);
+  for (set<int>::const_iterator it = edited.begin(); it != edited.end(); ++it) {
+    if (_N_contigs == 1 || ContigHasLinks(*it) || _constraints.Pinned(*it)) { // as in ContigsUsed()
+      shreds.push_back(vector<int>(1, *it));
+    }
   }
-  order.ClearGaps();
-  // Make a mapping of contig position in ContigOrdering -> position of first contig in that contig's scaffold-in-progress.
-  // Initially each contig is a scaffold-in-progress unto itself, so this is just an identity mapping.
-  vector<int> scaffold_start(order.N_contigs_used());
-  for (int i = 0; i < order.N_contigs_used(); i++) {
-    scaffold_start[i] = i;
+  _constraints.ConstrainShreds(shreds);
+  ContigOrdering order(_N_contigs, shreds.empty() ? vector<int>() : shreds[0]);
+  if (!shreds.empty()) {
+    shreds.erase(shreds.begin());
   }
-  // Make a mapping of contig position in ContigOrdering -> size of scaffold-in-progress starting at
-  // that contig (or 0 if contig doesn't start a scaffold.)
-  vector<int> scaffold_size(order.N_contigs_used(), 1);
-  // Make a reverse mapping of contig length to position in ContigOrdering, so that we can
-  //immediately find the position of the longest contig.
-
-  /*************************
-  multimap< int, int, greater<int> > length_map;
-  for ( int i = 0; i < order.N_contigs_used(); i++ )
-  length_map.insert( make_pair( _contig_lengths[ order.contig_ID(i) ], i ) );
-  **************************/
-
-  // Calculate the LDE (Link Density Enrichment) of each contig.  This is the (observed/expected)
-  // density of intra-contig Hi-C links on that contig and is used to normalize inter-contig link
-  // densities.
-  vector<double> enrichments;
-  // TEMP: Write link density enrichments to file.
-  ofstream out("enrichments.txt", ios::out);
+  InsertShreds(order, shreds, min_N_REs, false, exhaustive);
+
+  // 3. Improve the ordering near the seeds by inversions.  Inverting a stretch of contigs only
+  // changes the scores of the pairs with one contig in it and the other within _CP_score_dist of it,
+  // so each inversion is scored on a sub-ordering that spans the seed's window plus that far on
+  // either side.
+  auto inversion_legal = [&](const int a, const int b) {
+    if (a > 0 && (_constraints.Pinned(order.contig_ID(a-1), order.contig_ID(a)) ||
+                  _constraints.Forbidden(order.contig_ID(a-1), order.contig_ID(b)))) {
+      return false;
+    }
+    if (b+1 < order.N_contigs_used() && (_constraints.Pinned(order.contig_ID(b), order.contig_ID(b+1)) ||
+                                         _constraints.Forbidden(order.contig_ID(a), order.contig_ID(b+1)))) {
+      return false;
+    }
+    return true;
+  };
 
-  for (int i = 0; i < _N_contigs; i++) {
-    double enrichment = link_size_distribution.FindEnrichmentOnContig(_contig_lengths[i], _matrix[ 2*i ][ 2*i ]);
-    // double norm = (double) _contig_lengths[i] / (3500 * (_contig_RE_sites[i]+1) );
-    enrichments.push_back(enrichment);
-    out << enrichment << endl;
-  }
-  out.close();
-  int N_gaps_found = 0;
-  // 1. Loop Steps 2-4 repeatedly until all contigs are merged into a scaffold.
-  while (N_gaps_found+1 < order.N_contigs_used()) {
-    // 2. Find the longest pair of adjacent contigs in the ContigOrdering.  (A pair's "length" here
-    // is defined as the length of the shorter contig.)
-    int LP_pos1 = -1, LP_pos2 = -1, LP_length = 0; // LP = longest pair
-    for (int i = 0; i+1 < order.N_contigs_used(); i++) {
-      // This contig may part of a scaffold-in-progress.  If so, we only examine it if it's the
-      // first contig in its scaffold - otherwise it's redundant.
-      if (i != scaffold_start[i]) {
+  EnrichmentScorer enrichment(*this, order);
+  cout << setprecision(8);
+  cout << "ReorderIncrementally: enrichment after reinsertion = " << enrichment.Score() << endl;
+  int N_inversions = 0;
+  bool improved = true;
+  for (int pass = 0; pass < 10 && improved; pass++) {
+    improved = false;
+    const int N_inversions_before = N_inversions;
+    for (set<int>::const_iterator it = seeds.begin(); it != seeds.end(); ++it) {
+      const int pos = order.contig_pos(*it);
+      if (pos == -1) {
         continue;
       }
-      // If this contig is the start of the final scaffold-in-progress, then no further linking
-      // needs to be made beyond it.
-      int i2 = i + scaffold_size[i]; // the start of the next scaffold
-      if (i2 == order.N_contigs_used()) {
+      const int N = order.N_contigs_used();
+      const int lo = max(0, pos - window), hi = min(N - 1, pos + window);
+      if (lo == hi) {
         continue;
       }
-      assert(i2 <  order.N_contigs_used());
-      assert(scaffold_size[i] > 0);
-      assert(scaffold_size[i2] > 0);
-      // PRINT5(i, i2, scaffold_size[i], scaffold_size[i2], order.N_contigs_used());
-
-      // Find the length of this scaffold-in-progress, and the subsequent one (which will become
-      // linked to this one by a gap), by adding their contig lengths.
-      // Note that gaps don't count as part of a merged length.
-      int length1 = 0, length2 = 0;
-      for (int j = 0; j < scaffold_size[i]; j++) {
-	length1 += _contig_lengths[ order.contig_ID(i+j) ];
+      int start = lo, stop = hi+1, dist = 0;
+      while (start > 0 && dist <= _CP_score_dist) {
+        dist += DeNovo() ? _contig_lengths[ order.contig_ID(--start) ] : _contig_size;
       }
-      for (int j = 0; j < scaffold_size[i2]; j++) {
-	length2 += _contig_lengths[ order.contig_ID(i2+j) ];
+      for (dist = 0; stop < N && dist <= _CP_score_dist; stop++) {
+        dist += DeNovo() ? _contig_lengths[ order.contig_ID(stop) ] : _contig_size;
       }
+      ContigOrdering local(order, start, stop);
+      double score = OrderingScore(local, false);
 
-      // Find the length of the shorter of the two contigs/scaffolds.  Keep track of which pair has
-      // the longest length.
+      for (int a = lo; a <= hi; a++) {
+        for (int b = a+1; b <= hi; b++) {
+          if (!inversion_legal(a, b)) {
+            continue;
+          }
+          local.Invert(a - start, b - start);
+          const double new_score = OrderingScore(local, false);
+          if (new_score > score * (1 + 1e-12)) {
+            enrichment.BeginEdit(order, a, b+1);
+            order.Invert(a, b);
+            enrichment.EndEdit(order, b+1);
+            score = new_score;
+            N_inversions++;
+            improved = true;
+          } else {
+            local.Invert(a - start, b - start); // undo
+          }
+        }
+      }
+    }
+    cout << "ReorderIncrementally: pass " << pass << ": " << N_inversions - N_inversions_before
+         << " inversions kept, enrichment = " << enrichment.Score() << endl;
+  }
+  cout << "ReorderIncrementally: " << seeds.size() << " seeds, " << N_inversions << " inversions kept" << endl;
+
+  // 4. Orient the contigs.  Most keep their old orientations, so the enrichment is updated one
+  // flipped contig at a time, on a copy of the ordering that follows along.
+  ContigOrdering unoriented = order;
+  const vector<int> unoriented_data = unoriented.data();
+  OrientContigs(order);
+  const vector<int> &oriented_data = order.data();
+  for (size_t i = 0; i < oriented_data.size(); i++) {
+    if (oriented_data[i] != unoriented_data[i]) {
+      enrichment.BeginEdit(unoriented, i, i+1);
+      unoriented.Invert(i);
+      enrichment.EndEdit(unoriented, i+1);
+    }
+  }
+  cout << "Incremental ordering:\t";
+  ReportOrderingSize(order);
+  cout << "..... ENRICHMENT SCORE = " << enrichment.Score() << endl;
+  return order;
+}
+
+// A set of contigs, for the partial orderings in MakeBeamOrder()'s beam.  It's persistent: insert()
+// makes a new set, which shares all but O(log N) of its nodes with the old one, so each partial
+// ordering can have its own set without copying a vector of N_contigs flags at each step.  The set
+// is a binary trie, with the bits of 64 contigs in each leaf.
+class BeamContigSet {
+ public:
+  BeamContigSet() : _depth(0) {}
+  explicit BeamContigSet(const int N_contigs) : _depth(0) {
+    while ((int64_t(64) << _depth) < N_contigs) {
+      _depth++;
+    }
+  }
+  bool contains(const int c) const {
+    const Node *node = _root.get();
+    for (int level = _depth-1; node && level >= 0; level--) {
+      node = node->child[ (c >> (6+level)) & 1 ].get();
+    }
+    return node && (node->bits >> (c & 63) & 1);
+  }
+  BeamContigSet insert(const int c) const {
+    BeamContigSet set(*this);
+    set._root = Insert(_root.get(), c, _depth-1);
+    return set;
+  }
+
+ private:
+  struct Node {
+    Node() : bits(0) {}
+    shared_ptr<const Node> child[2];
+    uint64_t bits; // in the leaves
+  };
+  static shared_ptr<const Node> Insert(const Node *node, const int c, const int level) {
+    shared_ptr<Node> copy = node ? make_shared<Node>(*node) : make_shared<Node>();
+    if (level < 0) {
+      copy->bits |= uint64_t(1) << (c & 63);
+    } else {
+      const int bit = (c >> (6+level)) & 1;
+      copy->child[bit] = Insert(node ? node->child[bit].get() : NULL, c, level-1);
+    }
+    return copy;
+  }
+  int _depth;
+  shared_ptr<const Node> _root;
+};
+
+// A hash of a partial ordering, as a sequence of oriented contigs, and of its reverse (reversed and
+// with each contig flipped), so that MakeBeamOrder() can tell when two partial orderings are the same
+// one, possibly reversed.  Each is a pair of polynomial hashes mod 2^64, which can be updated in
+// O(1) time when a contig is added to either end.  The chance that two different orderings collide
+// in all 128 bits is negligible.
+struct BeamHash {
+  static const uint64_t BASE0 = 0x9e3779b97f4a7c15ULL, BASE1 = 0xc2b2ae3d27d4eb4fULL;
+  BeamHash() { fw[0] = fw[1] = rc[0] = rc[1] = 0; power[0] = power[1] = 1; }
+  static uint64_t Value(const int x) { return x >= 0 ? 2*uint64_t(x) + 1 : 2*uint64_t(~x) + 2; }
+  void Append(const int x) {
+    fw[0] = fw[0] * BASE0 + Value(x);      fw[1] = fw[1] * BASE1 + Value(x);
+    rc[0] += Value(~x) * power[0];          rc[1] += Value(~x) * power[1];
+    power[0] *= BASE0;                      power[1] *= BASE1;
+  }
+  void Prepend(const int x) {
+    fw[0] += Value(x) * power[0];           fw[1] += Value(x) * power[1];
+    rc[0] = rc[0] * BASE0 + Value(~x);      rc[1] = rc[1] * BASE1 + Value(~x);
+    power[0] *= BASE0;                      power[1] *= BASE1;
+  }
+  // The same for an ordering and its reverse.
+  pair<uint64_t, uint64_t> key() const { return min(make_pair(fw[0], fw[1]), make_pair(rc[0], rc[1])); }
+  uint64_t fw[2], rc[2], power[2]; // power = BASE^(length of the ordering)
+};
+
+// A contig added to one end of a partial ordering in MakeBeamOrder()'s beam, on top of a stack of
+// the contigs added before it at that end.  The stacks share their bottoms, so they form a tree.
+struct BeamNode {
+  int contig; // oriented, as in ContigOrdering::data()
+  int prev; // the node under this one in the stack, or -1
+};
+
+// A partial ordering in MakeBeamOrder()'s beam: a seed ordering, with stacks of contigs added to
+// its left and right.
+struct BeamState {
+  int seed; // index of the seed ordering it grew from
+  int left, right; // the tops of the stacks of contigs added to the left and right, or -1
+  int front, back; // the oriented contigs at either end
+  BeamContigSet used; // which contigs are in the partial ordering
+  BeamHash hash;
+  double density, orient_LL; // total LinkDensity() and ContigOrientLogLikelihood() over all adjacencies
+};
+
+// A way to extend a BeamState: by adding one (oriented) contig to its left or right end.
+struct BeamExtension {
+  int parent; // index of the BeamState in the beam
+  bool left;
+  int contig; // oriented, as in ContigOrdering::data()
+  double density, orient_LL; // totals for the extended state
+};
+
+// Rank extensions by link density, then by orientation log-likelihood.  The remaining comparisons
+// just make the ranking deterministic.
+static bool better_extension(const BeamExtension &a, const BeamExtension &b) {
+  if (a.density != b.density) return a.density > b.density;
+  if (a.orient_LL != b.orient_LL) return a.orient_LL > b.orient_LL;
+  if (a.parent != b.parent) return a.parent < b.parent;
+  if (a.left != b.left) return a.left;
+  return a.contig < b.contig;
+}
+
+static bool better_state(const BeamState &a, const BeamState &b) {
+  if (a.density != b.density) return a.density > b.density;
+  return a.orient_LL > b.orient_LL;
+}
+
+/*******************************************************************************
+ * MakeBeamOrder: An alternative to MakeTrunkOrder() and MakeFullOrder().  Instead of committing to
+ * one spanning tree, keep a beam of the beam_width best partial orderings, and grow each of them one
+ * contig at a time, at either end, until none of them can grow any more.  A partial ordering is
+ * scored by the total LinkDensity() between adjacent contigs, with ties (notably, between the two
+ * orientations of a new contig) broken by the total ContigOrientLogLikelihood() of the adjacencies.
+ * A contig can only be added next to a contig it shares links with.  The beam starts from the
+ * trunk (from MakeTrunkOrder()) if seed_with_trunk = true; otherwise from the beam_width pairs of
+ * contigs with the highest link density.  The extensions of the partial orderings in the beam are
+ * found in parallel on the ThreadPool.
+ * Only contigs with at least min_N_REs RE sites, or in the trunk, are used.  Afterwards, the best
+ * ordering found is filled in with the ones it's missing, via InsertShreds(), and oriented, as in
+ * MakeFullOrder().  So, as with MakeFullOrder(), the full ordering contains the whole trunk.  A
+ * larger beam_width takes proportionally more runtime.
+ ******************************************************************************/
+ContigOrdering ChromLinkMatrix::MakeBeamOrder(const int beam_width,
+                                              const int min_N_REs,
+                                              const ContigOrdering &trunk,
+                                              const bool seed_with_trunk,
+                                              const bool exhaustive) const {
+  cout << "MakeBeamOrder with beam width " << beam_width << endl;
+  assert(beam_width > 0);
+  assert(!_contig_RE_sites.empty());
+  assert(trunk.N_contigs() == _N_contigs);
+  // Handle the trivial case, where there are fewer than two contigs or there are no links between
+  // the contigs.
+  if (!has_links()) {
+    return ContigOrdering(_N_contigs, false);
+  }
+  if (_N_contigs == 1) {
+    return ContigOrdering(1, true);
+  }
+
+  // Find the contigs that can be used in the beam, and the links between them.
+  vector<bool> contigs_used = ContigsUsed(false);
+  vector<bool> in_beam(_N_contigs, false);
+  for (int c = 0; c < _N_contigs; c++) {
+    in_beam[c] = contigs_used[c] && _contig_RE_sites[c] > 0 &&
+      (_contig_RE_sites[c] >= min_N_REs || trunk.contig_used(c));
+  }
+  vector< vector<int> > linked_contigs(_N_contigs);
+  for (int x = 0; x < _N_contigs; x++) {
+    if (in_beam[x]) {
+      linked_contigs[x] = LinkedContigs(x);
+    }
+    vector<int> &linked = linked_contigs[x];
+    linked.erase(remove_if(linked.begin(), linked.end(), [&](const int c) { return !in_beam[c]; }), linked.end());
+  }
+
+  // The ContigOrientLogLikelihood() of two adjacent oriented contigs, x followed by y.
+  auto orient_LL = [this](const int x, const int y) {
+    return ContigOrientLogLikelihood(x >= 0 ? x : ~x, x < 0, y >= 0 ? y : ~y, y < 0);
+  };
+
+  // The seed orderings, and the stacks of contigs added to them.
+  vector< vector<int> > seeds;
+  vector<BeamNode> nodes;
+  auto make_state = [&](const int seed) {
+    BeamState state;
+    state.seed = seed;
+    state.left = state.right = -1;
+    state.front = seeds[seed].front();
+    state.back = seeds[seed].back();
+    state.used = BeamContigSet(_N_contigs);
+    for (size_t i = 0; i < seeds[seed].size(); i++) {
+      state.used = state.used.insert(seeds[seed][i] >= 0 ? seeds[seed][i] : ~seeds[seed][i]);
+      state.hash.Append(seeds[seed][i]);
+    }
+    return state;
+  };
+
+  // Make the initial beam.
+  vector<BeamState> beam;
+  if (seed_with_trunk && trunk.N_contigs_used() > 0) {
+    seeds.push_back(trunk.data());
+    BeamState state = make_state(0);
+    state.density = state.orient_LL = 0;
+    for (size_t i = 1; i < seeds[0].size(); i++) {
+      int prev = seeds[0][i-1] >= 0 ? seeds[0][i-1] : ~seeds[0][i-1];
+      int c = seeds[0][i] >= 0 ? seeds[0][i] : ~seeds[0][i];
+      state.density += LinkDensity(prev, c);
+      state.orient_LL += orient_LL(seeds[0][i-1], seeds[0][i]);
+    }
+    beam.push_back(state);
+  } else {
+    // Start from the best pairs of contigs, each in its most likely orientation.
+    for (int c1 = 0; c1 < _N_contigs; c1++) {
+      for (size_t k = 0; k < linked_contigs[c1].size(); k++) {
+        int c2 = linked_contigs[c1][k];
+        if (c2 < c1) {
+          continue;
+        }
+        vector<int> seed(2);
+        double best_LL = 0;
+        for (int rc = 0; rc < 4; rc++) {
+          double LL = orient_LL(rc & 1 ? ~c1 : c1, rc & 2 ? ~c2 : c2);
+          if (rc == 0 || LL > best_LL) {
+            seed[0] = rc & 1 ? ~c1 : c1;
+            seed[1] = rc & 2 ? ~c2 : c2;
+            best_LL = LL;
+          }
+        }
+        seeds.push_back(seed);
+        BeamState state = make_state(seeds.size() - 1);
+        state.density = LinkDensity(c1, c2);
+        state.orient_LL = best_LL;
+        beam.push_back(state);
+      }
+    }
+    sort(beam.begin(), beam.end(), [&](const BeamState &a, const BeamState &b) {
+        return better_state(a, b) || (!better_state(b, a) && seeds[a.seed] < seeds[b.seed]);
+      });
+    if ((int) beam.size() > beam_width) {
+      beam.resize(beam_width);
+    }
+  }
+
+  // Grow the partial orderings in the beam until none of them can grow.  Each partial ordering
+  // that can't grow any more is set aside as a finished ordering.  Growing a partial ordering takes
+  // O(log N) time and space, whatever its length.
+  vector<BeamState> finished;
+  while (!beam.empty()) {
+    vector< vector<BeamExtension> > extensions(beam.size());
+    ThreadPool::Global().ParallelFor(0, beam.size(), [&](int i) {
+        const BeamState &state = beam[i];
+        for (int left = 0; left < 2; left++) {
+          int end = left ? state.front : state.back;
+          const vector<int> &linked = linked_contigs[ end >= 0 ? end : ~end ];
+          for (size_t k = 0; k < linked.size(); k++) {
+            int c = linked[k];
+            if (state.used.contains(c)) {
+              continue;
+            }
+            // Use the contig's more likely orientation.
+            double LL_fw = left ? orient_LL(c, end) : orient_LL(end, c);
+            double LL_rc = left ? orient_LL(~c, end) : orient_LL(end, ~c);
+            BeamExtension ext = { i, bool(left), LL_rc > LL_fw ? ~c : c,
+                                  state.density + LinkDensity(end >= 0 ? end : ~end, c),
+                                  state.orient_LL + max(LL_fw, LL_rc) };
+            extensions[i].push_back(ext);
+          }
+        }
+      });
+
+    vector<BeamExtension> all;
+    for (size_t i = 0; i < beam.size(); i++) {
+      if (extensions[i].empty()) {
+        finished.push_back(beam[i]);
+      }
+      all.insert(all.end(), extensions[i].begin(), extensions[i].end());
+    }
+    sort(all.begin(), all.end(), better_extension);
+
+    // Keep the best extensions.  Different partial orderings can grow into the same one (possibly
+    // reversed), so skip the duplicates.
+    vector<BeamState> next_beam;
+    set< pair<uint64_t, uint64_t> > seen;
+    for (size_t i = 0; i < all.size() && (int) next_beam.size() < beam_width; i++) {
+      const BeamExtension &ext = all[i];
+      BeamState state = beam[ext.parent];
+      if (ext.left) {
+        state.hash.Prepend(ext.contig);
+      } else {
+        state.hash.Append(ext.contig);
+      }
+      if (!seen.insert(state.hash.key()).second) {
+        continue;
+      }
+      BeamNode node = { ext.contig, ext.left ? state.left : state.right };
+      (ext.left ? state.left : state.right) = nodes.size();
+      (ext.left ? state.front : state.back) = ext.contig;
+      nodes.push_back(node);
+      state.used = state.used.insert(ext.contig >= 0 ? ext.contig : ~ext.contig);
+      state.density = ext.density;
+      state.orient_LL = ext.orient_LL;
+      next_beam.push_back(state);
+    }
+    beam.swap(next_beam);
+  }
+
+  // Make a ContigOrdering out of the best finished ordering: its left stack from the top, its seed,
+  // and its right stack from the bottom.
+  ContigOrdering ordering(_N_contigs, false);
+  if (!finished.empty()) {
+    const BeamState &best = *min_element(finished.begin(), finished.end(), better_state);
+    vector<int> contigs, right;
+    for (int n = best.left; n != -1; n = nodes[n].prev) {
+      contigs.push_back(nodes[n].contig);
+    }
+    contigs.insert(contigs.end(), seeds[best.seed].begin(), seeds[best.seed].end());
+    for (int n = best.right; n != -1; n = nodes[n].prev) {
+      right.push_back(nodes[n].contig);
+    }
+    contigs.insert(contigs.end(), right.rbegin(), right.rend());
+    for (size_t i = 0; i < contigs.size(); i++) {
+      int x = contigs[i];
+      ordering.AddContig(x >= 0 ? x : ~x, -1, x < 0);
+    }
+  }
+  cout << "Beam ordering:\t";
+  ReportOrderingSize(ordering);
+
+  // Insert the usable contigs that aren't in the ordering, as singleton shreds, in decreasing order
+  // of size.
+  vector< pair<int,int> > left_out;
+  for (int c = 0; c < _N_contigs; c++) {
+    if (in_beam[c] && !ordering.contig_used(c)) {
+      left_out.push_back(make_pair(-_contig_RE_sites[c], c));
+    }
+  }
+  sort(left_out.begin(), left_out.end());
+  vector< vector<int> > shreds;
+  for (size_t i = 0; i < left_out.size(); i++) {
+    shreds.push_back(vector<int>(1, left_out[i].second));
+  }
+  cout << "Inserting " << shreds.size() << " contigs not in the beam ordering" << endl;
+  InsertShreds(ordering, shreds, -1, false, exhaustive); // these contigs have already been filtered
+
+  // Determine the proper orientation of contigs in this ContigOrdering, and report on it, as in
+  // MakeFullOrder().
+  OrientContigs(ordering);
+  ordering.Print();
+  cout << setprecision(8);
+  cout << "Full ordering:\t";
+  ReportOrderingSize(ordering);
+  cout << "..... ENRICHMENT SCORE = " << EnrichmentScore(ordering) << endl;
+  return ordering;
+}  // End of MakeBeamOrder
+
+/*******************************************************************************
+ * SpaceContigs: No, not contigs in space.  Given an ordering of the contigs in this
+ * ChromLinkMatrix, estimate the spacing between them.  Fill the variable _gaps in the
+ * ContigOrdering.  Once a ContigOrdering has had its gaps estimated by SpaceContigs, it can be
+ * converted into a super-scaffold.  Method: For each pair of adjacent contigs, consider the set of
+ * link distances between them.  (Note that their orientations must have already been determined by
+ * OrientContigs.)  Determine what number to add to these link distances to make them most
+ * concordant with the expectations of the LinkSizeDistribution.
+ * ALGORITHM:
+ * 1. Loop Steps 2-4 repeatedly until all contigs are merged into a scaffold.
+ * 2. Find the longest pair of adjacent contigs in the ContigOrdering.  (A pair's "length" here is
+ *    defined as the length of the shorter contig.)
+ * 3. Determine the gap size between these two contigs.  Do this by considering the set of link
+ *    distances between them (note that their orientations are  determined by OrientContigs) and
+ *    determining what number to add to these link distances to make them most concordant with the
+ *    expectations of the LinkSizeDistribution.  Call function: FindGapSize().
+ * 4. Using the derived gap size, merge these contigs into a scaffold-in-progress.  They are now
+ *    measured as a single contig for the purposes of length.
+ ******************************************************************************/
+void ChromLinkMatrix::SpaceContigs(ContigOrdering &order,
+                                   const LinkSizeDistribution &link_size_distribution) const {
+  // Sanity checks.
+  for (size_t i = 0; i < _SAM_files.size(); i++) {
+    cout << "in CLM: " << _SAM_files[i] << endl;
+  }
+  for (size_t i = 0; i < link_size_distribution.SAM_files().size(); i++) {
+    cout << "in LSD: " << link_size_distribution.SAM_files()[i] << endl;
+  }
+  assert(_SAM_files == link_size_distribution.SAM_files());
+  SpaceContigs(order, vector<LinkSizeDistribution>(1, link_size_distribution));
+}
+
+// SpaceContigs, with a LinkSizeDistribution for each library.  Each contig's LDE is the weighted
+// mean of its LDEs in the libraries, and the log-likelihood of each gap size is the weighted sum of
+// the libraries' log-likelihoods.
+void ChromLinkMatrix::SpaceContigs(ContigOrdering &order,
+                                   const vector<LinkSizeDistribution> &lsds) const {
+  cout << "SpaceContigs" << endl;
+  assert((int) lsds.size() == N_libraries());
+  assert(order.N_contigs() == _N_contigs);
+  assert(order.has_Q_scores()); // can't space contigs if they're not already oriented
+  if (order.N_contigs_used() < 2) {
+    return; // no spacing is necessary unless there are multiple contigs in the ordering
+  }
+  order.ClearGaps();
+  // Make a mapping of contig position in ContigOrdering -> position of first contig in that contig's scaffold-in-progress.
+  // Initially each contig is a scaffold-in-progress unto itself, so this is just an identity mapping.
+  vector<int> scaffold_start(order.N_contigs_used());
+  for (int i = 0; i < order.N_contigs_used(); i++) {
+    scaffold_start[i] = i;
+  }
+  // Make a mapping of contig position in ContigOrdering -> size of scaffold-in-progress starting at
+  // that contig (or 0 if contig doesn't start a scaffold.)
+  vector<int> scaffold_size(order.N_contigs_used(), 1);
+  // Make a reverse mapping of contig length to position in ContigOrdering, so that we can
+  //immediately find the position of the longest contig.
+
+  /*************************
+  multimap< int, int, greater<int> > length_map;
+  for ( int i = 0; i < order.N_contigs_used(); i++ )
+  length_map.insert( make_pair( _contig_lengths[ order.contig_ID(i) ], i ) );
+  **************************/
+
+  // Calculate the LDE (Link Density Enrichment) of each contig.  This is the (observed/expected)
+  // density of intra-contig Hi-C links on that contig and is used to normalize inter-contig link
+  // densities.
+  vector<double> enrichments;
+  // TEMP: Write link density enrichments to file.
+  ofstream out("enrichments.txt", ios::out);
+
+  for (int i = 0; i < _N_contigs; i++) {
+    double enrichment;
+    if (lsds.size() == 1) {
+      enrichment = lsds[0].FindEnrichmentOnContig(_contig_lengths[i], Links().Bin(2*i, 2*i).ToVector());
+    } else {
+      const vector<int> links = Links().Bin(2*i, 2*i).ToVector();
+      double total_weight = 0;
+      enrichment = 0;
+      for (size_t l = 0; l < lsds.size(); l++) {
+        pair<int, int> range = LibraryRange(i, i, l);
+        vector<int> library_links(links.begin() + range.first, links.begin() + range.second);
+        enrichment += _library_weights[l] * lsds[l].FindEnrichmentOnContig(_contig_lengths[i], library_links);
+        total_weight += _library_weights[l];
+      }
+      enrichment /= total_weight;
+    }
+    // double norm = (double) _contig_lengths[i] / (3500 * (_contig_RE_sites[i]+1) );
+    enrichments.push_back(enrichment);
+    out << enrichment << endl;
+  }
+  out.close();
+  int N_gaps_found = 0;
+  // 1. Loop Steps 2-4 repeatedly until all contigs are merged into a scaffold.
+  while (N_gaps_found+1 < order.N_contigs_used()) {
+    // 2. Find the longest pair of adjacent contigs in the ContigOrdering.  (A pair's "length" here
+    // is defined as the length of the shorter contig.)
+    int LP_pos1 = -1, LP_pos2 = -1, LP_length = 0; // LP = longest pair
+    for (int i = 0; i+1 < order.N_contigs_used(); i++) {
+      // This contig may part of a scaffold-in-progress.  If so, we only examine it if it's the
+      // first contig in its scaffold - otherwise it's redundant.
+      if (i != scaffold_start[i]) {
+        continue;
+      }
+      // If this contig is the start of the final scaffold-in-progress, then no further linking
+      // needs to be made beyond it.
+      int i2 = i + scaffold_size[i]; // the start of the next scaffold
+      if (i2 == order.N_contigs_used()) {
+        continue;
+      }
+      assert(i2 <  order.N_contigs_used());
+      assert(scaffold_size[i] > 0);
+      assert(scaffold_size[i2] > 0);
+      // PRINT5(i, i2, scaffold_size[i], scaffold_size[i2], order.N_contigs_used());
+
+      // Find the length of this scaffold-in-progress, and the subsequent one (which will become
+      // linked to this one by a gap), by adding their contig lengths.
+      // Note that gaps don't count as part of a merged length.
+      int length1 = 0, length2 = 0;
+      for (int j = 0; j < scaffold_size[i]; j++) {
+	length1 += _contig_lengths[ order.contig_ID(i+j) ];
+      }
+      for (int j = 0; j < scaffold_size[i2]; j++) {
+	length2 += _contig_lengths[ order.contig_ID(i2+j) ];
+      }
+
+      // Find the length of the shorter of the two contigs/scaffolds.  Keep track of which pair has
+      // the longest length.
       int length = min(length1, length2);
       // PRINT5(i, i2, length1, length2, length);
       if (LP_length < length) {
@@ -1096,7 +2109,7 @@ void ChromLinkMatrix::SpaceContigs(ContigOrdering &order,
       rc2 = swap;
     }
     // PRINT6(pos1, pos2, contig1, contig2, rc1, rc2);
-    const vector<int> &dists = _matrix[ 2*contig1+rc1 ] [ 2*contig2+rc2 ];
+    const vector<int> dists = Links().Bin(2*contig1+rc1, 2*contig2+rc2).ToVector();
     // assert( !dists.empty() );
     const int &L1 = _contig_lengths[contig1];
     const int &L2 = _contig_lengths[contig2];
@@ -1108,8 +2121,10 @@ void ChromLinkMatrix::SpaceContigs(ContigOrdering &order,
     // Assuming these contigs are separated at a distance D, the actual size of all the Hi-C links
     // is D higher than the reported number. Determine the value of D that makes this set of links
     // most concordant with the expectations of the LinkSizeDistribution.
-    int D = FindGapSize(order, LP_pos2-1, link_size_distribution, enrichments);
-    D = link_size_distribution.FindDistanceBetweenLinks(L1, L2, local_LDE, dists);
+    int D = FindGapSize(order, LP_pos2-1, lsds, enrichments);
+    if (lsds.size() == 1) {
+      D = lsds[0].FindDistanceBetweenLinks(L1, L2, local_LDE, dists);
+    }
     // assert( D != INT_MAX );
     // 4. Using the derived gap size, merge these contigs into a scaffold-in-progress.  They are now
     // measured as a single contig for the purposes of length.
@@ -1231,13 +2246,20 @@ vector< vector<int> > ChromLinkMatrix::FindSpanningTree(const int min_N_REs) con
         }
 	// PRINT7(iteration, i, j, link_weight, lens[i], lens[j], min_len_reduced);
 
+	// A curator's constraints override the links: a forbidden adjacency is never an edge, and a
+	// pinned one is always the best possible edge, even if there are no links.
+	if (_constraints.Forbidden(i,j)) {
+          continue;
+        }
+	const bool pinned = _constraints.Pinned(i,j);
+
 	double link_weight = LinkDensity(i,j);
 	// PRINT3( i, j, link_weight );
-	if (link_weight == 0) {
+	if (link_weight == 0 && !pinned) {
           continue; // no links between these two contigs
         }
-	double edge_weight = 1.0 / link_weight; // better-linked contigs should have a *smaller*
-                                                // edge weight in the graph
+	double edge_weight = pinned ? 0 : 1.0 / link_weight; // better-linked contigs should have a
+                                                             // *smaller* edge weight in the graph
 
 	// Use the already-observed longest path to guide further development of the tree.  The idea
 	// is to use the longest path as a scaffold, and fit into it  the contigs that were
@@ -1245,7 +2267,7 @@ vector< vector<int> > ChromLinkMatrix::FindSpanningTree(const int min_N_REs) con
 	// non-adjacent contigs in the longest  path from moving directly to each other, and
 	// penalize adjacent ones.
 	vector<int>::const_iterator j_it = find(trunk.begin(), trunk.end(), j);
-	if (i_it != trunk.end() && j_it != trunk.end()) {
+	if (i_it != trunk.end() && j_it != trunk.end() && !pinned) {
 	  if (i_it + 1 != j_it && i_it - 1 != j_it) {
             continue; // these two contigs aren't adjacent in the longest path
           } else {
@@ -1405,6 +2427,14 @@ void ChromLinkMatrix::SmoothThornsInTree(vector< vector<int> > & tree) const {
       }
     }
 
+    // Don't break a pinned adjacency, or make a forbidden one.
+    if (choice != 0) {
+      int CorD = choice == 1 ? C : D;
+      if (_constraints.Pinned(B,CorD) || _constraints.Forbidden(A,CorD)) {
+        choice = 0;
+      }
+    }
+
     // cout << "THORNY SITUATION:\t(C,B,D) = (" << C << "," << B << "," << D << ")\tA = " << A << "\tN_links_AC = " << N_links_AC << "\tN_links_AD = " << N_links_AD << "\tCHANGE RATIO = " << (N_links_AC/N_links_AD) << "\tCHOICE = " << choice << endl;
     // Apply the change!
     if (choice != 0) {
@@ -1449,14 +2479,14 @@ ContigOrdering ChromLinkMatrix::TreeTrunk(const vector< vector<int> > &tree,
  * 2. "Prune" the tree down to the longest path, by creating a ContigOrdering consisting of just the
  *    nodes in the longest path. This will leave out some "pruned" contigs. (TreeTrunk())
  * 3. Repeat this pruning and shred the tree into a set of linear paths, by repeatedly finding the
- *    longest path and then pruning that path.
+ *    longest path and then pruning that path.  (TreeShredder; the tree itself isn't modified.)
  * 4. Reinsert the linear "shreds" into the ContigOrdering, each time simply finding the optimal
- *    point at which to insert them.
+ *    point at which to insert them, among the points next to contigs they share links with.
  ******************************************************************************/
-ContigOrdering ChromLinkMatrix::ReinsertShreds(vector< vector<int> > &tree,
+ContigOrdering ChromLinkMatrix::ReinsertShreds(const vector< vector<int> > &tree,
                                                const int min_N_REs,
-                                               const bool use_CP_score) const {
-  bool verbose = false;
+                                               const bool use_CP_score,
+                                               const bool exhaustive) const {
   assert (!_contig_RE_sites.empty());
   cout << "ReinsertShreds with use_CP_score = " << boolalpha << use_CP_score << ", CP_score_dist = " << _CP_score_dist << endl;
   assert(_N_contigs == (int) tree.size());
@@ -1465,43 +2495,20 @@ ContigOrdering ChromLinkMatrix::ReinsertShreds(vector< vector<int> > &tree,
     return ContigOrdering(1, true);
   }
 
-  vector<int> longest_path = find_longest_path(tree); // this is redundant but oh well
-  ContigOrdering order(_N_contigs, longest_path);
+  // 3. Shred the tree into a set of linear paths, by repeatedly finding the longest path and then
+  // pruning that path.  The first of these is the longest path in the tree, i.e., the trunk.
+  vector<bool> removed;
+  vector< vector<int> > shreds = ShredTree(tree, &removed);
+  ContigOrdering order(_N_contigs, shreds.empty() ? vector<int>() : shreds[0]);
+  if (!shreds.empty()) {
+    shreds.erase(shreds.begin());
+  }
 
-  // 3. Repeat this pruning and shred the tree into a set of linear paths, by repeatedly finding the
-  // longest path and then pruning that path.
-  vector< vector<int> > shreds;
-  int n_nodes_left = _N_contigs;
+  int n_nodes_left = 0;
   vector<bool> nodes_left(_N_contigs, true);
-
-  while (1) {
-    // Excise the longest path from the graph, along with any links to other nodes.
-    for (size_t i = 0; i < longest_path.size(); ++i) {
-      int node = longest_path[i];
-      assert(nodes_left[node]);
-      nodes_left[node] = false;
-      n_nodes_left--;
-
-      for (size_t j = 0; j < tree[node].size(); ++j) {
-	vector<int> &j_adjs = tree[tree[node][j]];
-	j_adjs.erase(remove(j_adjs.begin(), j_adjs.end(), node), j_adjs.end());
-      }
-      tree[node].clear();
-    }
-
-    // Find one of the longest remaining paths in the reduced graph.
-    // Technically the longest_path function is guaranteed to find one of the longest paths (in case
-    // of a tie) in one of the components of the graph.  If longest_path returns an empty path,
-    // there are no non-trivial paths left, and we're done.
-    longest_path = find_longest_path(tree);
-    if (longest_path.empty()) {
-      break;
-    }
-    shreds.push_back(longest_path);
-    //cout << "Next shred:";
-    //for ( size_t i = 0; i < longest_path.size(); i++ )
-    //  cout << '\t' << longest_path[i];
-    //cout << endl;
+  for (int i = 0; i < _N_contigs; i++) {
+    nodes_left[i] = !removed[i];
+    n_nodes_left += nodes_left[i];
   }
 
   // Examine the singleton shreds.  Every contig with no data should be in a singleton shred, but
@@ -1528,11 +2535,48 @@ ContigOrdering ChromLinkMatrix::ReinsertShreds(vector< vector<int> > &tree,
   }
   cout << endl;
 
+  // Make the shreds obey a curator's constraints.  This may cut up the trunk.
+  if (!_constraints.empty()) {
+    vector< vector<int> > all_shreds(1, order.data());
+    all_shreds.insert(all_shreds.end(), shreds.begin(), shreds.end());
+    _constraints.ConstrainShreds(all_shreds);
+    order = ContigOrdering(_N_contigs, all_shreds.empty() ? vector<int>() : all_shreds[0]);
+    shreds.assign(all_shreds.begin() + min(static_cast<size_t>(1), all_shreds.size()), all_shreds.end());
+  }
+
   // 4. Reinsert the linear "shreds" into the ContigOrdering, each time simply finding the optimal
   // point at which to insert them. Note that we are reinserting them in decreasing order of their
   // size.
   cout << "Reinserting " << shreds.size() << " shreds" << endl;
+  InsertShreds(order, shreds, min_N_REs, use_CP_score, exhaustive);
+  return order;
+}  // End of ReinsertShreds
 
+/*******************************************************************************
+ * InsertShreds: Insert a set of shreds (lists of contig IDs, not in the ordering) into a
+ * ContigOrdering, one at a time, in the order given.  Each shred is put at the point, and in the
+ * orientation, with the most net links to its new neighbors (or with the best OrderingScore, if
+ * use_CP_score = true).  Shreds with no more than min_N_REs RE sites are skipped.  This is step 4
+ * of ReinsertShreds(), and is also used by MakeBeamOrder() to place the contigs its beam missed.
+ * If exhaustive = true, every position is tried, not just those next to linked contigs (see below.)
+ ******************************************************************************/
+void ChromLinkMatrix::InsertShreds(ContigOrdering &order,
+                                   const vector< vector<int> > &shreds,
+                                   const int min_N_REs,
+                                   const bool use_CP_score,
+                                   const bool exhaustive) const {
+  bool verbose = false;
+
+  // A shred can only gain links by being inserted next to a contig that shares links with one of
+  // the shred's ends.  So for each shred end, find the contigs that share links with it (i.e., those
+  // with nonzero LinkDensity() to it), and only try the positions next to those contigs.  The
+  // ContigOrdering finds the position of each of those contigs in O(log N) time.
+  // With exhaustive = true, every position is tried instead, as this function used to.  Without the
+  // CP score, this is guaranteed to make the same choices, and that's checked.  With the CP score,
+  // the choices may differ, because the score of an insertion isn't just a function of its neighbors.
+  // With the CP score, an EnrichmentScorer follows the ordering, so each candidate insertion is
+  // scored by the change to the pairs of contigs near it, rather than by a full OrderingScore().
+  EnrichmentScorer *scorer = use_CP_score ? new EnrichmentScorer(*this, order) : NULL;
   for (size_t i = 0; i < shreds.size(); i++) {
     vector<int> shred = shreds[i];
     int shred_start = shred[0];
@@ -1549,10 +2593,16 @@ ContigOrdering ChromLinkMatrix::ReinsertShreds(vector< vector<int> > &tree,
       shred_len += (_contig_RE_sites.empty() ? _contig_lengths[ shred[j] ] : _contig_RE_sites[ shred[j] ]);
     }
 
+    // A shred with pinned contigs is always inserted, however short it is.
+    bool has_pins = false;
+    for (size_t j = 0; j < shred.size(); j++) {
+      has_pins |= _constraints.Pinned(shred[j]);
+    }
+
     if (verbose) {
       cout << "Shred length: " << shred_len << '\t';
     }
-    if (shred_len > min_N_REs) {
+    if (shred_len > min_N_REs || has_pins) {
       if (verbose) {
         cout << "PASS!\n";
       }
@@ -1563,28 +2613,79 @@ ContigOrdering ChromLinkMatrix::ReinsertShreds(vector< vector<int> > &tree,
       continue;
     }
 
-    // Consider all possible positions and orientations in which to insert this shred.
+    // Find the candidate positions: those next to contigs that share links with the shred's ends.
+    vector<int> candidates;
+    for (int end = 0; end < 2; end++) {
+      const vector<int> linked = LinkedContigs( end ? shred_end : shred_start );
+      for (size_t k = 0; k < linked.size(); k++) {
+        int pos = order.contig_pos( linked[k] );
+        if (pos != -1) {
+          candidates.push_back(pos);
+          candidates.push_back(pos+1);
+        }
+      }
+    }
+    sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+
+    vector<int> positions = candidates;
+    if (exhaustive) {
+      positions.clear();
+      for (int j = 0; j <= order.N_contigs_used(); j++) {
+        positions.push_back(j);
+      }
+    }
+
+    // A curator's constraints rule out inserting the shred between two pinned contigs, or next to a
+    // contig that one of its ends is forbidden from.
+    auto legal = [&](const int j, const bool rc) {
+      int cID_prev = j-1 < 0 ? -1 : order.contig_ID(j-1);
+      int cID_next = j >= order.N_contigs_used() ? -1 : order.contig_ID(j);
+      if (cID_prev != -1 && cID_next != -1 && _constraints.Pinned(cID_prev, cID_next)) {
+        return false;
+      }
+      if (cID_prev != -1 && _constraints.Forbidden(cID_prev, rc ? shred_end : shred_start)) {
+        return false;
+      }
+      if (cID_next != -1 && _constraints.Forbidden(cID_next, rc ? shred_start : shred_end)) {
+        return false;
+      }
+      return true;
+    };
+
+    // Consider the candidate positions and orientations in which to insert this shred.
     // Find the position with the most data (immediate links) in support of it.
     double best_N_links = 0;
     double best_score = 0;
     int best_j = -1;
     bool best_rc = false;
-    for (int j = 0; j <= order.N_contigs_used(); j++) {
+    for (size_t k = 0; k < positions.size(); k++) {
+      int j = positions[k];
       for (int rc = 0; rc < 2; rc++) {
 	if (rc && shred_start == shred_end) {
           continue; // no need to reverse singletons
         }
+	if (!_constraints.empty() && !legal(j, rc)) {
+          continue;
+        }
 	if (verbose) {
           cout << "Adding at position " << j << " with " << ( rc ? "RC" : "FW" ) << " orientation" << endl;
         }
 	if (use_CP_score) {
-	  ContigOrdering order_plus = order;
-	  order_plus.AddContigs(shred, j);
+	  // Make the insertion, read its OrderingScore from the scorer, and undo it.
+	  const int stop = j + shred.size();
+	  scorer->BeginEdit(order, j, j);
+	  order.AddContigs(shred, j);
 	  if (rc) {
-            order_plus.Invert(j, j + shred.size() - 1);
+            order.Invert(j, stop - 1);
+          }
+	  scorer->EndEdit(order, stop);
+	  const double score = scorer->OrderingScore();
+	  scorer->BeginEdit(order, j, stop);
+	  for (int k = stop - 1; k >= j; k--) {
+            order.RemoveContig(k);
           }
-	  double score;
-	  score = OrderingScore(order_plus, true);
+	  scorer->EndEdit(order, j);
 	  if (score > best_score) {
 	    best_score = score;
 	    best_j = j;
@@ -1629,13 +2730,35 @@ ContigOrdering ChromLinkMatrix::ReinsertShreds(vector< vector<int> > &tree,
     if (verbose) {
       cout << "Best stuff: N_links = " << (use_CP_score ? best_score : best_N_links) << " from j=" << best_j << ", rc=" << int(best_rc) << endl;
     }
+    if (exhaustive && !use_CP_score) {
+      assert(best_j == -1 || binary_search(candidates.begin(), candidates.end(), best_j));
+    }
+    // A shred with no good position goes at the end, unless the constraints rule that out; then it
+    // goes at the last legal position.
+    if (best_j == -1 && !_constraints.empty() && !legal(order.N_contigs_used(), false)) {
+      for (int j = order.N_contigs_used(); j >= 0 && best_j == -1; j--) {
+        for (int rc = 0; rc < 2 && best_j == -1; rc++) {
+          if (legal(j, rc)) {
+            best_j = j;
+            best_rc = bool(rc);
+          }
+        }
+      }
+    }
     if (best_rc) {
       reverse(shred.begin(), shred.end());
     }
-    order.AddContigs(shred, best_j);
+    if (use_CP_score) {
+      const int j = best_j == -1 ? order.N_contigs_used() : best_j;
+      scorer->BeginEdit(order, j, j);
+      order.AddContigs(shred, best_j);
+      scorer->EndEdit(order, j + shred.size());
+    } else {
+      order.AddContigs(shred, best_j);
+    }
   }
-  return order;
-}  // End of ReinsertShreds
+  delete scorer;
+}  // End of InsertShreds
 
 /*******************************************************************************
  * OrientContigs: Determine the proper orientation for the contigs in this ContigOrdering (without
@@ -1644,17 +2767,44 @@ ContigOrdering ChromLinkMatrix::ReinsertShreds(vector< vector<int> > &tree,
  * the WDAG.
  ******************************************************************************/
 void ChromLinkMatrix::OrientContigs(ContigOrdering &order) const {
-  cout << "OrientContigs" << endl;
+  const int N = order.N_contigs_used();
+  const size_t N_cached = _orient_LLs.size();
+  // Find the log-likelihood of each adjacency in each of its four orientations.  The adjacencies
+  // that were in an earlier ordering (e.g., the trunk) are already cached.
+  vector<double> log_likes(4 * max(0, N-1));
+  for (int i = 0; i+1 < N; i++) {
+    AdjacencyOrientLogLikelihoods(order.contig_ID(i), order.contig_ID(i+1), &log_likes[4*i]);
+  }
+  cout << "OrientContigs: " << _orient_LLs.size() - N_cached << " of " << max(0, N-1) << " adjacencies are new" << endl;
+  // A curator's fixed orientations are enforced by making the other orientation of each fixed contig
+  // all but impossible in the WDAG.  The quality scores below still come from the real likelihoods.
+  vector<double> constrained_log_likes = log_likes;
+  for (int i = 0; i < N && !_constraints.empty(); i++) {
+    const int fixed = _constraints.Orientation(order.contig_ID(i));
+    if (fixed == -1) {
+      continue;
+    }
+    for (int rc = 0; rc < 2; rc++) {
+      if (i > 0) {
+        constrained_log_likes[4*(i-1) + 2*rc + !fixed] = -1e100;
+      }
+      if (i+1 < N) {
+        constrained_log_likes[4*i + 2*!fixed + rc] = -1e100;
+      }
+    }
+  }
+
   // Build a WDAG (Weighed Directed Acyclic Graph) representing all possible ways to orient contigs
   // in this ContigOrdering
-  WDAG wdag = order.OrientationWDAG(this);
+  WDAG wdag = order.OrientationWDAG(constrained_log_likes);
   // Compute the highest-weight path on this WDAG.
   wdag.FindBestPath();
   //wdag.WriteToFile("wdag.txt");
   vector<int> best_node_IDs = wdag.BestNodeIDs();
   assert((int) best_node_IDs.size() == order.N_contigs_used() + 2); // path includes start,end nodes
   // Use the node IDs of the highest-weight path to determine which contigs should be flipped.
-  // Due to the node ID numbering, an even node ID indicates that a contig should be flipped.
+  // Due to the node ID numbering, an even node ID indicates that a contig should be rc.  The WDAG's
+  // orientations are absolute, so a contig that's already rc is only flipped if it should be fw.
 
   /* clang says:  "warning: C-style casts are discouraged. Use static_cast."
   for (int i = 1; i+1 < (int)best_node_IDs.size(); i++) {
@@ -1662,33 +2812,43 @@ void ChromLinkMatrix::OrientContigs(ContigOrdering &order) const {
   for (int i = 1; i+1 < static_cast<int>(best_node_IDs.size()); i++) {
     int node_ID = best_node_IDs[i];
     assert(node_ID == 2*i-1 || node_ID == 2*i);
-    if (node_ID == 2*i) {
+    if ((node_ID == 2*i) != order.contig_rc(i-1)) {
       order.Invert(i-1);
     }
   }
+  // A lone contig has no adjacency through which to enforce a fixed orientation.
+  if (N == 1 && _constraints.Orientation(order.contig_ID(0)) != -1 &&
+      order.contig_rc(0) != bool(_constraints.Orientation(order.contig_ID(0)))) {
+    order.Invert(0);
+  }
 
   // Calculate quality scores for each contig's orientation.  The quality score is defined as the
   // relative likelihood that the contig belongs in its chosen  orientation rather than the
-  // opposite, given its neighbors' orientations and the links it shares with them.
-  for (int i = 0; i < order.N_contigs_used(); i++) {
-    int ID = order.contig_ID(i);
-    bool rc = order.contig_rc(i);
+  // opposite, given its neighbors' orientations and the links it shares with them.  The
+  // orientations in log_likes are absolute, so they still apply after the inversions above.
+  for (int i = 0; i < N; i++) {
+    const int rc = order.contig_rc(i);
     // Calculate the log-likelihood of the data, given the orientation as we see it, and the
     // log-likelihood of the data, if this contig were flipped.  We must be careful to handle edge
     // cases.
     double LL = 0, LL_alt = 0;
     if (i > 0) {
-      LL += ContigOrientLogLikelihood(order.contig_ID(i-1), order.contig_rc(i-1), ID, rc);
-      LL_alt += ContigOrientLogLikelihood(order.contig_ID(i-1), order.contig_rc(i-1), ID, !rc);
+      const int rc_prev = order.contig_rc(i-1);
+      LL += log_likes[4*(i-1) + 2*rc_prev + rc];
+      LL_alt += log_likes[4*(i-1) + 2*rc_prev + !rc];
     }
-    if (i+1 < order.N_contigs_used()) {
-      LL += ContigOrientLogLikelihood(ID, rc, order.contig_ID(i+1), order.contig_rc(i+1));
-      LL_alt += ContigOrientLogLikelihood(ID, !rc, order.contig_ID(i+1), order.contig_rc(i+1));
+    if (i+1 < N) {
+      const int rc_next = order.contig_rc(i+1);
+      LL += log_likes[4*i + 2*rc + rc_next];
+      LL_alt += log_likes[4*i + 2*!rc + rc_next];
     }
 
     // The difference between log-likelihoods describes how much statistical confidence is behind our call of this contig's orientation.
+    // A contig whose orientation the curator fixed against the data gets a negative score.
     double diff = LL - LL_alt;
-    assert(diff >= 0); // if this fails, the WDAG hasn't done its job properly - there's a bug somewhere
+    if (_constraints.Orientation(order.contig_ID(i)) == -1) {
+      assert(diff >= 0); // if this fails, the WDAG hasn't done its job properly - there's a bug somewhere
+    }
     // double ratio = LL_alt / LL;
     // PRINT5(i, LL, LL_alt, diff, ratio);
     // Load the quality score into the ContigOrdering.
@@ -1729,6 +2889,24 @@ void ChromLinkMatrix::FreeMatrix() {
   delete[] _matrix;
 }
 
+// PackLinks: Pack the links in the matrix into _links, and free the matrix.  If they're already
+// packed, do nothing.
+void ChromLinkMatrix::PackLinks() {
+  if (!_matrix_init) {
+    return;
+  }
+  _links = make_shared<LinkArena>(_matrix, 2 * _N_contigs);
+  FreeMatrix();
+}
+
+// UnpackLinks: Move the links in _links back into a new matrix.
+void ChromLinkMatrix::UnpackLinks() {
+  assert(!_matrix_init && _links);
+  InitMatrix();
+  _links->Unpack(_matrix);
+  _links.reset();
+}
+
 // LoadRESitesFile: Fill _contig_RE_sites.
 void ChromLinkMatrix::LoadRESitesFile(const string &RE_sites_file) {
   cout << "Loading contig RE lengths for use in normalization <-\t" << RE_sites_file << endl;
@@ -1783,6 +2961,9 @@ void ChromLinkMatrix::AddLinkToMatrix(const int contig1,
   int dist_rc_fw = read1_dist1 + read2_dist1 + OFFSET;
   int dist_rc_rc = read1_dist1 + read2_dist2 + OFFSET;
 
+  if (!_matrix_init) {
+    UnpackLinks();
+  }
   // Record all four distances in the 2-D matrix object for this ChromLinkMatrix.
   // The conversion from contig ID to bin ID is: bin ID = 2 * contig ID + (1 if rc)
   // Note that the matrix is filled in a symmetric fashion, and should always remain symmetric.
@@ -1796,6 +2977,135 @@ void ChromLinkMatrix::AddLinkToMatrix(const int contig1,
   _matrix[2*contig2][2*contig1].push_back(dist_rc_rc);
 }
 
+// AddLink: Add a Hi-C link that was made by DeNovoLinkFilter to the matrix.  Intra-contig
+// links are kept in the diagonal bin, for LinkSizeDistribution.
+void ChromLinkMatrix::AddLink(const CLMLink &link) {
+  if (link.contig1 == link.contig2) {
+    if (!_matrix_init) {
+      UnpackLinks();
+    }
+    _matrix[2*link.contig1][2*link.contig1].push_back(link.dist11);
+    return;
+  }
+  AddLinkToMatrix(link.contig1, link.contig2, link.dist11, link.dist12, link.dist21, link.dist22);
+}
+
+// SetDeNovoContigs: Set the lengths and RE site counts of the contigs in this de novo CLM, from
+// the lengths and RE site counts of all the contigs in the assembly.
+void ChromLinkMatrix::SetDeNovoContigs(const set<int> &contig_IDs,
+                                       const vector<int> &contig_lengths_orig,
+                                       const vector<int> &contig_RE_sites_orig) {
+  _contig_lengths.clear();
+  _contig_RE_sites.clear();
+  for (set<int>::const_iterator it = contig_IDs.begin(); it != contig_IDs.end(); ++it) {
+    _contig_lengths.push_back(contig_lengths_orig[*it]);
+    _contig_RE_sites.push_back(contig_RE_sites_orig[*it]);
+  }
+  FindLongestContig();
+  _most_contig_REs = *(max_element(_contig_RE_sites.begin(), _contig_RE_sites.end())); // as in LoadRESitesFile
+  FindDensityNorms();
+}
+
+// SetLibraries: Set the weights and RE sites of the libraries that this de novo CLM's links come
+// from.  If the libraries are trivial, the links aren't weighted at all.
+void ChromLinkMatrix::SetLibraries(const LinkLibraries &libraries,
+                                   const set<int> &contig_IDs) {
+  assert(DeNovo());
+  assert((int) contig_IDs.size() == _N_contigs);
+  _library_names.clear();
+  _library_weights.clear();
+  _library_RE_sites.clear();
+  _most_library_REs.clear();
+  _library_counts.clear();
+  if (libraries.trivial()) {
+    FindDensityNorms();
+    return;
+  }
+
+  const int L = libraries.N();
+  double min_weight = libraries.weight(0);
+  for (int l = 1; l < L; l++) {
+    min_weight = min(min_weight, libraries.weight(l));
+  }
+
+  _library_RE_sites.resize(L);
+  _most_library_REs.resize(L, -1);
+  for (int l = 0; l < L; l++) {
+    _library_names.push_back(libraries.name(l));
+    _library_weights.push_back(libraries.weight(l) / min_weight);
+    const vector<int> &RE_sites = libraries.RE_sites(l);
+    if (RE_sites.empty()) {
+      continue;
+    }
+    // Add 1 to each count to prevent dividing by 0, as in LoadRESitesFile.
+    for (set<int>::const_iterator it = contig_IDs.begin(); it != contig_IDs.end(); ++it) {
+      _library_RE_sites[l].push_back(RE_sites[*it] + 1);
+    }
+    _most_library_REs[l] = *(max_element(_library_RE_sites[l].begin(), _library_RE_sites[l].end()));
+  }
+  _library_counts.assign(_N_contigs * _N_contigs * L, 0);
+  FindDensityNorms();
+}
+
+// FindDensityNorms: Fill _density_norms with each contig's factor in LinkDensity(): the most RE
+// sites (or the longest length) of any contig, divided by the contig's own, in integer arithmetic.
+// If the contigs haven't been set yet, leave it empty; SetDeNovoContigs() will fill it.
+void ChromLinkMatrix::FindDensityNorms() {
+  _density_norms.clear();
+  if (!DeNovo() || (int) _contig_lengths.size() != _N_contigs) {
+    return;
+  }
+  const bool use_REs = !_contig_RE_sites.empty();
+  const bool by_library = use_REs && !_library_weights.empty();
+  const int L = by_library ? N_libraries() : 1;
+  _density_norms.resize(L * _N_contigs, 0);
+  for (int l = 0; l < L; l++) {
+    const bool own_REs = by_library && !_library_RE_sites[l].empty();
+    const vector<int> &sizes = !use_REs ? _contig_lengths : own_REs ? _library_RE_sites[l] : _contig_RE_sites;
+    const int most = !use_REs ? _longest_contig : own_REs ? _most_library_REs[l] : _most_contig_REs;
+    for (int i = 0; i < _N_contigs; i++) {
+      _density_norms[l*_N_contigs+i] = sizes[i] == 0 ? 0 : most / sizes[i];
+    }
+  }
+}
+
+// SetContigBiases: Set the contig biases by which LinkDensity() normalizes the links, from the
+// biases of all the contigs in the assembly.
+void ChromLinkMatrix::SetContigBiases(const vector<double> &contig_biases,
+                                      const set<int> &contig_IDs) {
+  assert(DeNovo());
+  assert((int) contig_IDs.size() == _N_contigs);
+  _contig_biases.clear();
+  if (contig_biases.empty()) {
+    return;
+  }
+  for (set<int>::const_iterator it = contig_IDs.begin(); it != contig_IDs.end(); ++it) {
+    assert(*it < (int) contig_biases.size());
+    assert(contig_biases[*it] > 0);
+    _contig_biases.push_back(contig_biases[*it]);
+  }
+}
+
+// FinishLibrary: Count the links from library #l between each pair of contigs: they're the links in
+// each bin beyond the ones from the earlier libraries.
+void ChromLinkMatrix::FinishLibrary(const int l) {
+  if (_library_weights.empty()) {
+    return;
+  }
+  const int L = _library_weights.size();
+  assert(l < L);
+  for (int i = 0; i < _N_contigs; i++) {
+    for (int j = 0; j < _N_contigs; j++) {
+      int *counts = &_library_counts[(i*_N_contigs+j)*L];
+      int N_links = _matrix_init ? _matrix[2*i][2*j].size() : Links().N_links(2*i, 2*j);
+      for (int m = 0; m < l; m++) {
+        N_links -= counts[m];
+      }
+      counts[l] = N_links;
+    }
+  }
+}
+
 // CalculateRepeatFactors: Fill the _repeat_factors vector.  This vector contains the 'factor', or
 // multiplicity, of each contig: the ratio by which the total  density of links in each contig
 // exceeds the density expected by chance.  Used in normalization.  Run this after all the links are
@@ -1818,9 +3128,9 @@ void ChromLinkMatrix::CalculateRepeatFactors() {
 
   for (int i = 0; i < _N_contigs; i++) {
     for (int j = 0; j < _N_contigs; j++) {
-      if (!_matrix[2*i][2*j].empty()) {
+      if (Links().N_links(2*i, 2*j) != 0) {
 	// TODO(nburton@washington.edu): there's a floating point exception in here somewhere
-	int64_t N_links_norm = _matrix[2*i][2*j].size();
+	int64_t N_links_norm = Links().N_links(2*i, 2*j);
 	N_links_norm = N_links_norm *
           (_most_contig_REs / _contig_RE_sites[i]) *
           (_most_contig_REs / _contig_RE_sites[j]); // normalize
@@ -1847,6 +3157,151 @@ void ChromLinkMatrix::CalculateRepeatFactors() {
   out.close();
 }
 
+/*******************************************************************************
+ * BootstrapWeight: The weight of link #k between these two contigs in a bootstrap replicate: a
+ * Poisson(1) variable, found by hashing the seed, the contig pair and k into a uniform variable
+ * and looking it up in the Poisson CDF.  The contig pair is put in canonical order first, so that
+ * the link gets the same weight in all eight of its bins.
+ ******************************************************************************/
+static uint64_t mix64(uint64_t x) {
+  // The finalizer of splitmix64.
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+int ChromLinkMatrix::BootstrapWeight(const int contig1,
+                                     const int contig2,
+                                     const int k) const {
+  // The CDF of the Poisson distribution with mean 1, P(X <= x) = sum_{i<=x} e^-1 / i!.  The
+  // chance of a weight above 9 is about 1e-7, so that's the cap.
+  static const double POISSON_1_CDF[] = { 0.36787944117144233, 0.73575888234288467, 0.91969860292860584,
+                                          0.98101184312384626, 0.99634015317265637, 0.99940581518241839,
+                                          0.99991675885071205, 0.99998975080332544, 0.99999887479740210 };
+  static const int N_CDF = sizeof(POISSON_1_CDF) / sizeof(double);
+
+  const uint64_t lo = min(contig1, contig2), hi = max(contig1, contig2);
+  uint64_t x = mix64(_bootstrap_seed ^ mix64((lo << 32) | hi));
+  x = mix64(x ^ static_cast<uint64_t>(k));
+  const double u = (x >> 11) * (1.0 / 9007199254740992.0); // uniform in [0,1), from the top 53 bits
+
+  int weight = 0;
+  while (weight < N_CDF && u >= POISSON_1_CDF[weight]) {
+    weight++;
+  }
+  return weight;
+}
+
+/*******************************************************************************
+ * LibraryWeight: The weight of the library that link #k between these two contigs came from.  The
+ * links in each bin are in library order, so this is found by stepping through the per-library
+ * counts.  Links past the counted ones (which are still being loaded) belong to the last library.
+ ******************************************************************************/
+double ChromLinkMatrix::LibraryWeight(const int contig1,
+                                      const int contig2,
+                                      const int k) const {
+  const int L = _library_weights.size();
+  const int *counts = &_library_counts[(contig1*_N_contigs+contig2)*L];
+  int stop = 0;
+  for (int l = 0; l+1 < L; l++) {
+    stop += counts[l];
+    if (k < stop) {
+      return _library_weights[l];
+    }
+  }
+  return _library_weights[L-1];
+}
+
+/*******************************************************************************
+ * LibraryRange: The range of indices in the bins of these two contigs that hold the links from
+ * library #l.  The range is clipped to the bin, since WriteFile() may truncate very large bins.
+ ******************************************************************************/
+pair<int, int> ChromLinkMatrix::LibraryRange(const int contig1,
+                                             const int contig2,
+                                             const int l) const {
+  const int N_links = Links().N_links(2*contig1, 2*contig2);
+  if (_library_weights.empty()) {
+    return make_pair(0, N_links);
+  }
+  const int L = _library_weights.size();
+  const int *counts = &_library_counts[(contig1*_N_contigs+contig2)*L];
+  int start = 0;
+  for (int m = 0; m < l; m++) {
+    start += counts[m];
+  }
+  const int stop = (l+1 == L) ? N_links : start + counts[l];
+  return make_pair(min(start, N_links), min(stop, N_links));
+}
+
+/*******************************************************************************
+ * LibraryLinkCount: The number of links between these two contigs from library #l, counting each
+ * with its bootstrap weight.
+ ******************************************************************************/
+int64_t ChromLinkMatrix::LibraryLinkCount(const int contig1,
+                                          const int contig2,
+                                          const int l) const {
+  const pair<int, int> range = LibraryRange(contig1, contig2, l);
+  if (_bootstrap_seed == 0) {
+    return range.second - range.first;
+  }
+  int64_t count = 0;
+  for (int k = range.first; k < range.second; k++) {
+    count += BootstrapWeight(contig1, contig2, k);
+  }
+  return count;
+}
+
+/*******************************************************************************
+ * LinkCount: The number of links between these two contigs, counting each with its LinkWeight().
+ ******************************************************************************/
+double ChromLinkMatrix::LinkCount(const int contig1,
+                                  const int contig2) const {
+  if (_library_weights.empty()) {
+    return LibraryLinkCount(contig1, contig2, 0);
+  }
+  double count = 0;
+  for (size_t l = 0; l < _library_weights.size(); l++) {
+    count += _library_weights[l] * LibraryLinkCount(contig1, contig2, l);
+  }
+  return count;
+}
+
+/*******************************************************************************
+ * LinkedContigs: The contigs c != x with LinkCount(c, x) != 0.  LinkCount(c, x) is only nonzero if
+ * bin [2c,2x] is non-empty, and so is bin [2x,2c], since AddLinkToMatrix() pushes each link to both;
+ * so only the non-empty bins in row 2x need to be checked.
+ ******************************************************************************/
+vector<int> ChromLinkMatrix::LinkedContigs(const int x) const {
+  vector<int> linked, Ys;
+  Links().NonEmptyBins(2*x, Ys);
+  for (size_t i = 0; i < Ys.size(); i++) {
+    const int c = Ys[i] / 2;
+    if (Ys[i] % 2 == 0 && c != x && LinkCount(c, x) != 0) {
+      linked.push_back(c);
+    }
+  }
+  return linked;
+}
+
+/*******************************************************************************
+ * ContigHasLinks: True if contig c has any links.  As in LinkedContigs(), only the non-empty bins in
+ * row 2c need to be checked.
+ ******************************************************************************/
+bool ChromLinkMatrix::ContigHasLinks(const int c) const {
+  vector<int> Ys;
+  Links().NonEmptyBins(2*c, Ys);
+  for (size_t i = 0; i < Ys.size(); i++) {
+    const int x = Ys[i] / 2;
+    if (Ys[i] % 2 == 0 && LinkCount(min(c,x), max(c,x)) != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
 /*******************************************************************************
  * LinkDensity: Return the number of Hi-C links connecting these two contigs (normalized to contig
  * lengths, if this is a de novo CLM.)  This function assumes, and does not check, that
@@ -1854,20 +3309,31 @@ void ChromLinkMatrix::CalculateRepeatFactors() {
  ******************************************************************************/
 double ChromLinkMatrix::LinkDensity(const int contig1,
                                     const int contig2) const {
-  double N_links = _matrix[ 2*contig1 ][ 2*contig2 ].size();
   if (!DeNovo()) {
-    return N_links;
+    return LinkCount(contig1, contig2);
+  }
+
+  // If the links were balanced (see SetContigBiases), the biases take the place of all the other
+  // normalization.
+  if (!_contig_biases.empty()) {
+    return LinkCount(contig1, contig2) / (_contig_biases[contig1] * _contig_biases[contig2]);
   }
 
   //N_links /= ( _repeat_factors[contig1] * _repeat_factors[contig2] );
   //return N_links; // TEMP: should already be effectively normalized by contig length/RE sites thru repeat_factor
-  // Normalize by contig length,
-  const bool use_REs = !_contig_RE_sites.empty();
-  if (use_REs) {
-    return N_links * (_most_contig_REs / _contig_RE_sites[contig1]) * (_most_contig_REs / _contig_RE_sites[contig2]);
-  } else {
-    return N_links * (_longest_contig / _contig_lengths[contig1]) * (_longest_contig / _contig_lengths[contig2]);
+  // Normalize by contig RE sites (or lengths, if there are no RE sites), using the factors in
+  // _density_norms.  If the links are weighted by library, there's a block of factors for each
+  // library, so that each library's links are normalized by its own RE sites.
+  assert(!_density_norms.empty());
+  if (_library_weights.empty() || _contig_RE_sites.empty()) {
+    return LinkCount(contig1, contig2) * _density_norms[contig1] * _density_norms[contig2];
   }
+  double density = 0;
+  for (int l = 0; l < N_libraries(); l++) {
+    const int *norms = &_density_norms[l*_N_contigs];
+    density += _library_weights[l] * LibraryLinkCount(contig1, contig2, l) * norms[contig1] * norms[contig2];
+  }
+  return density;
 }
 
 /*******************************************************************************
@@ -1912,7 +3378,7 @@ void ChromLinkMatrix::PlotTree(const vector< vector<int> > &tree,
  ******************************************************************************/
 int ChromLinkMatrix::FindGapSize(const ContigOrdering &order,
                                  const int pos,
-                                 const LinkSizeDistribution &lsd,
+                                 const vector<LinkSizeDistribution> &lsds,
                                  const vector<double> &enrichments) const {
   cout << "FindGapSize" << endl;
   assert(pos >= 0);
@@ -1992,7 +3458,7 @@ int ChromLinkMatrix::FindGapSize(const ContigOrdering &order,
   int max_N_links = 0;
   for (int i = s1_start; i <= pos; i++) {
     for (int j = pos+1; j <= s2_stop; j++) {
-      int N_links = _matrix[2*order.contig_ID(i)][2*order.contig_ID(j)].size();
+      int N_links = Links().N_links(2*order.contig_ID(i), 2*order.contig_ID(j));
       if (N_links > max_N_links) {
       max_N_links = N_links;
       }
@@ -2036,7 +3502,7 @@ int ChromLinkMatrix::FindGapSize(const ContigOrdering &order,
 	const int & L2 = _contig_lengths[contig2];
 	// Find the links between these two contigs.  Adjust them as necessary to take them account
 	// the extra distance between the contigs on their scaffolds.
-	vector<int> links = _matrix[ 2*contig1+rc1 ] [ 2*contig2+rc2 ];
+	vector<int> links = Links().Bin(2*contig1+rc1, 2*contig2+rc2).ToVector();
 	for (size_t k = 0; k < links.size(); k++) {
 	  if (links[k] + extra_dists[i][j] < 0) {
             links[k] = INT_MAX; // prevent integer overflow
@@ -2048,8 +3514,18 @@ int ChromLinkMatrix::FindGapSize(const ContigOrdering &order,
 	// each contig.
 	double local_LDE = pow(enrichments[contig1], double(2*L1)/(L1+L2)) * pow(enrichments[contig2], double(2*L2)/(L1*L2));
 
-	// Finally, find the log-likelihood contribution from this pair of contigs.
-	double this_ll = lsd.log_likelihood_D(D, L1, L2, local_LDE, links, log_factorial);
+	// Finally, find the log-likelihood contribution from this pair of contigs.  With several
+	// libraries, each library's links are scored by its own LinkSizeDistribution.
+	double this_ll = 0;
+	if (lsds.size() == 1) {
+	  this_ll = lsds[0].log_likelihood_D(D, L1, L2, local_LDE, links, log_factorial);
+	} else {
+	  for (size_t l = 0; l < lsds.size(); l++) {
+	    pair<int, int> range = LibraryRange(contig1, contig2, l);
+	    vector<int> library_links(links.begin() + range.first, links.begin() + range.second);
+	    this_ll += _library_weights[l] * lsds[l].log_likelihood_D(D, L1, L2, local_LDE, library_links, log_factorial);
+	  }
+	}
 	// PRINT4( D, i, j, this_ll );
 	if (this_ll < worsts[i][j]) {
           worsts[i][j] = this_ll;
@@ -2088,77 +3564,117 @@ void ChromLinkMatrix::ReportOrderingSize(const ContigOrdering &order) const {
 }
 
 /*******************************************************************************
- * LoadDeNovoCLMsFromSAM: Import one or more SAM/BAM files and create a set of de novo
- * ChromLinkMatrices corresponding to a ClusterVec (i.e., a set of contig  clusters that have been
- * derived by Lachesis' clustering algorithm; see GenomeLinkMatrix).  As many or as few of the
- * ChromLinkMatrix pointers can be non-NULL.  Whichever ones are non-NULL will be assumed to
- * represent ChromLinkMatrices for the  cluster ID equal to their index in the vector, and will be
- * filled accordingly.  If you are creating a set of ChromLinkMatrices for each chromosome, this is
- * much faster than calling LoadFromSAMDeNovo individually for each ChromLinkMatrix  object because
- * it only reads through the SAM file(s) once.
+ * DeNovoLinkFilter: Decides which Hi-C read pairs go into which de novo ChromLinkMatrix, and
+ * converts them into CLMLinks with contig IDs local to their cluster.  This is shared by all of the
+ * ways to load de novo CLMs (from SAM files, in memory or out-of-core, or from a vector<HiCLink>),
+ * so that they all filter the links in exactly the same way.  Clusters with wanted[i] = false are
+ * skipped.
  ******************************************************************************/
-void LoadDeNovoCLMsFromSAM(const string &SAM_file,
-                           const string &RE_sites_file,
-                           const ClusterVec &clusters,
-                           vector<ChromLinkMatrix *> CLMs) {
-  assert(CLMs.size() == clusters.size());
-  int N_clusters = clusters.size();
-  bool verbose = true;
-  // Find the lengths of all of the de novo contigs.  This tells us how many de novo contigs there
-  // are in the total dataset.
-  vector<int> contig_lengths_orig = TargetLengths(SAM_file);
-  vector<int> contig_RE_sites_orig = ParseTabDelimFile<int>(RE_sites_file, 1);
-  int N_contigs_total = contig_lengths_orig.size();
-  // For each ChromLinkMatrix that we're actually creating, make a lookup table of the lengths and
-  // number of RE sites in the contigs in this cluster.
-  vector<int> used;
-  for (int i = 0; i < N_clusters; i++) {
-    if (CLMs[i] == NULL) {
-      continue;
-    }
-    used.push_back(i);
-    CLMs[i]->_contig_lengths.clear();
-    CLMs[i]->_contig_RE_sites.clear();
-    for (set<int>::const_iterator it = clusters[i].begin(); it != clusters[i].end(); ++it) {
-      // cout << "cluster #" << i << ", contig global#" << *it << ": length = " << contig_lengths_orig[*it] << endl;
-      CLMs[i]->_contig_lengths.push_back(contig_lengths_orig[*it]);
-      CLMs[i]->_contig_RE_sites.push_back(contig_RE_sites_orig[*it] );
+class DeNovoLinkFilter {
+ public:
+  DeNovoLinkFilter(const ClusterVec &clusters,
+                   const vector<bool> &wanted,
+                   const vector<int> &contig_lengths_orig)
+    : _wanted(wanted), _contig_lengths_orig(contig_lengths_orig) {
+    assert(wanted.size() == clusters.size());
+    int N_clusters = clusters.size();
+    int N_contigs_total = contig_lengths_orig.size();
+
+    // Convert the clusters vector into two lookup tables, which map contig IDs to cluster IDs, and
+    // also onto "local" contig indices for the cluster.  For example, if there are 8 contigs in two
+    // clusters: {0,2,5,6} and {1,3,7}, then the cluster_IDs table will look like this:
+    // [ 0, 1, 0, 1, -1, 0, 0, 1 ].
+    // The local_cIDs lookup table will look like this for cluster #0:
+    // [0, -1, 1, -1, -1, 2, 3, -1] and like this for cluster #1:
+    // [-1, 0, -1, 1, -1, -1, -1, 2].
+    _cluster_IDs.resize(N_contigs_total, -1);
+    _local_cIDs.resize(N_contigs_total, -1);
+    vector<int> ID(N_clusters, 0);
+    for (int i = 0; i < N_clusters; i++) {
+      for (set<int>::const_iterator it = clusters[i].begin(); it != clusters[i].end(); ++it) {
+        _cluster_IDs[*it] = i;
+        _local_cIDs [*it] = ID[i]++;
+      }
     }
-    CLMs[i]->FindLongestContig();
-    CLMs[i]->_SAM_files.push_back(SAM_file); // keep track of which SAM files were used to generate this matrix
   }
 
-  cout << "Filling "
-       << ( used.size() == 1 ? "cluster " + boost::lexical_cast<string>(used[0]) : boost::lexical_cast<string>(used.size()) + " clusters")
-       << " with Hi-C data from SAM file " << SAM_file
-       << (verbose ? "\t(dot = 1M alignments)" : "") << endl;
+  int N_contigs_total() const { return _contig_lengths_orig.size(); }
 
-  // Convert the clusters vector into two lookup tables, which map contig IDs to cluster IDs, and
-  // also onto "local" contig indices for the cluster.  For example, if there are 8 contigs in two
-  // clusters: {0,2,5,6} and {1,3,7}, then the cluster_IDs table will look like this:
-  // [ 0, 1, 0, 1, -1, 0, 0, 1 ].
-  // The local_cIDs lookup table will look like this for cluster #0:
-  // [0, -1, 1, -1, -1, 2, 3, -1] and like this for cluster #1:
-  // [-1, 0, -1, 1, -1, -1, -1, 2].
-  vector<int> cluster_IDs(N_contigs_total, -1);
-  vector<int>  local_cIDs(N_contigs_total, -1);
-  vector<int> ID(N_clusters, 0);
-  for (int i = 0; i < N_clusters; i++) {
-    for (set<int>::const_iterator it = clusters[i].begin(); it != clusters[i].end(); ++it) {
-      cluster_IDs[*it] = i;
-      local_cIDs [*it] = ID[i]++;
+  // Classify: If this read pair belongs in one of the wanted CLMs, fill link and return the
+  // cluster ID; otherwise return -1.
+  int Classify(const HiCLink &pair, CLMLink &link) const {
+    // Ignore reads with mapping quality 0.  (In the GSM862723 dataset this is roughly 4% of reads.)
+    if (pair.mapq1 == 0 || pair.mapq2 == 0) {
+      return -1;
+    }
+    assert(pair.contig1 < N_contigs_total());
+    assert(pair.contig2 < N_contigs_total());
+
+    // Find what contigs these reads map to, and which clusters they belong to.  We only care about
+    // this link if both reads align, to contigs in the same cluster, and that cluster is one of the
+    // wanted ones that we're building.
+    int cluster = _cluster_IDs[pair.contig1];
+    int cluster2 = _cluster_IDs[pair.contig2];
+    if (cluster == -1) {
+      return -1;
     }
+    if (cluster != cluster2) {
+      return -1;
+    }
+    if (!_wanted[cluster]) {
+      return -1;
+    }
+
+    // If the two reads align to the exact same contig, the link isn't informative, so skip it.
+    if (pair.contig1 == pair.contig2) { // TEMP: allow these links so LinkSizeDistribution can do its stuff
+      CLMLink intra = { _local_cIDs[pair.contig1], _local_cIDs[pair.contig1], abs(pair.pos2 - pair.pos1), 0, 0, 0, pair.library };
+      link = intra;
+      return cluster;
+    }
+
+    // For each read, find the distance to either end of its contig.
+    int read1_dist1 = pair.pos1;
+    int read2_dist1 = pair.pos2;
+    int read1_dist2 = _contig_lengths_orig[pair.contig1] - pair.pos1;
+    int read2_dist2 = _contig_lengths_orig[pair.contig2] - pair.pos2;
+    assert(read1_dist2 >= 0);
+    assert(read2_dist2 >= 0);
+
+    CLMLink inter = { _local_cIDs[pair.contig1], _local_cIDs[pair.contig2], read1_dist1, read1_dist2, read2_dist1, read2_dist2, pair.library };
+    link = inter;
+    return cluster;
   }
 
-  /*******************************
-  for ( int i = 0; i < N_contigs_total; i++ )
-    PRINT3( i, cluster_IDs[i], local_cIDs[i] );
-  for ( int i = 0; i < N_clusters; i++ )
-    PRINT2( i, ID[i] );
-  for ( int i = 0; i < N_clusters; i++ )
-    PRINT( CLMs[i] );
-  *********************************/
-  int N_pairs_used = 0;
+ private:
+  const vector<bool> &_wanted;
+  const vector<int> &_contig_lengths_orig;
+  vector<int> _cluster_IDs;
+  vector<int> _local_cIDs;
+};
+
+/*******************************************************************************
+ * ForEachDeNovoLinkInSAM: Read the Hi-C links in a SAM/BAM file that fall within one of the
+ * clusters, and call add_link(cluster ID, link) on each one, in file order.  Clusters with
+ * wanted[i] = false are skipped.  The contig IDs in each link are local to its cluster.  This is
+ * the SAM-reading half of LoadDeNovoCLMsFromSAM and LoadDeNovoCLMsFromSAMOutOfCore.
+ * If libraries is not NULL, each link's library is found (by the file, or by the read group of the
+ * first read) and recorded in the link; if library != -1, the links from other libraries are
+ * skipped.
+ ******************************************************************************/
+static void ForEachDeNovoLinkInSAM(const string &SAM_file,
+                                   const ClusterVec &clusters,
+                                   const vector<bool> &wanted,
+                                   const function<void(int, const CLMLink &)> &add_link,
+                                   const LinkLibraries *libraries = NULL,
+                                   const int library = -1) {
+  bool verbose = true;
+  const int file_library = libraries ? libraries->FileLibrary(SAM_file) : 0;
+  const bool use_read_groups = libraries && (libraries->uses_read_groups() || file_library == -1);
+  // Find the lengths of all of the de novo contigs.  This tells us how many de novo contigs there
+  // are in the total dataset.
+  vector<int> contig_lengths_orig = TargetLengths(SAM_file);
+  DeNovoLinkFilter filter(clusters, wanted, contig_lengths_orig);
+
   // Set up a SAMStepper object to read in the alignments.
   SAMStepper stepper(SAM_file);
   stepper.FilterAlignedPairs(); // Only look at read pairs where both reads aligned to the assembly.
@@ -2171,7 +3687,7 @@ void LoadDeNovoCLMsFromSAM(const string &SAM_file,
     }
     const bam1_core_t & c1 = aligns.first->core;
     const bam1_core_t & c2 = aligns.second->core;
-    // Ignore reads with mapping quality 0.  (In the GSM862723 dataset this is roughly 4% of reads.)
+    // Ignore reads with mapping quality 0.
     if (c1.qual == 0 || c2.qual == 0) {
       continue;
     }
@@ -2185,49 +3701,82 @@ void LoadDeNovoCLMsFromSAM(const string &SAM_file,
     assert(c2.tid == c1.mtid);
     assert(c1.pos == c2.mpos);
     assert(c2.pos == c1.mpos);
-    assert(c1.tid < N_contigs_total);
-    assert(c2.tid < N_contigs_total);
 
-    // Find what contigs these reads map to, and which clusters they belong to.  We only care about
-    // this link if both reads align, to contigs in the same cluster, and that cluster is one of the
-    // non-NULL ones that we're building.
-    int cluster = cluster_IDs[c1.tid];
-    int cluster2 = cluster_IDs[c2.tid];
-    if (cluster == -1) {
-      continue;
+    int pair_library = file_library;
+    if (use_read_groups) {
+      uint8_t *RG = bam_aux_get(aligns.first, "RG");
+      pair_library = libraries->Library(SAM_file, RG ? bam_aux2Z(RG) : NULL);
     }
-    if (cluster != cluster2) {
+    if (library != -1 && pair_library != library) {
       continue;
     }
-    if (CLMs[cluster] == NULL) {
-      continue;
+
+    HiCLink pair = { c1.tid, c1.pos, (int32_t) c1.qual, c2.tid, c2.pos, (int32_t) c2.qual, pair_library };
+    CLMLink link;
+    int cluster = filter.Classify(pair, link);
+    if (cluster != -1) {
+      add_link(cluster, link);
     }
+  }
 
-    // If the two reads align to the exact same contig, the link isn't informative, so skip it.
-    if (c1.tid == c2.tid) { // TEMP: allow these links so LinkSizeDistribution can do its stuff
-      int dist = abs(c2.pos - c1.pos);
-      int x = 2*local_cIDs[c1.tid];
-      CLMs[cluster]->_matrix[x][x].push_back(dist);
+  if (verbose) {
+    cout << endl;
+  }
+}
+
+/*******************************************************************************
+ * LoadDeNovoCLMsFromSAM: Import one or more SAM/BAM files and create a set of de novo
+ * ChromLinkMatrices corresponding to a ClusterVec (i.e., a set of contig  clusters that have been
+ * derived by Lachesis' clustering algorithm; see GenomeLinkMatrix).  As many or as few of the
+ * ChromLinkMatrix pointers can be non-NULL.  Whichever ones are non-NULL will be assumed to
+ * represent ChromLinkMatrices for the  cluster ID equal to their index in the vector, and will be
+ * filled accordingly.  If you are creating a set of ChromLinkMatrices for each chromosome, this is
+ * much faster than calling LoadFromSAMDeNovo individually for each ChromLinkMatrix  object because
+ * it only reads through the SAM file(s) once.
+ ******************************************************************************/
+void LoadDeNovoCLMsFromSAM(const string &SAM_file,
+                           const string &RE_sites_file,
+                           const ClusterVec &clusters,
+                           vector<ChromLinkMatrix *> CLMs,
+                           const LinkLibraries &libraries,
+                           const int library) {
+  assert(CLMs.size() == clusters.size());
+  int N_clusters = clusters.size();
+  bool verbose = true;
+  // Find the lengths of all of the de novo contigs.
+  vector<int> contig_lengths_orig = TargetLengths(SAM_file);
+  vector<int> contig_RE_sites_orig = ParseTabDelimFile<int>(RE_sites_file, 1);
+  // For each ChromLinkMatrix that we're actually creating, make a lookup table of the lengths and
+  // number of RE sites in the contigs in this cluster.
+  vector<int> used;
+  vector<bool> wanted(N_clusters, false);
+  for (int i = 0; i < N_clusters; i++) {
+    if (CLMs[i] == NULL) {
       continue;
     }
+    used.push_back(i);
+    wanted[i] = true;
+    CLMs[i]->SetDeNovoContigs(clusters[i], contig_lengths_orig, contig_RE_sites_orig);
+    // Keep track of which SAM files were used to generate this matrix.  With several libraries, a file may be read once per library.
+    vector<string> &SAM_files = CLMs[i]->_SAM_files;
+    if (library == -1 || find(SAM_files.begin(), SAM_files.end(), SAM_file) == SAM_files.end()) {
+      SAM_files.push_back(SAM_file);
+    }
+  }
 
-    // For each read, find the distance to either end of its contig.
-    int read1_dist1 = c1.pos;
-    int read2_dist1 = c2.pos;
-    int read1_dist2 = contig_lengths_orig[c1.tid] - c1.pos;
-    int read2_dist2 = contig_lengths_orig[c2.tid] - c2.pos;
-    assert(read1_dist2 >= 0);
-    assert(read2_dist2 >= 0);
+  cout << "Filling "
+       << ( used.size() == 1 ? "cluster " + boost::lexical_cast<string>(used[0]) : boost::lexical_cast<string>(used.size()) + " clusters")
+       << " with Hi-C data from SAM file " << SAM_file
+       << (library != -1 ? " (library " + libraries.name(library) + ")" : "")
+       << (verbose ? "\t(dot = 1M alignments)" : "") << endl;
 
-    // Add the link to the matrix object.
-    // cout << "Adding link to cluster #" << cluster << endl;
-    CLMs[cluster]->AddLinkToMatrix(local_cIDs[c1.tid], local_cIDs[c2.tid], read1_dist1, read1_dist2, read2_dist1, read2_dist2);
-    N_pairs_used++;
+  ForEachDeNovoLinkInSAM(SAM_file, clusters, wanted,
+                         [&CLMs](int cluster, const CLMLink &link) { CLMs[cluster]->AddLink(link); },
+                         library != -1 ? &libraries : NULL, library);
+  for (size_t i = 0; i < used.size(); i++) {
+    CLMs[used[i]]->PackLinks();
   }
 
-  if (verbose) {
-    cout << endl;
-  }
   // for ( int i = 0; i < N_clusters; i++ ) {
   //   CLMs[i]->CalculateRepeatFactors();
   // }
@@ -2333,6 +3882,11 @@ void LoadNonDeNovoCLMsFromSAM(const string &SAM_file,
     CLMs[c1.tid]->AddLinkToMatrix(contig1, contig2, read1_dist1, read1_dist2, read2_dist1, read2_dist2);
     N_pairs_used++;
   }
+  for (int chrID = 0; chrID < N_chroms; chrID++) {
+    if (CLMs[chrID]) {
+      CLMs[chrID]->PackLinks();
+    }
+  }
 
   if (verbose) {
     cout << endl;
@@ -2343,17 +3897,228 @@ void LoadNonDeNovoCLMsFromSAM(const string &SAM_file,
   // }
 }  // End of LoadNonDeNovo...
 
-// These multi-SAM-file functions are wrappers for their respective one-SAM-file functions.
+// The multi-SAM-file version of LoadDeNovoCLMsFromSAM reads the files as the one-SAM-file version
+// would, one after another.  If the links are weighted by library, the libraries are loaded one at
+// a time, in order, so that each bin holds the links of each library in turn.  Each SAM file is
+// only read for the libraries it may contain; so if the libraries are assigned by file, each file is
+// still read just once.
+// The links are gathered by cluster, and each ChromLinkMatrix is then filled with its own links in
+// one go.  Filling them all at once, link by link, would interleave the bins of every CLM in
+// memory, which makes ordering a freshly built CLM much slower than ordering one read from a file.
+// The SAM files are read in parallel on the ThreadPool, in batches of up to THREADS files, as in
+// GenomeLinkMatrix::LoadFromSAM, and the CLMs are then filled in parallel.  The result doesn't
+// depend on the number of threads.
 void LoadDeNovoCLMsFromSAM(const vector<string> &SAM_files,
                            const string &RE_sites_file,
                            const ClusterVec &clusters,
-                           vector<ChromLinkMatrix *> CLMs) {
+                           vector<ChromLinkMatrix *> CLMs,
+                           const LinkLibraries &libraries) {
   AssertFilesExist(SAM_files);
-  for (size_t i = 0; i < SAM_files.size(); i++) {
-    LoadDeNovoCLMsFromSAM(SAM_files[i], RE_sites_file, clusters, CLMs);
+  assert(CLMs.size() == clusters.size());
+  int N_clusters = clusters.size();
+  vector<bool> wanted(N_clusters, false);
+  for (int i = 0; i < N_clusters; i++) {
+    wanted[i] = (CLMs[i] != NULL);
+    if (wanted[i] && !libraries.trivial()) {
+      CLMs[i]->SetLibraries(libraries, clusters[i]);
+    }
+  }
+  vector<int> contig_RE_sites_orig = ParseTabDelimFile<int>(RE_sites_file, 1);
+
+  ThreadPool &pool = ThreadPool::Global();
+  const int N_libraries = libraries.trivial() ? 1 : libraries.N();
+  vector< vector<CLMLink> > links(N_clusters);
+  for (int l = 0; l < N_libraries; l++) {
+    const int library = libraries.trivial() ? -1 : l;
+    vector<string> library_SAM_files;
+    for (size_t f = 0; f < SAM_files.size(); f++) {
+      if (library == -1 || libraries.FileMayContain(SAM_files[f], library)) {
+        library_SAM_files.push_back(SAM_files[f]);
+      }
+    }
+
+    // Read the SAM files in batches of up to THREADS files at once.  Each file's links go into its own per-cluster buckets, which are then appended to links
+    // in file order, so the CLMs get their links in the same order whatever the number of threads.
+    const size_t batch_size = pool.N_threads();
+    for (size_t start = 0; start < library_SAM_files.size(); start += batch_size) {
+      const size_t stop = min(start + batch_size, library_SAM_files.size());
+
+      for (size_t f = start; f < stop; f++) {
+        const string &SAM_file = library_SAM_files[f];
+        // Set up the CLMs as the one-SAM-file version does.  The contig lengths are reset from each file in turn, so the last one wins.
+        vector<int> contig_lengths_orig = TargetLengths(SAM_file);
+        for (int i = 0; i < N_clusters; i++) {
+          if (!wanted[i]) {
+            continue;
+          }
+          CLMs[i]->SetDeNovoContigs(clusters[i], contig_lengths_orig, contig_RE_sites_orig);
+          vector<string> &CLM_SAM_files = CLMs[i]->_SAM_files;
+          if (library == -1 || find(CLM_SAM_files.begin(), CLM_SAM_files.end(), SAM_file) == CLM_SAM_files.end()) {
+            CLM_SAM_files.push_back(SAM_file);
+          }
+        }
+        cout << "Reading Hi-C data from SAM file " << SAM_file
+             << (library != -1 ? " (library " + libraries.name(library) + ")" : "")
+             << "\t(dot = 1M alignments)" << endl;
+      }
+
+      vector< vector< vector<CLMLink> > > file_links(stop - start, vector< vector<CLMLink> >(N_clusters));
+      pool.ParallelFor(start, stop, [&](int f) {
+        vector< vector<CLMLink> > &buckets = file_links[f-start];
+        ForEachDeNovoLinkInSAM(library_SAM_files[f], clusters, wanted,
+                               [&buckets](int cluster, const CLMLink &link) { buckets[cluster].push_back(link); },
+                               library != -1 ? &libraries : NULL, library);
+      });
+
+      for (size_t f = 0; f < file_links.size(); f++) {
+        for (int i = 0; i < N_clusters; i++) {
+          if (links[i].empty()) {
+            links[i].swap(file_links[f][i]);
+          } else {
+            links[i].insert(links[i].end(), file_links[f][i].begin(), file_links[f][i].end());
+          }
+          vector<CLMLink>().swap(file_links[f][i]);
+        }
+      }
+    }
+
+    // Fill the CLMs, each with its own links.  They're independent, so they're filled in parallel.
+    pool.ParallelFor(0, N_clusters, [&](int i) {
+      if (!wanted[i]) {
+        return;
+      }
+      cout << "Filling cluster " + boost::lexical_cast<string>(i) + " with " + boost::lexical_cast<string>(links[i].size()) + " Hi-C links\n";
+      for (size_t j = 0; j < links[i].size(); j++) {
+        CLMs[i]->AddLink(links[i][j]);
+      }
+      vector<CLMLink>().swap(links[i]);
+      if (library != -1) {
+        CLMs[i]->FinishLibrary(library);
+      }
+      if (l == N_libraries-1) {
+        CLMs[i]->PackLinks();
+      }
+    });
   }
 }
 
+/*******************************************************************************
+ * LoadDeNovoCLMsFromLinks: The in-memory version of LoadDeNovoCLMsFromSAM.  Fill the non-NULL
+ * ChromLinkMatrices with the Hi-C read pairs in links, instead of reading them from SAM files.
+ * contig_lengths and contig_RE_sites describe all of the contigs in the draft assembly (the RE site
+ * counts as in the RE sites file, i.e., without the 1 that LoadRESitesFile adds.)  SAM_files names
+ * the files that the links came from, if any; it's only recorded in the CLMs, as if they had been
+ * loaded from these files.
+ ******************************************************************************/
+void LoadDeNovoCLMsFromLinks(const vector<HiCLink> &links,
+                             const vector<int> &contig_lengths,
+                             const vector<int> &contig_RE_sites,
+                             const vector<string> &SAM_files,
+                             const ClusterVec &clusters,
+                             vector<ChromLinkMatrix *> CLMs,
+                             const LinkLibraries &libraries) {
+  assert(CLMs.size() == clusters.size());
+  assert(contig_lengths.size() == contig_RE_sites.size());
+  int N_clusters = clusters.size();
+
+  vector<bool> wanted(N_clusters, false);
+  int N_used = 0;
+  for (int i = 0; i < N_clusters; i++) {
+    if (CLMs[i] == NULL) {
+      continue;
+    }
+    wanted[i] = true;
+    N_used++;
+    CLMs[i]->SetDeNovoContigs(clusters[i], contig_lengths, contig_RE_sites);
+    CLMs[i]->SetLibraries(libraries, clusters[i]);
+    CLMs[i]->_SAM_files = SAM_files;
+  }
+
+  cout << "Filling " << N_used << " clusters with " << links.size() << " Hi-C read pairs from memory" << endl;
+
+  // Load the links one library at a time, as in LoadDeNovoCLMsFromSAM.
+  const int N_libraries = libraries.trivial() ? 1 : libraries.N();
+  DeNovoLinkFilter filter(clusters, wanted, contig_lengths);
+  CLMLink link;
+  for (int l = 0; l < N_libraries; l++) {
+    for (size_t i = 0; i < links.size(); i++) {
+      if (N_libraries > 1 && links[i].library != l) {
+        continue;
+      }
+      int cluster = filter.Classify(links[i], link);
+      if (cluster != -1) {
+        CLMs[cluster]->AddLink(link);
+      }
+    }
+    for (int i = 0; i < N_clusters; i++) {
+      if (CLMs[i] != NULL) {
+        CLMs[i]->FinishLibrary(l);
+      }
+    }
+  }
+  for (int i = 0; i < N_clusters; i++) {
+    if (CLMs[i] != NULL) {
+      CLMs[i]->PackLinks();
+    }
+  }
+}
+
+/*******************************************************************************
+ * LoadDeNovoCLMsFromSAMOutOfCore: The out-of-core version of LoadDeNovoCLMsFromSAM.  The links are
+ * read from all the SAM files in one pass and spilled to disk, grouped by cluster (see
+ * CLMLinkSpill); then each wanted ChromLinkMatrix is built from its cluster's links alone and
+ * handed to consume(), which takes ownership of it.  The links come back in the order they were
+ * read, so each CLM is identical to the one LoadDeNovoCLMsFromSAM would make.
+ ******************************************************************************/
+void LoadDeNovoCLMsFromSAMOutOfCore(const vector<string> &SAM_files,
+                                    const string &RE_sites_file,
+                                    const ClusterVec &clusters,
+                                    const string &species,
+                                    const vector<bool> &wanted,
+                                    const string &spill_dir,
+                                    const int64_t memory_budget,
+                                    const function<void(int, ChromLinkMatrix *)> &consume,
+                                    const LinkLibraries &libraries) {
+  assert(wanted.size() == clusters.size());
+  AssertFilesExist(SAM_files);
+  int N_clusters = clusters.size();
+
+  CLMLinkSpill spill(N_clusters, spill_dir, memory_budget);
+  for (size_t i = 0; i < SAM_files.size(); i++) {
+    cout << "Spilling Hi-C data from SAM file " << SAM_files[i] << " to " << spill_dir << "\t(dot = 1M alignments)" << endl;
+    ForEachDeNovoLinkInSAM(SAM_files[i], clusters, wanted,
+                           [&spill](int cluster, const CLMLink &link) { spill.AddLink(cluster, link); },
+                           libraries.trivial() ? NULL : &libraries);
+  }
+  spill.Finish();
+
+  // LoadDeNovoCLMsFromSAM resets the contig lengths from each SAM file in turn, so the last one wins.
+  vector<int> contig_lengths_orig = TargetLengths(SAM_files.back());
+  vector<int> contig_RE_sites_orig = ParseTabDelimFile<int>(RE_sites_file, 1);
+
+  for (int i = 0; i < N_clusters; i++) {
+    if (!wanted[i]) {
+      continue;
+    }
+    cout << "Filling cluster " << i << " with spilled Hi-C data" << endl;
+    ChromLinkMatrix *CLM = new ChromLinkMatrix(species, clusters[i].size());
+    CLM->SetDeNovoContigs(clusters[i], contig_lengths_orig, contig_RE_sites_orig);
+    CLM->SetLibraries(libraries, clusters[i]);
+    CLM->_SAM_files = SAM_files;
+    // The spilled links carry their libraries, so with several libraries, read them once per library.
+    const int N_libraries = libraries.trivial() ? 1 : libraries.N();
+    for (int l = 0; l < N_libraries; l++) {
+      spill.ForEachLink(i, [CLM, l, N_libraries](const CLMLink &link) {
+          if (N_libraries == 1 || link.library == l) {
+            CLM->AddLink(link);
+          }
+        });
+      CLM->FinishLibrary(l);
+    }
+    CLM->PackLinks();
+    consume(i, CLM);
+  }
+}
 
 void LoadNonDeNovoCLMsFromSAM(const vector<string> &SAM_files,
                               vector<ChromLinkMatrix *> CLMs) {
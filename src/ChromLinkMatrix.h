@@ -26,12 +26,22 @@
  *
  * A ChromLinkMatrix contains a 2-D array of data, of size (2*_N_contigs) x (2*_N_contigs).  There
  * are two bins for each contig, corresponding to the forward and reverse orientation of each
- * contig.  Each bin contains a vector<int> representing the set of distances of all links between
- * the two contigs, assuming a particular orientation.
+ * contig.  Each bin contains the set of distances of all links between the two contigs, assuming a
+ * particular orientation.  While the links are being loaded, each bin is a vector<int>; once they're
+ * loaded, the bins are packed into a LinkArena (see LinkArena.h), which stores them several times
+ * more compactly, and which the ordering algorithms stream through.  A CLM file's LinkArena is also
+ * written to a link store (see LinkStore.h), which later runs map read-only instead of parsing the
+ * file, so that several Lachesis processes can share one copy of it.
  *
  * ChromLinkMatrices take their data from SAM files.  You can load data from SAM files using
  * LoadFromSAM...().
  *
+ * If the Hi-C data combine several libraries (see LinkLibraries.h), a de novo CLM loads the links
+ * one library at a time, so each bin holds a run of links from each library, in library order.
+ * The CLM records how many links each library contributed to each contig pair, and weights each
+ * run by its library's weight; link densities are normalized to each library's own RE sites.  No
+ * extra data is stored per link.
+ *
  * The goal of the ChromLinkMatrix class is to find a oriented ordering of contigs (a ContigOrdering
  * object) that is best supported by the Hi-C links. The Make...Order() functions employ a
  * graph-based optimization algorithm to find the best ordering of contigs.  The OrientContigs()
@@ -46,6 +56,11 @@
 #define _CHROM_LINK_MATRIX__H
 
 #include <algorithm> // max_element
+#include <assert.h>
+#include <functional>
+#include <inttypes.h> // int64_t
+#include <map>
+#include <memory> // shared_ptr
 #include <set>
 #include <string>
 #include <vector>
@@ -53,11 +68,17 @@
 
 #include "ClusterVec.h"
 #include "ContigOrdering.h"
+#include "HiCLink.h"
+#include "LinkArena.h"
+#include "LinkLibraries.h"
 #include "LinkSizeDistribution.h"
+#include "OrderingConstraints.h"
 #include "TrueMapping.h"
 
 using namespace std;
 
+struct CLMLink; // see LinkSpill.h
+
 class ChromLinkMatrix {
  public:
   /* CONSTRUCTORS */
@@ -78,20 +99,32 @@ class ChromLinkMatrix {
                   const int cluster_ID);
   // Load a ChromLinkMatrix from a file that was previously written with WriteFile().
   // ChromLinkMatrix( const string & CLM_file ) : _CP_score_dist(1e7) { ReadFile( CLM_file ); }
- ChromLinkMatrix(const string &CLM_file) : _CP_score_dist(10000000) {
+  explicit ChromLinkMatrix(const string &CLM_file) : _CP_score_dist(10000000), _bootstrap_seed(0) {
     ReadFile(CLM_file);
   }
+  // Bootstrap replicate: A ChromLinkMatrix that shares the link data of clm (without copying it),
+  // but in which each link between two contigs is counted a random number of times, drawn from a
+  // Poisson distribution with mean 1.  The weights are a fixed hash of bootstrap_seed (which must
+  // be nonzero) and the link, so they don't have to be stored, and replicates with different seeds
+  // can be used in parallel.  clm must outlive the replicate, and mustn't be modified meanwhile.
+  ChromLinkMatrix(const ChromLinkMatrix &clm, const uint64_t bootstrap_seed);
 
   // Destructor: Cleans up.
   ~ChromLinkMatrix();
   /* FILE I/O */
 
-  // ReadFile: Read the data from file CLM_file into this ChromLinkMatrix.
+  // ReadFile: Read the data from file CLM_file into this ChromLinkMatrix.  If the file has a link
+  // store (see LinkStore.h), the links are read from it in place, instead of from the file.
   //void ReadFile(const string &CLM_file);
   void ReadFile(const string &CLM_file);
-  // WriteFile: Write the data in this ChromLinkMatrix to file "CLM_file".
+  // WriteFile: Write the data in this ChromLinkMatrix to file "CLM_file", and its links to a link
+  // store beside it.
   void WriteFile(const string &CLM_file,
                  const bool heatmap = false) const;
+  // ClipToFileFormat: Drop the links that WriteFile() can't fit on a line of a CLM file, so that
+  // this ChromLinkMatrix is the same as one that ReadFile() reads back from its file.  Call this
+  // before using a freshly built CLM in place of its file.  Only very deep bins are affected.
+  void ClipToFileFormat();
   // DrawHeatmap: Call WriteFile("heatmap.txt"), then run the R script "heatmap.R", which uses R and
   // ggplot2 to make a heatmap image of this ChromLinkMatrix.
   void DrawHeatmap(const string &heatmap_file = "") const;
@@ -114,6 +147,17 @@ class ChromLinkMatrix {
   void LoadFromSAMNonDeNovo(const vector<string> &SAM_files,
                             const int chrom_ID);
 
+  // SetContigBiases: Normalize this de novo CLM's link densities by contig biases, as found by
+  // GenomeLinkMatrix::BalanceMatrix() for all the contigs in the assembly, instead of by contig RE
+  // sites or lengths.  contig_IDs are the IDs of this CLM's contigs in the assembly.  If
+  // contig_biases is empty, go back to the usual normalization.  The biases aren't written to the
+  // CLM file, so set them again after reading one.
+  void SetContigBiases(const vector<double> &contig_biases,
+                       const set<int> &contig_IDs);
+  // SetConstraints: Make the ordering algorithms honour a curator's constraints on this group (see
+  // OrderingConstraints.h.)  Like the biases, the constraints aren't written to the CLM file.
+  void SetConstraints(const OrderingConstraints &constraints) { _constraints = constraints; }
+
   /* QUERY FUNCTIONS */
 
   int N_contigs() const { return _N_contigs; }
@@ -121,7 +165,11 @@ class ChromLinkMatrix {
   int contig_size() const { return _contig_size; }
   bool has_links() const;
   int NLinks(const int contig1,
-             const int contig2) const { return _matrix[2*contig1][2*contig2].size(); }
+             const int contig2) const { return Links().N_links(2*contig1, 2*contig2); }
+  // N_libraries: The number of Hi-C libraries whose links are weighted separately (1 if the links
+  // aren't weighted.)
+  int N_libraries() const { return _library_weights.empty() ? 1 : _library_weights.size(); }
+  const OrderingConstraints &constraints() const { return _constraints; }
 
   // EmptyRows: Return a vector indicating which contigs in the ChromLinkMatrix have data at all.
   // Contigs in centromeres will end up as false.
@@ -130,6 +178,10 @@ class ChromLinkMatrix {
   // ContigOrientLogLikelihood: Return the log-likelihood of observing two contigs in a given
   // orientation, as defined by the links between the contigs.
   double ContigOrientLogLikelihood( const int c1, const bool rc1, const int c2, const bool rc2 ) const;
+  // AdjacencyOrientLogLikelihoods: Fill log_likes[2*rc1+rc2] with the ContigOrientLogLikelihood()
+  // of contig c1 followed by contig c2, in each of their four orientations.  The results are
+  // cached in _orient_LLs, so each adjacency is only computed once per ordering run.
+  void AdjacencyOrientLogLikelihoods(const int c1, const int c2, double *log_likes) const;
 
   // OrderingScore: Find the "score" of this ContigOrdering, indicating how well it matches up with
   // the Hi-C link data.  If oriented = true, takes orientation into account.  oriented=false is
@@ -145,7 +197,8 @@ class ChromLinkMatrix {
                        const int shred_stop = -1) const;
   // EnrichmentScore: Find the "enrichment", the degree to which the Hi-C links between contigs are
   // between close contigs.  It's analogous to the concentration  of signal along the main diagonal
-  // of the heatmap.
+  // of the heatmap.  To score an ordering through many local changes, use an EnrichmentScorer
+  // instead.
   double EnrichmentScore(const ContigOrdering &order) const;
 
   /* PRE-PROCESSING FUNCTIONS */
@@ -162,23 +215,62 @@ class ChromLinkMatrix {
   /* GRAPH ALGORITHM METHODS */
   // MAIN ALGORITHMS
   ContigOrdering MakeTrunkOrder(const int min_N_REs) const;
-  ContigOrdering MakeFullOrder(const int min_N_REs, const bool use_CP_score = false) const;
+  // MakeFullOrder: Find the full ordering from the spanning tree left by MakeTrunkOrder().  If
+  // exhaustive = true, InsertShreds() tries every position for each shred (see InsertShreds().)  If
+  // use_CP_score = true, each position is scored by the OrderingScore() of the ordering with the
+  // shred inserted there, as tracked by an EnrichmentScorer.
+  ContigOrdering MakeFullOrder(const int min_N_REs, const bool use_CP_score = false, const bool exhaustive = false) const;
+  // MakeBeamOrder: Find the full ordering by beam search instead.  The trunk's contigs are always
+  // included; if seed_with_trunk = true, the search also starts from the trunk.
+  ContigOrdering MakeBeamOrder(const int beam_width,
+                               const int min_N_REs,
+                               const ContigOrdering &trunk,
+                               const bool seed_with_trunk = false,
+                               const bool exhaustive = false) const;
   void SpaceContigs(ContigOrdering &order, const LinkSizeDistribution &link_size_distribution) const;
+  // With several libraries, each library has its own LinkSizeDistribution (lsds[l] for library
+  // #l), and the gap sizes are found from the weighted evidence of all of them.
+  void SpaceContigs(ContigOrdering &order, const vector<LinkSizeDistribution> &lsds) const;
+  // ReorderIncrementally: Re-optimize an existing ordering after a curator's edits, instead of
+  // ordering from scratch.  The edited contigs are taken out of old_order and reinserted (with any
+  // contigs that aren't in old_order yet) as shreds, honouring the constraints; then the ordering
+  // within window positions of each edited contig and each of its old neighbours is improved by
+  // inversions, and the contigs are reoriented.  Far from the edits, the ordering is left alone.
+  ContigOrdering ReorderIncrementally(const ContigOrdering &old_order,
+                                      const vector<int> &edited_contigs,
+                                      const int min_N_REs,
+                                      const int window,
+                                      const bool exhaustive = false) const;
 
   vector< vector<int> > FindSpanningTree(const int min_N_REs) const;
   void SmoothThornsInTree(vector< vector<int> > & tree) const;
   ContigOrdering TreeTrunk(const vector< vector<int> > &tree, const bool verbose) const;
-  ContigOrdering ReinsertShreds(vector< vector<int> > &tree, const int min_N_REs, const bool use_CP_score = false) const;
+  ContigOrdering ReinsertShreds(const vector< vector<int> > &tree, const int min_N_REs, const bool use_CP_score = false, const bool exhaustive = false) const;
+  void InsertShreds(ContigOrdering &order, const vector< vector<int> > &shreds, const int min_N_REs, const bool use_CP_score = false,
+                    const bool exhaustive = false) const;
   void OrientContigs(ContigOrdering &order) const;
 
  private:
   // DeNovo: Return true iff this is a de novo CLM.
   bool DeNovo() const { return _contig_size == 0; }
+  // Weighted: Return true iff some links count more than once (see LinkWeight.)
+  bool Weighted() const { return !_library_weights.empty() || _bootstrap_seed != 0; }
   // Initialize the matrix of data and allocate memory for it.
   void InitMatrix();
   void FreeMatrix();
+  // PackLinks: Pack the links in the matrix into _links, and free the matrix.  Every function that
+  // loads links calls this when it's done.  UnpackLinks: The reverse, so that more links can be
+  // added.
+  void PackLinks();
+  void UnpackLinks();
+  // Links: The packed links.  Only valid once the links are loaded.
+  const LinkArena &Links() const { assert(!_matrix_init && _links); return *_links; }
   // LoadRESitesFile: Fill _contig_RE_sites.
   void LoadRESitesFile(const string & RE_sites_file);
+  // WriteLibrariesFile, ReadLibrariesFile: Write and read the library data of a CLM whose links are
+  // weighted by library, in an auxiliary file to the CLM file.
+  void WriteLibrariesFile(const string &libraries_file) const;
+  void ReadLibrariesFile(const string &libraries_file);
   // AddToMatrix: Add a individual Hi-C link to the matrix.  This function is only used when loading
   // data from SAM files.
   void AddLinkToMatrix(const int contig1,
@@ -187,6 +279,24 @@ class ChromLinkMatrix {
                        const int read1_dist2,
                        const int read2_dist1,
                        const int read2_dist2);
+  // AddLink: Add a Hi-C link that was made by DeNovoLinkFilter to the matrix.
+  void AddLink(const CLMLink &link);
+  // SetDeNovoContigs: Set the lengths and RE site counts of the contigs in this de novo CLM, from
+  // the lengths and RE site counts of all the contigs in the assembly.
+  void SetDeNovoContigs(const set<int> &contig_IDs,
+                        const vector<int> &contig_lengths_orig,
+                        const vector<int> &contig_RE_sites_orig);
+  // SetLibraries: Set the weights and RE sites of the libraries that this de novo CLM's links come
+  // from, given the IDs of its contigs in the assembly.  Call this before loading any links.  If
+  // the libraries are trivial(), the links aren't weighted.
+  void SetLibraries(const LinkLibraries &libraries,
+                    const set<int> &contig_IDs);
+  // FinishLibrary: All of the links from library #l have been loaded; count them for each contig
+  // pair.  The libraries must be loaded and finished in order.
+  void FinishLibrary(const int l);
+  // FindDensityNorms: Fill _density_norms.  Call this whenever the contigs' lengths or RE sites or
+  // the libraries change.
+  void FindDensityNorms();
 
   // CalculateRepeatFactors: Fill the _repeat_factors vector.  This vector contains the 'factor', or
   // multiplicity, of each contig: the ratio by which the total  density of links in each contig
@@ -198,6 +308,33 @@ class ChromLinkMatrix {
   // lengths, if this is a de novo CLM.
   double LinkDensity(const int contig1, const int contig2) const;
 
+  // LinkWeight: The number of times to count link #k between these two contigs: its library's
+  // weight (1 if there's one library), times its bootstrap weight if this is a bootstrap replicate.
+  // Link #k is the k'th element of each of the four orientation bins of the contig pair, in either
+  // order, since AddLinkToMatrix() pushes a link to all eight at once.
+  double LinkWeight(const int contig1, const int contig2, const int k) const {
+    const double weight = _library_weights.empty() ? 1 : LibraryWeight(contig1, contig2, k);
+    return _bootstrap_seed == 0 ? weight : weight * BootstrapWeight(contig1, contig2, k);
+  }
+  int BootstrapWeight(const int contig1, const int contig2, const int k) const;
+  // LibraryWeight: The weight of the library that link #k between these two contigs came from.
+  double LibraryWeight(const int contig1, const int contig2, const int k) const;
+  // LibraryRange: The range [first,second) of the links between these two contigs that came from
+  // library #l, as indices into the contig pair's bins.
+  pair<int, int> LibraryRange(const int contig1, const int contig2, const int l) const;
+  // LibraryLinkCount: The number of links between these two contigs from library #l, each counted
+  // with its bootstrap weight (but not its library weight.)
+  int64_t LibraryLinkCount(const int contig1, const int contig2, const int l) const;
+  // LinkCount: The number of links between these two contigs, counted with their LinkWeight().
+  double LinkCount(const int contig1, const int contig2) const;
+  // LinkedContigs: The contigs c != x with LinkCount(c, x) != 0, in increasing order.  Found from
+  // the non-empty bins in x's row, so this takes time in proportion to their number, not to
+  // N_contigs.
+  vector<int> LinkedContigs(const int x) const;
+  // ContigHasLinks: True if contig c has any links, to itself or another contig.  Like
+  // LinkedContigs(), this only looks at the non-empty bins in c's row.
+  bool ContigHasLinks(const int c) const;
+
   // PlotTree: Use grpahviz to print a spanning tree to a graph image at out/<filename>.  <filename>
   // should end in "png".  Note that graphviz is very slow for large graphs, and the output images
   // themselves are sometimes so large as to cause memory problems.  Hence this is NOT RECOMMENDED
@@ -210,10 +347,20 @@ class ChromLinkMatrix {
   // estimated.
   int FindGapSize(const ContigOrdering &order,
                   const int pos,
-                  const LinkSizeDistribution &lsd,
+                  const vector<LinkSizeDistribution> &lsds,
                   const vector<double> &enrichments ) const;
   void ReportOrderingSize(const ContigOrdering &order) const;
 
+  // OrderingScoreRows: The kernel of OrderingScore(), specialized to the mode
+  // of this CLM so the inner loops have no branches on it.  See ChromLinkMatrix.cc.
+  template<bool DE_NOVO, bool ORIENTED, bool WEIGHTED>
+  double OrderingScoreRows(const vector<int> &data,
+                           const int N,
+                           const int i1_start,
+                           const int i1_stop,
+                           const int i2_min,
+                           double score) const;
+
   /* DATA */
   // The species under consideration.  Knowing this helps us avoid confusion.
   string _species;
@@ -226,17 +373,51 @@ class ChromLinkMatrix {
   int _most_contig_REs; // largest element in _contig_RE_sites; -1 for non-de novo CLMs
 
   /* MAIN DATA STRUCTURE: a matrix with size (2*_N_contigs) x (2*_N_contigs); each element is a vector of read pairs' distances */
+  // A new ChromLinkMatrix starts with no links in _links, and no _matrix.  While links are being
+  // loaded, they're added to _matrix (which is made when the first one is added); then PackLinks()
+  // moves them into _links.  ReadFile() may instead map _links from the CLM file's link store.
   vector<int> ** _matrix;
   bool _matrix_init; // is the matrix initialized? (if not, don't free it!)
+  shared_ptr<LinkArena> _links; // shared with any bootstrap replicates
   // "Repetitiveness factors" for each contig: the number of total links involving this contig,
   // divided by the average.  Used in normalization.
   vector<double> _repeat_factors;
   // tree: A spanning tree.  An intermediate result, created by MakeTrunkOrder, used by MakeFullOrder.
   mutable vector< vector<int> > _tree;
+  // The orientation log-likelihoods of the adjacencies that OrientContigs() has seen since the
+  // last MakeTrunkOrder(), keyed by (c1,c2), with the four values as in
+  // AdjacencyOrientLogLikelihoods().  Most of the trunk's adjacencies survive into the full
+  // ordering, so orienting the full ordering only computes the adjacencies made by inserting the
+  // shreds.  Not copied into bootstrap replicates, whose links are weighted differently.
+  mutable map< pair<int,int>, vector<double> > _orient_LLs;
   // The set of SAM files used to gather this data.
   vector<string> _SAM_files;
   // Maximum distance used in the OrderingScore() function.  Higher values give more precise results but take much more runtime.  Defaults to 10Mb.
   int _CP_score_dist;
+  // The seed of the link weights in a bootstrap replicate, or 0 for an ordinary ChromLinkMatrix.
+  uint64_t _bootstrap_seed;
+
+  // The Hi-C libraries, if the links are weighted by library (see SetLibraries); otherwise these
+  // are all empty.  The weights are relative to the lowest weight.  _library_RE_sites[l] holds
+  // library #l's RE sites per contig (plus 1, as in LoadRESitesFile), or is empty if the library
+  // uses _contig_RE_sites.  _library_counts[(contig1*_N_contigs+contig2)*L+l] is the number of
+  // links between the two contigs from library #l, where L = N_libraries().
+  vector<string> _library_names;
+  vector<double> _library_weights;
+  vector< vector<int> > _library_RE_sites;
+  vector<int> _most_library_REs;
+  vector<int> _library_counts;
+
+  // The factors by which LinkDensity() normalizes the links between each pair of contigs: the link
+  // count is multiplied by the factor of each contig (see FindDensityNorms.)  There's one block of
+  // _N_contigs factors, or one block per library if the links are weighted by library and there
+  // are RE sites.  Empty for non-de novo CLMs.
+  vector<int> _density_norms;
+  // The contig biases set by SetContigBiases(), or empty.  If set, LinkDensity() divides the link
+  // count by the biases of the two contigs, and _density_norms isn't used.
+  vector<double> _contig_biases;
+  // The curator's constraints set by SetConstraints(), or none.
+  OrderingConstraints _constraints;
 
   // Friend function declarations (see below for documentation on these functions.)
   friend void LoadNonDeNovoCLMsFromSAM(const string &SAM_file, vector<ChromLinkMatrix *> CLMs);
@@ -244,11 +425,70 @@ class ChromLinkMatrix {
   friend void LoadDeNovoCLMsFromSAM(const string &SAM_file,
                                     const string &RE_sites_file,
                                     const ClusterVec &clusters,
-                                    vector<ChromLinkMatrix *> CLMs);
+                                    vector<ChromLinkMatrix *> CLMs,
+                                    const LinkLibraries &libraries,
+                                    const int library);
   friend void LoadDeNovoCLMsFromSAM(const vector<string> &SAM_files,
                                     const string &RE_sites_file,
                                     const ClusterVec &clusters,
-                                    vector<ChromLinkMatrix *> CLMs);
+                                    vector<ChromLinkMatrix *> CLMs,
+                                    const LinkLibraries &libraries);
+  friend void LoadDeNovoCLMsFromLinks(const vector<HiCLink> &links,
+                                      const vector<int> &contig_lengths,
+                                      const vector<int> &contig_RE_sites,
+                                      const vector<string> &SAM_files,
+                                      const ClusterVec &clusters,
+                                      vector<ChromLinkMatrix *> CLMs,
+                                      const LinkLibraries &libraries);
+  friend void LoadDeNovoCLMsFromSAMOutOfCore(const vector<string> &SAM_files,
+                                             const string &RE_sites_file,
+                                             const ClusterVec &clusters,
+                                             const string &species,
+                                             const vector<bool> &wanted,
+                                             const string &spill_dir,
+                                             const int64_t memory_budget,
+                                             const function<void(int, ChromLinkMatrix *)> &consume,
+                                             const LinkLibraries &libraries);
+  friend class EnrichmentScorer;
+};
+
+// EnrichmentScorer: Keeps ChromLinkMatrix::EnrichmentScore() of an ordering up to date while the
+// ordering is edited.  EnrichmentScore() is a ratio of sums over the contig pairs within
+// _CP_score_dist of each other: the OrderingScore terms over the null score, scaled by the number of
+// links and total squared length of the pairs.  This keeps only those four sums.  An edit changes the
+// terms of just the pairs whose span overlaps it; their old terms are subtracted before the edit, and
+// their new terms added after it.  So an edit costs about as much as its own OrderingScore delta, and
+// nothing is kept per position.  The contigs near the edit are read with ContigOrdering::contig_ID(),
+// so the ordering is never flattened.  Score() agrees with EnrichmentScore() up to floating-point
+// rounding.
+class EnrichmentScorer {
+ public:
+  EnrichmentScorer(const ChromLinkMatrix &clm, const ContigOrdering &order);
+
+  // To edit the ordering, call BeginEdit() on the ordering as it is, where [start,stop) are the
+  // positions that the edit replaces; make the edit; then call EndEdit() on the edited ordering,
+  // where [start,new_stop) are the positions that replaced them.  The contigs after the edit may
+  // shift, but must be the same, in the same order and orientations.  For example:
+  // AddContigs(IDs,pos) is (pos, pos, pos+IDs.size()); RemoveContig(pos) is (pos, pos+1, pos);
+  // Invert(a,b) is (a, b+1, b+1); and MoveContig(a,b), with a < b, is (a, b+1, b+1).
+  void BeginEdit(const ContigOrdering &order, const int start, const int stop);
+  void EndEdit(const ContigOrdering &order, const int new_stop);
+
+  double Score() const;
+  // OrderingScore: ChromLinkMatrix::OrderingScore() of the ordering, oriented, up to floating-point
+  // rounding.
+  double OrderingScore() const { return _score; }
+
+ private:
+  // AddTerms: Add sign times the terms of the contig pairs (i1,i2) with i1 < stop and i2 >= start.
+  // These are the pairs whose span overlaps [start,stop), or crosses position start if it's empty.
+  void AddTerms(const ContigOrdering &order, const int start, const int stop, const int sign);
+
+  const ChromLinkMatrix &_clm;
+  int _N_contigs_used;
+  int _edit_start; // the start of the edit in progress, or -1
+  double _N_links, _score;
+  int64_t _len_sq, _null_score; // the null score's terms are whole numbers, so they're added up exactly
 };
 
 // LoadDeNovoCLMsFromSAM: Import one or more SAM/BAM files and create a set of de novo
@@ -258,15 +498,53 @@ class ChromLinkMatrix {
 // represent ChromLinkMatrices for the  cluster ID equal to their index in the vector, and will be
 // filled accordingly.  If you are creating a set of ChromLinkMatrices for each chromosome, this is
 // much faster than calling LoadFromSAMDeNovo individually for each ChromLinkMatrix  object because
-// it only reads through the SAM file(s) once.
+// it only reads through the SAM file(s) once.  If the links come from several libraries, each
+// file is read once per library that it may contain (see LinkLibraries.h); the single-file version
+// only loads the read pairs from library #library, unless library = -1.  The multi-file version
+// gathers the links by cluster as it reads, then fills each ChromLinkMatrix in turn, so that each
+// one's bins lie together in memory.  It reads up to THREADS files at once, and fills up to THREADS
+// ChromLinkMatrices at once (see ThreadPool.h).
 void LoadDeNovoCLMsFromSAM(const string &SAM_file,
                            const string &RE_sites_file,
                            const ClusterVec &clusters,
-                           vector<ChromLinkMatrix *> CLMs);
+                           vector<ChromLinkMatrix *> CLMs,
+                           const LinkLibraries &libraries = LinkLibraries(),
+                           const int library = -1);
 void LoadDeNovoCLMsFromSAM(const vector<string> &SAM_files,
                            const string &RE_sites_file,
                            const ClusterVec &clusters,
-                           vector<ChromLinkMatrix *> CLMs);
+                           vector<ChromLinkMatrix *> CLMs,
+                           const LinkLibraries &libraries = LinkLibraries());
+
+// LoadDeNovoCLMsFromLinks: The in-memory version of LoadDeNovoCLMsFromSAM.  Fill the non-NULL
+// ChromLinkMatrices with the Hi-C read pairs in links, which are filtered exactly as they would be
+// if they were read from a SAM file.  contig_lengths and contig_RE_sites describe all the contigs
+// in the draft assembly; SAM_files is only recorded in the CLMs, to label where the links came from.
+// Each link's library is given by HiCLink::library.
+void LoadDeNovoCLMsFromLinks(const vector<HiCLink> &links,
+                             const vector<int> &contig_lengths,
+                             const vector<int> &contig_RE_sites,
+                             const vector<string> &SAM_files,
+                             const ClusterVec &clusters,
+                             vector<ChromLinkMatrix *> CLMs,
+                             const LinkLibraries &libraries = LinkLibraries());
+
+// LoadDeNovoCLMsFromSAMOutOfCore: The out-of-core version of LoadDeNovoCLMsFromSAM, for when the
+// ChromLinkMatrices of all the wanted clusters won't fit in memory together.  The SAM files are
+// read once, and the links are spilled to disk in spill_dir (see CLMLinkSpill), using at most
+// memory_budget bytes of buffer.  Then the ChromLinkMatrices are built one at a time: for each
+// cluster i with wanted[i] = true, a new ChromLinkMatrix is created and filled, and passed to
+// consume(i, CLM), which takes ownership of it.  The CLMs are identical to the ones that
+// LoadDeNovoCLMsFromSAM would make.
+void LoadDeNovoCLMsFromSAMOutOfCore(const vector<string> &SAM_files,
+                                    const string &RE_sites_file,
+                                    const ClusterVec &clusters,
+                                    const string &species,
+                                    const vector<bool> &wanted,
+                                    const string &spill_dir,
+                                    const int64_t memory_budget,
+                                    const function<void(int, ChromLinkMatrix *)> &consume,
+                                    const LinkLibraries &libraries = LinkLibraries());
 
 // LoadNonDeNovoCLMsFromSAM: Import one or more SAM/BAM files and create a set of non-de novo
 // ChromLinkMatrices corresponding to each chromosome.  As many or as few of the ChromLinkMatrix
@@ -282,4 +560,16 @@ void LoadNonDeNovoCLMsFromSAM(const string &SAM_file,
 void LoadNonDeNovoCLMsFromSAM(const vector<string> &SAM_files,
                               vector<ChromLinkMatrix *> CLMs);
 
+
+// find_longest_path: Find the longest path in a tree, given as an adjacency list.  Returns an empty
+// path if no node has a neighbor.  Used to find the trunk (see TreeTrunk()).
+vector<int> find_longest_path(const vector< vector<int> > &adj_list);
+
+// ShredTree: Break a tree, given as an adjacency list, into "shreds" by repeatedly finding the
+// longest path in what's left of the tree and removing it, as ReinsertShreds() does.  The first
+// shred is the longest path in the whole tree.  The shreds are exactly the ones that repeated calls
+// to find_longest_path() would find, removing each path from the tree in between.  If removed isn't
+// NULL, it's filled with whether each node is in a shred.
+vector< vector<int> > ShredTree(const vector< vector<int> > &tree, vector<bool> *removed = NULL);
+
 #endif
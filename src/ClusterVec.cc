@@ -151,6 +151,7 @@ ClusterVec::ReadFile( const string & file, const vector<string> * contig_names )
 // Spit a ClusterVec out to a file.  Each set<int> becomes one tab-delimited line.
 // If contig names are given (optional; could be NULL), output contig names instead of IDs.  This file is more human-readable but can't be read by ReadFile()
 // unless ReadFile() is also supplied with the same set of contig names.
+// The file is written to <file>.tmp and then renamed into place.
 void
 ClusterVec::WriteFile( const string & file, const vector<string> * contig_names ) const
 {
@@ -158,7 +159,7 @@ ClusterVec::WriteFile( const string & file, const vector<string> * contig_names
   //if ( contig_names != NULL ) PRINT2( _N_contigs, contig_names->size() );
   if ( contig_names != NULL ) assert( _N_contigs == (int) contig_names->size() );
 
-  ofstream out( file.c_str(), ios::out );
+  ofstream out( ( file + ".tmp" ).c_str(), ios::out );
 
   // Write a header.
   out << "# ClusterVec file - see ClusterVec.h for documentation of this object type" << endl;
@@ -176,6 +177,7 @@ ClusterVec::WriteFile( const string & file, const vector<string> * contig_names
     PrintCluster( i, out, contig_names );
 
   out.close();
+  boost::filesystem::rename( file + ".tmp", file );
 }
 
 
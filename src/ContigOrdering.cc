@@ -62,7 +62,8 @@ int scratch = set_random_seed();
 // Constructor.
 ContigOrdering::ContigOrdering( const int N_contigs, const bool all_used )
   : _N_contigs( N_contigs ),
-    _N_contigs_used( all_used ? N_contigs : 0 )
+    _N_contigs_used( all_used ? N_contigs : 0 ),
+    _data( N_contigs )
 {
   assert( N_contigs < INT_MAX ); // we want to make sure N_contigs stays positive and ~N_contigs stays negative
 
@@ -78,7 +79,7 @@ ContigOrdering::ContigOrdering( const int N_contigs, const bool all_used )
 ContigOrdering::ContigOrdering( const int N_contigs, const vector<int> & data )
   : _N_contigs( N_contigs ),
     _N_contigs_used( data.size() ),
-    _data( data )
+    _data( N_contigs )
 {
   assert( N_contigs < INT_MAX ); // we want to make sure N_contigs stays positive and ~N_contigs stays negative
   assert( N_contigs >= _N_contigs_used ); // can't use more contigs than we have!
@@ -92,13 +93,16 @@ ContigOrdering::ContigOrdering( const int N_contigs, const vector<int> & data )
     assert( !_contigs_used[c] );
     _contigs_used[c] = true;
   }
+
+  _data.Assign( data );
 }
 
 
 
 ContigOrdering::ContigOrdering( const int N_contigs, vector<bool> contigs_used )
   : _N_contigs( N_contigs ),
-    _contigs_used( contigs_used )
+    _contigs_used( contigs_used ),
+    _data( N_contigs )
 {
   assert( N_contigs < INT_MAX ); // we want to make sure N_contigs stays positive and ~N_contigs stays negative
 
@@ -112,7 +116,8 @@ ContigOrdering::ContigOrdering( const int N_contigs, vector<bool> contigs_used )
 // Create a sub-ordering containing only the contigs in [start,stop).
 ContigOrdering::ContigOrdering( const ContigOrdering & order, const int start, const int stop )
   : _N_contigs( order.N_contigs() ),
-    _N_contigs_used( 0 )
+    _N_contigs_used( 0 ),
+    _data( order.N_contigs() )
 {
   assert( start >= 0 );
   assert( start < stop );
@@ -139,8 +144,9 @@ ContigOrdering::ReadFile( const string & order_file )
   vector<string> tokens;
 
   bool first_line = true;
-  bool has_Q = false, has_gaps = false;
+  bool has_Q = false, has_gaps = false, has_support = false;
   int N_contigs_to_read = 0;
+  vector<double> support;
   bool old_version = false;
 
 
@@ -210,14 +216,16 @@ ContigOrdering::ReadFile( const string & order_file )
 	  if ( tokens[1] == "N_contigs_used" ) N_contigs_to_read = boost::lexical_cast<int>( tokens[2] );
 	  if ( tokens[1] == "has_Q_scores" ) has_Q    = ( tokens[2] == "1" );
 	  if ( tokens[1] == "has_gaps"     ) has_gaps = ( tokens[2] == "1" );
+	  if ( tokens[1] == "has_adjacency_support" ) has_support = ( tokens[2] == "1" );
 	  assert( has_Q || !has_gaps ); // can't have gaps but not quality scores
 
 	}
 
 	// Parse non-header lines.  They should contain 5 tokens: local contig ID, global contig name, contig orientation, orientation quality, gap size.
+	// Files with adjacency support have a sixth token.
 	else {
 
-	  assert( tokens.size() == 5 );
+	  assert( tokens.size() == ( has_support ? 6u : 5u ) );
 
 	  // Get the contig ID and orientation.  Note that we don't actually care about global contig name.
 	  int ID = boost::lexical_cast<int>( tokens[0] );
@@ -228,6 +236,7 @@ ContigOrdering::ReadFile( const string & order_file )
 	  int gap      = has_gaps ? boost::lexical_cast<int>   ( tokens[4] ) : -1;
 
 	  AddContig( ID, -1, rc, orient_Q, gap );
+	  if ( has_support ) support.push_back( boost::lexical_cast<double>( tokens[5] ) );
 	}
 
 
@@ -242,6 +251,11 @@ ContigOrdering::ReadFile( const string & order_file )
   assert( _N_contigs_used == N_contigs_to_read );
   assert( _N_contigs_used <= _N_contigs );
   if ( has_gaps ) assert( _gaps.back() == -1 );
+  if ( has_support ) {
+    assert( !support.empty() && support.back() == -1 );
+    support.pop_back(); // the placeholder is added back by SetAdjacencySupport()
+    SetAdjacencySupport( support );
+  }
 }
 
 
@@ -249,10 +263,11 @@ ContigOrdering::ReadFile( const string & order_file )
 // WriteFile: Write files in the ContigOrdering format.  The format consists of a header with commented lines; then one line for each
 // contig used in the ContigOrdering, with five columns: local ID, global contig name, orientation (1=rc), orientation quality, gap size.
 // If global_IDs and global_contig_names aren't given, the contig name column is filled with '.'s.  Likewise for the quality column if !has_Q_scores().
+// The file is written to <order_file>.tmp and then renamed into place, so an interrupted run never leaves a partially written ordering behind.
 void
 ContigOrdering::WriteFile( const string & order_file, const set<int> & global_IDs, const vector<string> * global_contig_names ) const
 {
-  ofstream out( order_file.c_str(), ios:: out );
+  ofstream out( ( order_file + ".tmp" ).c_str(), ios:: out );
 
   const bool output_old_version = false;
 
@@ -288,9 +303,13 @@ ContigOrdering::WriteFile( const string & order_file, const set<int> & global_ID
     out << "#\tN_contigs_used\t" << _N_contigs_used << "\t(Number of contigs ordered by this ordering)" << endl;
     out << "#\thas_Q_scores\t" << has_Q_scores() << "\t(Boolean: has orientation quality scores?)" << endl;
     out << "#\thas_gaps\t" << has_gaps() << "\t(Boolean: have gap sizes between contigs been estimated?)" << endl;
+    if ( has_adjacency_support() ) // only written if true, so that files without adjacency support are unchanged
+      out << "#\thas_adjacency_support\t1\t(Boolean: has the bootstrap support of each adjacency been estimated?)" << endl;
     out << "#\n";
     out << "# Columns:" << endl;
-    out << "#contig_ID(local)\tcontig_name\tcontig_rc\torientation_Q_score\tgap_size_after_contig" << endl;
+    out << "#contig_ID(local)\tcontig_name\tcontig_rc\torientation_Q_score\tgap_size_after_contig";
+    if ( has_adjacency_support() ) out << "\tadjacency_support_after_contig";
+    out << endl;
 
     // Determine whether or not the global contig information has been supplied.  Without it, we can't write out the global contig names.
     bool has_contig_names = !global_IDs.empty() && global_contig_names != NULL;
@@ -319,12 +338,14 @@ ContigOrdering::WriteFile( const string & order_file, const set<int> & global_ID
       else out << "\t.";
       if ( has_gaps() ) out << '\t' << _gaps[i]; // orientation quality score
       else out << "\t.";
+      if ( has_adjacency_support() ) out << '\t' << _adjacency_support[i]; // adjacency support
       out << endl;
     }
 
   }
 
   out.close();
+  boost::filesystem::rename( order_file + ".tmp", order_file );
 }
 
 
@@ -342,18 +363,19 @@ ContigOrdering::AddContig( const int contig_ID, const int pos, const bool rc, co
   assert( !_contigs_used[contig_ID] );
 
   if ( orient_Q_score == -1 ) assert( !has_Q_scores() );
+  assert( !has_adjacency_support() ); // ReadFile() sets the adjacency support after adding all the contigs
 
   int contig_ID_rc = rc ? ~contig_ID : contig_ID;
 
   // Insert the contig.
   if ( pos == -1 ) {
-    _data.push_back( contig_ID_rc );
+    _data.Insert( _N_contigs_used, vector<int>( 1, contig_ID_rc ) );
     if ( orient_Q_score != -1 ) _orient_Q.push_back( orient_Q_score );
     if ( has_gaps() || gap != -1 ) _gaps.push_back( gap );
   }
   else {
     assert( pos <= _N_contigs_used ); // equality is ok here - just add to end
-    _data.insert( _data.begin() + pos, contig_ID_rc );
+    _data.Insert( pos, vector<int>( 1, contig_ID_rc ) );
     if ( orient_Q_score != -1 ) _orient_Q.insert( _orient_Q.begin() + pos, orient_Q_score );
     if ( has_gaps() || gap != -1 ) _gaps.insert( _gaps.begin() + pos, gap );
   }
@@ -379,16 +401,16 @@ ContigOrdering::AddContigs( vector<int> contig_IDs, const int pos )
   }
   assert( !has_Q_scores() && !has_gaps() ); // don't add Q-scores or gaps and then modify the underlying ordering!
 
-  // Bookkeeping.
-  _N_contigs_used += size;
-
   // Insert the contigs.
   if ( pos == -1 )
-    _data.insert( _data.end(), contig_IDs.begin(), contig_IDs.end() );
+    _data.Insert( _N_contigs_used, contig_IDs );
   else {
     assert( pos <= _N_contigs_used );
-    _data.insert( _data.begin() + pos, contig_IDs.begin(), contig_IDs.end() );
+    _data.Insert( pos, contig_IDs );
   }
+
+  // Bookkeeping.
+  _N_contigs_used += size;
 }
 
 
@@ -405,7 +427,7 @@ ContigOrdering::RemoveContig( const int pos )
   _N_contigs_used--;
 
   // Remove the contig from the ordering.
-  _data.erase( _data.begin() + pos );
+  _data.Erase( pos );
 }
 
 
@@ -421,20 +443,9 @@ ContigOrdering::MoveContig( const int old_pos, const int new_pos )
   assert( !has_Q_scores() && !has_gaps() ); // don't add Q-scores or gaps and then modify the underlying ordering!
   if ( old_pos == new_pos ) return; // no work to do
 
-  // Find the contig that's being moved.
-  int contig_ID = _data[old_pos];
-  //cout << "Moving a contig (" << _data[old_pos] << ") from " << old_pos << " to " << new_pos << endl;
-
-  // Shift the contigs in between as necessary.
-  if ( new_pos > old_pos )
-    for ( int i = old_pos; i < new_pos; i++ )
-      _data[i] = _data[i+1];
-  else
-    for ( int i = old_pos; i > new_pos; i-- )
-      _data[i] = _data[i-1];
-
-  // Put the moved contig into its new place.
-  _data[new_pos] = contig_ID;
+  // Take out the contig that's being moved, and put it into its new place.  The contigs in between shift over by 1.
+  int contig_ID = _data.Erase( old_pos );
+  _data.Insert( new_pos, vector<int>( 1, contig_ID ) );
 }
 
 
@@ -449,17 +460,8 @@ ContigOrdering::Invert( const int start, const int stop )
   assert( start <= stop );
   assert( stop < _N_contigs_used );
 
-  // We accomplish the inversion by swapping pairs of numbers in-place (and also inverting them.)
-  int swap1 = start, swap2 = stop;
-  while ( swap1 < swap2 ) {
-    int swap = _data[swap1];
-    _data[swap1] = ~_data[swap2];
-    _data[swap2] = ~swap;
-    swap1++;
-    swap2--;
-  }
-
-  if ( swap1 == swap2 ) _data[swap1] = ~_data[swap1];
+  // The OrderTree reverses the range and inverts each number in it.
+  _data.Invert( start, stop );
 
 
   // Also reverse the quality scores and gaps, if there are any.
@@ -475,6 +477,12 @@ ContigOrdering::Invert( const int start, const int stop )
     it2 += stop - 1; // the -1 is necessary because _gaps[i] is the gap between contig i and i+1
     reverse( it1, it2 );
   }
+  if ( has_adjacency_support() ) {
+    vector<double>::iterator it1 = _adjacency_support.begin(), it2 = _adjacency_support.begin();
+    it1 += start;
+    it2 += stop; // the adjacencies within [start,stop] are [start,stop)
+    reverse( it1, it2 );
+  }
 }
 
 
@@ -533,11 +541,12 @@ ContigOrdering::PerturbRandom( const int N )
 void
 ContigOrdering::Clear()
 {
-  _data.clear();
+  _data.Clear();
   _N_contigs_used = 0;
   _contigs_used = vector<bool>( _N_contigs, false );
   _orient_Q.clear();
   _gaps.clear();
+  _adjacency_support.clear();
 }
 
 
@@ -550,14 +559,15 @@ ContigOrdering::Sort()
   // If there are quality scores or gaps, scrap them, because they're about to lose meaning.
   _orient_Q.clear();
   _gaps.clear();
+  _adjacency_support.clear();
 
-  _data.clear();
-
+  vector<int> data;
   for ( int i = 0; i < _N_contigs; i++ )
     if ( _contigs_used[i] )
-      _data.push_back( i ); // i instead of ~i means fw instead of rc
+      data.push_back( i ); // i instead of ~i means fw instead of rc
 
-  assert( (int) _data.size() == _N_contigs_used );
+  assert( (int) data.size() == _N_contigs_used );
+  _data.Assign( data );
 }
 
 
@@ -569,8 +579,9 @@ ContigOrdering::Randomize()
   // If there are quality scores or gaps, scrap them, because they're about to lose meaning.
   _orient_Q.clear();
   _gaps.clear();
+  _adjacency_support.clear();
 
-  _data.clear();
+  vector<int> data;
 
   // Vector of which contigs are available to add to the ordering.  Unused contigs are pre-marked as unavailable.
   vector<bool> avail = _contigs_used;
@@ -589,9 +600,10 @@ ContigOrdering::Randomize()
 
     // Choose a random orientation for this contig.
     if ( lrand48() % 2 ) x = ~x;
-    _data.push_back(x);
+    data.push_back(x);
   }
 
+  _data.Assign( data );
 }
 
 
@@ -611,11 +623,13 @@ ContigOrdering::AppendUnusedContigs()
 {
   assert( !has_Q_scores() && !has_gaps() ); // don't add Q-scores or gaps and then modify the underlying ordering!
 
+  vector<int> unused;
   for ( int contig_ID = 0; contig_ID < _N_contigs; contig_ID++ )
     if ( !_contigs_used[contig_ID] )
-      _data.push_back(contig_ID);
+      unused.push_back(contig_ID);
 
-  assert( (int) _data.size() == _N_contigs );
+  _data.Insert( _N_contigs_used, unused );
+  assert( _data.size() == _N_contigs );
 
   // Mark all contigs as used.
   _contigs_used = vector<bool>( _N_contigs, true );
@@ -664,6 +678,17 @@ ContigOrdering::SetGaps( const vector<int> & gaps )
 
 
 
+// Set the _adjacency_support vector.  As with SetGaps(), the input has one element for each pair of adjacent contigs.
+void
+ContigOrdering::SetAdjacencySupport( const vector<double> & support )
+{
+  assert( (int) support.size() + 1 == _N_contigs_used );
+  _adjacency_support = support;
+  _adjacency_support.push_back(-1); // add the 'backstop'
+}
+
+
+
 
 /* OrientationWDAG: Make a WDAG representing contig orientations in this ContigOrdering.
  *
@@ -680,8 +705,9 @@ ContigOrdering::SetGaps( const vector<int> & gaps )
  *
  *************************************************************************************************************************************************************/
 WDAG
-ContigOrdering::OrientationWDAG( const ChromLinkMatrix * clm ) const
+ContigOrdering::OrientationWDAG( const vector<double> & log_likes ) const
 {
+  assert( (int) log_likes.size() == 4 * max( 0, _N_contigs_used - 1 ) );
 
   // Build a WDAG representing the possible paths through this ContigOrdering with different orientations of the contigs.
   // This method for building a WDAG follows HMM:to_WDAG().
@@ -721,12 +747,10 @@ ContigOrdering::OrientationWDAG( const ChromLinkMatrix * clm ) const
       for ( int rc1 = 0; rc1 < 2; rc1++ )
 	for ( int rc2 = 0; rc2 < 2; rc2++ ) {
 
-	  int contig1 = contig_ID(i-1);
-	  int contig2 = contig_ID(i);
-
 	  // Each oriented pair of contigs points to an element in the ChromLinkMatrix, which is a vector<int> giving the distance between the reads in those
-	  // two contigs, assuming the contigs are immediately adjacent with the specified orientations.
-	  double log_like = clm->ContigOrientLogLikelihood( contig1, rc1, contig2, rc2 );
+	  // two contigs, assuming the contigs are immediately adjacent with the specified orientations.  The log-likelihood of those distances was found by
+	  // the caller.
+	  double log_like = log_likes[ 4*(i-1) + 2*rc1 + rc2 ];
 
 	  // Make the edge.
 	  WDAGNode * node1 = rc1 ? contig_rc[i-1] : contig_fw[i-1];
@@ -761,11 +785,12 @@ ContigOrdering::OrientationWDAG( const ChromLinkMatrix * clm ) const
 string
 ContigOrdering::as_string() const
 {
+  const vector<int> & data = _data.data();
   ostringstream oss;
   for ( int i = 0; i < _N_contigs_used; i++ ) {
     if ( i > 0 ) oss << ',';
-    if ( _data[i] >= 0 ) oss <<  _data[i] << "_fw";
-    else                        oss << ~_data[i] << "_rc";
+    if ( data[i] >= 0 ) oss <<  data[i] << "_fw";
+    else                       oss << ~data[i] << "_rc";
   }
   return oss.str();
 }
@@ -42,6 +42,7 @@
 #define _CONTIG_ORDERING__H
 
 #include "TrueMapping.h"
+#include "OrderTree.h"
 
 // Modules in ~/include (must add -L~/include and -lJ<module> to link)
 #include "markov/WDAG.h"
@@ -79,6 +80,7 @@ class ContigOrdering
   // ReadFile, WriteFile: Read and write files in the ContigOrdering format.  The format consists of a header with commented lines; then one line for each
   // contig used in the ContigOrdering, with five columns: local ID, global contig name, orientation (1=rc), orientation quality, gap size.
   // If global_IDs and global_contig_names aren't given, the contig name column is filled with '.'s.  Likewise for the quality column if !has_Q_scores().
+  // If has_adjacency_support(), there is a sixth column: the adjacency support.
   void ReadFile ( const string & order_file );
   void WriteFile( const string & order_file, const set<int> & global_IDs = set<int>(), const vector<string> * global_contig_names = NULL ) const;
 
@@ -110,29 +112,40 @@ class ContigOrdering
   void SetGaps( const vector<int> & gaps ); // set the _gaps vector
   void ClearGaps() { _gaps.clear(); }
 
+  // Adjacency support
+  void SetAdjacencySupport( const vector<double> & support ); // set the _adjacency_support vector
+
   /* QUERY FUNCTIONS */
 
   // Queries to see whether or not this ContigOrdering has had its contigs oriented and/or spaced.
   bool has_Q_scores() const { return !_orient_Q.empty(); } // orientation happens in ChromLinkMatrix::OrientContigs()
   bool has_gaps()     const { return !_gaps.empty(); }     // spacing happens in ChromLinkMatrix::SpaceContigs()
+  bool has_adjacency_support() const { return !_adjacency_support.empty(); } // see OrderCLM() in LachesisAPI.h
 
   int N_contigs()        const { return _N_contigs; }
   int N_contigs_used()   const { return _N_contigs_used; }
   int N_contigs_unused() const { return _N_contigs - _N_contigs_used; }
   // The following four functions input integers for position in the ContigOrdering, NOT contig IDs.
-  int    contig_ID      ( const int pos ) const { assert(pos>=0 && pos<_N_contigs_used); return ( _data[pos] >= 0 ? _data[pos] : ~_data[pos] ); }
-  bool   contig_rc      ( const int pos ) const { assert(pos>=0 && pos<_N_contigs_used); return ( _data[pos] < 0 ); }
+  int    contig_ID      ( const int pos ) const { assert(pos>=0 && pos<_N_contigs_used); int x = _data.at(pos); return ( x >= 0 ? x : ~x ); }
+  bool   contig_rc      ( const int pos ) const { assert(pos>=0 && pos<_N_contigs_used); return ( _data.at(pos) < 0 ); }
   double contig_orient_Q( const int pos ) const { assert(pos>=0 && pos<_N_contigs_used); assert( has_Q_scores() ); return _orient_Q[pos]; }
   int    gap_size       ( const int pos ) const { assert(pos>=0 && pos<_N_contigs_used); if ( !has_gaps() ) return -1; return _gaps[pos]; } // gap size after contig
-  // The following function inputs contig IDs, NOT integers for position.
+  double adjacency_support( const int pos ) const { assert(pos>=0 && pos<_N_contigs_used); if ( !has_adjacency_support() ) return -1; return _adjacency_support[pos]; } // support for the adjacency after contig
+  // The following functions input contig IDs, NOT integers for position.
   bool contig_used( const int contig_ID ) const { return _contigs_used.at(contig_ID); }
+  int  contig_pos ( const int contig_ID ) const { return _data.Position(contig_ID); } // -1 if the contig isn't used; O(log N)
+
+  // The whole ordering, as a flat vector in the format of _data (below).  Scoring functions should iterate over this rather than calling contig_ID() and
+  // contig_rc() for every position: it's rebuilt at most once after each modification, whereas each call to contig_ID() on a modified ordering is O(log N).
+  const vector<int> & data() const { return _data.data(); }
 
 
   // Orientation quality scores.  These must be loaded via AddOrientQC() or via ReadFile().
 
 
-  // Make a WDAG representing contig orientations in this ContigOrdering.
-  WDAG OrientationWDAG( const ChromLinkMatrix * clm ) const; // clm is used just to call ContigOrientLogLikelihood()
+  // Make a WDAG representing contig orientations in this ContigOrdering.  The edge weights are the log-likelihoods of each pair of adjacent contigs in each of
+  // their four orientations: log_likes[4*i + 2*rc1 + rc2] is the ChromLinkMatrix::ContigOrientLogLikelihood() of the contigs at positions i and i+1.
+  WDAG OrientationWDAG( const vector<double> & log_likes ) const;
 
 
   /* OUTPUT FUNCTIONS */
@@ -154,15 +167,21 @@ class ContigOrdering
   vector<bool> _contigs_used; // flags indicating which contigs are in _data
   int _N_contigs_used; // equal to size of _data; also number of true values in _contigs_used
 
-  /* MAIN DATA STRUCTURE: a vector representing the positions and orientations of contigs.
-   * This vector should contain _N_contigs_used distinct integers in range [_N_contigs,_N_contigs).
-   * Forward contigs are represented by positive numbers, while reversed contigs are represented by negative numbers: contig x in rc is given the number ~x. */
-  vector<int> _data;
+  /* MAIN DATA STRUCTURE: a sequence representing the positions and orientations of contigs.
+   * This sequence should contain _N_contigs_used distinct integers in range [_N_contigs,_N_contigs).
+   * Forward contigs are represented by positive numbers, while reversed contigs are represented by negative numbers: contig x in rc is given the number ~x.
+   * It's stored in an OrderTree, so that adding, removing, moving, and inverting contigs take O(log N) time instead of O(N). */
+  OrderTree _data;
 
   // A vector representing the estimated gap sizes between contigs.  _gaps[i] represents the gap *after* contig #i.  As a placeholder, _gaps.back() = 0.
   // This vector will be empty until one of SetGap and SetGaps is called (by ChromLinkMatrix::SpaceContigs()); then it will have length _N_contigs_used.
   vector<int> _gaps;
 
+  // A vector representing the bootstrap support for the adjacencies between contigs: _adjacency_support[i] is the fraction of bootstrap replicates in which
+  // contig #i and contig #i+1 were adjacent.  As with _gaps, _adjacency_support.back() = -1 is a placeholder.  This vector will be empty unless
+  // SetAdjacencySupport() is called (by OrderCLM(), if the bootstrap is requested.)
+  vector<double> _adjacency_support;
+
 
   // Quality scores for orientations.  This vector does NOT parallel the _data vector; it is only used in ContigOrderings in which AddOrientQ() has been
   // called, which should only happen in ContigOrderings that have been fixed.  If you call AddOrientQ() and then any other modification function, the quality
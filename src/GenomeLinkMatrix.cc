@@ -18,9 +18,13 @@
 #include "GenomeLinkMatrix.h"
 #include "TrueMapping.h"
 #include "TextFileParsers.h" // ParseTabDelimFile
+#include "ThreadPool.h"
+#include "LinkSpill.h"
+#include "LinkStore.h"
 
 #include <sys/time.h> // struct timeval, gettimeofday
 #include <assert.h>
+#include <math.h> // llround
 #include <set>
 #include <map> // map, multimap
 #include <string>
@@ -116,7 +120,8 @@ median_of_set( const set<int> & s )
 // In fact, many other function calls will fail on this GenomeLinkMatrix because _SAM_files is empty.
 GenomeLinkMatrix::GenomeLinkMatrix( const string & species, const int bin_size )
   : _species( species ),
-    _bin_size( bin_size )
+    _bin_size( bin_size ),
+    _memory_budget( 0 )
 {
   assert( bin_size > 0 );
   _N_bins = 0;
@@ -133,6 +138,7 @@ GenomeLinkMatrix::GenomeLinkMatrix( const vector<string> & SAM_files, const int
   assert( bin_size > 0 );
   _bin_size = bin_size; // setting a non-zero bin_size indicates that this is a non-de novo GLM
   _species = "human"; // these SAM files must be human
+  _memory_budget = 0;
 
 
   cout << "Creating a new GenomeLinkMatrix with bin_size = " << bin_size << " and SAM_files =";
@@ -175,12 +181,19 @@ GenomeLinkMatrix::GenomeLinkMatrix( const vector<string> & SAM_files, const int
 // Load a de novo GenomeLinkMatrix with a set of SAM files representing alignments to contigs.
 // Also optionally load a list of the number of restriction sites per contig.  If a file is given, contigs' RE lengths will be used for normalization, instead
 // of their lengths in bp.
-GenomeLinkMatrix::GenomeLinkMatrix( const string & species, const vector<string> & SAM_files, const string & RE_sites_file )
+// If memory_budget > 0, load the links out-of-core, buffering at most memory_budget bytes of them in memory at once and spilling the rest to spill_dir.
+GenomeLinkMatrix::GenomeLinkMatrix( const string & species, const vector<string> & SAM_files, const string & RE_sites_file,
+				    const int64_t memory_budget, const string & spill_dir, const LinkLibraries & libraries,
+				    const function<void( int, int, int )> & add_intra_link )
+  : _libraries( libraries )
 {
   assert( !SAM_files.empty() );
+  assert( memory_budget >= 0 );
   _bin_size = 0; // setting this indicates at this a de novo GLM
   _species = species;
   _RE_sites_file = RE_sites_file;
+  _memory_budget = memory_budget;
+  _spill_dir = spill_dir;
 
 
   cout << "Creating a new GenomeLinkMatrix for an assembly in progress, with SAM_files =";
@@ -219,7 +232,48 @@ GenomeLinkMatrix::GenomeLinkMatrix( const string & species, const vector<string>
 
 
   // Fill the matrix with data from the SAM files.
-  LoadFromSAMDeNovo( SAM_files );
+  LoadFromSAMDeNovo( SAM_files, add_intra_link );
+}
+
+
+
+
+
+// Load a de novo GenomeLinkMatrix from Hi-C read pairs in memory, instead of SAM files.  contig_RE_sites may be empty, in which case contigs' RE lengths
+// can't be used for normalization.  SAM_files and RE_sites_file are only recorded, so that WriteFile() makes a file that can be read back in.
+GenomeLinkMatrix::GenomeLinkMatrix( const string & species, const vector<int> & contig_lengths, const vector<int> & contig_RE_sites,
+				    const vector<HiCLink> & links, const vector<string> & SAM_files, const string & RE_sites_file,
+				    const LinkLibraries & libraries )
+  : _libraries( libraries )
+{
+  assert( !contig_lengths.empty() );
+  _bin_size = 0; // setting this indicates at this a de novo GLM
+  _species = species;
+  _RE_sites_file = RE_sites_file;
+  _SAM_files = SAM_files;
+  _memory_budget = 0;
+
+  _N_bins = contig_lengths.size();
+  cout << "Creating a new GenomeLinkMatrix for an assembly in progress, from data in memory.  Number of contigs = " << _N_bins << endl;
+
+  // Set the original order to identity (i.e., no rearrangement until ReorderContigsByRef() gets called.)
+  _contig_orig_order.clear();
+  for ( int i = 0; i < _N_bins; i++ )
+    _contig_orig_order.push_back(i);
+
+  _contig_lengths = contig_lengths;
+
+  // Add 1 to all RE site counts, as in LoadRESitesFile.
+  _contig_RE_sites = contig_RE_sites;
+  assert( _contig_RE_sites.empty() || (int) _contig_RE_sites.size() == _N_bins );
+  for ( size_t i = 0; i < _contig_RE_sites.size(); i++ )
+    _contig_RE_sites[i]++;
+
+  _contig_skip = vector<bool>(_N_bins,false);
+
+  // Create an empty matrix for these bins, and fill it.
+  InitMatrix();
+  LoadFromLinks( links );
 }
 
 
@@ -233,6 +287,22 @@ static const unsigned LINE_LEN = 50000;
 
 
 
+// RoundLinks: Convert a matrix of link counts, which may be weighted (see LinkLibraries.h), into integer counts, rounding to the nearest integer.
+static boost::numeric::ublas::compressed_matrix<int64_t>
+RoundLinks( const boost::numeric::ublas::compressed_matrix<double> & links )
+{
+  typedef boost::numeric::ublas::compressed_matrix<double> matrix_t;
+  boost::numeric::ublas::compressed_matrix<int64_t> rounded( links.size1(), links.size2(), links.nnz() );
+  for ( matrix_t::const_iterator1 it1 = links.begin1(); it1 != links.end1(); ++it1 )
+    for ( matrix_t::const_iterator2 it2 = it1.begin(); it2 != it1.end(); ++it2 ) {
+      int64_t count = llround( *it2 );
+      if ( count != 0 ) rounded.push_back( it2.index1(), it2.index2(), count );
+    }
+  return rounded;
+}
+
+
+
 
 // ReadFile: Read the data from file GLM_file into this GenomeLinkMatrix.
 // The file GLM_file should have been created by a previous call to GenomeLinkMatrix::WriteFile(), and needs to have a commented header as defined there.
@@ -291,7 +361,10 @@ GenomeLinkMatrix::ReadFile( const string & GLM_file )
 	  _SAM_files.push_back( tokens[i] );
     }
 
-    else if ( line[0] == 'X' ) continue; // skip the header line of the matrix itself
+    // This is the header line of the matrix itself.  If the file has a link store, fill the matrix from that instead of from the rest of the file.
+    else if ( line[0] == 'X' ) {
+      if ( ReadLinkStore( GLM_file ) ) break;
+    }
 
     // If this is not a header line, put data in the matrix.
     // The data may be sparse, and that's ok - the matrix will just contain 0s.  However, there may not be data on the diagonal.
@@ -338,12 +411,13 @@ GenomeLinkMatrix::ReadFile( const string & GLM_file )
 // The output format is a long tall table with (_N_bins^2) rows and three columns: X, Y, Z.  X and Y are bin IDs; Z is the value in the bin.
 // It's printed as a "sparse matrix", so that lines with Z=0 are not printed.
 // This format is designed for easy input to GenomeLinkMatrix::ReadFile(), or to R and Perl.  (NOTE: R and Perl may not like the new sparse-matrix format.)
+// The file is written to <GLM_file>.tmp and then renamed into place.
 void
-GenomeLinkMatrix::WriteFile( const string & GLM_file ) const
+GenomeLinkMatrix::WriteFile( const string & GLM_file, const bool heatmap ) const
 {
   cout << "GenomeLinkMatrix::WriteFile  ->  " << GLM_file << endl;
 
-  ofstream out( GLM_file.c_str(), ios::out );
+  ofstream out( ( GLM_file + ".tmp" ).c_str(), ios::out );
 
   // Print a header to file.  The header is for easier human reading and also contains numbers used by GenomeLinkMatrix::ReadFile().
   out << "# GenomeLinkMatrix file - see GenomeLinkMatrix.h for documentation of this object type" << endl;
@@ -370,6 +444,67 @@ GenomeLinkMatrix::WriteFile( const string & GLM_file ) const
     }
 
   out.close();
+  if ( heatmap ) {
+    LinkStore::Remove( GLM_file );
+    boost::filesystem::rename( GLM_file + ".tmp", GLM_file );
+    return;
+  }
+
+  // Write the same entries to a link store, in compressed sparse row format: the index of each row's first entry (and the number of entries at the end), and
+  // the column and value of each entry.  The link store goes in first, so that a reader never finds the new GLM file with an old link store.
+  vector<uint64_t> row_starts( 1, 0 );
+  vector<int32_t> cols;
+  vector<int64_t> vals;
+  boost::numeric::ublas::compressed_matrix<int64_t>::const_iterator1 it1;
+  boost::numeric::ublas::compressed_matrix<int64_t>::const_iterator2 it2;
+  for ( it1 = _matrix.begin1(); it1 != _matrix.end1(); ++it1 ) {
+    row_starts.resize( it1.index1() + 1, cols.size() ); // rows with no stored entries
+    for ( it2 = it1.begin(); it2 != it1.end(); ++it2 )
+      if ( it2.index1() != it2.index2() && *it2 != 0 ) {
+	cols.push_back( it2.index2() );
+	vals.push_back( *it2 );
+      }
+  }
+  row_starts.resize( _N_bins + 1, cols.size() );
+
+  LinkStore::Writer writer;
+  writer.AddSection( row_starts.data(), row_starts.size() );
+  writer.AddSection( cols.data(), cols.size() );
+  writer.AddSection( vals.data(), vals.size() );
+  writer.Write( GLM_file, GLM_file + ".tmp" );
+
+  boost::filesystem::rename( GLM_file + ".tmp", GLM_file );
+}
+
+
+
+// ReadLinkStore: Fill the matrix from the link store of file GLM_file, as written by WriteFile().  Return false, and leave the matrix alone, if there's no
+// usable link store.
+bool
+GenomeLinkMatrix::ReadLinkStore( const string & GLM_file )
+{
+  const shared_ptr<const LinkStore> store = LinkStore::Open( GLM_file );
+  if ( !store || store->N_sections() != 3 ) return false;
+  size_t N_rows = 0, N_cols = 0, N_vals = 0;
+  const uint64_t * row_starts = store->Section<uint64_t>( 0, N_rows );
+  const int32_t * cols = store->Section<int32_t>( 1, N_cols );
+  const int64_t * vals = store->Section<int64_t>( 2, N_vals );
+  if ( row_starts == NULL || cols == NULL || vals == NULL ) return false;
+  if ( N_rows != size_t( _N_bins ) + 1 || N_cols != N_vals || row_starts[0] != 0 || row_starts[_N_bins] != N_cols ) return false;
+
+  // Check that the entries are in row-major order, as compressed_matrix::push_back() requires.
+  for ( int x = 0; x < _N_bins; x++ ) {
+    if ( row_starts[x+1] < row_starts[x] ) return false;
+    for ( uint64_t i = row_starts[x]; i < row_starts[x+1]; i++ )
+      if ( cols[i] < 0 || cols[i] >= _N_bins || ( i > row_starts[x] && cols[i] <= cols[i-1] ) ) return false;
+  }
+
+  cout << "Loading matrix data from link store..." << endl;
+  _matrix.reserve( N_vals );
+  for ( int x = 0; x < _N_bins; x++ )
+    for ( uint64_t i = row_starts[x]; i < row_starts[x+1]; i++ )
+      _matrix.push_back( x, cols[i], vals[i] );
+  return true;
 }
 
 
@@ -382,22 +517,23 @@ GenomeLinkMatrix::LoadFromSAMDeNovo( const string & SAM_file )
 {
   assert( DeNovo() ); // this indicates that the input contigs aren't split into bins
   assert( _N_bins > 0 );
-  LoadFromSAM( SAM_file, vector<int>( _N_bins, 1 ) );
+  LoadFromSAM( vector<string>( 1, SAM_file ), vector<int>( _N_bins, 1 ) );
 }
 
 
 
 // This multi-SAM-file function is a wrapper for the one-SAM-file function.
 void
-GenomeLinkMatrix::LoadFromSAMDeNovo( const vector<string> & SAM_files )
+GenomeLinkMatrix::LoadFromSAMDeNovo( const vector<string> & SAM_files, const function<void( int, int, int )> & add_intra_link )
 {
   // Check the existence of *all* of the files, before taking the time to load in *any* of the files.
   assert( !SAM_files.empty() );
   for ( size_t i = 0; i < SAM_files.size(); i++ )
     assert( boost::filesystem::is_regular_file( SAM_files[i] ) );
 
-  for ( size_t i = 0; i < SAM_files.size(); i++ )
-    LoadFromSAMDeNovo( SAM_files[i] );
+  assert( DeNovo() );
+  assert( _N_bins > 0 );
+  LoadFromSAM( SAM_files, vector<int>( _N_bins, 1 ), add_intra_link );
 }
 
 
@@ -411,7 +547,7 @@ GenomeLinkMatrix::LoadFromSAMNonDeNovo( const string & SAM_file )
 {
   assert( _species == "human" );
   assert( !DeNovo() );
-  LoadFromSAM( SAM_file, BinsPerChromInHumanGenome() );
+  LoadFromSAM( vector<string>( 1, SAM_file ), BinsPerChromInHumanGenome() );
 }
 
 
@@ -425,8 +561,9 @@ GenomeLinkMatrix::LoadFromSAMNonDeNovo( const vector<string> & SAM_files )
   for ( size_t i = 0; i < SAM_files.size(); i++ )
     assert( boost::filesystem::is_regular_file( SAM_files[i] ) );
 
-  for ( size_t i = 0; i < SAM_files.size(); i++ )
-    LoadFromSAMNonDeNovo( SAM_files[i] );
+  assert( _species == "human" );
+  assert( !DeNovo() );
+  LoadFromSAM( SAM_files, BinsPerChromInHumanGenome() );
 }
 
 
@@ -457,6 +594,10 @@ GenomeLinkMatrix::NormalizeToDeNovoContigLengths( const bool use_RE_sites )
   int64_t longest_contig = *( max_element( lens.begin(), lens.end() ) );
   int64_t longest_squared = longest_contig * longest_contig;
 
+  _bin_scales.resize( _N_bins, 1 );
+  for ( int i = 0; i < _N_bins; i++ )
+    _bin_scales[i] *= double( longest_contig ) / lens[i];
+
 
   // Now, normalize!  The math is performed in a single step for each bin, to minimize the effect of rounding error.
   for ( int i = 0; i < _N_bins; i++ )
@@ -509,11 +650,15 @@ GenomeLinkMatrix::ReorderContigsByRef( TrueMapping & true_mapping )
   vector<int>  old_contig_lengths  = _contig_lengths;
   vector<int>  old_contig_RE_sites = _contig_RE_sites;
   vector<bool> old_contig_skip     = _contig_skip;
+  vector<double> old_bin_scales    = _bin_scales;
+  vector<double> old_biases        = _biases;
   for ( int i = 0; i < _N_bins; i++ ) {
     _contig_orig_order[ contig_order[i] ] = i;
     _contig_lengths   [ contig_order[i] ] = old_contig_lengths[i];
     _contig_RE_sites  [ contig_order[i] ] = old_contig_RE_sites[i];
     _contig_skip      [ contig_order[i] ] = old_contig_skip[i];
+    if ( !_bin_scales.empty() ) _bin_scales[ contig_order[i] ] = old_bin_scales[i];
+    if ( !_biases.empty()     ) _biases    [ contig_order[i] ] = old_biases[i];
   }
 
 }
@@ -610,8 +755,12 @@ GenomeLinkMatrix::SkipRepeats( const double & repeat_multiplicity, const bool fl
 
 
   // Find the repetitiveness factor for each contig: the number of links it contains, divided by average.
+  // Only row i is divided by contig i's factor, so the matrix is no longer symmetric: entry (i,j) is divided by factor i, and entry (j,i) by factor j.
+  // For _bin_scales, this counts as dividing both entries by the square root of each factor (see BalanceMatrix.)
+  _bin_scales.resize( _N_bins, 1 );
   for ( int i = 0; i < _N_bins; i++ ) {
     double factor = N_links[i] / N_links_avg;
+    if ( factor != 0 ) _bin_scales[i] /= sqrt( factor );
 
     // Adjust all link densities by their repetitiveness factors.  This mitigates the effect of mappability and repeat-mediated mapping variation.
     for ( int j = 0; j < _N_bins; j++ )
@@ -638,6 +787,156 @@ GenomeLinkMatrix::SkipRepeats( const double & repeat_multiplicity, const bool fl
 
 
 
+// BalanceMatrix: Balance the matrix by iterative correction (ICE).  Each iteration multiplies each contig's bias by the square root of the ratio of its total
+// balanced link density to the mean; this converges to biases under which all the totals are equal.  (The square root damps the update: in a symmetric
+// matrix, a contig's total also moves with its partners' biases, and the undamped update tends to overshoot.)
+void
+GenomeLinkMatrix::BalanceMatrix( const double tolerance, const int max_iterations )
+{
+  cout << "BalanceMatrix with tolerance = " << tolerance << ", max_iterations = " << max_iterations << endl;
+  assert( DeNovo() ); // don't use on binned-human-chromosome data
+  assert( tolerance > 0 );
+  assert( max_iterations > 0 );
+
+  // Gather the link densities into compressed sparse rows, which the threads can read without touching _matrix.  There's one entry for each element stored
+  // in _matrix, in the same order.  SkipRepeats() may have made the matrix asymmetric, by dividing entries (i,j) and (j,i) by different factors; their
+  // geometric mean undoes this, as a rescaling of each contig, which doesn't change the balanced matrix.
+  const boost::numeric::ublas::compressed_matrix<int64_t> & matrix = _matrix; // const, so that looking up (j,i) never inserts an element
+  vector<int64_t> row_starts( _N_bins + 1, 0 );
+  vector<int> cols;
+  vector<double> vals;
+  cols.reserve( _matrix.nnz() );
+  vals.reserve( _matrix.nnz() );
+
+  boost::numeric::ublas::compressed_matrix<int64_t>::const_iterator1 it1;
+  boost::numeric::ublas::compressed_matrix<int64_t>::const_iterator2 it2;
+  for ( it1 = matrix.begin1(); it1 != matrix.end1(); ++it1 )
+    for ( it2 = it1.begin(); it2 != it1.end(); ++it2 ) {
+      const int i = it2.index1(), j = it2.index2();
+      row_starts[i+1]++;
+      cols.push_back( j );
+      vals.push_back( sqrt( double( *it2 ) * matrix(j,i) ) );
+    }
+  for ( int i = 0; i < _N_bins; i++ )
+    row_starts[i+1] += row_starts[i];
+
+
+  // RowSums: Find each contig's total balanced link density with the active contigs, under the current biases.  The rows are independent, so they're
+  // summed in parallel, in chunks.
+  vector<double> biases( _N_bins, 1 ), sums( _N_bins, 0 );
+  vector<char> active( _N_bins, 0 );
+  for ( int i = 0; i < _N_bins; i++ )
+    active[i] = !_contig_skip[i];
+
+  const int chunk_size = 1024;
+  const int N_chunks = ( _N_bins + chunk_size - 1 ) / chunk_size;
+  auto RowSums = [&]() {
+    ThreadPool::Global().ParallelFor( 0, N_chunks, [&]( int c ) {
+	for ( int i = c * chunk_size; i < min( _N_bins, ( c+1 ) * chunk_size ); i++ ) {
+	  double sum = 0;
+	  for ( int64_t k = row_starts[i]; k < row_starts[i+1]; k++ )
+	    if ( active[ cols[k] ] ) sum += vals[k] / biases[ cols[k] ];
+	  sums[i] = sum / biases[i];
+	}
+      } );
+  };
+
+  // Only balance the non-skipped contigs that have links to at least min_partners other such contigs.  A contig with only a few partners makes the balancing
+  // converge very slowly, and its bias would mostly be noise anyway.  Dropping a contig can leave its partners with too few, so repeat until nothing changes.
+  const int min_partners = 10;
+  for ( bool changed = true; changed; ) {
+    changed = false;
+    for ( int i = 0; i < _N_bins; i++ ) {
+      if ( !active[i] ) continue;
+      int N_partners = 0;
+      for ( int64_t k = row_starts[i]; k < row_starts[i+1]; k++ )
+	if ( cols[k] != i && active[ cols[k] ] && vals[k] != 0 ) N_partners++;
+      if ( N_partners < min_partners ) { active[i] = false; changed = true; }
+    }
+  }
+
+  RowSums();
+  int N_active = 0;
+  double total_density = 0;
+  for ( int i = 0; i < _N_bins; i++ )
+    if ( active[i] ) { N_active++; total_density += sums[i]; }
+  if ( N_active == 0 ) {
+    cout << "WARNING: BalanceMatrix: There are no links between non-skipped contigs, so there's nothing to balance." << endl;
+    return;
+  }
+
+
+  // Iterate until all the active contigs' totals are within tolerance of the mean.
+  int iteration = 0;
+  double max_deviation = 0;
+  while ( true ) {
+    double mean = 0;
+    for ( int i = 0; i < _N_bins; i++ )
+      if ( active[i] ) mean += sums[i];
+    mean /= N_active;
+
+    max_deviation = 0;
+    for ( int i = 0; i < _N_bins; i++ )
+      if ( active[i] ) max_deviation = max( max_deviation, fabs( sums[i] / mean - 1 ) );
+    if ( max_deviation < tolerance || iteration == max_iterations ) break;
+
+    for ( int i = 0; i < _N_bins; i++ )
+      if ( active[i] ) biases[i] *= sqrt( sums[i] / mean );
+    RowSums();
+    iteration++;
+  }
+
+  cout << "BalanceMatrix balanced " << N_active << " of " << _N_bins << " contigs." << endl;
+  if ( max_deviation < tolerance ) cout << "BalanceMatrix converged after " << iteration << " iterations." << endl;
+  else cout << "WARNING: BalanceMatrix did not converge after " << max_iterations << " iterations (largest deviation from the mean: " << max_deviation << ")" << endl;
+
+
+  // Give each inactive contig the bias that brings its total with the active contigs to the mean.  (Its sum was found with a bias of 1.)
+  double mean = 0, balanced_density = 0;
+  for ( int i = 0; i < _N_bins; i++ )
+    if ( active[i] ) balanced_density += sums[i];
+  mean = balanced_density / N_active;
+  for ( int i = 0; i < _N_bins; i++ )
+    if ( !active[i] && sums[i] != 0 ) biases[i] = sums[i] / mean;
+
+  // Rescale the biases so the active contigs' total link density is the same as before balancing.
+  const double scale = sqrt( balanced_density / total_density );
+  for ( int i = 0; i < _N_bins; i++ )
+    biases[i] *= scale;
+
+
+  // Apply the biases to the matrix, element by element, in the same order in which they were gathered.
+  int64_t k = 0;
+  boost::numeric::ublas::compressed_matrix<int64_t>::iterator1 jt1;
+  boost::numeric::ublas::compressed_matrix<int64_t>::iterator2 jt2;
+  for ( jt1 = _matrix.begin1(); jt1 != _matrix.end1(); ++jt1 )
+    for ( jt2 = jt1.begin(); jt2 != jt1.end(); ++jt2, ++k )
+      *jt2 = llround( vals[k] / ( biases[ jt2.index1() ] * biases[ jt2.index2() ] ) );
+  assert( k == (int64_t) vals.size() );
+
+  _biases = biases;
+}
+
+
+
+// ContigBiases: The biases found by BalanceMatrix(), relative to the links as loaded.  The matrix held (roughly) the loaded links times _bin_scales[i] *
+// _bin_scales[j] when it was balanced, so the bias relative to the loaded links is _biases[i] / _bin_scales[i].
+vector<double>
+GenomeLinkMatrix::ContigBiases() const
+{
+  if ( _biases.empty() ) return vector<double>();
+
+  vector<double> biases( _N_bins, 1 );
+  for ( int i = 0; i < _N_bins; i++ )
+    biases[ _contig_orig_order[i] ] = _biases[i] / ( _bin_scales.empty() ? 1 : _bin_scales[i] );
+  return biases;
+}
+
+
+
+
+
+
 // AHClustering: Apply a greedy agglomerative hierarchical clustering algorithm to cluster the contigs into scaffolds.
 // The distance metric between clusters is "average linkage", as described here: http://www2.statistics.com/resources/glossary/a/avglnkg.php
 // CEN_contigs, if not an empty vector, lists a set of contig IDs (0-indexed) for contigs containing centromeres.  These contigs will NOT be merged.
@@ -1366,7 +1665,7 @@ GenomeLinkMatrix::GetClusters() const
 void
 GenomeLinkMatrix::DrawHeatmap( const string & heatmap_file ) const
 {
-  WriteFile("heatmap.txt");
+  WriteFile( "heatmap.txt", true ); // true means not to write a link store
 
   // The R script "heatmap.R" is hardwired to take "heatmap.txt" as input and write to out/heatmap.jpg.
   // For details on how this script works, see the script itself.
@@ -1398,6 +1697,8 @@ GenomeLinkMatrix::InitMatrix()
   assert( _N_bins > 0 );
   _matrix.resize( _N_bins, _N_bins, 0 );
   _normalized = false;
+  _bin_scales.clear();
+  _biases.clear();
 }
 
 
@@ -1438,18 +1739,145 @@ GenomeLinkMatrix::LoadRESitesFile( const string & RE_sites_file )
 
 
 
+// LoadFromLinks: Fill this de novo GenomeLinkMatrix with Hi-C read pairs in memory.
+// LoadFromSAM reads the SAM files one alignment at a time, so each read pair is seen twice, once from each read; here each read pair counts once for each of
+// its reads that passes the filters in ForEachLinkInSAM.  This gives the same matrix as LoadFromSAM on the same read pairs.
+void
+GenomeLinkMatrix::LoadFromLinks( const vector<HiCLink> & links )
+{
+  assert( DeNovo() );
+  cout << "Reading Hi-C data (" << _species << ") from " << links.size() << " read pairs in memory" << endl;
+
+  boost::numeric::ublas::mapped_matrix<double> mapped_matrix( _N_bins, _N_bins );
+
+  for ( size_t i = 0; i < links.size(); i++ ) {
+    const HiCLink & link = links[i];
+
+    // Same filters as ForEachLinkInSAM: skip reads whose partner maps to the same location, and intra-bin links.
+    if ( link.pos1 == link.pos2 ) continue;
+    if ( link.contig1 == link.contig2 ) continue;
+    assert( link.contig1 < _N_bins );
+    assert( link.contig2 < _N_bins );
+
+    int N_reads = ( link.mapq1 != 0 ) + ( link.mapq2 != 0 ); // reads with mapping quality 0 are ignored
+    if ( N_reads == 0 ) continue;
+    double weight = N_reads * _libraries.LinkWeight( link.contig1, link.contig2, link.library );
+
+    mapped_matrix(link.contig1,link.contig2) += weight;
+    mapped_matrix(link.contig2,link.contig1) += weight;
+  }
+
+  boost::numeric::ublas::compressed_matrix<double> compressed_matrix = mapped_matrix;
+  _matrix = _matrix + RoundLinks( compressed_matrix );
+}
+
+
+
+
 // LoadFromSAM: Fill this GenomeLinkMatrix with data from one or more SAM/BAM files.
 // Note that this is NOT the same function as ChromLinkMatrix::LoadFromSAM() because the two objects store Hi-C data differently.
 // DO NOT CALL THIS FUNCTION DIRECTLY - instead call the wrappers LoadFromSAMDeNovo() or LoadFromSAMNonDeNovo(), which fill bins_per_contig.
+// The SAM files are read in parallel on the ThreadPool, in batches of up to THREADS files.  Each file's links go into a separate matrix (see LinksFromSAM),
+// and these are added into _matrix in file order.  With weights, they're added up before they're rounded into _matrix.  Either way, the result doesn't
+// depend on the number of threads.
+// If _memory_budget > 0, the per-file matrices are never built.  Instead the SAM files are read one at a time, and their links are streamed into a
+// GLMLinkSpill, which keeps at most _memory_budget bytes of them in memory and merges its sorted runs into _matrix at the end.  The spill counts the links
+// from each library separately, and weights them as it merges.
+// If add_intra_link is set, it's called on the intra-contig links as they're read (see ForEachLinkInSAM), from several threads at once if the files are read
+// in parallel.
 void
-GenomeLinkMatrix::LoadFromSAM( const string & SAM_file, const vector<int> & bins_per_contig )
+GenomeLinkMatrix::LoadFromSAM( const vector<string> & SAM_files, const vector<int> & bins_per_contig, const function<void( int, int, int )> & add_intra_link )
+{
+  if ( !_libraries.trivial() ) assert( DeNovo() ); // the library weights are by contig
+
+  if ( _memory_budget > 0 ) {
+    cout << "Loading Hi-C links out-of-core, with a memory budget of " << _memory_budget << " bytes" << endl;
+
+    GLMLinkSpill spill( _N_bins, _spill_dir, _memory_budget, _libraries.N() );
+    for ( size_t i = 0; i < SAM_files.size(); i++ ) {
+      _SAM_files.push_back( SAM_files[i] );
+      ForEachLinkInSAM( SAM_files[i], bins_per_contig, [&spill]( int bin1, int bin2, double weight, int library ) {
+	  assert( weight == 1 ); // GLMLinkSpill only counts links
+	  spill.AddLink( bin1, bin2, library );
+	  spill.AddLink( bin2, bin1, library );
+	}, add_intra_link );
+    }
+
+    boost::numeric::ublas::compressed_matrix<int64_t> links =
+      _libraries.trivial() ? spill.Merge() : spill.Merge( [this]( int bin1, int bin2, int library ) { return _libraries.LinkWeight( bin1, bin2, library ); } );
+    if ( _matrix.nnz() == 0 ) _matrix.swap( links );
+    else _matrix = _matrix + links;
+    return;
+  }
+
+  ThreadPool & pool = ThreadPool::Global();
+  const size_t batch_size = pool.N_threads();
+
+  // Without weights, each file's link counts are integers, so they go straight into _matrix.  With weights, they're added up in weighted_total, which is
+  // only rounded at the end; the first file's matrix becomes weighted_total, rather than being copied into it.  Either way, each file's matrix is freed as
+  // soon as it's added.
+  boost::numeric::ublas::compressed_matrix<double> weighted_total;
+  auto add_to_matrix = [this]( boost::numeric::ublas::compressed_matrix<int64_t> links ) {
+    if ( _matrix.nnz() == 0 ) _matrix.swap( links );
+    else _matrix = _matrix + links;
+  };
+
+  for ( size_t start = 0; start < SAM_files.size(); start += batch_size ) {
+    const size_t stop = min( start + batch_size, SAM_files.size() );
+
+    vector< boost::numeric::ublas::compressed_matrix<double> > links( stop - start );
+    pool.ParallelFor( start, stop, [&]( int i ) { links[i-start] = LinksFromSAM( SAM_files[i], bins_per_contig, add_intra_link ); } );
+
+    for ( size_t i = start; i < stop; i++ ) {
+      _SAM_files.push_back( SAM_files[i] );
+      if ( _libraries.trivial() ) add_to_matrix( RoundLinks( links[i-start] ) );
+      else if ( i == 0 ) weighted_total.swap( links[i-start] );
+      else weighted_total = weighted_total + links[i-start];
+      boost::numeric::ublas::compressed_matrix<double>().swap( links[i-start] );
+    }
+  }
+
+  if ( !_libraries.trivial() && !SAM_files.empty() ) add_to_matrix( RoundLinks( weighted_total ) );
+}
+
+
+
+// LinksFromSAM: Read the Hi-C links from one SAM/BAM file into a new matrix of the same dimensions as _matrix.  Helper for LoadFromSAM.
+// This function doesn't modify the GenomeLinkMatrix, so it can be called for several SAM files at once.
+boost::numeric::ublas::compressed_matrix<double>
+GenomeLinkMatrix::LinksFromSAM( const string & SAM_file, const vector<int> & bins_per_contig, const function<void( int, int, int )> & add_intra_link ) const
+{
+  // Set up a mapped matrix to handle the data as it comes in.  Later this will be converted to a compressed_matrix object for referencing.
+  boost::numeric::ublas::mapped_matrix<double> mapped_matrix( _N_bins, _N_bins );
+
+  // Tally the appropriate spots in the 2-d matrix.
+  ForEachLinkInSAM( SAM_file, bins_per_contig, [this,&mapped_matrix]( int bin1, int bin2, double weight, int library ) {
+      weight *= _libraries.LinkWeight( bin1, bin2, library );
+      mapped_matrix(bin1,bin2) += weight;
+      mapped_matrix(bin2,bin1) += weight;
+    }, add_intra_link );
+
+  // Convert all the data from this SAM file to compressed_matrix format.
+  cout << "Compressing mapped_matrix data..." << endl;
+  boost::numeric::ublas::compressed_matrix<double> compressed_matrix = mapped_matrix;
+  return compressed_matrix;
+}
+
+
+
+// ForEachLinkInSAM: Read the Hi-C links from one SAM/BAM file, and call add_link( bin1, bin2, weight, library ) on each one.  Helper for LoadFromSAM.
+// Each link is reported once; the caller is responsible for the symmetric entry (bin2,bin1), and for the library's weight (see LinkLibraries.h.)
+// The intra-contig links, which the matrix doesn't use, are passed to add_intra_link( contig, pos1, pos2 ) with the positions of the read and its partner.  This
+// lets the MisjoinDetector tally them in the same pass through the SAM file.
+void
+GenomeLinkMatrix::ForEachLinkInSAM( const string & SAM_file, const vector<int> & bins_per_contig, const function<void( int, int, double, int )> & add_link,
+				    const function<void( int, int, int )> & add_intra_link ) const
 {
 
   bool verbose = true;
 
   cout << "Reading Hi-C data (" << _species << ") from SAM file " << SAM_file << (verbose ? "\t(dot = 1M alignments)" : "" ) << endl;
   assert( boost::filesystem::is_regular_file( SAM_file ) );
-  _SAM_files.push_back( SAM_file );
 
   // Using the number of bins in each contig, find the offset of each contig in the vector of bins.  This is just an indexing exercise.
   int contig_start = 0;
@@ -1464,10 +1892,10 @@ GenomeLinkMatrix::LoadFromSAM( const string & SAM_file, const vector<int> & bins
   vector<int> contig_lens = TargetLengths( SAM_file );
 
 
-  // Set up a mapped matrix to handle the data as it comes in.  Later this will be converted to a compressed_matrix object for referencing.
-  boost::numeric::ublas::mapped_matrix<double> mapped_matrix( _N_bins, _N_bins );
-
 
+  // The library of the reads in this file, unless they have read groups that say otherwise.
+  const int file_library = _libraries.FileLibrary( SAM_file );
+  const bool use_read_groups = _libraries.uses_read_groups();
 
   // Set up a SAMStepper object to read in the alignments.
   SAMStepper stepper(SAM_file);
@@ -1493,6 +1921,9 @@ GenomeLinkMatrix::LoadFromSAM( const string & SAM_file, const vector<int> & bins
     // Skip links involving non-canonical chromosomes.
     if ( c.tid >= N_chroms || c.mtid >= N_chroms ) continue;
 
+    // Pass on the intra-contig links, with their positions, before they're binned.
+    if ( c.tid == c.mtid && add_intra_link ) add_intra_link( c.tid, c.pos, c.mpos );
+
     // Find the bin ID of each read.  If the contigs are not being divided, then the contig IDs correspond with bin IDs, and this is easy.
     int bin1 = contig_offsets[c. tid];
     int bin2 = contig_offsets[c.mtid];
@@ -1524,9 +1955,14 @@ GenomeLinkMatrix::LoadFromSAM( const string & SAM_file, const vector<int> & bins
       //PRINT3( dist, dist_norm, weight );
     }
 
-    // Tally the appropriate spots in the 2-d matrix.
-    mapped_matrix(bin1,bin2) += weight;
-    mapped_matrix(bin2,bin1) += weight;
+    int library = file_library;
+    if ( use_read_groups ) {
+      uint8_t * RG = bam_aux_get( align, "RG" );
+      library = _libraries.Library( SAM_file, RG ? bam_aux2Z( RG ) : NULL );
+    }
+    else if ( library == -1 ) library = _libraries.Library( SAM_file, NULL ); // reports the error
+
+    add_link( bin1, bin2, weight, library );
   }
 
 
@@ -1534,12 +1970,6 @@ GenomeLinkMatrix::LoadFromSAM( const string & SAM_file, const vector<int> & bins
 
   if ( verbose ) cout << endl;
   cout << "N aligns read from " << SAM_file << ": " << stepper.N_aligns_read() << endl;
-
-
-  // Convert all the data from this SAM file to compressed_matrix format, and add it in.
-  cout << "Compressing mapped_matrix data..." << endl;
-  boost::numeric::ublas::compressed_matrix<int64_t> compressed_matrix = mapped_matrix;
-  _matrix = _matrix + compressed_matrix;
 }
 
 
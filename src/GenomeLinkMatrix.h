@@ -47,6 +47,7 @@
  * -- Analyze and validate the clusters.
  *
  * The functions ReadFile() and WriteFile() can be used to read/write GenomeLinkMatrix objects from GenomeLinkMatrix format (*.GLM) files.
+ * WriteFile() also writes the matrix to a link store (see LinkStore.h) beside the file, which ReadFile() then maps and reads instead of parsing the file.
  * GLM files can be made into graphics using heatmap.R.
  *
  *
@@ -56,6 +57,7 @@
  * Use SkipShortContigs() to mark contigs for skipping if they are below a given size threshold.
  * Use SkipContigsWithFewREs() to mark contigs for skipping if they don't have enough RE (restriction endonuclease) sites.
  * Use SkipRepeats() to mark contigs for skipping if they are repetitive - i.e., they have a normalized number of Hi-C links that is much greater than average.
+ * Use BalanceMatrix() after the Skip...() functions to correct for the remaining biases (e.g., mappability and GC content) by iterative correction.
  *
  *
  *
@@ -72,10 +74,13 @@
 
 
 #include "ClusterVec.h"
+#include "HiCLink.h"
+#include "LinkLibraries.h"
 #include "TrueMapping.h"
 #include <string>
 #include <vector>
 #include <map> // multimap
+#include <functional>
 using namespace std;
 
 // Boost libraries
@@ -95,9 +100,18 @@ class GenomeLinkMatrix
   // Load a non-de novo GenomeLinkMatrix (HUMAN ONLY) with a set of SAM files representing human-genome alignments.  Split the GLM into bins of size bin_size.
   GenomeLinkMatrix( const vector<string> & SAM_files, const int bin_size );
   // Load a de novo GenomeLinkMatrix with a set of SAM files representing alignments to contigs.
-  GenomeLinkMatrix( const string & species, const vector<string> & SAM_files, const string & RE_sites_file = "" );
+  // If memory_budget > 0, the links are loaded out-of-core: they're buffered in at most memory_budget bytes and spilled to sorted runs in spill_dir.
+  // If the reads come from several Hi-C libraries, each link is weighted by its library (see LinkLibraries.h.)
+  // The intra-contig links aren't kept in the matrix, but if add_intra_link is set, it's called on them as they're read (see ForEachLinkInSAM.)
+  GenomeLinkMatrix( const string & species, const vector<string> & SAM_files, const string & RE_sites_file = "",
+		    const int64_t memory_budget = 0, const string & spill_dir = "", const LinkLibraries & libraries = LinkLibraries(),
+		    const function<void( int, int, int )> & add_intra_link = function<void( int, int, int )>() );
+  // Load a de novo GenomeLinkMatrix from Hi-C read pairs in memory (see HiCLink.h) instead of SAM files.  contig_RE_sites holds the RE site counts as in an
+  // RE sites file.  SAM_files and RE_sites_file only name where the data came from; they're recorded in WriteFile(), so the file can be read back in.
+  GenomeLinkMatrix( const string & species, const vector<int> & contig_lengths, const vector<int> & contig_RE_sites, const vector<HiCLink> & links,
+		    const vector<string> & SAM_files = vector<string>(), const string & RE_sites_file = "", const LinkLibraries & libraries = LinkLibraries() );
   // Load a GenomeLinkMatrix from a file that was previously written with WriteFile().  This may or may not be a de novo GLM.
-  GenomeLinkMatrix( const string & LM_file ) { ReadFile( LM_file ); }
+  GenomeLinkMatrix( const string & LM_file ) : _memory_budget(0) { ReadFile( LM_file ); }
 
 
 
@@ -109,13 +123,13 @@ class GenomeLinkMatrix
 
   // ReadFile: Read the data from file GLM_file into this GenomeLinkMatrix.
   void ReadFile( const string & GLM_file );
-  // WriteFile: Write the data in this GenomeLinkMatrix to file GLM_file.
-  void WriteFile( const string & GLM_file ) const;
+  // WriteFile: Write the data in this GenomeLinkMatrix to file GLM_file, and to a link store beside it unless the file is only for drawing a heatmap.
+  void WriteFile( const string & GLM_file, const bool heatmap = false ) const;
 
 
   // LoadForSAMDeNovo: A wrapper for LoadFromSAM for de novo GLMs.
   void LoadFromSAMDeNovo( const        string  & SAM_file  );
-  void LoadFromSAMDeNovo( const vector<string> & SAM_files );
+  void LoadFromSAMDeNovo( const vector<string> & SAM_files, const function<void( int, int, int )> & add_intra_link = function<void( int, int, int )>() );
 
   // LoadFromSAMNonDeNovo: A wrapper for LoadFromSAM for non-de novo GLMs.
   void LoadFromSAMNonDeNovo( const        string  & SAM_file  );
@@ -150,6 +164,17 @@ class GenomeLinkMatrix
   // This should be run AFTER normalizing for contig length.
   void SkipRepeats( const double & repeat_multiplicity, const bool flip = false );
 
+  // BalanceMatrix: Balance the matrix by iterative correction (ICE; Imakaev et al., Nature Methods 2012): find a bias for each contig such that, after each
+  // link density is divided by the biases of its two contigs, every non-skipped contig has the same total link density with the other non-skipped contigs.
+  // Stop when every such total is within tolerance of the mean, or after max_iterations.  Contigs with links to only a few others are left out, like the
+  // skipped contigs; these are given the bias that balances their links to the balanced contigs.  This should be run AFTER the Skip...() functions, and it supersedes the per-contig factors applied by SkipRepeats().
+  void BalanceMatrix( const double tolerance, const int max_iterations );
+
+  // ContigBiases: The biases found by BalanceMatrix(), relative to the links as loaded (i.e., before any normalization), indexed by the contigs' original IDs
+  // (before ReorderContigsByRef().)  Dividing the number of links between two contigs by their biases gives their balanced link density, up to a constant.
+  // Empty if BalanceMatrix() hasn't been called.
+  vector<double> ContigBiases() const;
+
   /* MAIN CLUSTERING ALGORITHMS
      Contigs that have been marked as "skipped" by one of the Skip...() functions are not used in clustering.  However, if set_skipped_contigs = true, then
      after clustering, skipped contigs are assigned to clusters by how well they match the non-skipped contigs (see SetClusters()).
@@ -203,10 +228,24 @@ class GenomeLinkMatrix
   // LoadRESitesFile: Fill _RE_sites_file, _contig_RE_sites.
   void LoadRESitesFile( const string & RE_sites_file );
 
+  // ReadLinkStore: Helper for ReadFile.  Fill the matrix from the link store beside GLM_file (see LinkStore.h), if it has a usable one.
+  bool ReadLinkStore( const string & GLM_file );
+
   // LoadFromSAM: Fill this GenomeLinkMatrix's matrix with Hi-C data from one or more SAM/BAM files containing human genome-aligned reads.
   // Note that this is NOT the same function as ChromLinkMatrix::LoadFromSAM() because the two objects store Hi-C data differently.
   // DO NOT CALL THIS FUNCTION DIRECTLY - instead call the wrappers LoadFromSAMDeNovo() or LoadFromSAMNonDeNovo(), which fill bins_per_contig.
-  void LoadFromSAM( const string & SAM_file, const vector<int> & bins_per_contig );
+  // The SAM files are read in parallel on the ThreadPool, or serially through a GLMLinkSpill if _memory_budget > 0.
+  void LoadFromSAM( const vector<string> & SAM_files, const vector<int> & bins_per_contig,
+		    const function<void( int, int, int )> & add_intra_link = function<void( int, int, int )>() );
+  // LinksFromSAM: Helper for LoadFromSAM.  Return the (weighted) links in one SAM file, in a matrix of the same dimensions as _matrix.
+  boost::numeric::ublas::compressed_matrix<double> LinksFromSAM( const string & SAM_file, const vector<int> & bins_per_contig,
+								 const function<void( int, int, int )> & add_intra_link ) const;
+  // LoadFromLinks: Fill this de novo GenomeLinkMatrix's matrix with Hi-C read pairs in memory, counting them exactly as LoadFromSAM would.
+  void LoadFromLinks( const vector<HiCLink> & links );
+  // ForEachLinkInSAM: Helper for LoadFromSAM.  Call add_link( bin1, bin2, weight, library ) once for each informative link in one SAM file.  If add_intra_link
+  // is set, also call add_intra_link( contig, pos1, pos2 ) on each read whose partner aligned to the same contig.
+  void ForEachLinkInSAM( const string & SAM_file, const vector<int> & bins_per_contig, const function<void( int, int, double, int )> & add_link,
+			 const function<void( int, int, int )> & add_intra_link = function<void( int, int, int )>() ) const;
 
   // Count the number of bins in the human genome.  This only works in non-de novo GLMs.
   vector<int> BinsPerChromInHumanGenome() const;
@@ -235,6 +274,13 @@ class GenomeLinkMatrix
   int _bin_size; // size of bins, in non-de novo GenomeLinkMatrices; set to 0 for de novo GenomeLinkMatrices
   boost::numeric::ublas::compressed_matrix<int64_t> _matrix; // the main data structure!
 
+  // Out-of-core loading: if _memory_budget > 0, LoadFromSAM() buffers at most this many bytes of links, spilling sorted runs into _spill_dir.
+  int64_t _memory_budget;
+  string _spill_dir;
+
+  // The Hi-C libraries that the links come from, and their weights.  Only used while loading the links.
+  LinkLibraries _libraries;
+
   // _contig_orig_order: Set by ReorderContigsByRef() so it can remember the original ordering of the contigs and output them properly in GetClusters().
   vector<int> _contig_orig_order;
 
@@ -244,6 +290,12 @@ class GenomeLinkMatrix
 
   bool _normalized; // has NormalizeToDeNovoContigLengths() been called?
 
+  // _bin_scales: The factor by which each bin's links have been scaled so far by normalization (empty if all 1.)  The link density between bins i and j is
+  // (roughly; see SkipRepeats) the number of links as loaded, times _bin_scales[i] * _bin_scales[j].
+  vector<double> _bin_scales;
+  // _biases: The biases found by BalanceMatrix(), relative to the matrix as it was when BalanceMatrix() was called.  Empty if it hasn't been called.
+  vector<double> _biases;
+
   // contig_skip: Flags indicating which contigs should not be used in clustering (though they may get added in afterward; see SetClusters.)
   // Contigs may be marked for skipping if they are (1) repetitive, as determined by SkipRepeats(); or (2) too short, as determined by SkipShortContigs().
   vector<bool> _contig_skip;
@@ -0,0 +1,53 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * HiCLink.h
+ *
+ * A HiCLink is one Hi-C read pair, aligned to the draft assembly: the contig ID, position and mapping quality of each read.  This is the in-memory form of
+ * the link data that Lachesis otherwise reads from SAM/BAM files.  The GenomeLinkMatrix and ChromLinkMatrix can be built from a vector<HiCLink> (see
+ * LachesisAPI.h), applying exactly the same filters as when they're built from SAM files, so the same read pairs give the same results either way.
+ *
+ * Contig IDs are indices into the draft assembly, in the order of the SAM header (and the draft assembly fasta).  Positions are 0-based, as in BAM records.
+ * A read with mapping quality 0 is ignored, so a HiCLink can also stand for a single read whose mate's alignment isn't available: mapq2 = 0, and contig2 and
+ * pos2 give the mate's position as recorded in the read's own alignment.
+ *
+ * If the read pairs come from several Hi-C libraries, each HiCLink also records the ID of its library in a LinkLibraries object (see LinkLibraries.h.)
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _HIC_LINK__H
+#define _HIC_LINK__H
+
+
+#include <inttypes.h> // int32_t
+
+
+
+struct HiCLink {
+  int32_t contig1, pos1, mapq1; // read 1
+  int32_t contig2, pos2, mapq2; // read 2
+  int32_t library; // ID in a LinkLibraries (0 if there's only one library)
+};
+
+
+#endif
@@ -25,11 +25,18 @@
  * GenomeLinkMatrix: A matrix of Hi-C links between all contigs.  Contains contig clustering algorithms.
  * ChromLinkMatrix: A matrix of Hi-C links between contigs in a group.  Contains contig ordering, orienting, and spacing algorithms.
  * LinkSizeDistribution: The density of Hi-C links as a function of distance.  Used for contig spacing.
+ * MisjoinDetector: Finds candidate misjoins in the contigs of the draft assembly, from their intra-contig Hi-C links.
  * ClusterVec: A vector< set<int> > describing a clustering result.
  * ContigOrdering: An ordering of contigs in a group, eventually including orientation and spacing.
  * TrueMapping: The true location of each contig on the reference assembly, if there is one.  Used for reference-based validation.
  * Reporter: Tools to evaluate the Lachesis result and produce the REPORT.txt file.
  * TextFileParsers: A set of useful functions to parse text files.
+ * CacheManifest: Fingerprints of the inputs to the files in cached_data, so stale cached files can be detected and regenerated.
+ * ProgressJournal: A record of which steps of the run have been completed, so a run with RESUME = 1 can skip them.
+ *                  The wall time and peak memory of each stage are recorded in <OUTPUT_DIR>/stage_times.txt, for bin/PerfRegression.pl.
+ * ThreadPool: The process-wide pool of THREADS threads that the stages use for parallelism.
+ * LinkSpill: Out-of-core buffers for Hi-C links, used to load the GLM and CLMs within MEMORY_BUDGET.
+ * LachesisAPI: The library interface (liblachesis), which runs clustering and ordering on data in memory.  The clustering and ordering steps here use it too.
  *
  *
  *
@@ -51,26 +58,44 @@
 #include <cerrno>
 #include <string>
 #include <vector>
+#include <set>
+#include <map>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <mutex>
+#include <memory> // shared_ptr
+#include <chrono>
+#include <functional>
+#include <algorithm> // max
 using namespace std;
 
 // Modules in ~/include (must add -L~/include and -lJ<module> to link)
 #include "TimeMem.h"
+#include "gtools/SAMStepper.h" // TargetNames(), TargetLengths()
 
 // Boost includes
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp> // split
 
 // Local includes
 #include "RunParams.h"
 #include "GenomeLinkMatrix.h"
 #include "ChromLinkMatrix.h"
 #include "LinkSizeDistribution.h"
+#include "MisjoinDetector.h"
 #include "ClusterVec.h"
 #include "ContigOrdering.h"
 #include "TrueMapping.h"
 #include "Reporter.h"
+#include "CacheManifest.h"
+#include "TextFileParsers.h" // ParseTabDelimFile
+#include "ProgressJournal.h"
+#include "ThreadPool.h"
+#include "BackgroundWriter.h"
+#include "LachesisAPI.h"
+#include "OrderingConstraints.h"
 
 
 
@@ -81,9 +106,168 @@ using namespace std;
 
 
 
+// InputsManifest: Fingerprint the inputs shared by all of the cached data files (all.GLM and group*.CLM.)
+// The clustering parameters are applied only after the GLM is loaded, so they don't belong here; their effect on the CLMs is captured by the cluster
+// membership, which is added to each CLM's manifest separately.
+CacheManifest
+InputsManifest( const RunParams & run_params )
+{
+  CacheManifest manifest;
+  manifest.AddParam( "species", run_params._species );
+  manifest.AddSAMFiles( run_params._SAM_files );
+  manifest.AddParam( "RE_site_seq", run_params._RE_site_seq );
+  manifest.AddFile( "RE_sites_file", run_params.DraftContigRESitesFilename() );
+  if ( run_params._libraries_file != "." ) manifest.AddFile( "LIBRARIES_FILE", run_params._libraries_file ); // only if set, so old caches stay valid
+  const vector<string> library_RE_sites_files = run_params.LibraryRESitesFilenames();
+  for ( size_t i = 0; i < library_RE_sites_files.size(); i++ )
+    manifest.AddFile( "library_RE_sites_file", library_RE_sites_files[i] );
+  return manifest;
+}
+
+
+
+
+// ClusteringManifest: Fingerprint everything that determines the clustering result, for the ProgressJournal.
+CacheManifest
+ClusteringManifest( const RunParams & run_params )
+{
+  CacheManifest manifest = InputsManifest( run_params );
+  manifest.AddParam( "USE_REFERENCE", boost::lexical_cast<string>( run_params._use_ref ) );
+  manifest.AddParam( "SIM_BIN_SIZE", boost::lexical_cast<string>( run_params._sim_bin_size ) );
+  manifest.AddParam( "CLUSTER_N", boost::lexical_cast<string>( run_params._cluster_N ) );
+  string CEN_contig_IDs;
+  for ( size_t i = 0; i < run_params._cluster_CEN_contig_IDs.size(); i++ )
+    CEN_contig_IDs += boost::lexical_cast<string>( run_params._cluster_CEN_contig_IDs[i] ) + " ";
+  manifest.AddParam( "CLUSTER_CONTIGS_WITH_CENS", CEN_contig_IDs );
+  manifest.AddParam( "CLUSTER_MIN_RE_SITES", boost::lexical_cast<string>( run_params._cluster_min_RE_sites ) );
+  manifest.AddParam( "CLUSTER_MAX_LINK_DENSITY", boost::lexical_cast<string>( run_params._cluster_max_link_density ) );
+  manifest.AddParam( "CLUSTER_NONINFORMATIVE_RATIO", boost::lexical_cast<string>( run_params._cluster_noninformative_ratio ) );
+  if ( run_params._cluster_balance_iterations > 0 ) { // only recorded if used, so clusterings from before balancing existed can still be resumed
+    manifest.AddParam( "CLUSTER_BALANCE_ITERATIONS", boost::lexical_cast<string>( run_params._cluster_balance_iterations ) );
+    manifest.AddParam( "CLUSTER_BALANCE_TOLERANCE", boost::lexical_cast<string>( run_params._cluster_balance_tolerance ) );
+  }
+  return manifest;
+}
+
+
+
+
+// ContigBiasesFile: The file where clustering leaves the contig biases from balancing the GLM, for ordering to use.  Only written if
+// CLUSTER_BALANCE_ITERATIONS > 0.  Each line is: contig ID, bias, contig name.
+string
+ContigBiasesFile( const RunParams & run_params )
+{
+  return run_params._out_dir + "/main_results/contig_biases.txt";
+}
+
+
+
+
+// MemoryBudget: The MEMORY_BUDGET parameter, in bytes.  If this is 0, all link data is loaded in memory; otherwise the GLM and CLMs are loaded out-of-core.
+int64_t
+MemoryBudget( const RunParams & run_params )
+{
+  return int64_t( run_params._memory_budget_MB ) << 20;
+}
+
+
+
+// SpillDir: The directory where out-of-core loading spills its sorted runs of links.  The run files are deleted as soon as they've been merged.
+string
+SpillDir( const RunParams & run_params )
+{
+  return run_params._out_dir + "/cached_data/spill";
+}
+
+
+
+
+// MisjoinsManifest: Fingerprint the inputs of misjoin detection, for the cache manifest of main_results/misjoins.bed.
+CacheManifest
+MisjoinsManifest( const RunParams & run_params )
+{
+  CacheManifest manifest;
+  manifest.AddParam( "species", run_params._species );
+  manifest.AddSAMFiles( run_params._SAM_files );
+  manifest.AddParam( "MISJOIN_WINDOW", boost::lexical_cast<string>( run_params._misjoin_window ) );
+  manifest.AddParam( "MISJOIN_MAX_RATIO", boost::lexical_cast<string>( run_params._misjoin_max_ratio ) );
+  return manifest;
+}
+
+
+
+// MisjoinsFile: The BED file of candidate misjoins.  Like the GLM, it's only remade if its inputs have changed (see MisjoinsManifest.)
+string
+MisjoinsFile( const RunParams & run_params )
+{
+  return run_params._out_dir + "/main_results/misjoins.bed";
+}
+
+
+
+// MisjoinsDue: Is misjoin detection on, with the BED file not already up to date?
+bool
+MisjoinsDue( const RunParams & run_params )
+{
+  return run_params._misjoin_window > 0 && !MisjoinsManifest( run_params ).MatchesCache( MisjoinsFile( run_params ) );
+}
+
+
+
+// WriteMisjoins: Write the candidate misjoins found by the detector to the BED file, with its manifest.
+void
+WriteMisjoins( const MisjoinDetector & detector, const RunParams & run_params )
+{
+  system ( ( "mkdir -p " + run_params._out_dir + "/main_results" ).c_str() );
+  const string BED_file = MisjoinsFile( run_params );
+  CacheManifest::Invalidate( BED_file );
+  detector.WriteBEDFile( BED_file );
+  MisjoinsManifest( run_params ).WriteFile( BED_file );
+}
+
+
+
+
+// Look for misjoins in the contigs of the draft assembly, and write the candidates to main_results/misjoins.bed.  This is done during the clustering, from
+// the links that the GLM reads from the SAM files, so there's nothing left to do here.  But if the GLM came from its cache (or the clustering was skipped by
+// RESUME), the SAM files weren't read; rather than read them all again just for this, skip misjoin detection with a warning.
+void
+LachesisMisjoins( const RunParams & run_params )
+{
+  if ( !MisjoinsDue( run_params ) ) {
+    cout << "Candidate misjoins were already found at " << MisjoinsFile( run_params ) << "; skipping misjoin detection." << endl;
+    return;
+  }
+
+  cout << "WARNING: Skipping misjoin detection, because the links weren't tallied as the GLM read the SAM files (the GLM was read from cached_data, the "
+       << "clustering was skipped by RESUME, or the SAM headers disagree).  To look for misjoins, run again with OVERWRITE_GLM = 1." << endl;
+}
+
+
+
+
+// SAMHeadersAgree: Do all of the SAM files list the same contigs, with the same lengths, as the first one?  The MisjoinDetector indexes its tallies by the
+// contig IDs in the SAM files, so it can only be used if they do.
+bool
+SAMHeadersAgree( const vector<string> & SAM_files )
+{
+  const vector<string> names = TargetNames( SAM_files[0] );
+  const vector<int> lengths = TargetLengths( SAM_files[0] );
+  for ( size_t i = 1; i < SAM_files.size(); i++ )
+    if ( TargetNames( SAM_files[i] ) != names || TargetLengths( SAM_files[i] ) != lengths ) {
+      cout << "WARNING: The SAM files " << SAM_files[0] << " and " << SAM_files[i] << " have different contigs in their headers; skipping misjoin detection."
+	   << endl;
+      return false;
+    }
+  return true;
+}
+
+
+
+
 // Run the Lachesis clustering algorithm.
 void
-LachesisClustering( const RunParams & run_params )
+LachesisClustering( const RunParams & run_params, ProgressJournal & journal )
 {
   cout << "\n\t|~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~|\n\t|                                 |\n\t|       LACHESIS CLUSTERING       |\n\t|                                 |\n\t|~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~|\n\n";
 
@@ -91,51 +275,117 @@ LachesisClustering( const RunParams & run_params )
   system ( ( "mkdir -p " + run_params._out_dir + "/cached_data" ).c_str() );
   system ( ( "mkdir -p " + run_params._out_dir + "/main_results" ).c_str() );
 
-  // Set up a TrueMapping object.
-  TrueMapping * true_mapping = run_params.LoadTrueMapping();
-  const bool postfosmid = false; // placeholder for parameters optimized for the post-fosmid case
+  // If RESUME = 1 and the clustering has already been done with these same inputs and parameters, skip it.
+  const string clustering_fingerprint = ClusteringManifest( run_params ).Fingerprint();
+  if ( journal.Done( "clustering", clustering_fingerprint ) &&
+       boost::filesystem::is_regular_file( run_params._out_dir + "/main_results/clusters.txt" ) &&
+       boost::filesystem::is_regular_file( run_params._out_dir + "/main_results/clusters.by_name.txt" ) &&
+       ( run_params._cluster_balance_iterations == 0 || boost::filesystem::is_regular_file( ContigBiasesFile( run_params ) ) ) ) {
+    cout << "RESUME: Clustering was already completed; skipping it." << endl;
+    return;
+  }
+
+  // Start building the TrueMapping, if there's a reference (and a spare core), while the GLM is loaded.  It's only needed once the GLM is clustered.
+  run_params.StartLoadingTrueMapping();
 
   GenomeLinkMatrix * glm;
 
   // Look for the *.GLM file, which describes the data in a GenomeLinkMatrix.
-  // If the OVERWRITE_GLM flag is not set, and if the file exists (because of a previous run), read the data from it to make a GenomeLinkMatrix object.
-  // Otherwise, create the data by reading the SAM files, which takes longer.
+  // If the OVERWRITE_GLM flag is not set, and if the file exists (because of a previous run) and its manifest matches the current inputs, read the data from
+  // it to make a GenomeLinkMatrix object.  Otherwise, create the data by reading the SAM files, which takes longer.
   string GLM_file = run_params._out_dir + "/cached_data/all.GLM";
-  if ( !boost::filesystem::is_regular_file( GLM_file ) || run_params._overwrite_GLM ) {
-    glm = new GenomeLinkMatrix( run_params._species, run_params._SAM_files, run_params.DraftContigRESitesFilename() );
+  const CacheManifest GLM_manifest = InputsManifest( run_params );
+  if ( run_params._overwrite_GLM || !GLM_manifest.MatchesCache( GLM_file ) ) {
+
+    // If the candidate misjoins are due to be found, tally the intra-contig links for them as the SAM files are read.  This is the only time they're found:
+    // LachesisMisjoins doesn't read the SAM files again.
+    MisjoinDetector * misjoins = NULL;
+    function<void( int, int, int )> add_intra_link;
+    if ( MisjoinsDue( run_params ) && SAMHeadersAgree( run_params._SAM_files ) ) {
+      misjoins = new MisjoinDetector( TargetNames( run_params._SAM_files[0] ), TargetLengths( run_params._SAM_files[0] ),
+				      run_params._misjoin_window, run_params._misjoin_max_ratio );
+      add_intra_link = [misjoins]( int contig, int pos1, int pos2 ) { misjoins->AddLink( contig, pos1, pos2 ); };
+    }
+
+    glm = new GenomeLinkMatrix( run_params._species, run_params._SAM_files, run_params.DraftContigRESitesFilename(),
+				MemoryBudget( run_params ), SpillDir( run_params ), run_params.LoadLinkLibraries(), add_intra_link );
+    CacheManifest::Invalidate( GLM_file );
     glm->WriteFile( GLM_file );
+    GLM_manifest.WriteFile( GLM_file );
+
+    if ( misjoins != NULL ) {
+      misjoins->FindMisjoins();
+      WriteMisjoins( *misjoins, run_params );
+      delete misjoins;
+    }
   }
   else
     glm = new GenomeLinkMatrix( GLM_file );
 
-  // Pre-processing.
-  glm->NormalizeToDeNovoContigLengths( true );
-  if ( true_mapping && run_params._sim_bin_size == 0 ) glm->ReorderContigsByRef( *true_mapping );
-
-  glm->SkipContigsWithFewREs( run_params._cluster_min_RE_sites );
-  glm->SkipRepeats( postfosmid ? 1.2 : run_params._cluster_max_link_density );
-
-  if ( run_params._cluster_draw_heatmap ) glm->DrawHeatmap( "heatmap.jpg" );
+  // Pre-process the GLM, cluster it, and report on the clustering (see LachesisAPI.)  If there is a TrueMapping, perform reference-based validation.
+  vector<double> contig_biases;
+  const TrueMapping * true_mapping = run_params.LoadTrueMapping();
+  ClusterVec clusters = ClusterGLM( *glm, LachesisClusteringParams( run_params ), true_mapping, &contig_biases );
+  delete glm;
+  clusters.WriteFile( run_params._out_dir + "/main_results/clusters.txt" );
+  clusters.WriteFile( run_params._out_dir + "/main_results/clusters.by_name.txt", run_params.LoadDraftContigNames() );
 
+  // If the GLM was balanced, write the contig biases for ordering.  (If balancing found nothing to balance, every bias is 1.)
+  // Like the other result files, this is written to a temporary file and then renamed into place, so a RESUME run never reads a partially written one.
+  if ( run_params._cluster_balance_iterations > 0 ) {
+    const vector<string> * contig_names = run_params.LoadDraftContigNames();
+    contig_biases.resize( contig_names->size(), 1 );
+    const string biases_file = ContigBiasesFile( run_params );
+    ofstream out( ( biases_file + ".tmp" ).c_str(), ios::out );
+    for ( size_t i = 0; i < contig_biases.size(); i++ )
+      out << i << '\t' << contig_biases[i] << '\t' << (*contig_names)[i] << endl;
+    out.close();
+    boost::filesystem::rename( biases_file + ".tmp", biases_file );
+  }
+  journal.MarkDone( "clustering", clustering_fingerprint );
+}
 
-  glm->AHClustering( run_params._cluster_N, run_params._cluster_CEN_contig_IDs, 0, run_params._cluster_noninformative_ratio, run_params._cluster_draw_dotplot, true_mapping );
 
-  // Improve the clustering results, in the postfosmid case.
-  if ( postfosmid ) glm->MoveContigsInClusters( 1.2 );
-  //glm->UndoMisjoins();
 
-  // If only using high-quality (i.e., well-aligning to reference) contigs, throw out the low-quality contigs at the last minute.
-  //glm->ExcludeLowQualityContigs( true_mapping );
 
-  // Report on the clustering.  If there is a TrueMapping, perform reference-based validation.
-  glm->ValidateClusters( true_mapping, run_params._cluster_draw_dotplot );
+// LoadOldOrdering: Read a group's ordering file from an earlier run, for ORDER_INCREMENTAL.  The group's membership may have changed since (e.g., if a curator
+// moved contigs between groups), so the contigs are matched by name (contig_IDs maps names to global IDs) and given their local IDs in the current cluster.
+// Contigs that have left the group are dropped, and their old neighbours are added to edited, so they're reconsidered too.
+static ContigOrdering
+LoadOldOrdering( const string & order_file, const set<int> & cluster, const map<string, int> & contig_IDs, set<int> & edited )
+{
+  map<int, int> local_IDs; // global ID -> local ID
+  for ( set<int>::const_iterator it = cluster.begin(); it != cluster.end(); ++it )
+    local_IDs.insert( make_pair( *it, local_IDs.size() ) );
+
+  ContigOrdering order( cluster.size(), false );
+  ifstream in( order_file.c_str(), ios::in );
+  string line;
+  vector<string> tokens;
+  bool dropped = false; // was the contig before this one dropped?
+
+  while ( getline( in, line ) ) {
+    if ( line.empty() || line[0] == '#' ) continue;
+    boost::split( tokens, line, boost::is_any_of("\t") );
+    if ( tokens.size() < 3 ) {
+      cerr << "ERROR: Can't parse line '" << line << "' of ordering file " << order_file << endl;
+      exit(1);
+    }
 
-  ClusterVec clusters = glm->GetClusters();
-  clusters.WriteFile( run_params._out_dir + "/main_results/clusters.txt" );
-  clusters.WriteFile( run_params._out_dir + "/main_results/clusters.by_name.txt", run_params.LoadDraftContigNames() );
+    map<string, int>::const_iterator ID = contig_IDs.find( tokens[1] );
+    map<int, int>::const_iterator local_ID = ( ID == contig_IDs.end() ? local_IDs.end() : local_IDs.find( ID->second ) );
+    if ( local_ID == local_IDs.end() || order.contig_used( local_ID->second ) ) { // no longer in the group
+      if ( order.N_contigs_used() > 0 ) edited.insert( order.contig_ID( order.N_contigs_used() - 1 ) );
+      dropped = true;
+      continue;
+    }
 
+    order.AddContig( local_ID->second, -1, tokens[2] == "1" );
+    if ( dropped ) edited.insert( local_ID->second );
+    dropped = false;
+  }
 
-  if ( true_mapping ) delete true_mapping; // cleanup
+  return order;
 }
 
 
@@ -143,7 +393,7 @@ LachesisClustering( const RunParams & run_params )
 
 // Run the Lachesis ordering and orienting algorithms.
 void
-LachesisOrdering( const RunParams & run_params )
+LachesisOrdering( const RunParams & run_params, ProgressJournal & journal )
 {
   cout << "\n\t|~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~|\n\t|                                 |\n\t|        LACHESIS ORDERING        |\n\t|                                 |\n\t|~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~|\n\n";
 
@@ -157,69 +407,199 @@ LachesisOrdering( const RunParams & run_params )
   const ClusterVec clusters( clusters_file, run_params.LoadDraftContigNames() );
   assert( (int) clusters.size() >= run_params._cluster_N );
 
+  // If clustering balanced the GLM, load the contig biases, so the CLMs can be normalized the same way.
+  vector<double> contig_biases;
+  if ( run_params._cluster_balance_iterations > 0 ) {
+    if ( !boost::filesystem::is_regular_file( ContigBiasesFile( run_params ) ) ) {
+      cerr << "ERROR: Can't find file '" << ContigBiasesFile( run_params ) << "' with contig biases.  Maybe the clustering was run with CLUSTER_BALANCE_ITERATIONS = 0?" << endl;
+      exit(1);
+    }
+    contig_biases = ParseTabDelimFile<double>( ContigBiasesFile( run_params ), 1 );
+  }
+
 
   system ( ( "mkdir -p " + run_params._out_dir + "/cached_data" ).c_str() ); // make the directory, if necessary
 
-  // Look for the complete set of ChromLinkMatrix files (*.CLM).  If the CLM files don't all already exist (or if the OVERWRITE_CLMS flag is set), create them.
-  // This requires loading the SAM files, which is time-consuming, so we only do it if we have to.
-  // But creating the set of CLMs all at once only requires reading through the SAM files once, so it's much faster than creating them all individually.
+  // Look for the complete set of ChromLinkMatrix files (*.CLM).  A CLM file is stale if it doesn't exist, if its manifest doesn't match the current inputs and
+  // cluster membership, or if the OVERWRITE_CLMS flag is set.  Stale CLMs are created from the SAM files, which is time-consuming, so we only do it if we have to.
+  // But creating a set of CLMs all at once only requires reading through the SAM files once, so all of the stale CLMs are created together.
+  const CacheManifest inputs_manifest = InputsManifest( run_params );
+  vector<CacheManifest> CLM_manifests( clusters.size(), inputs_manifest );
+  vector<bool> stale( clusters.size(), false );
+  int N_stale = 0;
   for ( size_t i = 0; i < clusters.size(); i++ ) {
     string CLM_file = run_params._out_dir + "/cached_data/group" + boost::lexical_cast<string>( i ) + ".CLM";
+    CLM_manifests[i].AddCluster( clusters[i] );
 
-    cout << "01 HERE.\n";
-    if ( !boost::filesystem::is_regular_file( CLM_file ) || run_params._overwrite_CLMs ) {
-      cout << "Need to read SAM files and create ChromLinkMatrix files at " << run_params._out_dir << "/cached_data/group*.CLM.  This will take a while." << endl;
+    if ( run_params._overwrite_CLMs || !CLM_manifests[i].MatchesCache( CLM_file ) ) {
+      stale[i] = true;
+      N_stale++;
+    }
+  }
 
-      // Initialize a set of ChromLinkMatrix objects, each with the proper number of contigs.
-      vector<ChromLinkMatrix *> CLMs( clusters.size() );
-      for ( size_t j = 0; j < clusters.size(); j++ )
-	CLMs[j] = new ChromLinkMatrix( run_params._species, clusters[j].size() );
+  // If RESUME = 1, skip each group that has already been ordered with the same CLM and ordering parameters.
+  vector<CacheManifest> ordering_manifests( CLM_manifests );
+  vector<string> constraints_files( clusters.size() ); // empty if the group has no constraints
+  vector<bool> ordered( clusters.size(), false );
+  int N_to_order = 0;
+  for ( size_t i = 0; i < clusters.size(); i++ ) {
+    const string i_str = boost::lexical_cast<string>(i);
+    CacheManifest & ordering_manifest = ordering_manifests[i];
+    ordering_manifest.AddParam( "ORDER_MIN_N_RES_IN_TRUNK", boost::lexical_cast<string>( run_params._order_min_N_REs_in_trunk ) );
+    ordering_manifest.AddParam( "ORDER_MIN_N_RES_IN_SHREDS", boost::lexical_cast<string>( run_params._order_min_N_REs_in_shreds ) );
+    if ( run_params._order_beam_width > 0 ) // only recorded if used, so orderings cached before ORDER_BEAM_WIDTH existed can still be resumed
+      ordering_manifest.AddParam( "ORDER_BEAM_WIDTH", boost::lexical_cast<string>( run_params._order_beam_width ) );
+    if ( run_params._order_bootstrap_replicates > 0 )
+      ordering_manifest.AddParam( "ORDER_BOOTSTRAP_REPLICATES", boost::lexical_cast<string>( run_params._order_bootstrap_replicates ) );
+    if ( run_params._cluster_balance_iterations > 0 )
+      ordering_manifest.AddFile( "contig_biases", ContigBiasesFile( run_params ) );
+    const string constraints_file = run_params._order_constraints_dir + "/group" + i_str + ".constraints";
+    if ( run_params._order_constraints_dir != "." && boost::filesystem::is_regular_file( constraints_file ) ) {
+      constraints_files[i] = constraints_file;
+      ordering_manifest.AddFile( "constraints", constraints_file );
+    }
+    if ( run_params._order_incremental )
+      ordering_manifest.AddParam( "ORDER_INCREMENTAL_WINDOW", boost::lexical_cast<string>( run_params._order_incremental_window ) );
 
-      // Read all of the SAM files and fill all of the ChromLinkMatrices.
-      LoadDeNovoCLMsFromSAM( run_params._SAM_files, run_params.DraftContigRESitesFilename(), clusters, CLMs );
+    ordered[i] = journal.Done( "ordering.group" + i_str, ordering_manifest.Fingerprint() ) &&
+      boost::filesystem::is_regular_file( run_params._out_dir + "/cached_data/group"  + i_str + ".trunk.ordering" ) &&
+      boost::filesystem::is_regular_file( run_params._out_dir + "/main_results/group" + i_str + ".ordering" );
+    if ( !ordered[i] ) N_to_order++;
+  }
 
-      // Write the ChromLinkMatrices to files.
-      for ( size_t j = 0; j < clusters.size(); j++ ) {
-	string new_file_head = run_params._out_dir + "/cached_data/group" + boost::lexical_cast<string>( j );
-	string new_CLM_file = new_file_head + ".CLM";
-	CLMs[j]->WriteFile( new_CLM_file );
-	delete CLMs[j];
-      }
+  // If dotplots are to be drawn for any group, start building the TrueMapping for them while the CLMs are loaded.
+  const bool draw_dotplots = run_params._use_ref && run_params._order_draw_dotplots && N_to_order != 0;
+  if ( draw_dotplots ) run_params.StartLoadingTrueMapping();
+
+  const LinkLibraries libraries = N_stale != 0 ? run_params.LoadLinkLibraries() : LinkLibraries();
+
+  // The stale CLMs' files are written by a background thread, each followed by its manifest, so that the disk I/O overlaps the work that follows.  The queue
+  // is short, so the writer never keeps more than a few CLMs alive on its own.
+  BackgroundWriter CLM_writer( 2 );
+  const function<void( int, const shared_ptr<ChromLinkMatrix> & )> write_CLM = [&]( int j, const shared_ptr<ChromLinkMatrix> & CLM ) {
+    const string new_CLM_file = run_params._out_dir + "/cached_data/group" + boost::lexical_cast<string>( j ) + ".CLM";
+    const CacheManifest manifest = CLM_manifests[j];
+    CLM_writer.Push( [CLM, new_CLM_file, manifest]() {
+	CacheManifest::Invalidate( new_CLM_file );
+	CLM->WriteFile( new_CLM_file );
+	manifest.WriteFile( new_CLM_file );
+      } );
+  };
+
+  // In memory, the freshly built CLMs go straight to the ordering loop below, which hands each one to the writer, instead of being read back from their files.
+  vector< shared_ptr<ChromLinkMatrix> > fresh_CLMs( clusters.size() );
+
+  if ( N_stale != 0 && MemoryBudget( run_params ) > 0 ) {
+    cout << "Need to read SAM files and create " << N_stale << " of " << clusters.size() << " ChromLinkMatrix files at " << run_params._out_dir << "/cached_data/group*.CLM, out-of-core.  This will take a while." << endl;
+
+    // Read all of the SAM files once, spilling the links to disk; then build the stale ChromLinkMatrices one at a time, writing each while the next is built.
+    // Keeping them all for the ordering loop would defeat the MEMORY_BUDGET, so they're freed once written, and the ordering loop reads them back.
+    LoadDeNovoCLMsFromSAMOutOfCore( run_params._SAM_files, run_params.DraftContigRESitesFilename(), clusters, run_params._species, stale,
+				    SpillDir( run_params ), MemoryBudget( run_params ), [&]( int j, ChromLinkMatrix * CLM ) {
+	write_CLM( j, shared_ptr<ChromLinkMatrix>( CLM ) );
+      }, libraries );
+    CLM_writer.Finish();
+  }
+  else if ( N_stale != 0 ) {
+    cout << "Need to read SAM files and create " << N_stale << " of " << clusters.size() << " ChromLinkMatrix files at " << run_params._out_dir << "/cached_data/group*.CLM.  This will take a while." << endl;
 
-      break;
-    }
+    vector<ChromLinkMatrix *> CLMs( clusters.size(), NULL );
+    for ( size_t i = 0; i < clusters.size(); i++ )
+      if ( stale[i] ) CLMs[i] = new ChromLinkMatrix( run_params._species, clusters[i].size() );
+
+    // Read all of the SAM files and fill the stale ChromLinkMatrices.  LoadDeNovoCLMsFromSAM() skips the NULL entries, which are the up-to-date CLMs.
+    LoadDeNovoCLMsFromSAM( run_params._SAM_files, run_params.DraftContigRESitesFilename(), clusters, CLMs, libraries );
+
+    // Make each CLM exactly what its file will hold, so the ordering doesn't depend on whether the CLM was just built or read from the cache.
+    for ( size_t i = 0; i < clusters.size(); i++ )
+      if ( CLMs[i] != NULL ) {
+	CLMs[i]->ClipToFileFormat();
+	fresh_CLMs[i].reset( CLMs[i] );
+      }
   }
 
 
 
+  // Load everything that the groups share before starting the parallel loop, so that the threads only read it.
+  const vector<string> * contig_names = run_params.LoadDraftContigNames();
+  const TrueMapping * true_mapping = draw_dotplots ? run_params.LoadTrueMapping() : NULL;
+  mutex dotplot_mutex; // QuickDotplot writes to a fixed script filename, so only one dotplot can be drawn at a time
+
+  // For ORDER_INCREMENTAL, the earlier orderings are matched to the current groups by contig name.
+  map<string, int> contig_IDs;
+  if ( run_params._order_incremental )
+    for ( size_t i = 0; i < contig_names->size(); i++ )
+      contig_IDs[ (*contig_names)[i] ] = i;
+
   // Loop over all clusters.  For each cluster, load a ChromLinkMatrix object and use it to order and orient the contigs.
-  for ( size_t i = 0; i < clusters.size(); i++ ) {
+  // The clusters are independent, so they're ordered in parallel on the ThreadPool (largest-first would balance better, but the groups are already sorted
+  // by decreasing length in GenomeLinkMatrix::CanonicalizeClusters.)
+  ThreadPool::Global().ParallelFor( 0, clusters.size(), [&]( int i ) {
+    string i_str = boost::lexical_cast<string>(i);
+    string trunk_file = run_params._out_dir + "/cached_data/group"  + i_str + ".trunk.ordering";
+    string ordering_file = run_params._out_dir + "/main_results/group" + i_str + ".ordering";
+
+    // If this group's CLM was just built, queue its file to be written.  The ordering below only reads the CLM's links, which is all the writer reads too.
+    shared_ptr<ChromLinkMatrix> fresh_CLM;
+    fresh_CLM.swap( fresh_CLMs[i] );
+    if ( fresh_CLM ) write_CLM( i, fresh_CLM );
+
+    // If RESUME = 1 and this group has already been ordered (see above), skip it.
+    if ( ordered[i] ) {
+      cout << "RESUME: Ordering on cluster #" << i << " was already completed; skipping it." << endl;
+      return;
+    }
+
     cout << ": Ordering on cluster #" << i << endl;
 
-    // Read in the ChromLinkMatrix from the *.CLM file.  This file should have
+    // Read in the ChromLinkMatrix from the *.CLM file, unless it was just built.  The file should have
     // been created above if it didn't already exist.
-    string i_str = boost::lexical_cast<string>(i);
     string clm_input = run_params._out_dir + "/cached_data/group" + i_str + ".CLM";
     cout << "TESTME: " + clm_input + "\n";
-    ChromLinkMatrix clm(clm_input);
+    const shared_ptr<ChromLinkMatrix> clm_ptr = fresh_CLM ? fresh_CLM : make_shared<ChromLinkMatrix>( clm_input );
+    fresh_CLM.reset(); // the CLM is freed once it's both ordered and written
+    ChromLinkMatrix & clm = *clm_ptr;
+    if ( !contig_biases.empty() ) clm.SetContigBiases( contig_biases, clusters[i] );
+    const OrderingConstraints constraints = constraints_files[i] != "" ? OrderingConstraints( constraints_files[i], clusters[i], *contig_names ) : OrderingConstraints();
+    clm.SetConstraints( constraints );
 
     //clm.PrefilterLinks( clusters[i], run_params.LoadTrueMapping() );
 
     // Main algorithms to find the orderings in this chromosome: first the
     // 'trunk' ordering, then the full ordering.  Each of the orderings is also oriented.
-    //clm.DrawHeatmap( "heatmap." + boost::lexical_cast<string>(i) + ".jpg" );
-    ContigOrdering trunk = clm.MakeTrunkOrder(run_params._order_min_N_REs_in_trunk);
-    ContigOrdering order = clm.MakeFullOrder (run_params._order_min_N_REs_in_shreds);
-    string trunk_file = run_params._out_dir + "/cached_data/group"  + i_str + ".trunk.ordering";
-    trunk.WriteFile( trunk_file, clusters[i], run_params.LoadDraftContigNames());
-    string ordering_file = run_params._out_dir + "/main_results/group" + i_str + ".ordering";
-    order.WriteFile(ordering_file, clusters[i], run_params.LoadDraftContigNames());
-    if (run_params._use_ref && run_params._order_draw_dotplots) {
+    // With ORDER_INCREMENTAL, if this group was ordered before, re-optimize its old ordering around the edited contigs instead: those named in the constraints,
+    // those that have joined the group (or weren't placed before), and the old neighbours of those that have left it.  The old trunk is kept, minus the
+    // contigs that have left.
+    ContigOrdering trunk( 0 );
+    ContigOrdering order( 0 );
+    if ( run_params._order_incremental && boost::filesystem::is_regular_file( ordering_file ) && boost::filesystem::is_regular_file( trunk_file ) ) {
+      vector<int> edited_contigs = constraints.Contigs();
+      set<int> edited( edited_contigs.begin(), edited_contigs.end() ), unused;
+      ContigOrdering old_order = LoadOldOrdering( ordering_file, clusters[i], contig_IDs, edited );
+      for ( int c = 0; c < old_order.N_contigs(); c++ )
+	if ( !old_order.contig_used(c) ) edited.insert(c);
+      cout << "ORDER_INCREMENTAL: Reordering cluster #" << i << " around " << edited.size() << " edited contigs" << endl;
+
+      order = ReorderCLM( clm, old_order, vector<int>( edited.begin(), edited.end() ), LachesisOrderingParams( run_params ) );
+      trunk = LoadOldOrdering( trunk_file, clusters[i], contig_IDs, unused );
+      clm.OrientContigs( trunk );
+    }
+    else order = OrderCLM( clm, LachesisOrderingParams( run_params ), &trunk );
+
+    if ( !constraints.empty() )
+      cout << "Cluster #" << i << ": " << constraints.N_violations( order ) << " of " << constraints.N_constraints() << " ordering constraints are violated" << endl;
+    trunk.WriteFile( trunk_file, clusters[i], contig_names);
+    order.WriteFile(ordering_file, clusters[i], contig_names);
+    journal.MarkDone( "ordering.group" + i_str, ordering_manifests[i].Fingerprint() );
+    if (draw_dotplots) {
+      lock_guard<mutex> lock( dotplot_mutex );
       string dotplot_file = "clm." + i_str + ".dotplot.txt";
-      order.DrawDotplotVsTruth(clusters[i], *(run_params.LoadTrueMapping()), dotplot_file);
+      order.DrawDotplotVsTruth(clusters[i], *true_mapping, dotplot_file);
     }
-  }
+  } );
 
+  // Wait for the last CLM files, which the reporting may read.
+  CLM_writer.Finish();
 
 }
 
@@ -239,6 +619,8 @@ void LachesisReporting(const RunParams &run_params) {
   }
   ClusterVec clusters( clusters_file, run_params.LoadDraftContigNames() );
 
+  // Start building the TrueMapping, if there's a reference, while the orderings are loaded.  The Reporter waits for it.
+  run_params.StartLoadingTrueMapping();
 
   vector<ContigOrdering> trunks, orders;
 
@@ -289,7 +671,62 @@ void LachesisReporting(const RunParams &run_params) {
 
 
 
+// StageTimes: The wall time and peak memory usage of each stage of a Lachesis run.  Write() writes them to <OUTPUT_DIR>/stage_times.txt, which is read by
+// bin/PerfRegression.pl to catch performance regressions.  Each line has the form "<stage>\t<wall seconds>\t<peak RSS in KB>"; the last line is "total".
+class StageTimes
+{
+ public:
+
+  StageTimes() : _start( chrono::steady_clock::now() ), _total_peak_KB(0) {}
+
+  // Run: Run one stage, and record its wall time and the peak memory used while it ran.
+  void
+  Run( const string & stage, const function<void()> & run )
+  {
+    ResetPeakMemUsage();
+    const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    run();
+    Add( stage, chrono::duration<double>( chrono::steady_clock::now() - start ).count() );
+  }
+
+  // Add: Record a stage that was timed elsewhere.
+  void
+  Add( const string & stage, const double seconds )
+  {
+    const double peak_KB = PeakMemUsage();
+    _total_peak_KB = max( _total_peak_KB, peak_KB );
+    ostringstream line;
+    line << stage << '\t' << seconds << '\t' << peak_KB;
+    _lines.push_back( line.str() );
+  }
+
+  // Write: Write the stage times, and the total since this object was created.  The file is written to a temporary file and then renamed into place.
+  void
+  Write( const string & file ) const
+  {
+    ofstream out( ( file + ".tmp" ).c_str(), ios::out );
+    out << "# stage\twall_seconds\tpeak_RSS_KB" << endl;
+    for ( size_t i = 0; i < _lines.size(); i++ )
+      out << _lines[i] << endl;
+    out << "total\t" << chrono::duration<double>( chrono::steady_clock::now() - _start ).count() << '\t' << _total_peak_KB << endl;
+    out.close();
+    boost::filesystem::rename( file + ".tmp", file );
+  }
+
+ private:
+  const chrono::steady_clock::time_point _start;
+  double _total_peak_KB;
+  vector<string> _lines;
+};
+
+
+
+
+
+
 int main(int argc, char * argv[]) {
+  StageTimes stage_times;
+
   /* This is stupid
      system ( "cat splash_screen.txt" );
   */
@@ -307,13 +744,27 @@ int main(int argc, char * argv[]) {
   }
 
   // Input the Lachesis.ini file and find run parameters.
+  const chrono::steady_clock::time_point setup_start = chrono::steady_clock::now();
   const RunParams run_params(ini_file);
 
+  // Start the process-wide thread pool.  All parallel work in every stage shares these THREADS threads.
+  ThreadPool::SetNThreads( run_params._N_threads );
+  cout << "Using " << run_params._N_threads << " thread(s)." << endl;
+
+  // Set up the progress journal.  If RESUME = 1, steps already completed in a previous run (with the same inputs) will be skipped.
+  system ( ( "mkdir -p " + run_params._out_dir ).c_str() );
+  ProgressJournal journal( run_params._out_dir + "/progress.journal", run_params._resume );
+
+  stage_times.Add( "setup", chrono::duration<double>( chrono::steady_clock::now() - setup_start ).count() );
+
   // Run the steps of the Lachesis ordering!
 
-  if ( run_params._do_clustering ) LachesisClustering( run_params );
-  if ( run_params._do_ordering )   LachesisOrdering  ( run_params );
-  if ( run_params._do_reporting )  LachesisReporting ( run_params );
+  if ( run_params._do_clustering ) stage_times.Run( "clustering", [&]() { LachesisClustering( run_params, journal ); } );
+  if ( run_params._do_clustering && run_params._misjoin_window > 0 ) stage_times.Run( "misjoins",   [&]() { LachesisMisjoins( run_params ); } );
+  if ( run_params._do_ordering )   stage_times.Run( "ordering",   [&]() { LachesisOrdering  ( run_params, journal ); } );
+  if ( run_params._do_reporting )  stage_times.Run( "reporting",  [&]() { LachesisReporting ( run_params ); } );
+
+  stage_times.Write( run_params._out_dir + "/stage_times.txt" );
 
   cout << ": Done!" << endl;
   return 0;
@@ -0,0 +1,368 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+// For documentation, see LachesisAPI.h
+#include "LachesisAPI.h"
+#include "TextFileParsers.h" // ParseTabDelimFile
+#include "ThreadPool.h"
+
+// C libraries
+#include <assert.h>
+#include <stdlib.h> // abs
+#include <string.h> // strlen, strncmp
+#include <ctype.h> // isalnum
+
+// STL declarations
+#include <iostream>
+#include <algorithm> // min
+
+// Modules in ~/include (must add -L~/include and -lJ<module> to link)
+#include "gtools/SAMStepper.h" // SAMStepper, TargetLengths
+
+
+
+
+// LachesisInputFromRunParams: Fill a LachesisInput from the draft assembly, SAM files, and RE sites file named in a RunParams.
+LachesisInput
+LachesisInputFromRunParams( const RunParams & run_params )
+{
+  LachesisInput input;
+  input.species = run_params._species;
+  input.contig_names = *run_params.LoadDraftContigNames();
+  input.contig_lengths = TargetLengths( run_params._SAM_files[0] );
+  input.contig_RE_sites = ParseTabDelimFile<int>( run_params.DraftContigRESitesFilename(), 1 );
+  input.libraries = run_params.LoadLinkLibraries();
+  input.links = ReadHiCLinksFromSAM( run_params._SAM_files, input.libraries );
+  input.SAM_files = run_params._SAM_files;
+  return input;
+}
+
+
+
+// Determine whether two alignments are of reads from the same fragment, by the same name-matching rule as SAMStepper::next_pair().
+static bool
+same_fragment( const bam1_t * align1, const bam1_t * align2 )
+{
+  const char * name1 = bam1_qname(align1);
+  const char * name2 = bam1_qname(align2);
+  int len1 = strlen(name1), len2 = strlen(name2);
+  if ( strncmp( name1, name2, min( len1, len2 ) ) != 0 ) return false;
+  if ( len1 > len2 ) return !isalnum( name1[len2] );
+  if ( len2 > len1 ) return !isalnum( name2[len1] );
+  return true;
+}
+
+
+
+// ReadHiCLinksFromSAM: Read the Hi-C read pairs in a set of SAM/BAM files, in which both reads aligned to the draft assembly.
+// Reads are paired up exactly as in SAMStepper::next_pair(), which LoadDeNovoCLMsFromSAM uses: two consecutive alignments with the same fragment name.
+// A read whose mate's alignment isn't next to it becomes a HiCLink by itself, using the mate position from its own record and mapq2 = 0.  So it's counted
+// once in the GenomeLinkMatrix (as LoadFromSAM counts it) and not at all in the ChromLinkMatrices (as LoadDeNovoCLMsFromSAM skips it.)
+// Each read pair is assigned to a library by its SAM file, or by the read group of its first read.
+vector<HiCLink>
+ReadHiCLinksFromSAM( const vector<string> & SAM_files, const LinkLibraries & libraries )
+{
+  vector<HiCLink> links;
+  int64_t N_lone_reads = 0;
+
+  bam1_t * prev = bam_init1();
+
+  for ( size_t i = 0; i < SAM_files.size(); i++ ) {
+    cout << "Reading Hi-C read pairs from SAM file " << SAM_files[i] << "\t(dot = 1M alignments)" << endl;
+
+    SAMStepper stepper( SAM_files[i] );
+    stepper.FilterAlignedPairs(); // Only look at read pairs where both reads aligned to the assembly.
+
+    const int file_library = libraries.FileLibrary( SAM_files[i] );
+    auto library_of = [&]( bam1_t * read ) {
+      if ( !libraries.uses_read_groups() && file_library != -1 ) return file_library;
+      uint8_t * RG = bam_aux_get( read, "RG" );
+      return libraries.Library( SAM_files[i], RG ? bam_aux2Z( RG ) : NULL );
+    };
+
+    bool have_prev = false;
+    for ( bam1_t * align = stepper.next_read(); ; align = stepper.next_read() ) {
+      if ( align != NULL && stepper.N_aligns_read() % 1000000 == 0 ) cout << "." << flush;
+
+      // Pair this read with the previous one, if they match.  Otherwise the previous read is alone.
+      if ( have_prev && align != NULL && same_fragment( prev, align ) ) {
+	const bam1_core_t & c1 = prev->core;
+	const bam1_core_t & c2 = align->core;
+	HiCLink link = { c1.tid, c1.pos, (int32_t) c1.qual, c2.tid, c2.pos, (int32_t) c2.qual, library_of( prev ) };
+	links.push_back( link );
+	have_prev = false;
+	continue;
+      }
+
+      if ( have_prev && prev->core.mtid != -1 ) {
+	const bam1_core_t & c = prev->core;
+	HiCLink link = { c.tid, c.pos, (int32_t) c.qual, c.mtid, c.mpos, 0, library_of( prev ) };
+	links.push_back( link );
+	N_lone_reads++;
+      }
+
+      if ( align == NULL ) break;
+      bam_copy1( prev, align );
+      have_prev = true;
+    }
+    cout << endl;
+  }
+
+  bam_destroy1( prev );
+
+  cout << "Read " << links.size() << " Hi-C read pairs from " << SAM_files.size() << " SAM files (including " << N_lone_reads << " reads without their mates)" << endl;
+  return links;
+}
+
+
+
+
+LachesisClusteringParams::LachesisClusteringParams()
+  : N( 23 ),
+    min_RE_sites( 25 ),
+    max_link_density( 2 ),
+    noninformative_ratio( 3 ),
+    balance_iterations( 0 ),
+    balance_tolerance( 1e-4 ),
+    draw_heatmap( false ),
+    draw_dotplot( false ),
+    reorder_by_ref( true )
+{}
+
+
+
+LachesisClusteringParams::LachesisClusteringParams( const RunParams & run_params )
+  : N( run_params._cluster_N ),
+    CEN_contig_IDs( run_params._cluster_CEN_contig_IDs ),
+    min_RE_sites( run_params._cluster_min_RE_sites ),
+    max_link_density( run_params._cluster_max_link_density ),
+    noninformative_ratio( run_params._cluster_noninformative_ratio ),
+    balance_iterations( run_params._cluster_balance_iterations ),
+    balance_tolerance( run_params._cluster_balance_tolerance ),
+    draw_heatmap( run_params._cluster_draw_heatmap ),
+    draw_dotplot( run_params._cluster_draw_dotplot ),
+    reorder_by_ref( run_params._sim_bin_size == 0 )
+{}
+
+
+
+LachesisOrderingParams::LachesisOrderingParams()
+  : min_N_REs_in_trunk( 15 ),
+    min_N_REs_in_shreds( 15 ),
+    exhaustive_insertion( false ),
+    beam_width( 0 ),
+    beam_from_trunk( false ),
+    bootstrap_replicates( 0 ),
+    incremental_window( 3 )
+{}
+
+
+
+LachesisOrderingParams::LachesisOrderingParams( const RunParams & run_params )
+  : min_N_REs_in_trunk( run_params._order_min_N_REs_in_trunk ),
+    min_N_REs_in_shreds( run_params._order_min_N_REs_in_shreds ),
+    exhaustive_insertion( run_params._order_exhaustive_insertion ),
+    beam_width( run_params._order_beam_width ),
+    beam_from_trunk( false ),
+    bootstrap_replicates( run_params._order_bootstrap_replicates ),
+    incremental_window( run_params._order_incremental_window )
+{}
+
+
+
+
+// ClusterGLM: Run the clustering algorithm on a GenomeLinkMatrix that was just loaded (not normalized), and return the clusters.
+ClusterVec
+ClusterGLM( GenomeLinkMatrix & glm, const LachesisClusteringParams & params, const TrueMapping * true_mapping, vector<double> * contig_biases )
+{
+  const bool postfosmid = false; // placeholder for parameters optimized for the post-fosmid case
+
+  // Pre-processing.
+  glm.NormalizeToDeNovoContigLengths( true );
+
+  // ReorderContigsByRef() reorders the TrueMapping along with the GLM, so it gets a copy; the caller's TrueMapping may be shared.
+  TrueMapping reordered_mapping;
+  if ( true_mapping && params.reorder_by_ref ) {
+    reordered_mapping = *true_mapping;
+    glm.ReorderContigsByRef( reordered_mapping );
+    true_mapping = &reordered_mapping;
+  }
+
+  glm.SkipContigsWithFewREs( params.min_RE_sites );
+  glm.SkipRepeats( postfosmid ? 1.2 : params.max_link_density );
+
+  // Balancing comes after SkipRepeats, which needs the unbalanced link densities to find the repeats; the repeats are left out of the balancing.
+  if ( contig_biases ) contig_biases->clear();
+  if ( params.balance_iterations > 0 ) {
+    glm.BalanceMatrix( params.balance_tolerance, params.balance_iterations );
+    if ( contig_biases ) *contig_biases = glm.ContigBiases();
+  }
+
+  if ( params.draw_heatmap ) glm.DrawHeatmap( "heatmap.jpg" );
+
+
+  glm.AHClustering( params.N, params.CEN_contig_IDs, 0, params.noninformative_ratio, params.draw_dotplot, true_mapping );
+
+  // Improve the clustering results, in the postfosmid case.
+  if ( postfosmid ) glm.MoveContigsInClusters( 1.2 );
+  //glm.UndoMisjoins();
+
+  // If only using high-quality (i.e., well-aligning to reference) contigs, throw out the low-quality contigs at the last minute.
+  //glm.ExcludeLowQualityContigs( true_mapping );
+
+  // Report on the clustering.  If there is a TrueMapping, perform reference-based validation.
+  glm.ValidateClusters( true_mapping, params.draw_dotplot );
+
+  return glm.GetClusters();
+}
+
+
+
+// BootstrapAdjacencySupport: For each pair of adjacent contigs in order, find the fraction of bootstrap replicates of the CLM in whose full ordering the
+// two contigs are also adjacent.  Each replicate is a ChromLinkMatrix that shares clm's link data, with a seed equal to its (1-based) index, so the result is
+// reproducible whatever the number of threads.
+static vector<double>
+BootstrapAdjacencySupport( const ChromLinkMatrix & clm, const LachesisOrderingParams & params, const ContigOrdering & order )
+{
+  const int N_replicates = params.bootstrap_replicates;
+  const int N_adjacencies = order.N_contigs_used() - 1;
+
+  LachesisOrderingParams replicate_params = params;
+  replicate_params.bootstrap_replicates = 0;
+
+  // found[r][i]: whether adjacency #i of order was found in replicate #r.
+  vector< vector<char> > found( N_replicates, vector<char>( N_adjacencies, 0 ) );
+
+  ThreadPool::Global().ParallelFor( 0, N_replicates, [&]( int r ) {
+      ChromLinkMatrix replicate( clm, r+1 );
+      ContigOrdering replicate_order = OrderCLM( replicate, replicate_params );
+      for ( int i = 0; i < N_adjacencies; i++ ) {
+	int pos1 = replicate_order.contig_pos( order.contig_ID(i) );
+	int pos2 = replicate_order.contig_pos( order.contig_ID(i+1) );
+	found[r][i] = ( pos1 != -1 && pos2 != -1 && abs( pos1 - pos2 ) == 1 );
+      }
+    } );
+
+  vector<double> support( N_adjacencies, 0 );
+  for ( int r = 0; r < N_replicates; r++ )
+    for ( int i = 0; i < N_adjacencies; i++ )
+      support[i] += found[r][i];
+  for ( int i = 0; i < N_adjacencies; i++ )
+    support[i] /= N_replicates;
+
+  return support;
+}
+
+
+
+// OrderCLM: Run the ordering and orienting algorithms on a ChromLinkMatrix: first the 'trunk' ordering, then the full ordering.  Each is also oriented.
+// The full ordering is found either from the spanning tree, or by beam search (if params.beam_width > 0).
+ContigOrdering
+OrderCLM( const ChromLinkMatrix & clm, const LachesisOrderingParams & params, ContigOrdering * trunk )
+{
+  ContigOrdering trunk_order = clm.MakeTrunkOrder( params.min_N_REs_in_trunk );
+  const bool use_beam = params.beam_width > 0 && clm.constraints().empty();
+  if ( params.beam_width > 0 && !use_beam ) cout << "OrderCLM: This group has ordering constraints, so ORDER_BEAM_WIDTH is ignored" << endl;
+  ContigOrdering order = use_beam ?
+    clm.MakeBeamOrder( params.beam_width, params.min_N_REs_in_shreds, trunk_order, params.beam_from_trunk, params.exhaustive_insertion ) :
+    clm.MakeFullOrder( params.min_N_REs_in_shreds, false, params.exhaustive_insertion ); // this uses the spanning tree left behind by MakeTrunkOrder
+  if ( params.bootstrap_replicates > 0 && order.N_contigs_used() >= 2 )
+    order.SetAdjacencySupport( BootstrapAdjacencySupport( clm, params, order ) );
+  if ( trunk ) *trunk = trunk_order;
+  return order;
+}
+
+
+
+ContigOrdering
+ReorderCLM( const ChromLinkMatrix & clm, const ContigOrdering & old_order, const vector<int> & edited_contigs, const LachesisOrderingParams & params )
+{
+  return clm.ReorderIncrementally( old_order, edited_contigs, params.min_N_REs_in_shreds, params.incremental_window, params.exhaustive_insertion );
+}
+
+
+
+
+LachesisPipeline::LachesisPipeline( const LachesisInput & input )
+  : _input( input ),
+    _glm( NULL )
+{
+  assert( !input.contig_lengths.empty() );
+  assert( input.contig_RE_sites.size() == input.contig_lengths.size() );
+  assert( input.contig_names.empty() || input.contig_names.size() == input.contig_lengths.size() );
+}
+
+
+
+LachesisPipeline::~LachesisPipeline()
+{
+  delete _glm;
+  ClearCLMs();
+}
+
+
+
+void
+LachesisPipeline::ClearCLMs()
+{
+  for ( size_t i = 0; i < _CLMs.size(); i++ )
+    delete _CLMs[i];
+  _CLMs.clear();
+  _CLM_clusters.clear();
+}
+
+
+
+// Cluster: Cluster the contigs.  The GLM is built from the input the first time this is called; each call clusters a copy of it.
+ClusterVec
+LachesisPipeline::Cluster( const LachesisClusteringParams & params, const TrueMapping * true_mapping )
+{
+  if ( _glm == NULL )
+    _glm = new GenomeLinkMatrix( _input.species, _input.contig_lengths, _input.contig_RE_sites, _input.links, _input.SAM_files, "", _input.libraries );
+
+  GenomeLinkMatrix glm( *_glm );
+  return ClusterGLM( glm, params, true_mapping, &_contig_biases );
+}
+
+
+
+// Order: Order and orient the contigs in each cluster.  The CLMs are built from the input in one pass, unless they were already built for these clusters.
+vector<ContigOrdering>
+LachesisPipeline::Order( const ClusterVec & clusters, const LachesisOrderingParams & params, vector<ContigOrdering> * trunks )
+{
+  if ( _CLMs.empty() || _CLM_clusters != clusters ) {
+    ClearCLMs();
+    _CLM_clusters = clusters;
+    _CLMs.resize( clusters.size(), NULL );
+    for ( size_t i = 0; i < clusters.size(); i++ )
+      _CLMs[i] = new ChromLinkMatrix( _input.species, clusters[i].size() );
+    LoadDeNovoCLMsFromLinks( _input.links, _input.contig_lengths, _input.contig_RE_sites, _input.SAM_files, clusters, _CLMs, _input.libraries );
+  }
+
+  // Normalize by the contig biases from the last clustering, if any.  This is cheap, so it's redone on every call, in case Cluster() was called again.
+  for ( size_t i = 0; i < clusters.size(); i++ )
+    _CLMs[i]->SetContigBiases( _contig_biases, clusters[i] );
+
+  // The clusters are independent, so they're ordered in parallel.
+  vector<ContigOrdering> orders( clusters.size(), ContigOrdering( 0 ) );
+  if ( trunks ) trunks->assign( clusters.size(), ContigOrdering( 0 ) );
+  ThreadPool::Global().ParallelFor( 0, clusters.size(), [&]( int i ) {
+      cout << ": Ordering on cluster #" << i << endl;
+      orders[i] = OrderCLM( *_CLMs[i], params, trunks ? &(*trunks)[i] : NULL );
+    } );
+
+  return orders;
+}
@@ -0,0 +1,187 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * LachesisAPI.h
+ *
+ * The library interface to Lachesis (liblachesis.a), for programs that want to run clustering and ordering on data they already have in memory, without
+ * writing an INI file or passing data between the stages through files.
+ *
+ * LachesisInput: The draft assembly's contig metadata and the Hi-C read pairs (see HiCLink.h).  LachesisInputFromRunParams() fills one from the SAM files
+ *                and RE sites file named in an INI file.
+ *
+ * LachesisPipeline: Runs the stages on a LachesisInput, and returns the results directly: Cluster() returns a ClusterVec, and Order() returns a
+ *                   ContigOrdering for each group.  Nothing is written to disk.  The GenomeLinkMatrix is built once, on the first call to Cluster(), and
+ *                   re-used by later calls; the ChromLinkMatrices are built once for each clustering passed to Order(), and re-used until Order() is called
+ *                   with a different clustering.  So a parameter sweep only pays for loading the link data once.
+ *
+ * LachesisClusteringParams, LachesisOrderingParams: The heuristic parameters for the two stages (CLUSTER_* and ORDER_* in the INI file.)
+ *
+ * ClusterGLM(), OrderCLM(): The clustering and ordering algorithms as applied to one GenomeLinkMatrix or ChromLinkMatrix.  These are shared by the
+ *                           LachesisPipeline and by the Lachesis executable, which wraps them with its disk cache (cached_data/), progress journal, and
+ *                           reporting.  Reporting still goes through RunParams and the files in OUTPUT_DIR.
+ *
+ * Given the links that ReadHiCLinksFromSAM() reads from a set of SAM files, the pipeline gives the same results as the executable does on those SAM files.
+ *
+ * 'make install' installs liblachesis.a, which includes the bundled libraries in include/, and these headers, in <prefix>/include/lachesis.  To build a
+ * program against them: g++ -std=c++11 -I<prefix>/include/lachesis ... -L<prefix>/lib -llachesis -lbam -lboost_filesystem -lboost_system -lz -lpthread
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _LACHESIS_API__H
+#define _LACHESIS_API__H
+
+
+#include "HiCLink.h"
+#include "LinkLibraries.h"
+#include "ClusterVec.h"
+#include "ContigOrdering.h"
+#include "GenomeLinkMatrix.h"
+#include "ChromLinkMatrix.h"
+#include "TrueMapping.h"
+#include "RunParams.h"
+
+#include <string>
+#include <vector>
+using namespace std;
+
+
+
+
+// LachesisInput: Everything the pipeline needs to know about the draft assembly and its Hi-C data.
+struct LachesisInput {
+
+  string species; // as in the INI parameter SPECIES
+
+  // Contig metadata, one entry per contig of the draft assembly, in the order of the SAM header.
+  vector<string> contig_names; // optional; only needed to write results by contig name
+  vector<int> contig_lengths;
+  vector<int> contig_RE_sites; // number of restriction sites, as in the RE sites file (used for normalization and for filtering short contigs)
+
+  // The Hi-C read pairs.
+  vector<HiCLink> links;
+
+  // The SAM/BAM files the read pairs came from, if any.  This is only recorded in the GenomeLinkMatrix and ChromLinkMatrices, as their provenance.
+  vector<string> SAM_files;
+
+  // The Hi-C libraries that the read pairs came from (see LinkLibraries.h), indexed by HiCLink::library.  By default there's just one.
+  LinkLibraries libraries;
+};
+
+
+// LachesisInputFromRunParams: Fill a LachesisInput from the draft assembly, SAM files, and RE sites file named in a RunParams.
+LachesisInput LachesisInputFromRunParams( const RunParams & run_params );
+
+// ReadHiCLinksFromSAM: Read the Hi-C read pairs in a set of SAM/BAM files, in which both reads aligned to the draft assembly.
+// Each read pair's library is set from libraries (see LinkLibraries.h.)
+vector<HiCLink> ReadHiCLinksFromSAM( const vector<string> & SAM_files, const LinkLibraries & libraries = LinkLibraries() );
+
+
+
+
+struct LachesisClusteringParams {
+
+  LachesisClusteringParams(); // defaults, as in test_case.ini (but nothing is drawn)
+  LachesisClusteringParams( const RunParams & run_params );
+
+  int N; // CLUSTER_N
+  vector<int> CEN_contig_IDs; // CLUSTER_CONTIGS_WITH_CENS
+  int min_RE_sites; // CLUSTER_MIN_RE_SITES
+  double max_link_density; // CLUSTER_MAX_LINK_DENSITY
+  double noninformative_ratio; // CLUSTER_NONINFORMATIVE_RATIO
+  int balance_iterations; // CLUSTER_BALANCE_ITERATIONS: if > 0, balance the GLM (see GenomeLinkMatrix::BalanceMatrix) before clustering
+  double balance_tolerance; // CLUSTER_BALANCE_TOLERANCE
+  bool draw_heatmap, draw_dotplot; // CLUSTER_DRAW_HEATMAP, CLUSTER_DRAW_DOTPLOT
+  bool reorder_by_ref; // if a TrueMapping is given, reorder the contigs by it before clustering (true unless SIM_BIN_SIZE > 0)
+};
+
+
+
+struct LachesisOrderingParams {
+
+  LachesisOrderingParams(); // defaults, as in test_case.ini
+  LachesisOrderingParams( const RunParams & run_params );
+
+  int min_N_REs_in_trunk; // ORDER_MIN_N_RES_IN_TRUNK
+  int min_N_REs_in_shreds; // ORDER_MIN_N_RES_IN_SHREDS
+  bool exhaustive_insertion; // ORDER_EXHAUSTIVE_INSERTION: if true, ChromLinkMatrix::InsertShreds() tries every position for each shred
+  int beam_width; // ORDER_BEAM_WIDTH: if > 0, the full ordering is found by ChromLinkMatrix::MakeBeamOrder() instead of MakeFullOrder()
+  bool beam_from_trunk; // if true, MakeBeamOrder() starts from the trunk (not settable in the INI file; default false)
+  int bootstrap_replicates; // ORDER_BOOTSTRAP_REPLICATES: if > 0, find the bootstrap support of each adjacency in the full ordering
+  int incremental_window; // ORDER_INCREMENTAL_WINDOW: how far ReorderCLM() looks for improvements around each edited contig
+};
+
+
+
+
+// ClusterGLM: Run the clustering algorithm on a GenomeLinkMatrix that was just loaded (not normalized), and return the clusters.  This modifies the GLM.
+// If true_mapping is not NULL, it's used for reference-based validation of the clusters (but not modified.)  If the GLM is balanced (params.balance_iterations > 0) and
+// contig_biases is not NULL, it's filled with the contig biases (see GenomeLinkMatrix::ContigBiases), which OrderCLM can use via
+// ChromLinkMatrix::SetContigBiases(); otherwise it's cleared.
+ClusterVec ClusterGLM( GenomeLinkMatrix & glm, const LachesisClusteringParams & params, const TrueMapping * true_mapping = NULL,
+		       vector<double> * contig_biases = NULL );
+
+// OrderCLM: Run the ordering and orienting algorithms on a ChromLinkMatrix, and return the full ordering.  If trunk is not NULL, also return the trunk.
+// If params.bootstrap_replicates > 0, the ordering is also run on that many bootstrap replicates of the CLM (see ChromLinkMatrix.h), in parallel, and the
+// full ordering is given the fraction of replicates in which each pair of its adjacent contigs is also adjacent (in either order or orientation.)
+// If the CLM has constraints (see ChromLinkMatrix::SetConstraints), the full ordering is always found from the spanning tree, because beam search can't honour them.
+ContigOrdering OrderCLM( const ChromLinkMatrix & clm, const LachesisOrderingParams & params, ContigOrdering * trunk = NULL );
+
+// ReorderCLM: The incremental alternative to OrderCLM, for a group that a curator has edited: instead of ordering from scratch, start from old_order (an ordering
+// of the same contigs, e.g. from an earlier run) and re-optimize only the neighbourhood of the edited contigs (see ChromLinkMatrix::ReorderIncrementally.)
+// There's no bootstrap support, since finding it would mean ordering every replicate from scratch.
+ContigOrdering ReorderCLM( const ChromLinkMatrix & clm, const ContigOrdering & old_order, const vector<int> & edited_contigs, const LachesisOrderingParams & params );
+
+
+
+
+class LachesisPipeline
+{
+ public:
+
+  // The input is not copied, so it must outlive the LachesisPipeline.
+  LachesisPipeline( const LachesisInput & input );
+  ~LachesisPipeline();
+
+  // Cluster: Cluster the contigs.  If true_mapping is not NULL, it's used for reference-based validation (and reordering; see reorder_by_ref.)
+  ClusterVec Cluster( const LachesisClusteringParams & params, const TrueMapping * true_mapping = NULL );
+
+  // Order: Order and orient the contigs in each cluster.  Return the full ordering of each cluster; if trunks is not NULL, also fill it with the trunks.
+  // The clusters are ordered in parallel on the ThreadPool.  If the last call to Cluster() balanced the GLM, the CLMs are normalized by the same contig biases.
+  vector<ContigOrdering> Order( const ClusterVec & clusters, const LachesisOrderingParams & params, vector<ContigOrdering> * trunks = NULL );
+
+ private:
+
+  LachesisPipeline( const LachesisPipeline & );             // not copyable
+  LachesisPipeline & operator=( const LachesisPipeline & ); // not assignable
+
+  void ClearCLMs();
+
+  const LachesisInput & _input;
+  GenomeLinkMatrix * _glm; // the unmodified GLM; each call to Cluster() works on a copy
+  ClusterVec _CLM_clusters; // the clusters that _CLMs were built for
+  vector<ChromLinkMatrix *> _CLMs;
+  vector<double> _contig_biases; // from the last call to Cluster(), if it balanced the GLM; applied to _CLMs
+};
+
+
+#endif
@@ -0,0 +1,821 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * LachesisBench.cc
+ *
+ * LachesisBench: Time the core kernels of Lachesis in isolation, on synthetic data made in memory, so that an optimization can be measured in minutes
+ * instead of by a whole-pipeline run on a large dataset.  It's linked against liblachesis.a (see LachesisAPI.h) and isn't installed.
+ *
+ * The synthetic dataset: N_CONTIGS contigs of random lengths, in order along N_CHROMS chromosomes, with N_LINKS Hi-C links between them whose lengths follow
+ * a 1/d power law (as from SimulateHiC, but without the files.)  The contigs' IDs are in genome order, so the identity ordering of each cluster is the true
+ * one.  The ChromLinkMatrix kernels are timed on the CLM of the first chromosome.
+ *
+ * Each kernel is run WARMUP times untimed, then REPS times timed.  For each kernel, this reports the number of operations per repetition, the median and
+ * fastest time per repetition, and the median latency and throughput per operation.  What counts as an operation is listed with each kernel:
+ *
+ * LoadCLMs                  LoadDeNovoCLMsFromLinks() on all the clusters, which calls ChromLinkMatrix::AddLinkToMatrix() per link.  Op = one Hi-C link.
+ * OrderingScore             ChromLinkMatrix::OrderingScore() of the true ordering, with orientation.  Op = one full score.
+ * OrderingScoreShred        OrderingScore() restricted to one contig, as when inserting a shred.  Op = one score (over each position in turn.)
+ * ContigOrientLogLikelihood ChromLinkMatrix::ContigOrientLogLikelihood() of each adjacent pair in the true ordering.  Op = one call (one orientation.)
+ * FindSpanningTree          ChromLinkMatrix::FindSpanningTree().  Op = one tree.
+ * FindBestPath              WDAG::FindBestPath() on the orientation WDAG of the true ordering, as in ChromLinkMatrix::OrientContigs().  Op = one search.
+ * log_likelihood_D          LinkSizeDistribution::log_likelihood_D() on LSD_LINKS links between two contigs, at a range of gap sizes D.  Op = one call;
+ *                           its cost is dominated by LinkSizeDistribution::LinkBin() on each link.
+ * AHClustering              GenomeLinkMatrix::AHClustering() on the normalized GLM (the normalization isn't timed.)  Op = one merge of two clusters.
+ *
+ * With CHECK = 1, LachesisBench runs its correctness checks instead, and exits with status 1 if any of them fails.  'make check' does this.  The checks
+ * compare an optimized kernel to the simple version it replaced, on CHECK_CASES random inputs:
+ *
+ * ShredTree                 ShredTree() versus repeated find_longest_path(), removing each path from the tree, as ReinsertShreds() used to do.  The
+ *                           inputs are random forests, with isolated nodes, shuffled node labels and shuffled adjacency lists.
+ * OrderTree                 The OrderTree behind ContigOrdering versus a plain vector, edited as ContigOrdering used to edit its _data.  The inputs are
+ *                           random sequences of Insert, Erase and Invert, with at(), Position() and contains() checked after each edit, both by walking
+ *                           the tree and from the flat vector, and with copies made and edited independently along the way.
+ * LinkArena                 The packed bins of a LinkArena versus the vector<int> bins they were packed from: each bin read through its iterator and
+ *                           ToVector(), NonEmptyBins(), Unpack(), and the arena read back from a link store, before and after random bins are clipped by
+ *                           Truncate(), as ClipToFileFormat() does.  The inputs are random matrices of bins, sparse and dense (so both indexes are used),
+ *                           with many empty and one-link bins, and distances at each boundary between widths: 255/256, 65535/65536, 2^24-1/2^24.
+ * EnrichmentScorer          EnrichmentScorer::Score() and OrderingScore() versus ChromLinkMatrix::EnrichmentScore() and OrderingScore(), after each
+ *                           of a random sequence of AddContig(), RemoveContig(), MoveContig() and Invert() edits.  The inputs are random orderings of
+ *                           random subsets of the contigs of one synthetic CLM (as for the kernels, but smaller.)
+ * ParallelFor               ThreadPool::ParallelFor() on 4 threads versus a serial loop, with body() throwing at a random index in some cases.  Every
+ *                           index must be done exactly once if nothing throws; otherwise the exception must reach the caller, and only once no call to
+ *                           body() is still running.
+ *
+ * Syntax: LachesisBench [ARG=value ...]
+ * Arguments (and defaults): N_CHROMS = 4, N_CONTIGS = 2000, N_LINKS = 2000000, LSD_LINKS = 10000, SEED = 1, WARMUP = 1, REPS = 5,
+ * KERNELS = all (or a comma-separated list of the kernel names above), CHECK = 0, CHECK_CASES = 1000.
+ * Lachesis's own output from the kernels is suppressed.
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+
+// C libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // strstr (in ParsedArgs.h)
+#include <stdint.h>
+#include <assert.h>
+#include <math.h>
+
+// STL declarations
+#include <string>
+#include <vector>
+#include <set>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm> // sort, transform
+#include <chrono>
+#include <functional>
+#include <random>
+#include <limits.h> // INT_MAX
+#include <atomic>
+#include <stdexcept>
+using namespace std;
+
+// Modules in ~/include
+#include "ParsedArgs.h"
+#include "markov/WDAG.h"
+
+// Boost includes
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp> // split
+
+// Local includes
+#include "HiCLink.h"
+#include "ClusterVec.h"
+#include "ContigOrdering.h"
+#include "OrderTree.h"
+#include "LinkArena.h"
+#include "LinkStore.h"
+#include "GenomeLinkMatrix.h"
+#include "ChromLinkMatrix.h"
+#include "LinkSizeDistribution.h"
+#include "ThreadPool.h"
+
+
+
+
+// The results of the kernels are added into this, so that the compiler can't optimize the calls away.
+static volatile double sink = 0;
+
+
+
+// QuietCout: While one of these exists, cout goes nowhere.
+class QuietCout
+{
+ public:
+  QuietCout() : _old( cout.rdbuf( _null.rdbuf() ) ) {}
+  ~QuietCout() { cout.rdbuf( _old ); }
+ private:
+  ostringstream _null;
+  streambuf * _old;
+};
+
+
+
+// The synthetic dataset.
+struct BenchData {
+  vector<int> contig_lengths, contig_RE_sites;
+  vector<HiCLink> links;
+  ClusterVec clusters; // one per chromosome, in genome order
+};
+
+
+
+// MakeBenchData: Make the synthetic dataset.  The contig lengths are log-normal with a median of 50 Kb, and there's one RE site per 4 Kb.
+BenchData
+MakeBenchData( const int N_chroms, const int N_contigs, const int64_t N_links, const int seed )
+{
+  mt19937_64 rng( seed );
+  uniform_real_distribution<double> uniform( 0, 1 );
+  normal_distribution<double> normal( 0, 0.8 );
+
+  BenchData data;
+  data.clusters = ClusterVec( N_chroms, N_contigs );
+
+  // Lay out the contigs along the chromosomes, in ID order.
+  vector<int64_t> starts; // genome position of each contig, plus the end of the genome
+  vector<int> chrom_of( N_contigs );
+  int64_t pos = 0;
+  for ( int i = 0; i < N_contigs; i++ ) {
+    const int len = max( 2000, int( 50000 * exp( normal( rng ) ) ) );
+    data.contig_lengths.push_back( len );
+    data.contig_RE_sites.push_back( len / 4096 );
+    chrom_of[i] = int64_t( i ) * N_chroms / N_contigs;
+    data.clusters[ chrom_of[i] ].insert( i );
+    starts.push_back( pos );
+    pos += len;
+  }
+  starts.push_back( pos );
+
+  // Make the links.  Each link starts at a uniformly random point, and goes a distance d ~ 1/d in [1 Kb, 10 Mb] to either side; links that leave their
+  // chromosome are kept as inter-chromosomal noise.
+  data.links.reserve( N_links );
+  const int64_t genome_len = pos;
+  for ( int64_t i = 0; i < N_links; i++ ) {
+    const int64_t pos1 = int64_t( uniform( rng ) * genome_len );
+    const int64_t d = int64_t( 1000 * pow( 1e4, uniform( rng ) ) );
+    int64_t pos2 = uniform( rng ) < 0.5 ? pos1 - d : pos1 + d;
+    if ( pos2 < 0 || pos2 >= genome_len ) pos2 = int64_t( uniform( rng ) * genome_len );
+
+    const int c1 = upper_bound( starts.begin(), starts.end(), pos1 ) - starts.begin() - 1;
+    const int c2 = upper_bound( starts.begin(), starts.end(), pos2 ) - starts.begin() - 1;
+    HiCLink link = { c1, int32_t( pos1 - starts[c1] ), 60, c2, int32_t( pos2 - starts[c2] ), 60, 0 };
+    data.links.push_back( link );
+  }
+
+  return data;
+}
+
+
+
+// WriteBenchLSDFile: Write a LinkSizeDistribution file with a 1/d link density, to make a LinkSizeDistribution from.  The bins are as in the
+// LinkSizeDistribution constructor: 16 per doubling, from _MIN_LINK_DIST to _MAX_LINK_DIST.
+void
+WriteBenchLSDFile( const string & file )
+{
+  const int N_bins = 256;
+  ofstream out( file.c_str(), ios::out );
+  out << "# N_bins = " << N_bins << endl;
+  out << "# max_intra_contig_link_dist = 1000000" << endl;
+  out << "# SAM files used in generating this dataset: LachesisBench" << endl;
+  for ( int i = 0; i < N_bins; i++ ) {
+    const int bin_start = int( LinkSizeDistribution::_MIN_LINK_DIST * pow( 2.0, i / 16.0 ) );
+    out << bin_start << '\t' << 1e6 / bin_start << endl;
+  }
+  out << LinkSizeDistribution::_MAX_LINK_DIST << "\t0" << endl;
+}
+
+
+
+// Benchmark: Time a kernel.  setup() is called, untimed, before each run of kernel(), which does N_ops operations.
+void
+Benchmark( const string & name, const int64_t N_ops, const int warmup, const int reps, const function<void()> & setup, const function<void()> & kernel )
+{
+  typedef chrono::steady_clock clock;
+  vector<double> seconds;
+
+  for ( int i = 0; i < warmup + reps; i++ ) {
+    QuietCout quiet;
+    setup();
+    const clock::time_point start = clock::now();
+    kernel();
+    const clock::time_point stop = clock::now();
+    if ( i >= warmup ) seconds.push_back( chrono::duration<double>( stop - start ).count() );
+  }
+
+  sort( seconds.begin(), seconds.end() );
+  const double median = seconds[ seconds.size() / 2 ];
+  printf( "%-26s %12lld %10.3f %10.3f %14.1f %14.0f\n", name.c_str(), (long long) N_ops, median * 1e3, seconds[0] * 1e3, median / N_ops * 1e9,
+	  N_ops / median );
+  fflush( stdout );
+}
+
+
+
+
+
+// RandomForest: A random forest on N nodes, with shuffled node labels and adjacency lists.  Each node is joined to a random earlier node, except for the
+// roots of the trees; some trees are isolated nodes.
+vector< vector<int> >
+RandomForest( const int N, mt19937_64 & rng )
+{
+  vector<int> label( N );
+  for ( int i = 0; i < N; i++ ) label[i] = i;
+  shuffle( label.begin(), label.end(), rng );
+
+  vector< vector<int> > forest( N );
+  for ( int i = 1; i < N; i++ ) {
+    if ( uniform_int_distribution<int>( 0, 9 )( rng ) == 0 ) continue; // a new tree
+    const int j = uniform_int_distribution<int>( 0, i-1 )( rng );
+    forest[ label[i] ].push_back( label[j] );
+    forest[ label[j] ].push_back( label[i] );
+  }
+  for ( int i = 0; i < N; i++ ) shuffle( forest[i].begin(), forest[i].end(), rng );
+  return forest;
+}
+
+
+
+// CheckShredTree: Compare ShredTree() to the shredding it replaced in ChromLinkMatrix::ReinsertShreds(), on N_cases random forests.  Return the number
+// of forests on which they differ.
+int
+CheckShredTree( const int N_cases, const int seed )
+{
+  mt19937_64 rng( seed );
+  int N_failed = 0;
+
+  for ( int c = 0; c < N_cases; c++ ) {
+    const int N = uniform_int_distribution<int>( 1, 300 )( rng );
+    vector< vector<int> > tree = RandomForest( N, rng );
+
+    vector<bool> removed;
+    const vector< vector<int> > shreds = ShredTree( tree, &removed );
+
+    // The old way: find the longest path, and remove its nodes from the tree, until there are no paths left.
+    vector< vector<int> > old_shreds;
+    vector<bool> old_removed( N, false );
+    for ( vector<int> path = find_longest_path( tree ); !path.empty(); path = find_longest_path( tree ) ) {
+      for ( size_t i = 0; i < path.size(); i++ ) {
+	const int node = path[i];
+	old_removed[node] = true;
+	for ( size_t j = 0; j < tree[node].size(); j++ ) {
+	  vector<int> & j_adjs = tree[ tree[node][j] ];
+	  j_adjs.erase( remove( j_adjs.begin(), j_adjs.end(), node ), j_adjs.end() );
+	}
+	tree[node].clear();
+      }
+      old_shreds.push_back( path );
+    }
+
+    if ( shreds != old_shreds || removed != old_removed ) {
+      cout << "CHECK FAILED: ShredTree differs from repeated find_longest_path on random forest #" << c << " (" << N << " nodes): "
+	   << shreds.size() << " vs. " << old_shreds.size() << " shreds" << endl;
+      N_failed++;
+    }
+  }
+
+  cout << "ShredTree: " << N_cases - N_failed << " of " << N_cases << " random forests OK" << endl;
+  return N_failed;
+}
+
+
+
+// OrderTreeMatches: Check every query of an OrderTree against the vector it should hold.  If walk, check at() before data(), so that at() walks the tree.
+static bool
+OrderTreeMatches( const OrderTree & tree, const vector<int> & model, const int N_contigs, const bool walk )
+{
+  if ( tree.size() != (int) model.size() ) return false;
+  if ( walk )
+    for ( size_t i = 0; i < model.size(); i++ )
+      if ( tree.at(i) != model[i] ) return false;
+  if ( tree.data() != model ) return false;
+  for ( size_t i = 0; i < model.size(); i++ )
+    if ( tree.at(i) != model[i] ) return false;
+
+  vector<int> pos( N_contigs, -1 );
+  for ( size_t i = 0; i < model.size(); i++ )
+    pos[ model[i] < 0 ? ~model[i] : model[i] ] = i;
+  for ( int c = 0; c < N_contigs; c++ )
+    if ( tree.Position(c) != pos[c] || tree.contains(c) != ( pos[c] != -1 ) ) return false;
+  return true;
+}
+
+
+
+// CheckOrderTree: Compare an OrderTree to a plain vector under the same random edits, on N_cases random sequences of edits.  Return the number of sequences
+// on which they differ.
+int
+CheckOrderTree( const int N_cases, const int seed )
+{
+  mt19937_64 rng( seed );
+  int N_failed = 0;
+
+  for ( int c = 0; c < N_cases; c++ ) {
+    const int N = uniform_int_distribution<int>( 1, 200 )( rng );
+    OrderTree tree( N );
+    vector<int> model, unused;
+    for ( int i = 0; i < N; i++ ) unused.push_back(i);
+    shuffle( unused.begin(), unused.end(), rng );
+
+    // Start from a random sequence of about half of the contigs.
+    const int N_start = uniform_int_distribution<int>( 0, N/2 )( rng );
+    for ( int i = 0; i < N_start; i++ ) {
+      model.push_back( rng() % 2 ? unused.back() : ~unused.back() );
+      unused.pop_back();
+    }
+    tree.Assign( model );
+
+    // A copy that's edited along with the original, and one that should keep its value while the original changes.
+    OrderTree copy( tree ), frozen( N );
+    vector<int> frozen_model;
+
+    bool ok = OrderTreeMatches( tree, model, N, false );
+    const int N_edits = uniform_int_distribution<int>( 1, 100 )( rng );
+    for ( int e = 0; e < N_edits && ok; e++ ) {
+      const int op = uniform_int_distribution<int>( 0, 2 )( rng );
+
+      if ( op == 0 && !unused.empty() ) { // Insert a run of contigs, as in AddContigs()
+	const int N_new = uniform_int_distribution<int>( 1, min( 5, (int) unused.size() ) )( rng );
+	const int pos = uniform_int_distribution<int>( 0, model.size() )( rng );
+	vector<int> data;
+	for ( int i = 0; i < N_new; i++ ) {
+	  data.push_back( rng() % 2 ? unused.back() : ~unused.back() );
+	  unused.pop_back();
+	}
+	tree.Insert( pos, data );
+	copy.Insert( pos, data );
+	model.insert( model.begin() + pos, data.begin(), data.end() );
+      }
+      else if ( op == 1 && !model.empty() ) { // Erase one contig, as in RemoveContig()
+	const int pos = uniform_int_distribution<int>( 0, model.size() - 1 )( rng );
+	const int value = tree.Erase( pos );
+	ok = ok && copy.Erase( pos ) == value && value == model[pos];
+	unused.push_back( value < 0 ? ~value : value );
+	model.erase( model.begin() + pos );
+      }
+      else if ( !model.empty() ) { // Invert a range, as in Invert()
+	int start = uniform_int_distribution<int>( 0, model.size() - 1 )( rng );
+	int stop  = uniform_int_distribution<int>( 0, model.size() - 1 )( rng );
+	if ( start > stop ) swap( start, stop );
+	tree.Invert( start, stop );
+	copy.Invert( start, stop );
+	reverse( model.begin() + start, model.begin() + stop + 1 );
+	for ( int i = start; i <= stop; i++ ) model[i] = ~model[i];
+      }
+
+      // Check the original by walking the tree or from the flat vector, at random, and the copy the other way.
+      const bool walk = rng() % 2;
+      ok = ok && OrderTreeMatches( tree, model, N, walk ) && OrderTreeMatches( copy, model, N, !walk );
+
+      // Now and then, take a snapshot by assignment, or replace the copy with a fresh copy of the original.
+      if ( rng() % 10 == 0 ) {
+	frozen = tree;
+	frozen_model = model;
+      }
+      if ( rng() % 10 == 0 ) copy = OrderTree( tree );
+    }
+    ok = ok && OrderTreeMatches( frozen, frozen_model, N, false );
+
+    if ( !ok ) {
+      cout << "CHECK FAILED: OrderTree differs from a plain vector on random edit sequence #" << c << " (" << N << " contigs)" << endl;
+      N_failed++;
+    }
+  }
+
+  cout << "OrderTree: " << N_cases - N_failed << " of " << N_cases << " random edit sequences OK" << endl;
+  return N_failed;
+}
+
+
+
+// LinkArenaMatches: Check every query of a LinkArena against the bins it should hold.  ever_nonempty[X][Y] says whether bin [X,Y] had links before it was
+// clipped: NonEmptyBins() may list a bin clipped to nothing, but no bin that never had links.
+static bool
+LinkArenaMatches( const LinkArena & arena, const vector< vector< vector<int> > > & bins, const vector< vector<bool> > & ever_nonempty )
+{
+  const int N_bins = bins.size();
+  if ( arena.N_bins() != N_bins ) return false;
+
+  vector<int> Ys;
+  for ( int X = 0; X < N_bins; X++ ) {
+    arena.NonEmptyBins( X, Ys );
+    if ( !is_sorted( Ys.begin(), Ys.end() ) || adjacent_find( Ys.begin(), Ys.end() ) != Ys.end() ) return false;
+    vector<bool> listed( N_bins, false );
+    for ( size_t i = 0; i < Ys.size(); i++ ) {
+      if ( Ys[i] < 0 || Ys[i] >= N_bins || !ever_nonempty[X][ Ys[i] ] ) return false;
+      listed[ Ys[i] ] = true;
+    }
+
+    for ( int Y = 0; Y < N_bins; Y++ ) {
+      if ( !bins[X][Y].empty() && !listed[Y] ) return false;
+      const LinkBin bin = arena.Bin( X, Y );
+      if ( arena.N_links( X, Y ) != (int) bins[X][Y].size() || bin.empty() != bins[X][Y].empty() ) return false;
+      if ( bin.ToVector() != bins[X][Y] ) return false;
+      vector<int> dists;
+      for ( LinkBin::const_iterator it = bin.begin(); it != bin.end(); ++it )
+	dists.push_back( *it );
+      if ( dists != bins[X][Y] ) return false;
+    }
+  }
+
+  // Unpack() should give back the same bins.
+  vector< vector< vector<int> > > unpacked( N_bins, vector< vector<int> >( N_bins ) );
+  vector<vector<int> *> unpacked_rows( N_bins );
+  for ( int X = 0; X < N_bins; X++ ) unpacked_rows[X] = unpacked[X].data();
+  arena.Unpack( unpacked_rows.data() );
+  return unpacked == bins;
+}
+
+
+
+// CheckLinkArena: Pack random matrices of bins into LinkArenas, and check that every way of reading an arena gives back the bins, including after the arena
+// is written to a link store and read back, and after random bins are clipped.  Return the number of matrices on which a check fails.
+int
+CheckLinkArena( const int N_cases, const int seed )
+{
+  mt19937_64 rng( seed );
+  int N_failed = 0, N_sparse = 0;
+
+  // The largest distance that fits in each width, and the smallest that doesn't.
+  const int edges[] = { 0, 1, 255, 256, 65535, 65536, ( 1 << 24 ) - 1, 1 << 24, INT_MAX };
+  const int N_edges = sizeof(edges) / sizeof(int);
+
+  // The text file that the link stores go with.  LinkStore only checks its size and modification time.
+  const string source_file = ( boost::filesystem::temp_directory_path() / boost::filesystem::unique_path( "LachesisBench.%%%%-%%%%.txt" ) ).string();
+  { ofstream out( source_file.c_str() ); out << "LachesisBench" << endl; }
+
+  for ( int c = 0; c < N_cases; c++ ) {
+    const int N_bins = uniform_int_distribution<int>( 1, 60 )( rng );
+    const double densities[] = { 0, 0.01, 0.05, 0.3, 1 };
+    const double density = densities[ uniform_int_distribution<int>( 0, 4 )( rng ) ];
+
+    // Fill the bins.  Most non-empty bins have one link; a few have hundreds.  Each bin's largest distance is at or near one of the edges.
+    vector< vector< vector<int> > > bins( N_bins, vector< vector<int> >( N_bins ) );
+    vector< vector<bool> > ever_nonempty( N_bins, vector<bool>( N_bins, false ) );
+    for ( int X = 0; X < N_bins; X++ )
+      for ( int Y = 0; Y < N_bins; Y++ ) {
+	if ( uniform_real_distribution<double>( 0, 1 )( rng ) >= density ) continue;
+	const int r = uniform_int_distribution<int>( 0, 99 )( rng );
+	const int N_links = r < 70 ? 1 : r < 98 ? uniform_int_distribution<int>( 2, 20 )( rng ) : uniform_int_distribution<int>( 100, 600 )( rng );
+	const int max_dist = edges[ uniform_int_distribution<int>( 0, N_edges - 1 )( rng ) ];
+	for ( int i = 0; i < N_links; i++ )
+	  bins[X][Y].push_back( rng() % 4 == 0 ? edges[ uniform_int_distribution<int>( 0, N_edges - 1 )( rng ) ] % ( max_dist + 1LL )
+				: uniform_int_distribution<int>( 0, max_dist )( rng ) );
+	bins[X][Y][ uniform_int_distribution<int>( 0, N_links - 1 )( rng ) ] = max_dist;
+	ever_nonempty[X][Y] = true;
+      }
+
+    vector<const vector<int> *> rows( N_bins );
+    for ( int X = 0; X < N_bins; X++ ) rows[X] = bins[X].data();
+    LinkArena arena( rows.data(), N_bins );
+    if ( arena.sparse() ) N_sparse++;
+
+    bool all_empty = true;
+    for ( int X = 0; X < N_bins; X++ )
+      for ( int Y = 0; Y < N_bins; Y++ )
+	all_empty &= bins[X][Y].empty();
+    bool ok = arena.empty() == all_empty && LinkArenaMatches( arena, bins, ever_nonempty );
+    if ( all_empty ) ok = ok && LinkArenaMatches( LinkArena( N_bins ), bins, ever_nonempty );
+
+    // Clip some of the bins, sometimes to nothing, and check again.
+    for ( int X = 0; X < N_bins; X++ )
+      for ( int Y = 0; Y < N_bins; Y++ )
+	if ( !bins[X][Y].empty() && rng() % 4 == 0 ) {
+	  const int N_keep = uniform_int_distribution<int>( 0, bins[X][Y].size() )( rng );
+	  arena.Truncate( X, Y, N_keep );
+	  bins[X][Y].resize( N_keep );
+	}
+    ok = ok && LinkArenaMatches( arena, bins, ever_nonempty );
+
+    // Write the clipped arena to a link store, and read it back from the mapping.
+    LinkStore::Writer writer;
+    arena.AddToStore( writer );
+    writer.Write( source_file, source_file );
+    const shared_ptr<LinkArena> stored = LinkArena::FromStore( LinkStore::Open( source_file ), N_bins );
+    ok = ok && stored && stored->sparse() == arena.sparse() && LinkArenaMatches( *stored, bins, ever_nonempty );
+
+    if ( !ok ) {
+      cout << "CHECK FAILED: LinkArena doesn't give back its bins on random matrix #" << c << " (" << N_bins << " x " << N_bins << " bins, density "
+	   << density << ", " << ( arena.sparse() ? "sparse" : "dense" ) << " index)" << endl;
+      N_failed++;
+    }
+  }
+
+  LinkStore::Remove( source_file );
+  boost::filesystem::remove( source_file );
+
+  cout << "LinkArena: " << N_cases - N_failed << " of " << N_cases << " random matrices OK (" << N_sparse << " with the sparse index)" << endl;
+  return N_failed;
+}
+
+
+
+// CheckEnrichmentScorer: Edit random orderings of a small synthetic CLM's contigs, and compare an EnrichmentScorer that follows the edits to
+// EnrichmentScore() after each one.  Return the number of orderings on which they differ by more than rounding.
+int
+CheckEnrichmentScorer( const int N_cases, const int seed )
+{
+  mt19937_64 rng( seed );
+  int N_failed = 0;
+
+  // Contigs of ~50 Kb, and _CP_score_dist of 10 Mb, so an edit's window is a few hundred contigs, as in a real group.
+  const int N_contigs = 200;
+  const BenchData data = MakeBenchData( 1, N_contigs, 20000, seed );
+  ChromLinkMatrix * clm;
+  {
+    QuietCout quiet;
+    clm = new ChromLinkMatrix( "bench", N_contigs );
+    LoadDeNovoCLMsFromLinks( data.links, data.contig_lengths, data.contig_RE_sites, vector<string>(), data.clusters, vector<ChromLinkMatrix *>( 1, clm ),
+			     LinkLibraries() );
+  }
+
+  for ( int c = 0; c < N_cases; c++ ) {
+    // A random ordering of a random stretch of at least 20 contigs, in random orientations.  (EnrichmentScore() requires some links between the contigs,
+    // so they can't be just any contigs.)
+    const int N_used = uniform_int_distribution<int>( 20, N_contigs )( rng );
+    const int first = uniform_int_distribution<int>( 0, N_contigs - N_used )( rng );
+    vector<int> contigs;
+    for ( int i = first; i < first + N_used; i++ ) contigs.push_back(i);
+    shuffle( contigs.begin(), contigs.end(), rng );
+    ContigOrdering order( N_contigs, contigs );
+    for ( int i = 0; i < N_used; i++ )
+      if ( rng() % 2 ) order.Invert(i);
+
+    EnrichmentScorer scorer( *clm, order );
+    bool ok = true;
+    const int N_edits = uniform_int_distribution<int>( 1, 10 )( rng );
+    for ( int e = 0; e < N_edits && ok; e++ ) {
+      const int N = order.N_contigs_used();
+      const int op = uniform_int_distribution<int>( 0, 3 )( rng );
+
+      if ( op == 0 && N < N_contigs ) { // AddContig
+	int contig;
+	do contig = uniform_int_distribution<int>( 0, N_contigs - 1 )( rng ); while ( order.contig_used( contig ) );
+	const int pos = uniform_int_distribution<int>( 0, N )( rng );
+	scorer.BeginEdit( order, pos, pos );
+	order.AddContig( contig, pos, rng() % 2 );
+	scorer.EndEdit( order, pos+1 );
+      }
+      else if ( op == 1 && N > 0 ) { // RemoveContig
+	const int pos = uniform_int_distribution<int>( 0, N - 1 )( rng );
+	scorer.BeginEdit( order, pos, pos+1 );
+	order.RemoveContig( pos );
+	scorer.EndEdit( order, pos );
+      }
+      else if ( op == 2 && N > 0 ) { // MoveContig
+	const int a = uniform_int_distribution<int>( 0, N - 1 )( rng ), b = uniform_int_distribution<int>( 0, N - 1 )( rng );
+	scorer.BeginEdit( order, min( a, b ), max( a, b ) + 1 );
+	order.MoveContig( a, b );
+	scorer.EndEdit( order, max( a, b ) + 1 );
+      }
+      else if ( N > 0 ) { // Invert a stretch of up to 20 contigs, as in ReorderIncrementally()
+	const int a = uniform_int_distribution<int>( 0, N - 1 )( rng ), b = min( N - 1, a + uniform_int_distribution<int>( 0, 19 )( rng ) );
+	scorer.BeginEdit( order, a, b+1 );
+	order.Invert( a, b );
+	scorer.EndEdit( order, b+1 );
+      }
+
+      const double expected = clm->EnrichmentScore( order ), score = scorer.Score();
+      const double expected_OS = clm->OrderingScore( order ), OS = scorer.OrderingScore();
+      ok = fabs( score - expected ) <= 1e-9 * max( 1.0, fabs( expected ) ) && fabs( OS - expected_OS ) <= 1e-9 * max( 1.0, fabs( expected_OS ) );
+    }
+
+    if ( !ok ) {
+      cout << "CHECK FAILED: EnrichmentScorer differs from EnrichmentScore on random ordering #" << c << " (" << order.N_contigs_used() << " contigs)" << endl;
+      N_failed++;
+    }
+  }
+
+  delete clm;
+  cout << "EnrichmentScorer: " << N_cases - N_failed << " of " << N_cases << " random edited orderings OK" << endl;
+  return N_failed;
+}
+
+
+
+// CheckParallelFor: Run ThreadPool::ParallelFor() on 4 threads over N_cases random ranges, with body() throwing at a random index in about half of them.
+// Return the number of ranges on which an index was done other than once (with no throw), the exception was lost or made up, or ParallelFor() returned
+// while a call to body() was still running.
+int
+CheckParallelFor( const int N_cases, const int seed )
+{
+  mt19937_64 rng( seed );
+  int N_failed = 0;
+  ThreadPool::SetNThreads( 4 );
+
+  for ( int c = 0; c < N_cases; c++ ) {
+    const int N = uniform_int_distribution<int>( 0, 200 )( rng );
+    const int throw_at = rng() % 2 ? uniform_int_distribution<int>( 0, N )( rng ) : -1; // throw_at = N means no throw
+    vector<int> N_calls( N, 0 ); // each index is claimed by one thread, so each entry is only written by one thread
+    atomic<int> N_running( 0 );
+
+    bool threw = false;
+    try {
+      ThreadPool::Global().ParallelFor( 0, N, [&]( int i ) {
+	  N_running++;
+	  N_calls[i]++;
+	  this_thread::yield();
+	  N_running--;
+	  if ( i == throw_at ) throw runtime_error( "CheckParallelFor" );
+	} );
+    }
+    catch ( const runtime_error & ) { threw = true; }
+
+    bool ok = N_running == 0 && threw == ( throw_at >= 0 && throw_at < N );
+    for ( int i = 0; i < N; i++ )
+      if ( N_calls[i] > 1 || ( !threw && N_calls[i] != 1 ) ) ok = false;
+
+    if ( !ok ) {
+      cout << "CHECK FAILED: ParallelFor differs from a serial loop on random range #" << c << " (" << N << " indices, throw at " << throw_at << ")" << endl;
+      N_failed++;
+    }
+  }
+
+  ThreadPool::SetNThreads( 1 );
+  cout << "ParallelFor: " << N_cases - N_failed << " of " << N_cases << " random ranges OK" << endl;
+  return N_failed;
+}
+
+
+
+int main( int argc, char * argv[] )
+{
+  ParsedArgs args = ParseArgs( argc, argv );
+  args.RequireOrDefault( "N_CHROMS", "4" );
+  args.RequireOrDefault( "N_CONTIGS", "2000" );
+  args.RequireOrDefault( "N_LINKS", "2000000" );
+  args.RequireOrDefault( "LSD_LINKS", "10000" );
+  args.RequireOrDefault( "SEED", "1" );
+  args.RequireOrDefault( "WARMUP", "1" );
+  args.RequireOrDefault( "REPS", "5" );
+  args.RequireOrDefault( "KERNELS", "all" );
+  args.RequireOrDefault( "CHECK", "0" );
+  args.RequireOrDefault( "CHECK_CASES", "1000" );
+
+  // In CHECK mode, run the correctness checks, and nothing else.
+  if ( args.ValueAsInt( "CHECK" ) ) {
+    const int N_cases = args.ValueAsInt( "CHECK_CASES" ), seed = args.ValueAsInt( "SEED" );
+    int N_failed = 0;
+    N_failed += CheckShredTree( N_cases, seed );
+    N_failed += CheckOrderTree( N_cases, seed );
+    N_failed += CheckLinkArena( N_cases, seed );
+    N_failed += CheckEnrichmentScorer( N_cases, seed );
+    N_failed += CheckParallelFor( N_cases, seed );
+    cout << "LachesisBench: " << ( N_failed ? "CHECKS FAILED" : "all checks passed" ) << endl;
+    return N_failed ? 1 : 0;
+  }
+
+  const int N_chroms = args.ValueAsInt( "N_CHROMS" );
+  const int N_contigs = args.ValueAsInt( "N_CONTIGS" );
+  const int64_t N_links = int64_t( args.ValueAsDouble( "N_LINKS" ) );
+  const int LSD_links = args.ValueAsInt( "LSD_LINKS" );
+  const int warmup = args.ValueAsInt( "WARMUP" );
+  const int reps = args.ValueAsInt( "REPS" );
+  if ( N_chroms < 1 || N_contigs < 2 * N_chroms || N_links < 1 || LSD_links < 1 || warmup < 0 || reps < 1 ) {
+    cerr << "ERROR: LachesisBench: Need N_CHROMS >= 1, N_CONTIGS >= 2 * N_CHROMS, N_LINKS >= 1, LSD_LINKS >= 1, WARMUP >= 0, REPS >= 1" << endl;
+    return 1;
+  }
+
+  set<string> kernels;
+  if ( args["KERNELS"] != "all" ) {
+    vector<string> names;
+    boost::split( names, args["KERNELS"], boost::is_any_of( "," ) );
+    kernels.insert( names.begin(), names.end() );
+  }
+  const auto wanted = [&kernels]( const string & name ) { return kernels.empty() || kernels.count( name ); };
+  const function<void()> no_setup = [](){};
+
+
+  // Make the synthetic dataset, and the objects the kernels are run on.
+  cout << "LachesisBench: " << N_contigs << " contigs on " << N_chroms << " chromosomes, " << N_links << " Hi-C links; "
+       << warmup << " warm-up run(s) and " << reps << " timed run(s) per kernel" << endl;
+
+  const BenchData data = MakeBenchData( N_chroms, N_contigs, N_links, args.ValueAsInt( "SEED" ) );
+
+  ChromLinkMatrix * clm;
+  {
+    QuietCout quiet;
+    clm = new ChromLinkMatrix( "bench", data.clusters[0].size() );
+    vector<ChromLinkMatrix *> CLMs( N_chroms, NULL );
+    CLMs[0] = clm;
+    LoadDeNovoCLMsFromLinks( data.links, data.contig_lengths, data.contig_RE_sites, vector<string>(), data.clusters, CLMs, LinkLibraries() );
+  }
+  const int N = clm->N_contigs();
+  const ContigOrdering true_order( N ); // the contigs' local IDs are in genome order
+
+  cout << "LachesisBench: The benchmarked CLM has " << N << " contigs" << endl << endl;
+  printf( "%-26s %12s %10s %10s %14s %14s\n", "KERNEL", "OPS/REP", "MEDIAN_MS", "MIN_MS", "NS/OP", "OPS/S" );
+
+
+  if ( wanted( "LoadCLMs" ) ) {
+    vector<ChromLinkMatrix *> CLMs( N_chroms, NULL );
+    Benchmark( "LoadCLMs", N_links, warmup, reps,
+	       [&]() {
+		 for ( int i = 0; i < N_chroms; i++ ) { delete CLMs[i]; CLMs[i] = new ChromLinkMatrix( "bench", data.clusters[i].size() ); }
+	       },
+	       [&]() { LoadDeNovoCLMsFromLinks( data.links, data.contig_lengths, data.contig_RE_sites, vector<string>(), data.clusters, CLMs, LinkLibraries() ); } );
+    for ( int i = 0; i < N_chroms; i++ ) delete CLMs[i];
+  }
+
+
+  if ( wanted( "OrderingScore" ) )
+    Benchmark( "OrderingScore", 1, warmup, reps, no_setup, [&]() { sink += clm->OrderingScore( true_order, true ); } );
+
+
+  if ( wanted( "OrderingScoreShred" ) )
+    Benchmark( "OrderingScoreShred", N, warmup, reps, no_setup,
+	       [&]() { for ( int i = 0; i < N; i++ ) sink += clm->OrderingScore( true_order, true, i, i+1 ); } );
+
+
+  if ( wanted( "ContigOrientLogLikelihood" ) )
+    Benchmark( "ContigOrientLogLikelihood", 4 * ( N - 1 ), warmup, reps, no_setup,
+	       [&]() {
+		 for ( int i = 0; i + 1 < N; i++ )
+		   for ( int rc = 0; rc < 4; rc++ )
+		     sink += clm->ContigOrientLogLikelihood( i, rc & 2, i+1, rc & 1 );
+	       } );
+
+
+  if ( wanted( "FindSpanningTree" ) )
+    Benchmark( "FindSpanningTree", 1, warmup, reps, no_setup, [&]() { sink += clm->FindSpanningTree( 1 ).size(); } );
+
+
+  if ( wanted( "FindBestPath" ) ) {
+    vector<double> log_likes( 4 * ( N - 1 ) );
+    for ( int i = 0; i + 1 < N; i++ )
+      clm->AdjacencyOrientLogLikelihoods( i, i+1, &log_likes[4*i] );
+    WDAG wdag = true_order.OrientationWDAG( log_likes );
+    Benchmark( "FindBestPath", 1, warmup, reps, no_setup, [&]() { wdag.FindBestPath(); sink += wdag.BestWeight(); } );
+  }
+
+
+  if ( wanted( "log_likelihood_D" ) ) {
+    const string LSD_file = ( boost::filesystem::temp_directory_path() / boost::filesystem::unique_path( "LachesisBench.%%%%%%.LSD.txt" ) ).string();
+    WriteBenchLSDFile( LSD_file );
+    LinkSizeDistribution * lsd;
+    {
+      QuietCout quiet;
+      lsd = new LinkSizeDistribution( LSD_file );
+    }
+    boost::filesystem::remove( LSD_file );
+
+    // The links between two 200-Kb contigs: the distances between uniformly random points on each.
+    mt19937_64 rng( args.ValueAsInt( "SEED" ) );
+    uniform_int_distribution<int> uniform( 1, 200000 );
+    vector<int> links( LSD_links );
+    for ( int i = 0; i < LSD_links; i++ ) links[i] = uniform( rng ) + uniform( rng );
+    vector<double> log_factorial( LSD_links + 1, 0 );
+    for ( int i = 2; i <= LSD_links; i++ ) log_factorial[i] = log_factorial[i-1] + log( i );
+
+    const int N_D = 100;
+    Benchmark( "log_likelihood_D", N_D, warmup, reps, no_setup,
+	       [&]() { for ( int D = 0; D < N_D; D++ ) sink += lsd->log_likelihood_D( 1000 * D, 200000, 200000, 1.0, links, log_factorial ); } );
+    delete lsd;
+  }
+
+
+  if ( wanted( "AHClustering" ) ) {
+    GenomeLinkMatrix * glm;
+    {
+      QuietCout quiet;
+      glm = new GenomeLinkMatrix( "bench", data.contig_lengths, data.contig_RE_sites, data.links );
+    }
+    GenomeLinkMatrix * copy = NULL;
+    Benchmark( "AHClustering", N_contigs - N_chroms, warmup, reps,
+	       [&]() {
+		 delete copy;
+		 copy = new GenomeLinkMatrix( *glm );
+		 copy->NormalizeToDeNovoContigLengths( true );
+	       },
+	       [&]() { copy->AHClustering( N_chroms, vector<int>(), 0, 3, false, NULL ); } );
+    delete copy;
+    delete glm;
+  }
+
+
+  delete clm;
+  return 0;
+}
@@ -0,0 +1,287 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+// For documentation, see LinkArena.h
+#include "LinkArena.h"
+
+// C libraries
+#include <assert.h>
+#include <stdint.h> // UINT32_MAX
+#include <stdlib.h> // exit
+
+#include <algorithm> // max_element
+#include <iostream>
+
+
+
+
+// Encode: Write each of the distances in WIDTH bytes, low byte first, starting at p.
+template<int WIDTH> static void
+Encode( const vector<int> & dists, uint8_t * p )
+{
+  for ( size_t k = 0; k < dists.size(); k++ ) {
+    const uint32_t dist = dists[k];
+    for ( int b = 0; b < WIDTH; b++ )
+      *p++ = uint8_t( dist >> ( 8 * b ) );
+  }
+}
+
+
+
+vector<int>
+LinkBin::ToVector() const
+{
+  vector<int> dists;
+  dists.reserve( _size );
+  for ( const_iterator it = begin(); it != end(); ++it )
+    dists.push_back( *it );
+  return dists;
+}
+
+
+
+LinkArena::LinkArena( const int N_bins )
+  : _N_bins( N_bins ), _row_offset_data( N_bins + 1, 0 ), _row_bin_data( N_bins + 1, 0 ), _byte_data( sizeof(uint32_t), 0 )
+{
+  IndexBins();
+  PointToData();
+}
+
+
+
+LinkArena::LinkArena( const vector<int> * const * bins, const int N_bins )
+  : _N_bins( N_bins ), _row_offset_data( N_bins + 1, 0 ), _row_bin_data( N_bins + 1, 0 )
+{
+  // Encode the bins in one pass, and make the sparse index as we go.
+  for ( int X = 0; X < N_bins; X++ ) {
+    const uint64_t row_start = _byte_data.size();
+    for ( int Y = 0; Y < N_bins; Y++ ) {
+      const vector<int> & dists = bins[X][Y];
+      if ( dists.empty() ) continue;
+      if ( dists.size() > LinkBin::SIZE_MASK ) {
+	cerr << "ERROR: LinkArena: " << dists.size() << " links between one pair of contigs is more than a LinkArena can hold.  Try using fewer Hi-C reads." << endl;
+	exit(1);
+      }
+      if ( _column_data.size() + 1 >= UINT32_MAX ) {
+	cerr << "ERROR: LinkArena: Too many pairs of contigs with links for a LinkArena to index.  Try ordering fewer contigs at once." << endl;
+	exit(1);
+      }
+      _column_data.push_back( Y );
+      _offset_data.push_back( _byte_data.size() - row_start ); // if this overflows, so does the row's size, below
+
+      // The distances are stored as unsigned 32-bit values, so a negative one takes 4 bytes.
+      const uint32_t max_dist = *max_element( dists.begin(), dists.end(), []( int a, int b ) { return uint32_t(a) < uint32_t(b); } );
+      const uint32_t width = max_dist < ( 1u << 8 ) ? 1 : max_dist < ( 1u << 16 ) ? 2 : max_dist < ( 1u << 24 ) ? 3 : 4;
+      const uint32_t header = uint32_t( dists.size() ) | ( width - 1 ) << 30;
+      const size_t start = _byte_data.size();
+      _byte_data.resize( start + sizeof(uint32_t) + dists.size() * width );
+      uint8_t * p = _byte_data.data() + start;
+      for ( int b = 0; b < 4; b++ )
+	*p++ = uint8_t( header >> ( 8 * b ) );
+      switch ( width ) {
+      case 1: Encode<1>( dists, p ); break;
+      case 2: Encode<2>( dists, p ); break;
+      case 3: Encode<3>( dists, p ); break;
+      default: Encode<4>( dists, p ); break;
+      }
+    }
+    const uint64_t row_size = _byte_data.size() - row_start;
+    if ( row_size > UINT32_MAX ) {
+      cerr << "ERROR: LinkArena: The links of one contig take " << row_size << " bytes, more than a LinkArena can index.  Try using fewer Hi-C reads." << endl;
+      exit(1);
+    }
+    _row_offset_data[X+1] = _byte_data.size();
+    _row_bin_data[X+1] = _column_data.size();
+  }
+  _byte_data.resize( _byte_data.size() + sizeof(uint32_t), 0 ); // padding, so that LinkBin::const_iterator can always read 4 bytes
+  _byte_data.shrink_to_fit();
+  IndexBins();
+  PointToData();
+}
+
+
+
+void
+LinkArena::NonEmptyBins( const int X, vector<int> & Ys ) const
+{
+  Ys.clear();
+  if ( sparse() ) {
+    Ys.insert( Ys.end(), _columns + _row_bins[X], _columns + _row_bins[X+1] );
+    return;
+  }
+  const uint32_t * offsets = _offsets + size_t( X ) * ( _N_bins + 1 );
+  for ( int Y = 0; Y < _N_bins; Y++ )
+    if ( offsets[Y] != offsets[Y+1] ) Ys.push_back( Y );
+}
+
+
+
+void
+LinkArena::Truncate( const int X, const int Y, const int N_keep )
+{
+  assert( !_store );
+  assert( N_keep >= 0 && N_keep <= N_links( X, Y ) );
+  if ( N_keep == N_links( X, Y ) ) return;
+  // Replace the size in the bin's header, and keep its width.
+  uint8_t * header = _byte_data.data() + _row_offsets[X] + _offsets[ sparse() ? Find( X, Y ) : size_t( X ) * ( _N_bins + 1 ) + Y ];
+  header[0] = uint8_t( N_keep );
+  header[1] = uint8_t( N_keep >> 8 );
+  header[2] = uint8_t( N_keep >> 16 );
+  header[3] = uint8_t( ( header[3] & 0xc0 ) | ( N_keep >> 24 ) );
+}
+
+
+
+void
+LinkArena::Unpack( vector<int> ** bins ) const
+{
+  vector<int> Ys;
+  for ( int X = 0; X < _N_bins; X++ ) {
+    NonEmptyBins( X, Ys );
+    for ( size_t i = 0; i < Ys.size(); i++ ) {
+      const LinkBin bin = Bin( X, Ys[i] );
+      for ( LinkBin::const_iterator it = bin.begin(); it != bin.end(); ++it )
+	bins[X][ Ys[i] ].push_back( *it );
+    }
+  }
+}
+
+
+
+size_t
+LinkArena::IndexBytes( const bool sparse, const int N_bins, const size_t N_nonempty, const size_t N_slots )
+{
+  const size_t N_row_offsets = size_t( N_bins ) + 1;
+  if ( !sparse ) return N_row_offsets * sizeof(uint64_t) + size_t( N_bins ) * ( N_bins + 1 ) * sizeof(uint32_t);
+  return 2 * N_row_offsets * sizeof(uint64_t) + N_nonempty * 2 * sizeof(uint32_t) + N_slots * sizeof(uint32_t);
+}
+
+
+
+void
+LinkArena::IndexBins()
+{
+  const size_t N_nonempty = _row_bin_data[_N_bins];
+  _N_slots = 1;
+  while ( _N_slots <= 2 * N_nonempty ) _N_slots *= 2;
+
+  // If the dense index is smaller, replace the sparse index with it.
+  if ( IndexBytes( false, _N_bins, 0, 0 ) <= IndexBytes( true, _N_bins, N_nonempty, _N_slots ) ) {
+    vector<uint32_t> offsets( size_t( _N_bins ) * ( _N_bins + 1 ) );
+    for ( int X = 0; X < _N_bins; X++ ) {
+      // Each bin's offset is that of the first non-empty bin at or after it in its row, or the row's size; so an empty bin has the same offset as the next.
+      uint32_t * row = offsets.data() + size_t( X ) * ( _N_bins + 1 );
+      uint64_t i = _row_bin_data[X];
+      for ( int Y = 0; Y <= _N_bins; Y++ ) {
+	while ( i < _row_bin_data[X+1] && _column_data[i] < uint32_t( Y ) ) i++;
+	row[Y] = i < _row_bin_data[X+1] ? _offset_data[i] : _row_offset_data[X+1] - _row_offset_data[X];
+      }
+    }
+    _offset_data.swap( offsets );
+    vector<uint64_t>().swap( _row_bin_data );
+    vector<uint32_t>().swap( _column_data );
+    vector<uint32_t>().swap( _slot_data );
+    _N_slots = 0;
+    return;
+  }
+
+  // Otherwise, make the hash table.
+  _column_data.shrink_to_fit();
+  _offset_data.shrink_to_fit();
+  _slot_data.assign( _N_slots, 0 );
+  for ( int X = 0; X < _N_bins; X++ )
+    for ( uint64_t i = _row_bin_data[X]; i < _row_bin_data[X+1]; i++ ) {
+      size_t s = Slot( X, _column_data[i] );
+      while ( _slot_data[s] != 0 ) s = ( s + 1 ) & ( _N_slots - 1 );
+      _slot_data[s] = i + 1;
+    }
+}
+
+
+
+shared_ptr<LinkArena>
+LinkArena::FromStore( const shared_ptr<const LinkStore> & store, const int N_bins )
+{
+  // A store holds 3 sections if the arena uses the dense index, and 6 if it uses the sparse index.
+  if ( !store || ( store->N_sections() != 3 && store->N_sections() != 6 ) ) return shared_ptr<LinkArena>();
+  const bool sparse = store->N_sections() == 6;
+  size_t N_row_offsets = 0, N_row_bins = 0, N_columns = 0, N_offsets = 0, N_slots = 0, N_bytes = 0;
+  const uint64_t * row_offsets = store->Section<uint64_t>( 0, N_row_offsets );
+  const uint64_t * row_bins = sparse ? store->Section<uint64_t>( 1, N_row_bins ) : NULL;
+  const uint32_t * columns = sparse ? store->Section<uint32_t>( 2, N_columns ) : NULL;
+  const uint32_t * offsets = store->Section<uint32_t>( sparse ? 3 : 1, N_offsets );
+  const uint32_t * slots = sparse ? store->Section<uint32_t>( 4, N_slots ) : NULL;
+  const uint8_t * bytes = store->Section<uint8_t>( sparse ? 5 : 2, N_bytes );
+  if ( row_offsets == NULL || offsets == NULL || bytes == NULL ) return shared_ptr<LinkArena>();
+  if ( N_row_offsets != size_t( N_bins ) + 1 || N_bytes != row_offsets[N_bins] + sizeof(uint32_t) || row_offsets[0] != 0 ) return shared_ptr<LinkArena>();
+
+  // Check that the rows fit together.  (This doesn't look at the bins themselves, so that their pages are only read in when they're used.)
+  if ( sparse ) {
+    if ( row_bins == NULL || columns == NULL || slots == NULL || N_row_bins != size_t( N_bins ) + 1 || row_bins[0] != 0 ) return shared_ptr<LinkArena>();
+    if ( N_columns != row_bins[N_bins] || N_offsets != row_bins[N_bins] || N_slots <= 2 * N_columns || ( N_slots & ( N_slots - 1 ) ) != 0 )
+      return shared_ptr<LinkArena>();
+    for ( int X = 0; X < N_bins; X++ )
+      if ( row_offsets[X+1] < row_offsets[X] || row_offsets[X+1] - row_offsets[X] > UINT32_MAX || row_bins[X+1] < row_bins[X] ) return shared_ptr<LinkArena>();
+  }
+  else {
+    if ( N_offsets != size_t( N_bins ) * ( N_bins + 1 ) ) return shared_ptr<LinkArena>();
+    for ( int X = 0; X < N_bins; X++ )
+      if ( row_offsets[X+1] < row_offsets[X] || row_offsets[X+1] - row_offsets[X] != offsets[ size_t( X ) * ( N_bins + 1 ) + N_bins ] )
+	return shared_ptr<LinkArena>();
+  }
+
+  shared_ptr<LinkArena> arena( new LinkArena( 0 ) );
+  arena->_N_bins = N_bins;
+  arena->_row_offsets = row_offsets;
+  arena->_row_bins = row_bins;
+  arena->_columns = columns;
+  arena->_offsets = offsets;
+  arena->_slots = slots;
+  arena->_N_slots = N_slots;
+  arena->_bytes = bytes;
+  arena->_store = store;
+  return arena;
+}
+
+
+
+void
+LinkArena::AddToStore( LinkStore::Writer & writer ) const
+{
+  writer.AddSection( _row_offsets, _N_bins + 1 );
+  if ( sparse() ) {
+    writer.AddSection( _row_bins, _N_bins + 1 );
+    writer.AddSection( _columns, _row_bins[_N_bins] );
+    writer.AddSection( _offsets, _row_bins[_N_bins] );
+    writer.AddSection( _slots, _N_slots );
+  }
+  else writer.AddSection( _offsets, size_t( _N_bins ) * ( _N_bins + 1 ) );
+  writer.AddSection( _bytes, _row_offsets[_N_bins] + sizeof(uint32_t) );
+}
+
+
+
+void
+LinkArena::PointToData()
+{
+  const bool sparse = !_slot_data.empty();
+  _row_offsets = _row_offset_data.data();
+  _row_bins = sparse ? _row_bin_data.data() : NULL;
+  _columns = sparse ? _column_data.data() : NULL;
+  _offsets = _offset_data.data();
+  _slots = sparse ? _slot_data.data() : NULL;
+  _bytes = _byte_data.data();
+}
@@ -0,0 +1,219 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * LinkArena.h
+ *
+ * LinkArena: The link distances of a ChromLinkMatrix, packed into a single block of memory.  A ChromLinkMatrix has (2*N_contigs)^2 bins, one for each pair of
+ * oriented contigs, and each bin holds the distances of the links between that pair.  While the links are loaded, each bin is a vector<int>; once they're all
+ * loaded, the bins are packed into a LinkArena, which is all that the ordering algorithms read.
+ *
+ * Each non-empty bin is stored as a 4-byte header, followed by its distances.  All the distances in a bin take the same number of bytes (1 to 4, low byte
+ * first): the fewest that hold the bin's largest distance.  The header holds the number of distances in its low 30 bits, and that width, less 1, in its high
+ * 2 bits.  Distances are at most the lengths of two contigs, so they mostly take 3 bytes.  The bins are laid out row by row, and a table of offsets locates
+ * each row in the block.  An empty bin has no bytes at all.  The bins in a row are found through one of two indexes, whichever is smaller:
+ * -- Dense: a table of the 32-bit offset of every bin [X,Y] in its row.  An empty bin costs 4 bytes here, instead of the 24 of an empty vector<int>, and
+ *    finding a bin is one lookup.  A CLM of contigs that are mostly linked to each other, as in a small group, is best stored this way.
+ * -- Sparse: in compressed sparse row format, each row lists the columns Y of its non-empty bins, in increasing order, each with the 32-bit offset of the bin
+ *    in the row; and a hash table (open addressing, with linear probing) finds a bin from [X,Y], since a binary search in the row makes the scoring loops
+ *    several times slower.  This takes ~20 bytes per non-empty bin, and nothing per empty bin, so in a large group, where most contig pairs have no links,
+ *    it's much smaller than the dense table, whose size grows with (2*N_contigs)^2.
+ * NonEmptyBins() lists the non-empty bins of a row.  With the sparse index, this takes time proportional to their number; with the dense index, it scans the
+ * row, but then the row is mostly full anyway.
+ *
+ * The distances keep the order in which they were loaded, rather than being sorted: link #k is the k'th element of each of its contig pair's orientation
+ * bins, which is how ChromLinkMatrix::LinkWeight() finds its library and bootstrap weight, and the scoring loops add up their terms in this order.  In this
+ * order, storing each distance as its difference from the last, as varints, saves only ~3% over this; and since each varint can only be found by decoding the
+ * one before it, it makes the scoring loops much slower.
+ *
+ * A LinkArena's arrays can be written to a link store (see LinkStore.h) as they are, since they hold only offsets; a LinkArena can then be made from the
+ * mapped link store, and reads its links straight from the mapping.  Such a LinkArena can't be modified.
+ *
+ * LinkBin: A view of one bin in a LinkArena.  Its const_iterator decodes the distances one at a time, so the scoring loops can stream through a bin without
+ * making a vector<int> of it.  A LinkBin is only valid while its LinkArena exists and isn't modified.
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _LINK_ARENA__H
+#define _LINK_ARENA__H
+
+
+#include <inttypes.h> // int32_t, uint32_t, uint64_t
+#include <stddef.h> // NULL
+#include <vector>
+#include <memory> // shared_ptr
+using namespace std;
+
+#include "LinkStore.h"
+
+
+
+
+class LinkBin
+{
+ public:
+
+  // Iterate over the distances in a bin, in order, decoding each one as it's read.
+  class const_iterator
+  {
+  public:
+    const_iterator( const uint8_t * p, const int width ) : _p(p), _width(width), _mask( width == 4 ? ~uint32_t(0) : ( uint32_t(1) << ( 8 * width ) ) - 1 ) {}
+
+    // Read 4 bytes and keep the distance's; the arena is padded so that this is always safe.
+    int operator*() const { return int( ( _p[0] | uint32_t( _p[1] ) << 8 | uint32_t( _p[2] ) << 16 | uint32_t( _p[3] ) << 24 ) & _mask ); }
+    const_iterator & operator++() { _p += _width; return *this; }
+    bool operator==( const const_iterator & it ) const { return _p == it._p; }
+    bool operator!=( const const_iterator & it ) const { return _p != it._p; }
+
+  private:
+    const uint8_t * _p; // the next distance
+    int _width;
+    uint32_t _mask;
+  };
+
+  LinkBin() : _data(NULL), _size(0), _width(1) {}
+  // Constructor: The bin whose header is at data, or an empty bin if data is NULL.
+  explicit LinkBin( const uint8_t * data ) : _data(NULL), _size(0), _width(1) {
+    if ( data == NULL ) return;
+    const uint32_t header = data[0] | uint32_t( data[1] ) << 8 | uint32_t( data[2] ) << 16 | uint32_t( data[3] ) << 24;
+    _data = data + sizeof(uint32_t);
+    _size = header & SIZE_MASK;
+    _width = ( header >> 30 ) + 1;
+  }
+
+  int size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  const_iterator begin() const { return const_iterator( _data, _width ); }
+  const_iterator end() const { return const_iterator( _data + _size * _width, _width ); }
+
+  // ToVector: Decode the whole bin.  For the places that need a vector<int> of the distances; the scoring loops should iterate instead.
+  vector<int> ToVector() const;
+
+  static const uint32_t SIZE_MASK = ( uint32_t(1) << 30 ) - 1; // the bits of a bin's header that hold its size
+
+ private:
+  const uint8_t * _data; // the first distance
+  int _size;
+  int _width; // bytes per distance
+};
+
+
+
+
+class LinkArena
+{
+ public:
+
+  // Constructor: An arena with N_bins x N_bins empty bins.
+  LinkArena( const int N_bins );
+  // Constructor: Pack the N_bins x N_bins bins of link distances in bins[X][Y].
+  LinkArena( const vector<int> * const * bins, const int N_bins );
+
+  // FromStore: The arena of N_bins x N_bins bins in a link store written by AddToStore(), read in place.  Return NULL if the store doesn't hold such an arena.
+  static shared_ptr<LinkArena> FromStore( const shared_ptr<const LinkStore> & store, const int N_bins );
+  // AddToStore: Add this arena's arrays to a link store.  They're written when the writer's Write() is called, so this arena must still exist then.
+  void AddToStore( LinkStore::Writer & writer ) const;
+
+  int N_bins() const { return _N_bins; }
+  // sparse: True if this arena uses the sparse index.
+  bool sparse() const { return _slots != NULL; }
+
+  // Bin: The links in bin [X,Y].
+  LinkBin Bin( const int X, const int Y ) const {
+    if ( !sparse() ) {
+      const size_t i = size_t( X ) * ( _N_bins + 1 ) + Y;
+      return LinkBin( _offsets[i] == _offsets[i+1] ? NULL : _bytes + _row_offsets[X] + _offsets[i] );
+    }
+    const size_t i = Find( X, Y );
+    return LinkBin( i == NOT_FOUND ? NULL : _bytes + _row_offsets[X] + _offsets[i] );
+  }
+  // NonEmptyBins: Fill Ys with the columns Y of the non-empty bins [X,Y] in row X, in increasing order.  (A bin emptied by Truncate() may still be listed.)
+  void NonEmptyBins( const int X, vector<int> & Ys ) const;
+  // empty: True if no bin has any links.
+  bool empty() const { return _row_offsets[_N_bins] == 0; }
+  // N_links: The number of links in bin [X,Y].
+  int N_links( const int X, const int Y ) const { return Bin( X, Y ).size(); }
+
+  // Truncate: Keep only the first N_keep links in bin [X,Y].  The bin's bytes stay where they are; the rest of them just aren't read.  This can't be called
+  // on an arena from a link store.
+  void Truncate( const int X, const int Y, const int N_keep );
+
+  // Unpack: Append the distances in each bin [X,Y] to bins[X][Y], the reverse of the packing constructor.
+  void Unpack( vector<int> ** bins ) const;
+
+  // N_bytes: The memory used by this arena.
+  size_t N_bytes() const { return IndexBytes( sparse(), _N_bins, N_nonempty(), _N_slots ) + _row_offsets[_N_bins] + sizeof(uint32_t); }
+
+ private:
+
+  LinkArena( const LinkArena & ); // the pointers below may point into the vectors below, so an arena can't be copied
+  LinkArena & operator=( const LinkArena & );
+
+  static const size_t NOT_FOUND = size_t(-1);
+
+  // N_nonempty: The number of non-empty bins in the sparse index, or 0 with the dense index.
+  size_t N_nonempty() const { return sparse() ? _row_bins[_N_bins] : 0; }
+  // IndexBytes: The size of the row offsets and the dense or sparse index of an arena.
+  static size_t IndexBytes( const bool sparse, const int N_bins, const size_t N_nonempty, const size_t N_slots );
+
+  // Slot: The slot in the hash table where the search for bin [X,Y] starts.
+  size_t Slot( const int X, const int Y ) const {
+    return ( ( uint64_t( X ) * 0x9e3779b97f4a7c15ULL ) ^ ( uint64_t( Y ) * 0xc2b2ae3d27d4eb4fULL ) ) >> 32 & ( _N_slots - 1 );
+  }
+  // Find: With the sparse index, the index in _columns and _offsets of bin [X,Y], or NOT_FOUND if it's empty.
+  size_t Find( const int X, const int Y ) const {
+    const uint64_t first = _row_bins[X], last = _row_bins[X+1];
+    for ( size_t s = Slot( X, Y );; s = ( s + 1 ) & ( _N_slots - 1 ) ) {
+      if ( _slots[s] == 0 ) return NOT_FOUND;
+      const uint64_t i = _slots[s] - 1;
+      if ( i >= first && i < last && _columns[i] == uint32_t( Y ) ) return i;
+    }
+  }
+
+  // IndexBins: Given the sparse index in _row_bin_data, _column_data, and _offset_data, keep it and add its hash table, or replace it with the dense
+  // index, whichever is smaller.
+  void IndexBins();
+
+  // PointToData: Point the arrays at the vectors that hold them.
+  void PointToData();
+
+  int _N_bins;
+  const uint64_t * _row_offsets; // the offset in _bytes of each row X, and the total size of the rows at the end
+  const uint8_t * _bytes; // the rows, then padding
+
+  // The dense index: _offsets holds the offset of each bin [X,Y] from the start of its row, at index X*(N_bins+1)+Y, and the size of row X at
+  // X*(N_bins+1)+N_bins.  The sparse index: _offsets holds the offset of each non-empty bin from the start of its row, and:
+  const uint32_t * _offsets;
+  const uint64_t * _row_bins; // the index in _columns and _offsets of the first non-empty bin in each row X, and the number of non-empty bins at the end
+  const uint32_t * _columns; // the column Y of each non-empty bin
+  const uint32_t * _slots; // the hash table: each slot is 0, or the index of a non-empty bin + 1; NULL with the dense index
+  size_t _N_slots; // a power of 2, more than twice the number of non-empty bins
+
+  // The arrays are either in these vectors, or in the link store.
+  vector<uint64_t> _row_offset_data, _row_bin_data;
+  vector<uint32_t> _offset_data, _column_data, _slot_data;
+  vector<uint8_t> _byte_data;
+  shared_ptr<const LinkStore> _store;
+};
+
+
+#endif
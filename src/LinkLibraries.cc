@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+// For documentation, see LinkLibraries.h
+#include "LinkLibraries.h"
+
+// C libraries
+#include <assert.h>
+#include <stdlib.h> // exit
+
+// STL declarations
+#include <iostream>
+#include <algorithm> // min_element
+
+
+
+
+LinkLibraries::LinkLibraries()
+  : _names( 1, "all" ),
+    _weights( 1, 1.0 ),
+    _RE_sites( 1 ),
+    _RE_factors( 1 ),
+    _min_weight( 1.0 ),
+    _default( true )
+{}
+
+
+
+void
+LinkLibraries::AddLibrary( const string & name, const double weight, const vector<int> & RE_sites )
+{
+  assert( weight > 0 );
+  if ( _default ) {
+    _names.clear();
+    _weights.clear();
+    _RE_sites.clear();
+    _default = false;
+  }
+
+  _names.push_back( name );
+  _weights.push_back( weight );
+  _RE_sites.push_back( RE_sites );
+  _min_weight = *min_element( _weights.begin(), _weights.end() );
+  FindREFactors();
+}
+
+
+
+void
+LinkLibraries::SetReferenceRESites( const vector<int> & RE_sites )
+{
+  _reference_RE_sites = RE_sites;
+  FindREFactors();
+}
+
+
+
+void
+LinkLibraries::AssignFile( const string & SAM_file, const int library )
+{
+  assert( library >= 0 && library < N() );
+  _file_libraries[SAM_file] = library;
+}
+
+
+
+void
+LinkLibraries::AssignReadGroup( const string & read_group, const int library )
+{
+  assert( library >= 0 && library < N() );
+  _read_group_libraries[read_group] = library;
+}
+
+
+
+int
+LinkLibraries::FileLibrary( const string & SAM_file ) const
+{
+  if ( _default ) return 0;
+  map<string,int>::const_iterator it = _file_libraries.find( SAM_file );
+  return it == _file_libraries.end() ? -1 : it->second;
+}
+
+
+
+bool
+LinkLibraries::FileMayContain( const string & SAM_file, const int library ) const
+{
+  if ( FileLibrary( SAM_file ) == library ) return true;
+
+  // If the library has read groups, they could be in any file.
+  for ( map<string,int>::const_iterator it = _read_group_libraries.begin(); it != _read_group_libraries.end(); ++it )
+    if ( it->second == library ) return true;
+  return false;
+}
+
+
+
+int
+LinkLibraries::Library( const string & SAM_file, const char * read_group ) const
+{
+  if ( read_group != NULL ) {
+    map<string,int>::const_iterator it = _read_group_libraries.find( read_group );
+    if ( it != _read_group_libraries.end() ) return it->second;
+  }
+
+  int library = FileLibrary( SAM_file );
+  if ( library == -1 ) {
+    cerr << "ERROR: LinkLibraries: A read pair in SAM file " << SAM_file << " (read group " << ( read_group ? read_group : "none" )
+	 << ") isn't assigned to any library.  Every SAM file and read group must be assigned to a library in LIBRARIES_FILE." << endl;
+    exit(1);
+  }
+  return library;
+}
+
+
+
+double
+LinkLibraries::LinkWeight( const int contig1, const int contig2, const int library ) const
+{
+  double weight = _weights[library] / _min_weight;
+  const vector<double> & factors = _RE_factors[library];
+  if ( !factors.empty() ) weight *= factors[contig1] * factors[contig2];
+  return weight;
+}
+
+
+
+// FindREFactors: For each library with its own RE sites, find the RE factor of each contig: the ratio of the contig's share of the reference RE sites to its
+// share of the library's RE sites.  1 is added to every count first, as in GenomeLinkMatrix::LoadRESitesFile().  The factors average out to about 1, so
+// renormalizing doesn't change the overall weight of a library.
+void
+LinkLibraries::FindREFactors()
+{
+  _RE_factors.resize( N() );
+
+  for ( int i = 0; i < N(); i++ ) {
+    _RE_factors[i].clear();
+    if ( _RE_sites[i].empty() || _reference_RE_sites.empty() ) continue;
+    assert( _RE_sites[i].size() == _reference_RE_sites.size() ); // if this fails, the RE sites are for different assemblies
+
+    double total = 0, ref_total = 0;
+    for ( size_t j = 0; j < _RE_sites[i].size(); j++ ) {
+      total     += _RE_sites[i][j] + 1;
+      ref_total += _reference_RE_sites[j] + 1;
+    }
+
+    for ( size_t j = 0; j < _RE_sites[i].size(); j++ )
+      _RE_factors[i].push_back( double( _reference_RE_sites[j] + 1 ) / ( _RE_sites[i][j] + 1 ) * total / ref_total );
+  }
+}
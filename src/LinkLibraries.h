@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * LinkLibraries.h
+ *
+ * A LinkLibraries object says which Hi-C library each read pair came from, and how much the links from each library should count.  This matters when the
+ * data combine several libraries, made with different restriction enzymes, fragment sizes, or sequencing depths: without weights, a deep library of low
+ * quality swamps a shallow library of high quality.  The libraries are described in the file named by the INI parameter LIBRARIES_FILE (see
+ * RunParams::LoadLinkLibraries() and bin/INIs/test_case.ini.)
+ *
+ * Each library has:
+ * -- A weight.  Each link from the library counts this many times, in the GenomeLinkMatrix and in the ChromLinkMatrices.
+ * -- The number of restriction sites on each contig, for the library's own enzyme.  Link densities are normalized to each library's own RE sites, so
+ *    libraries made with different enzymes can be combined.  A library made with the enzyme of RE_SITE_SEQ just uses the usual RE sites file.
+ * -- Its own LinkSizeDistribution, which is made by passing the LinkLibraries and the library ID to the LinkSizeDistribution constructor.
+ *
+ * Read pairs are assigned to libraries by SAM/BAM file, or by read group (the RG tag of the first read in the pair), which takes precedence.  Every read pair
+ * must be assigned to some library.  Libraries are numbered in the order in which they're added.
+ *
+ * The weights are applied while the links are loaded, without storing anything extra per link:
+ * -- GenomeLinkMatrix: each link adds LinkWeight() to its entry in the matrix, instead of 1.  The matrix holds integer counts, so the weights are scaled so
+ *    that the links of the least-weighted library count 1 each, and the result is rounded.
+ * -- ChromLinkMatrix: the links between each pair of contigs are loaded one library at a time, so each bin holds a run of links from each library, in
+ *    library order.  The CLM only records how many links each library contributed to each contig pair, and applies each library's weight to its whole run.
+ *
+ * The default LinkLibraries has a single library, of weight 1, containing every read pair.  With a single library that uses the reference RE sites, nothing
+ * is weighted, and every result is exactly the same as it would be without a LinkLibraries object.
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _LINK_LIBRARIES__H
+#define _LINK_LIBRARIES__H
+
+
+#include <string>
+#include <vector>
+#include <map>
+using namespace std;
+
+
+
+class LinkLibraries
+{
+ public:
+
+  // The default LinkLibraries: one library that contains every read pair.
+  LinkLibraries();
+
+  // AddLibrary: Add a library.  RE_sites gives the number of restriction sites on each contig (as in an RE sites file) for this library's enzyme, or is
+  // empty if the library was made with the enzyme of the reference RE sites (see SetReferenceRESites.)  The first call replaces the default library.
+  void AddLibrary( const string & name, const double weight, const vector<int> & RE_sites = vector<int>() );
+  // SetReferenceRESites: The RE sites that the GenomeLinkMatrix and ChromLinkMatrices are normalized to (i.e., the RE sites file of RE_SITE_SEQ.)
+  void SetReferenceRESites( const vector<int> & RE_sites );
+
+  // Assign all of the read pairs in a SAM/BAM file, or all of the read pairs in a read group, to a library.
+  void AssignFile( const string & SAM_file, const int library );
+  void AssignReadGroup( const string & read_group, const int library );
+
+
+  /* QUERY FUNCTIONS */
+
+  int N() const { return _names.size(); }
+  bool trivial() const { return N() == 1 && _RE_sites[0].empty(); } // if true, nothing is weighted or renormalized
+  const string & name( const int library ) const { return _names[library]; }
+  double weight( const int library ) const { return _weights[library]; }
+
+  // RE_sites: The RE site counts of library's enzyme, for all contigs, as in an RE sites file.  Empty if the library uses the reference RE sites.
+  const vector<int> & RE_sites( const int library ) const { return _RE_sites[library]; }
+
+  // uses_read_groups: True iff any read groups have been assigned, in which case Library() needs each read's RG tag.
+  bool uses_read_groups() const { return !_read_group_libraries.empty(); }
+
+  // FileLibrary: The library that all of the read pairs in this SAM file belong to, unless their read groups say otherwise; -1 if there's none.
+  int FileLibrary( const string & SAM_file ) const;
+  // FileMayContain: True iff there may be read pairs from this library in this SAM file.
+  bool FileMayContain( const string & SAM_file, const int library ) const;
+
+  // Library: The library of a read pair in this SAM file, with this read group (NULL if the read has no RG tag.)  If the read pair isn't assigned to any
+  // library, this reports an error and exits.
+  int Library( const string & SAM_file, const char * read_group ) const;
+
+  // LinkWeight: The amount that a link between these two contigs (IDs in the draft assembly) from this library adds to the GenomeLinkMatrix: the library's
+  // weight, relative to the lowest weight, times the RE factor of each contig.  The RE factor corrects the GenomeLinkMatrix's normalization by the reference RE
+  // sites to a normalization by the library's own RE sites.  This is 1 if trivial().
+  double LinkWeight( const int contig1, const int contig2, const int library ) const;
+
+
+ private:
+
+  vector<string> _names;
+  vector<double> _weights;
+  vector< vector<int> > _RE_sites;
+  vector<int> _reference_RE_sites;
+  vector< vector<double> > _RE_factors; // for each library, the RE factor of each contig; empty if the library uses the reference RE sites
+  double _min_weight;
+  bool _default; // true until AddLibrary() is first called
+
+  map<string,int> _file_libraries;
+  map<string,int> _read_group_libraries;
+
+  void FindREFactors();
+};
+
+
+#endif
@@ -104,10 +104,11 @@ uint_16log2_frac( const double x ) {
 // 4. Read through the SAM file(s) and find the number of links in each bin.
 // 5. Normalize to calculate the link density for each intra-contig bin.
 // 6. Assume the distribution approximates 1/x for large x, and extrapolate to bins beyond the intra-contig link length.
-LinkSizeDistribution::LinkSizeDistribution( const vector<string> & SAM_files )
+LinkSizeDistribution::LinkSizeDistribution( const vector<string> & SAM_files, const LinkLibraries & libraries, const int library )
   : _SAM_files( SAM_files )
 {
   cout << "LinkSizeDistribution!" << endl;
+  if ( library != -1 ) cout << "Using only the read pairs from library " << libraries.name( library ) << endl;
 
   bool verbose = true;
 
@@ -189,6 +190,10 @@ LinkSizeDistribution::LinkSizeDistribution( const vector<string> & SAM_files )
   // Loop over the input SAM files.
   for ( size_t i = 0; i < SAM_files.size(); i++ ) {
 
+    // If we only want one library, only read the files that may contain it, and check the library of each read pair (by the first read's read group.)
+    if ( library != -1 && !libraries.FileMayContain( SAM_files[i], library ) ) continue;
+    const bool check_library = library != -1 && libraries.uses_read_groups();
+
     cout << "Reading Hi-C data from SAM file " << SAM_files[i] << (verbose ? "\t(dot = 1M alignments)" : "" ) << endl;
 
 
@@ -206,6 +211,11 @@ LinkSizeDistribution::LinkSizeDistribution( const vector<string> & SAM_files )
       const bam1_core_t & c1 = aligns.first->core;
       const bam1_core_t & c2 = aligns.second->core;
 
+      if ( check_library ) {
+	uint8_t * RG = bam_aux_get( aligns.first, "RG" );
+	if ( libraries.Library( SAM_files[i], RG ? bam_aux2Z( RG ) : NULL ) != library ) continue;
+      }
+
       passes[0]++;
 
       // Ignore reads with mapping quality 0.
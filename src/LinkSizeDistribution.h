@@ -38,6 +38,9 @@
  * of intra-contig links.  The LinkSizeDistribution object should mainly be used for closer-range links (e.g., when ordering and spacing); for more distant
  * links (e.g., when ordering) it's simpler to just use 1/x.
  *
+ * If the Hi-C data combine several libraries (see LinkLibraries.h), their link sizes may be distributed differently, so each library gets its own
+ * LinkSizeDistribution, made from its own read pairs.
+ *
  *
  *
  * There are two main data structures in the LinkSizeDistribution object:
@@ -63,12 +66,15 @@
 #include <math.h> // sqrt
 using namespace std;
 
+#include "LinkLibraries.h"
+
 
 
 class LinkSizeDistribution
 {
  public:
-  LinkSizeDistribution( const vector<string> & SAM_files );
+  // Find the distribution of link sizes in a set of SAM files.  If library != -1, only use the read pairs from that library (see LinkLibraries.h.)
+  LinkSizeDistribution( const vector<string> & SAM_files, const LinkLibraries & libraries = LinkLibraries(), const int library = -1 );
   LinkSizeDistribution( const string & infile ) { ReadFile( infile ); }
 
 
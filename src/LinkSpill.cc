@@ -0,0 +1,328 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+// For documentation, see LinkSpill.h
+#include "LinkSpill.h"
+
+// C libraries
+#include <assert.h>
+#include <math.h> // llround
+#include <stdlib.h> // exit
+
+// STL declarations
+#include <iostream>
+#include <fstream>
+#include <algorithm> // sort
+#include <queue> // priority_queue
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+
+
+
+
+// A record in a GLM run file: a link ( ( bin1 * N_bins + bin2 ) * N_libraries + library ) and the number of times it appears.
+struct GLMRunRecord {
+  uint64_t key;
+  int64_t count;
+};
+
+// The maximum number of run files that are merged at once.  More runs than this are merged in several passes, to stay well under the open-file limit.
+static const size_t MAX_MERGE_WIDTH = 256;
+
+// The number of CLMLinks read from disk at a time in CLMLinkSpill::ForEachLink().
+static const size_t READ_CHUNK = 4096;
+
+
+
+// Make a filename for a new run file in spill_dir that won't collide with any other.
+static string
+new_run_file( const string & spill_dir, const string & prefix )
+{
+  return ( boost::filesystem::path( spill_dir ) / boost::filesystem::unique_path( prefix + ".%%%%-%%%%-%%%%.run" ) ).string();
+}
+
+
+
+// Check that a run file was written in full, once it's been closed.  If not (e.g., the spill directory is full), the links in it would be lost, so remove
+// the partial file and give up.
+static void
+check_run_written( const ofstream & out, const string & run_file )
+{
+  if ( !out.fail() ) return;
+  boost::filesystem::remove( run_file );
+  cerr << "ERROR: LinkSpill: Couldn't write the run file " << run_file << ".  Is there room in the spill directory " << boost::filesystem::path( run_file ).parent_path().string()
+       << "?  Free some disk space there, or set MEMORY_BUDGET = 0 to load the links in memory." << endl;
+  exit(1);
+}
+
+
+
+// Merge a set of sorted GLM run files into a single sorted run file, adding up the counts of identical links.  Return the number of distinct links.
+static int64_t
+merge_GLM_runs( const vector<string> & run_files, const string & out_file )
+{
+  assert( run_files.size() <= MAX_MERGE_WIDTH );
+
+  vector<ifstream *> ins( run_files.size() );
+  vector<GLMRunRecord> heads( run_files.size() );
+
+  // The priority queue holds (key, run ID) for the next record in each run, with the smallest key on top.
+  priority_queue< pair<uint64_t,int>, vector< pair<uint64_t,int> >, greater< pair<uint64_t,int> > > queue;
+  for ( size_t i = 0; i < run_files.size(); i++ ) {
+    ins[i] = new ifstream( run_files[i].c_str(), ios::in | ios::binary );
+    if ( ins[i]->read( (char *) &heads[i], sizeof(GLMRunRecord) ) ) queue.push( make_pair( heads[i].key, i ) );
+  }
+
+  ofstream out( out_file.c_str(), ios::out | ios::binary );
+  int64_t N_records = 0;
+  GLMRunRecord current;
+  bool have_current = false;
+
+  while ( !queue.empty() ) {
+    int i = queue.top().second;
+    queue.pop();
+
+    if ( have_current && heads[i].key == current.key ) current.count += heads[i].count;
+    else {
+      if ( have_current ) { out.write( (const char *) &current, sizeof(GLMRunRecord) ); N_records++; }
+      current = heads[i];
+      have_current = true;
+    }
+
+    if ( ins[i]->read( (char *) &heads[i], sizeof(GLMRunRecord) ) ) queue.push( make_pair( heads[i].key, i ) );
+  }
+  if ( have_current ) { out.write( (const char *) &current, sizeof(GLMRunRecord) ); N_records++; }
+  out.close();
+  check_run_written( out, out_file );
+
+  for ( size_t i = 0; i < run_files.size(); i++ )
+    delete ins[i];
+
+  return N_records;
+}
+
+
+
+
+GLMLinkSpill::GLMLinkSpill( const int N_bins, const string & spill_dir, const int64_t buffer_bytes, const int N_libraries )
+  : _N_bins( N_bins ),
+    _N_libraries( N_libraries ),
+    _spill_dir( spill_dir )
+{
+  assert( N_bins > 0 );
+  assert( N_libraries > 0 );
+  assert( buffer_bytes > 0 );
+  _max_buffer_size = max( (int64_t) 1 << 16, buffer_bytes / (int64_t) sizeof(uint64_t) );
+  _buffer.reserve( _max_buffer_size );
+  boost::filesystem::create_directories( _spill_dir );
+}
+
+
+
+GLMLinkSpill::~GLMLinkSpill()
+{
+  for ( size_t i = 0; i < _run_files.size(); i++ )
+    boost::filesystem::remove( _run_files[i] );
+}
+
+
+
+void
+GLMLinkSpill::AddLink( const int bin1, const int bin2, const int library )
+{
+  assert( bin1 >= 0 && bin1 < _N_bins );
+  assert( bin2 >= 0 && bin2 < _N_bins );
+  assert( library >= 0 && library < _N_libraries );
+
+  _buffer.push_back( ( (uint64_t) bin1 * _N_bins + bin2 ) * _N_libraries + library );
+  if ( _buffer.size() >= _max_buffer_size ) WriteRun();
+}
+
+
+
+// WriteRun: Sort the buffer, collapse identical links into counts, and write the result to a new run file.  The buffer's memory is kept for reuse.
+void
+GLMLinkSpill::WriteRun()
+{
+  if ( _buffer.empty() ) return;
+
+  sort( _buffer.begin(), _buffer.end() );
+
+  string run_file = new_run_file( _spill_dir, "GLM" );
+  ofstream out( run_file.c_str(), ios::out | ios::binary );
+  for ( size_t i = 0; i < _buffer.size(); ) {
+    GLMRunRecord record;
+    record.key = _buffer[i];
+    record.count = 0;
+    for ( ; i < _buffer.size() && _buffer[i] == record.key; i++ ) record.count++;
+    out.write( (const char *) &record, sizeof(GLMRunRecord) );
+  }
+  out.close();
+  check_run_written( out, run_file );
+
+  _run_files.push_back( run_file );
+  _buffer.clear();
+}
+
+
+
+// Merge all of the links into a compressed_matrix.  The runs are merged (in several passes, if there are many) into a single sorted run, whose records are
+// then pushed into the compressed_matrix in row-major order.  The records for each pair of bins are consecutive, one per library, so they can be weighted
+// and added up on the way.
+boost::numeric::ublas::compressed_matrix<int64_t>
+GLMLinkSpill::Merge( const function<double( int, int, int )> & weight )
+{
+  WriteRun();
+  vector<uint64_t>().swap( _buffer ); // free the buffer
+
+  cout << "GLMLinkSpill: Merging " << _run_files.size() << " sorted runs of links from " << _spill_dir << endl;
+
+  // Merge the runs, MAX_MERGE_WIDTH at a time, until there's only one left.  Even if there's only one run to begin with, merge it, to count its records.
+  int64_t N_records = 0;
+  do {
+    vector<string> merged_files;
+    for ( size_t start = 0; start < _run_files.size(); start += MAX_MERGE_WIDTH ) {
+      vector<string> batch( _run_files.begin() + start, _run_files.begin() + min( start + MAX_MERGE_WIDTH, _run_files.size() ) );
+      string merged_file = new_run_file( _spill_dir, "GLM" );
+      N_records = merge_GLM_runs( batch, merged_file );
+      for ( size_t i = 0; i < batch.size(); i++ )
+	boost::filesystem::remove( batch[i] );
+      merged_files.push_back( merged_file );
+    }
+    _run_files = merged_files;
+  } while ( _run_files.size() > 1 );
+
+  // Fill the matrix, in row-major order.
+  boost::numeric::ublas::compressed_matrix<int64_t> matrix( _N_bins, _N_bins, N_records );
+  ifstream in( _run_files[0].c_str(), ios::in | ios::binary );
+  GLMRunRecord record;
+  uint64_t pair = UINT64_MAX; // the pair of bins whose records are being added up
+  double total = 0;
+  while ( 1 ) {
+    const bool more = !in.read( (char *) &record, sizeof(GLMRunRecord) ).fail();
+    if ( !more || record.key / _N_libraries != pair ) {
+      if ( pair != UINT64_MAX && llround( total ) != 0 ) matrix.push_back( pair / _N_bins, pair % _N_bins, llround( total ) );
+      if ( !more ) break;
+      pair = record.key / _N_libraries;
+      total = 0;
+    }
+    if ( weight ) total += record.count * weight( pair / _N_bins, pair % _N_bins, record.key % _N_libraries );
+    else total += record.count;
+  }
+  in.close();
+
+  return matrix;
+}
+
+
+
+
+CLMLinkSpill::CLMLinkSpill( const int N_clusters, const string & spill_dir, const int64_t buffer_bytes )
+  : _spill_dir( spill_dir ),
+    _buffer_size( 0 ),
+    _buffers( N_clusters )
+{
+  assert( buffer_bytes > 0 );
+  // Allow for the vectors' unused capacity, which can be as much as the links themselves.
+  _max_buffer_size = max( (int64_t) 1 << 14, buffer_bytes / (int64_t) ( 2 * sizeof(CLMLink) ) );
+  boost::filesystem::create_directories( _spill_dir );
+}
+
+
+
+CLMLinkSpill::~CLMLinkSpill()
+{
+  for ( size_t i = 0; i < _run_files.size(); i++ )
+    boost::filesystem::remove( _run_files[i] );
+}
+
+
+
+void
+CLMLinkSpill::AddLink( const int cluster, const CLMLink & link )
+{
+  _buffers[cluster].push_back( link );
+  _buffer_size++;
+  if ( _buffer_size >= _max_buffer_size ) WriteRun();
+}
+
+
+
+void
+CLMLinkSpill::Finish()
+{
+  WriteRun();
+}
+
+
+
+// WriteRun: Write each cluster's buffered links, as one contiguous segment, to a new run file.  Then free the buffers.
+void
+CLMLinkSpill::WriteRun()
+{
+  if ( _buffer_size == 0 ) return;
+
+  string run_file = new_run_file( _spill_dir, "CLM" );
+  ofstream out( run_file.c_str(), ios::out | ios::binary );
+
+  vector< pair<int64_t,int64_t> > segments( _buffers.size() );
+  int64_t offset = 0;
+  for ( size_t i = 0; i < _buffers.size(); i++ ) {
+    segments[i] = make_pair( offset, (int64_t) _buffers[i].size() );
+    if ( !_buffers[i].empty() ) out.write( (const char *) &_buffers[i][0], _buffers[i].size() * sizeof(CLMLink) );
+    offset += _buffers[i].size();
+    vector<CLMLink>().swap( _buffers[i] );
+  }
+  out.close();
+  check_run_written( out, run_file );
+
+  _run_files.push_back( run_file );
+  _segments.push_back( segments );
+  _buffer_size = 0;
+}
+
+
+
+// Call f on every link in cluster #cluster, in the order in which they were added.
+void
+CLMLinkSpill::ForEachLink( const int cluster, const function<void( const CLMLink & )> & f ) const
+{
+  assert( _buffer_size == 0 ); // Finish() must be called first
+
+  vector<CLMLink> chunk( READ_CHUNK );
+
+  for ( size_t run = 0; run < _run_files.size(); run++ ) {
+    int64_t offset = _segments[run][cluster].first;
+    int64_t N_links = _segments[run][cluster].second;
+    if ( N_links == 0 ) continue;
+
+    ifstream in( _run_files[run].c_str(), ios::in | ios::binary );
+    in.seekg( offset * sizeof(CLMLink) );
+
+    while ( N_links > 0 ) {
+      size_t N_read = min( (int64_t) READ_CHUNK, N_links );
+      in.read( (char *) &chunk[0], N_read * sizeof(CLMLink) );
+      if ( !in ) {
+	cerr << "ERROR: LinkSpill: The run file " << _run_files[run] << " in " << _spill_dir << " is shorter than it should be.  Was it changed or removed during the run?" << endl;
+	exit(1);
+      }
+      for ( size_t i = 0; i < N_read; i++ )
+	f( chunk[i] );
+      N_links -= N_read;
+    }
+  }
+}
@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * LinkSpill.h
+ *
+ * Out-of-core support for loading Hi-C links when the draft assembly is too fragmented for all of the link data to fit in memory at once.  This is used when
+ * the INI parameter MEMORY_BUDGET is nonzero.  There are two classes here, one for each kind of link matrix:
+ *
+ * GLMLinkSpill: Collects the (bin1,bin2) links that make up a GenomeLinkMatrix.  Links are buffered in memory; whenever the buffer fills up, it is sorted,
+ *               duplicate links are collapsed into counts, and the result is written to disk as a sorted "run".  At the end, the runs are combined by an
+ *               external k-way merge into one sorted stream of (bin1,bin2,count), which is exactly what's needed to fill a compressed_matrix in row-major order
+ *               without any intermediate mapped_matrix.  If the links come from several libraries (see LinkLibraries.h), each link also records its library,
+ *               and the counts from each library are weighted when the matrix is filled.
+ *
+ * CLMLinkSpill: Collects the links that make up the ChromLinkMatrices of all the groups, in a single pass through the SAM files.  Links are buffered per
+ *               group; whenever the buffer fills up, each group's links are written to disk as one segment of a run, in the order they were read.  Then the
+ *               CLMs can be built one group at a time, by reading back that group's segment of every run (in run order), so only one CLM needs to be in memory
+ *               at once.  Because the links come back in the order they were read, the resulting CLMs are identical to the ones built in memory.
+ *
+ * The memory budget applies to the link buffers: each spill uses at most <buffer_bytes> of memory for buffering, plus a few kilobytes per run while merging.
+ * The finished GLM, and the one CLM under construction, must still fit in memory; their size is determined by the data, not by the buffers.
+ *
+ * Run files are written to <spill_dir> and deleted when the spill object is destroyed.  If a run file can't be written in full (e.g., the disk is full), Lachesis
+ * exits with an error, rather than go on without some of the links.
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _LINK_SPILL__H
+#define _LINK_SPILL__H
+
+
+#include <inttypes.h> // int32_t, uint64_t
+#include <vector>
+#include <string>
+#include <functional>
+using namespace std;
+
+#include <boost/numeric/ublas/matrix_sparse.hpp> // compressed_matrix
+
+
+
+
+class GLMLinkSpill
+{
+ public:
+
+  GLMLinkSpill( const int N_bins, const string & spill_dir, const int64_t buffer_bytes, const int N_libraries = 1 );
+  ~GLMLinkSpill();
+
+  // Add one link from bin1 to bin2, from library #library.  (The caller adds the reverse link separately, as the GLM is symmetric.)
+  void AddLink( const int bin1, const int bin2, const int library = 0 );
+
+  // Merge all of the links into a compressed_matrix of size N_bins x N_bins, containing the number of links between each pair of bins.  If weight is given,
+  // each link from library l between bin1 and bin2 counts weight( bin1, bin2, l ) instead, and the total is rounded to the nearest integer.
+  // This can only be called once.
+  boost::numeric::ublas::compressed_matrix<int64_t> Merge( const function<double( int, int, int )> & weight = function<double( int, int, int )>() );
+
+ private:
+
+  void WriteRun(); // sort and collapse the buffer, and write it to a new run file
+
+  int _N_bins, _N_libraries;
+  string _spill_dir;
+  size_t _max_buffer_size; // in links
+  vector<uint64_t> _buffer; // links, encoded as ( bin1 * N_bins + bin2 ) * N_libraries + library
+  vector<string> _run_files;
+};
+
+
+
+
+// CLMLink: One link, to be added to a ChromLinkMatrix.  The contig IDs are local to the group.  If contig1 == contig2, this is an intra-contig link and dist11
+// holds the distance between the reads; otherwise the four distances are the distances of each read to either end of its contig.  library is the ID of the
+// link's library in a LinkLibraries (0 if there's only one.)
+struct CLMLink {
+  int32_t contig1, contig2;
+  int32_t dist11, dist12, dist21, dist22;
+  int32_t library;
+};
+
+
+
+class CLMLinkSpill
+{
+ public:
+
+  CLMLinkSpill( const int N_clusters, const string & spill_dir, const int64_t buffer_bytes );
+  ~CLMLinkSpill();
+
+  // Add one link to cluster #cluster.
+  void AddLink( const int cluster, const CLMLink & link );
+
+  // Flush the buffer to disk.  Call this after the last AddLink() and before ForEachLink().
+  void Finish();
+
+  // Call f on every link in cluster #cluster, in the order in which they were added.
+  void ForEachLink( const int cluster, const function<void( const CLMLink & )> & f ) const;
+
+ private:
+
+  void WriteRun(); // write each cluster's buffered links to a new run file
+
+  string _spill_dir;
+  size_t _max_buffer_size; // in links
+  size_t _buffer_size;
+  vector< vector<CLMLink> > _buffers; // one per cluster
+  vector<string> _run_files;
+  vector< vector< pair<int64_t,int64_t> > > _segments; // for each run, for each cluster: offset (in links) and number of links
+};
+
+
+#endif
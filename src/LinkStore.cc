@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+// For documentation, see LinkStore.h
+#include "LinkStore.h"
+
+// C libraries
+#include <string.h> // memcmp, memcpy
+#include <fcntl.h> // open
+#include <unistd.h> // close
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+
+// STL declarations
+#include <iostream>
+#include <fstream>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+
+
+
+
+static const char MAGIC[8] = { 'L', 'A', 'C', 'H', 'L', 'N', 'K', '2' };
+static const uint64_t ORDER_MARK = 0x0102030405060708ULL; // reads back differently on a machine with the other byte order
+static const uint64_t ALIGNMENT = 64; // each section starts on a cache line
+
+// The header at the start of a link store.  It's followed by the offset and size of each section, as pairs of uint64_t's.
+struct LinkStoreHeader {
+  char magic[8];
+  uint64_t byte_order;
+  uint64_t source_size; // the size of the text file that this link store goes with
+  int64_t source_mtime; // the text file's modification time, in nanoseconds
+  uint64_t N_sections;
+};
+
+
+
+// StatSource: Find the size and modification time of a text file.  Return false if it can't be found.
+static bool
+StatSource( const string & source_file, uint64_t & size, int64_t & mtime )
+{
+  struct stat st;
+  if ( stat( source_file.c_str(), &st ) != 0 ) return false;
+  size = st.st_size;
+  mtime = int64_t( st.st_mtim.tv_sec ) * 1000000000 + st.st_mtim.tv_nsec;
+  return true;
+}
+
+
+
+shared_ptr<const LinkStore>
+LinkStore::Open( const string & source_file )
+{
+  const string store_file = Filename( source_file );
+  if ( !boost::filesystem::is_regular_file( store_file ) || !boost::filesystem::is_regular_file( source_file ) ) return shared_ptr<const LinkStore>();
+
+  const int fd = open( store_file.c_str(), O_RDONLY );
+  if ( fd == -1 ) return shared_ptr<const LinkStore>();
+  struct stat st;
+  if ( fstat( fd, &st ) != 0 || st.st_size < (off_t) sizeof(LinkStoreHeader) ) { close(fd); return shared_ptr<const LinkStore>(); }
+  void * data = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+  close(fd); // the mapping stays valid without the file descriptor
+  if ( data == MAP_FAILED ) {
+    cerr << "WARNING: LinkStore: Can't map " << store_file << " into memory; reading " << source_file << " instead" << endl;
+    return shared_ptr<const LinkStore>();
+  }
+
+  shared_ptr<LinkStore> store( new LinkStore );
+  store->_data = (const char *) data;
+  store->_size = st.st_size;
+
+  // Check that the header is sound, and that it goes with source_file.  If not, the destructor unmaps the file.
+  LinkStoreHeader header;
+  memcpy( &header, store->_data, sizeof(LinkStoreHeader) );
+  if ( memcmp( header.magic, MAGIC, sizeof(MAGIC) ) != 0 || header.byte_order != ORDER_MARK ) return shared_ptr<const LinkStore>();
+  uint64_t source_size;
+  int64_t source_mtime;
+  if ( !StatSource( source_file, source_size, source_mtime ) ) return shared_ptr<const LinkStore>();
+  if ( header.source_size != source_size || header.source_mtime != source_mtime ) return shared_ptr<const LinkStore>();
+  if ( header.N_sections > ( store->_size - sizeof(LinkStoreHeader) ) / ( 2 * sizeof(uint64_t) ) ) return shared_ptr<const LinkStore>();
+
+  const char * table = store->_data + sizeof(LinkStoreHeader);
+  for ( uint64_t i = 0; i < header.N_sections; i++ ) {
+    uint64_t section[2];
+    memcpy( section, table + i * sizeof(section), sizeof(section) );
+    if ( section[0] % ALIGNMENT != 0 || section[0] > store->_size || section[1] > store->_size - section[0] ) return shared_ptr<const LinkStore>();
+    store->_sections.push_back( make_pair( section[0], section[1] ) );
+  }
+
+  return store;
+}
+
+
+
+LinkStore::~LinkStore()
+{
+  if ( _data != NULL ) munmap( (void *) _data, _size );
+}
+
+
+
+void
+LinkStore::Writer::Write( const string & source_file, const string & new_source_file ) const
+{
+  const string store_file = Filename( source_file );
+
+  LinkStoreHeader header;
+  memcpy( header.magic, MAGIC, sizeof(MAGIC) );
+  header.byte_order = ORDER_MARK;
+  if ( !StatSource( new_source_file, header.source_size, header.source_mtime ) ) {
+    Remove( source_file );
+    return;
+  }
+  ofstream out( ( store_file + ".tmp" ).c_str(), ios::out | ios::binary );
+  header.N_sections = _sections.size();
+  out.write( (const char *) &header, sizeof(LinkStoreHeader) );
+
+  // Lay out the sections after the table, and write the table.
+  vector<uint64_t> offsets( _sections.size() );
+  uint64_t offset = sizeof(LinkStoreHeader) + _sections.size() * 2 * sizeof(uint64_t);
+  for ( size_t i = 0; i < _sections.size(); i++ ) {
+    offset = ( offset + ALIGNMENT - 1 ) / ALIGNMENT * ALIGNMENT;
+    offsets[i] = offset;
+    const uint64_t section[2] = { offset, _sections[i].second };
+    out.write( (const char *) section, sizeof(section) );
+    offset += _sections[i].second;
+  }
+
+  // Write the sections, each preceded by the padding that aligns it.
+  const char padding[ALIGNMENT] = {};
+  uint64_t written = sizeof(LinkStoreHeader) + _sections.size() * 2 * sizeof(uint64_t);
+  for ( size_t i = 0; i < _sections.size(); i++ ) {
+    out.write( padding, offsets[i] - written );
+    out.write( (const char *) _sections[i].first, _sections[i].second );
+    written = offsets[i] + _sections[i].second;
+  }
+
+  out.close();
+
+  // The link store is only a faster way to read source_file, so if it can't be written, the run can go on without it.
+  if ( out.fail() ) {
+    cerr << "WARNING: LinkStore: Couldn't write " << store_file << "; " << source_file << " will be read without it" << endl;
+    boost::filesystem::remove( store_file + ".tmp" );
+    Remove( source_file );
+    return;
+  }
+  boost::filesystem::rename( store_file + ".tmp", store_file );
+}
+
+
+
+void
+LinkStore::Remove( const string & source_file )
+{
+  boost::filesystem::remove( Filename( source_file ) );
+}
@@ -0,0 +1,117 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * LinkStore.h
+ *
+ * LinkStore: A binary image of the link data in a cached GLM or CLM file, which is mapped into memory read-only instead of being parsed.  Each cached file
+ * <file> in cached_data has its link store in <file>.links, written by the object's WriteFile() alongside the text file, and used by its ReadFile() in place
+ * of the text file's link data if it's there.  Several Lachesis processes on one machine (e.g., ordering different groups, or trying different parameters)
+ * can then map the same link stores, and share one copy of them in the page cache, instead of each parsing its own copy into its heap.
+ *
+ * A link store is a list of sections, each of which is an array of fixed-size numbers, and it has no pointers: each section is located by its offset from the
+ * start of the file, so the file can be mapped at any address.  What the sections mean is up to the object that wrote them:
+ * -- A CLM's link store holds the three arrays of its LinkArena, and the ChromLinkMatrix reads its links straight from the mapping (see LinkArena.h.)
+ * -- A GLM's link store holds its matrix in compressed sparse row format.  The GenomeLinkMatrix fills its matrix from the mapping, because clustering
+ *    normalizes the matrix in place; the mapping is only held while the GLM is read.
+ *
+ * The file starts with a header: 8 magic bytes, a number that shows the byte order, the size and modification time of the text file that the link store
+ * goes with, and the number of sections; then the offset and size (in bytes) of each section.  Each section starts on a 64-byte boundary.  A link store is
+ * only used if its header matches the text file beside it, so one left behind by an older version of the text file is ignored, even if the text file was
+ * edited without changing its size.
+ *
+ * A link store is written to <file>.links.tmp and renamed into place, and never modified afterwards.  A process that's rewriting a link store doesn't
+ * disturb any process that has the old one mapped: the old file stays intact until the last mapping of it goes away.
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _LINK_STORE__H
+#define _LINK_STORE__H
+
+
+#include <inttypes.h> // uint64_t
+#include <stddef.h> // size_t
+#include <string>
+#include <vector>
+#include <memory> // shared_ptr
+using namespace std;
+
+
+
+
+class LinkStore
+{
+ public:
+
+  // Open: Map the link store for text file source_file, read-only.  Return NULL if there isn't one, or if it doesn't go with the current source_file.
+  static shared_ptr<const LinkStore> Open( const string & source_file );
+
+  ~LinkStore();
+
+  int N_sections() const { return _sections.size(); }
+
+  // Section: The array of numbers in section #i, and how many there are.  Return NULL if the section's size isn't a multiple of sizeof(T).
+  template<class T> const T * Section( const int i, size_t & N ) const {
+    if ( _sections[i].second % sizeof(T) != 0 ) return NULL;
+    N = _sections[i].second / sizeof(T);
+    return reinterpret_cast<const T *>( _data + _sections[i].first );
+  }
+
+  // The filename of the link store that goes with text file source_file.
+  static string Filename( const string & source_file ) { return source_file + ".links"; }
+
+
+
+  // Writer: Builds a link store, one section at a time.
+  class Writer
+  {
+  public:
+    // AddSection: Add a section holding the N numbers at data.  The numbers are copied when Write() is called, so they must still exist then.
+    template<class T> void AddSection( const T * data, const size_t N ) { _sections.push_back( make_pair( (const void *) data, N * sizeof(T) ) ); }
+
+    // Write: Write the link store for text file source_file, which has been written as new_source_file and will be renamed to source_file after this, so
+    // that a reader never finds the new text file with the old link store.  The link store records new_source_file's size and modification time, which
+    // the rename keeps.
+    void Write( const string & source_file, const string & new_source_file ) const;
+
+  private:
+    vector< pair<const void *, size_t> > _sections; // the data, and its size in bytes
+  };
+
+
+
+  // Remove: Delete the link store for source_file, if there is one.  Call this when source_file is rewritten without a link store.
+  static void Remove( const string & source_file );
+
+ private:
+
+  LinkStore() : _data(NULL), _size(0) {}
+  LinkStore( const LinkStore & );
+  LinkStore & operator=( const LinkStore & );
+
+  const char * _data; // the mapping
+  size_t _size;
+  vector< pair<uint64_t, uint64_t> > _sections; // offset and size of each section, in bytes
+};
+
+
+#endif
@@ -0,0 +1,195 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+// For documentation, see MisjoinDetector.h
+#include "MisjoinDetector.h"
+#include "LinkSizeDistribution.h" // _MIN_LINK_DIST
+#include "ThreadPool.h"
+
+
+#include <assert.h>
+#include <stdlib.h> // abs
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm> // min, max
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+
+
+
+
+
+MisjoinDetector::MisjoinDetector( const vector<string> & contig_names, const vector<int> & contig_lengths, const int window, const double max_ratio )
+  : _window( window ),
+    _bin_size( window / _STEPS_PER_WINDOW ),
+    _N_seps( 2 * _STEPS_PER_WINDOW ),
+    _max_ratio( max_ratio ),
+    _contig_names( contig_names ),
+    _contig_lengths( contig_lengths )
+{
+  assert( _bin_size > 0 );
+  assert( _contig_names.size() == _contig_lengths.size() );
+
+  cout << "MisjoinDetector: Looking for misjoins in contigs of length >= " << 2 * _window << ", with a window of " << _window << " bp" << endl;
+
+  // Set up the tallies for step 1.  The links are added later, with AddLink.
+  const int N_contigs = _contig_lengths.size();
+  _counts.resize( N_contigs );
+  for ( int i = 0; i < N_contigs; i++ )
+    if ( _contig_lengths[i] >= 2 * _window ) vector< atomic<int> >( _contig_lengths[i] / _bin_size * _N_seps ).swap( _counts[i] );
+}
+
+
+
+// AddLink: Tally one read of an intra-contig link.  Skip the links to the partial bin at the end of the contig, and the links too long to cross between two
+// windows.
+void
+MisjoinDetector::AddLink( const int contig, const int pos1, const int pos2 )
+{
+  assert( contig >= 0 && contig < (int) _counts.size() );
+  vector< atomic<int> > & contig_counts = _counts[contig];
+  if ( contig_counts.empty() ) return;
+
+  if ( abs( pos2 - pos1 ) < LinkSizeDistribution::_MIN_LINK_DIST ) return;
+
+  const int bin1 = min( pos1, pos2 ) / _bin_size;
+  const int bin2 = max( pos1, pos2 ) / _bin_size;
+  const int sep = bin2 - bin1;
+  if ( sep >= _N_seps || ( bin2 + 1 ) * _N_seps > (int) contig_counts.size() ) return;
+
+  contig_counts[ bin1 * _N_seps + sep ].fetch_add( 1, memory_order_relaxed );
+}
+
+
+
+// FindMisjoins: Find the candidate misjoins from the links tallied so far (steps 2 and 3 in MisjoinDetector.h.)
+void
+MisjoinDetector::FindMisjoins()
+{
+  const int N_contigs = _contig_lengths.size();
+
+  // 2. Find the link size distribution at the resolution of the bins: the average number of links between two bins at each separation, over all contigs.
+  vector<double> expected_by_sep( _N_seps, 0 );
+  for ( int sep = 0; sep < _N_seps; sep++ ) {
+    int64_t N_links = 0, N_bin_pairs = 0;
+    for ( int i = 0; i < N_contigs; i++ ) {
+      const int N_bins = _counts[i].size() / _N_seps;
+      for ( int bin = 0; bin + sep < N_bins; bin++ )
+	N_links += _counts[i][ bin * _N_seps + sep ];
+      N_bin_pairs += max( 0, N_bins - sep );
+    }
+    if ( N_bin_pairs != 0 ) expected_by_sep[sep] = double( N_links ) / N_bin_pairs;
+  }
+
+
+  // 3. Find the candidate misjoins on each contig.  The contigs are independent, so this is done in parallel.
+  vector< vector<Misjoin> > misjoins( N_contigs );
+  ThreadPool::Global().ParallelFor( 0, N_contigs, [&]( int i ) { misjoins[i] = FindMisjoinsOnContig( i, expected_by_sep ); } );
+
+  _misjoins.clear();
+  for ( int i = 0; i < N_contigs; i++ )
+    _misjoins.insert( _misjoins.end(), misjoins[i].begin(), misjoins[i].end() );
+
+  cout << "MisjoinDetector: Found " << _misjoins.size() << " candidate misjoins" << endl;
+}
+
+
+
+// WriteBEDFile: Write the candidate misjoins to a BED file.  The file is written to a temporary file and then renamed into place, as with the cached data.
+void
+MisjoinDetector::WriteBEDFile( const string & BED_file ) const
+{
+  cout << "MisjoinDetector: Writing candidate misjoins to " << BED_file << endl;
+  ofstream out( ( BED_file + ".tmp" ).c_str(), ios::out );
+  out << "# Candidate misjoins in the draft assembly, found by MisjoinDetector with a window of " << _window << " bp and a maximum ratio of " << _max_ratio << endl;
+  out << "# contig\tstart\tstop\tname\tscore\tposition\tobserved_links\texpected_links" << endl;
+
+  for ( size_t i = 0; i < _misjoins.size(); i++ ) {
+    const Misjoin & m = _misjoins[i];
+    const int score = min( 1000, int( 1000 * m.observed / m.expected ) );
+    out << _contig_names[m.contig] << '\t' << m.start << '\t' << m.stop << "\tmisjoin\t" << score << '\t' << m.pos << '\t'
+	<< m.observed << '\t' << m.expected << endl;
+  }
+
+  out.close();
+  boost::filesystem::rename( BED_file + ".tmp", BED_file );
+}
+
+
+
+// FindMisjoinsOnContig: Find the candidate misjoins on one contig.  At each bin boundary b with a full window on each side, count the links crossing from the
+// left window (bins [b-k,b)) to the right window (bins [b,b+k)), where k = _STEPS_PER_WINDOW, and compare that to the number expected.
+vector<MisjoinDetector::Misjoin>
+MisjoinDetector::FindMisjoinsOnContig( const int contig, const vector<double> & expected_by_sep ) const
+{
+  vector<Misjoin> misjoins;
+  const vector< atomic<int> > & counts = _counts[contig];
+  const int N_bins = counts.size() / _N_seps;
+  const int k = _STEPS_PER_WINDOW;
+  if ( N_bins < 2 * k ) return misjoins;
+
+  // Find this contig's enrichment: the ratio of its links (between bins at the separations that can cross a boundary) to the number expected of a contig
+  // of its length.  Also find the number of links expected to cross a boundary on an average contig: there are min(sep,2k-sep) pairs of bins at each
+  // separation that straddle a given boundary.
+  int64_t N_links = 0;
+  double N_expected = 0, expected_crossing = 0;
+  for ( int sep = 1; sep < _N_seps; sep++ ) {
+    for ( int bin = 0; bin + sep < N_bins; bin++ )
+      N_links += counts[ bin * _N_seps + sep ];
+    N_expected += ( N_bins - sep ) * expected_by_sep[sep];
+    expected_crossing += min( sep, 2*k - sep ) * expected_by_sep[sep];
+  }
+  if ( N_expected == 0 || N_links == 0 ) return misjoins;
+  const double expected = expected_crossing * N_links / N_expected;
+  if ( expected < _MIN_EXPECTED_LINKS ) return misjoins;
+
+  // Scan the boundaries, merging each run of flagged boundaries into one candidate misjoin.
+  Misjoin current = { -1, -1, -1, -1, 0, 0 };
+  double lowest_ratio = 0;
+  for ( int b = k; b <= N_bins - k; b++ ) {
+
+    int64_t observed = 0;
+    for ( int bin1 = b - k; bin1 < b; bin1++ )
+      for ( int sep = b - bin1; sep < b - bin1 + k; sep++ )
+	observed += counts[ bin1 * _N_seps + sep ];
+
+    const double ratio = observed / expected;
+    const bool flagged = ratio < _max_ratio;
+
+    if ( flagged && current.contig == -1 ) {
+      Misjoin m = { contig, ( b - 1 ) * _bin_size, -1, b * _bin_size, observed, expected };
+      current = m;
+      lowest_ratio = ratio;
+    }
+    else if ( flagged && ratio < lowest_ratio ) {
+      current.pos = b * _bin_size;
+      current.observed = observed;
+      lowest_ratio = ratio;
+    }
+
+    // At the end of a run of flagged boundaries, record the misjoin.
+    if ( current.contig != -1 && ( !flagged || b == N_bins - k ) ) {
+      current.stop = ( flagged ? b + 1 : b ) * _bin_size;
+      misjoins.push_back( current );
+      current.contig = -1;
+    }
+  }
+
+  return misjoins;
+}
@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * MisjoinDetector.h
+ *
+ * A MisjoinDetector looks for misjoins (chimeric junctions) in the contigs of the draft assembly, using the intra-contig Hi-C links.  Lachesis can't fix a
+ * chimeric contig - it has to place the whole contig in one cluster, at one position - so the misjoins are reported for the user to break before rerunning.
+ *
+ * The idea: along a correctly assembled contig, the number of links crossing any point from the window of length W on its left to the window of length W on
+ * its right is roughly constant, because the density of links depends (mostly) on their length, as described by the LinkSizeDistribution.  At a misjoin, the
+ * two windows come from unrelated parts of the genome, so there are far fewer links crossing the point than expected.
+ *
+ * Method:
+ * 1. Divide each contig of length >= 2W into bins of length W / _STEPS_PER_WINDOW, and tally the intra-contig links between each pair of bins less than two
+ *    windows apart.  Only these tallies are kept, not the links, so memory is proportional to the assembly length.  As in LinkSizeDistribution, links
+ *    shorter than LinkSizeDistribution::_MIN_LINK_DIST are ignored.  The links are tallied while the GenomeLinkMatrix reads the SAM files (see AddLink), so
+ *    they cost no extra pass through the SAM files.  (If the GLM is read from its cache, the misjoins aren't found; see LachesisMisjoins in Lachesis.cc.)
+ * 2. Find the link size distribution at the resolution of the bins: the average number of links between two bins at each separation, over all contigs.
+ *    This is the same measurement that LinkSizeDistribution makes (over the same intra-contig links), but it's made from the tallies of step 1.
+ * 3. For each contig, in parallel: at each bin boundary with a full window on both sides, compare the observed number of links crossing the boundary to the
+ *    number expected from the link size distribution, scaled by the contig's overall link enrichment (as in LinkSizeDistribution::FindEnrichmentOnContig.)
+ *    Flag the boundary if the ratio is below max_ratio, and enough links are expected for the ratio to mean something.  Runs of flagged boundaries are
+ *    merged into one candidate misjoin.
+ *
+ * The candidate misjoins are written to a BED file (see WriteBEDFile.)  As in the GenomeLinkMatrix, each read pair counts once for each of its reads with
+ * mapping quality > 0, regardless of its library (see LinkLibraries.h.)
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _MISJOIN_DETECTOR__H
+#define _MISJOIN_DETECTOR__H
+
+
+#include <stdint.h> // int64_t
+#include <string>
+#include <vector>
+#include <atomic>
+using namespace std;
+
+
+
+
+class MisjoinDetector
+{
+ public:
+
+  // Set up a MisjoinDetector for an assembly with the given contigs, with no links yet.  Add the links with AddLink, then call FindMisjoins.  window is the
+  // window length W, in bp; max_ratio is the highest ratio of observed to expected links crossing a point that's flagged as a misjoin.
+  MisjoinDetector( const vector<string> & contig_names, const vector<int> & contig_lengths, const int window, const double max_ratio );
+
+  // AddLink: Tally one read of an intra-contig link, at positions pos1 and pos2 on the contig.  The read should have mapping quality > 0.  This may be called
+  // from several threads at once (e.g., by GenomeLinkMatrix::ForEachLinkInSAM, as it reads several SAM files in parallel.)
+  void AddLink( const int contig, const int pos1, const int pos2 );
+  // FindMisjoins: Find the candidate misjoins from the links added so far.
+  void FindMisjoins();
+
+  // A candidate misjoin.  The misjoin lies in the interval [start,stop) on the contig, which spans the flagged boundaries (plus one bin on either side.)  The
+  // numbers of observed and expected links are those at the flagged boundary with the lowest ratio.
+  struct Misjoin {
+    int contig;
+    int start, stop;
+    int pos; // the boundary with the lowest ratio
+    int64_t observed;
+    double expected;
+  };
+
+  const vector<Misjoin> & misjoins() const { return _misjoins; }
+
+  // WriteBEDFile: Write the candidate misjoins to a BED file, one per line, sorted by contig ID and position.  The columns are: contig name, start, stop, name
+  // ("misjoin"), score (the lowest ratio of observed to expected links, times 1000, capped at 1000), the flagged position, and the observed and expected links.
+  void WriteBEDFile( const string & BED_file ) const;
+
+
+ private:
+
+  // STEPS_PER_WINDOW: The number of bins in a window.  The candidate misjoins are found at a resolution of W / _STEPS_PER_WINDOW.
+  static const int _STEPS_PER_WINDOW = 4;
+  // MIN_EXPECTED_LINKS: Don't flag a boundary unless at least this many links are expected to cross it.  This keeps contigs with sparse data from being
+  // flagged everywhere.  A read pair whose reads both have mapping quality > 0 counts twice (see above), so this is about 20 read pairs.
+  static const int _MIN_EXPECTED_LINKS = 40;
+
+  // FindMisjoinsOnContig: Find the candidate misjoins on one contig, given the average number of links between two bins at each separation.
+  vector<Misjoin> FindMisjoinsOnContig( const int contig, const vector<double> & expected_by_sep ) const;
+
+  int _window, _bin_size, _N_seps; // _N_seps = 2 * _STEPS_PER_WINDOW: a link between bins this far apart can't cross from one window to the next
+  double _max_ratio;
+  vector<string> _contig_names;
+  vector<int> _contig_lengths;
+
+  // _counts[contig][ bin * _N_seps + sep ]: The number of links between bin and bin+sep on this contig.  Empty for contigs shorter than two windows.
+  // The counts are atomic, so AddLink can be called from several threads at once.
+  vector< vector< atomic<int> > > _counts;
+
+  vector<Misjoin> _misjoins;
+};
+
+
+#endif
@@ -0,0 +1,363 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+// For documentation, see OrderTree.h
+#include "OrderTree.h"
+
+// C libraries
+#include <assert.h>
+
+// STL declarations
+#include <algorithm> // swap
+
+
+
+// The treap priority of a contig: a fixed hash of its ID (the finalizer of MurmurHash3.)
+static uint32_t
+priority_hash( uint32_t x )
+{
+  x ^= x >> 16;
+  x *= 0x85ebca6b;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35;
+  x ^= x >> 16;
+  return x;
+}
+
+// Decode a contig from the ContigOrdering encoding.
+static inline int contig_of( const int x ) { return x >= 0 ? x : ~x; }
+
+
+
+
+OrderTree::OrderTree( const int N_contigs )
+  : _root( -1 ),
+    _left( N_contigs, -1 ),
+    _right( N_contigs, -1 ),
+    _parent( N_contigs, -1 ),
+    _size( N_contigs, 1 ),
+    _priority( N_contigs ),
+    _rc( N_contigs, 0 ),
+    _invert( N_contigs, 0 ),
+    _in_tree( N_contigs, 0 ),
+    _flat_valid( true )
+{
+  assert( N_contigs >= 0 );
+  for ( int i = 0; i < N_contigs; i++ )
+    _priority[i] = priority_hash(i);
+}
+
+
+
+// Copying an OrderTree copies its flat vector, if that's up to date, but not its lock.
+OrderTree::OrderTree( const OrderTree & tree )
+  : _flat_valid( false )
+{
+  *this = tree;
+}
+
+
+
+OrderTree &
+OrderTree::operator=( const OrderTree & tree )
+{
+  if ( this == &tree ) return *this;
+
+  _root     = tree._root;
+  _left     = tree._left;
+  _right    = tree._right;
+  _parent   = tree._parent;
+  _size     = tree._size;
+  _priority = tree._priority;
+  _rc       = tree._rc;
+  _invert   = tree._invert;
+  _in_tree  = tree._in_tree;
+
+  lock_guard<mutex> lock( tree._flat_mutex );
+  _flat = tree._flat;
+  _flat_valid.store( tree._flat_valid.load() );
+  return *this;
+}
+
+
+
+// Assign: Build the tree for a sequence from scratch.  This is the usual O(N) construction of a Cartesian tree: the nodes are added left to right, and the
+// rightmost path of the tree is kept on a stack.
+void
+OrderTree::Assign( const vector<int> & data )
+{
+  _flat_valid.store( false );
+  for ( int i = 0; i < (int) _in_tree.size(); i++ )
+    _in_tree[i] = 0;
+
+  vector<int> stack;
+  for ( size_t i = 0; i < data.size(); i++ ) {
+    int node = contig_of( data[i] );
+    assert( node < (int) _in_tree.size() );
+    assert( !_in_tree[node] ); // each contig can only appear once
+    _in_tree[node] = 1;
+    _left[node] = _right[node] = _parent[node] = -1;
+    _size[node] = 1;
+    _rc[node] = data[i] < 0;
+    _invert[node] = 0;
+
+    int last = -1;
+    while ( !stack.empty() && _priority[ stack.back() ] < _priority[node] ) {
+      last = stack.back();
+      stack.pop_back();
+    }
+    _left[node] = last;
+    if ( !stack.empty() ) _right[ stack.back() ] = node;
+    stack.push_back( node );
+  }
+
+  _root = stack.empty() ? -1 : stack[0];
+
+  // Fix the sizes and parent pointers, children before parents.
+  vector<int> order;
+  if ( _root != -1 ) order.push_back( _root );
+  for ( size_t i = 0; i < order.size(); i++ ) {
+    if ( _left [ order[i] ] != -1 ) order.push_back( _left [ order[i] ] );
+    if ( _right[ order[i] ] != -1 ) order.push_back( _right[ order[i] ] );
+  }
+  for ( int i = (int) order.size() - 1; i >= 0; i-- )
+    Update( order[i] );
+  if ( _root != -1 ) _parent[_root] = -1;
+
+  _flat = data;
+  _flat_valid.store( true, memory_order_release );
+}
+
+
+
+void
+OrderTree::Insert( const int pos, const vector<int> & data )
+{
+  assert( pos >= 0 && pos <= size() );
+  if ( data.empty() ) return;
+  _flat_valid.store( false );
+
+  // Build a tree from the new contigs, using the same nodes as if they were the whole sequence, then merge it in between the two halves of this tree.
+  int left, right;
+  Split( _root, pos, left, right );
+
+  int middle = -1;
+  for ( size_t i = 0; i < data.size(); i++ ) {
+    int node = contig_of( data[i] );
+    assert( node < (int) _in_tree.size() );
+    assert( !_in_tree[node] );
+    _in_tree[node] = 1;
+    _left[node] = _right[node] = _parent[node] = -1;
+    _size[node] = 1;
+    _rc[node] = data[i] < 0;
+    _invert[node] = 0;
+    middle = Merge( middle, node );
+  }
+
+  _root = Merge( Merge( left, middle ), right );
+  _parent[_root] = -1;
+}
+
+
+
+int
+OrderTree::Erase( const int pos )
+{
+  assert( pos >= 0 && pos < size() );
+  _flat_valid.store( false );
+
+  int left, middle, right;
+  Split( _root, pos, left, middle );
+  Split( middle, 1, middle, right );
+
+  int value = _rc[middle] ? ~middle : middle; // Split() pushed any pending inversion out of this single node
+  _in_tree[middle] = 0;
+
+  _root = Merge( left, right );
+  if ( _root != -1 ) _parent[_root] = -1;
+  return value;
+}
+
+
+
+void
+OrderTree::Invert( const int start, const int stop )
+{
+  assert( start >= 0 && start <= stop && stop < size() );
+  _flat_valid.store( false );
+
+  int left, middle, right;
+  Split( _root, start, left, middle );
+  Split( middle, stop - start + 1, middle, right );
+  _invert[middle] ^= 1;
+  _root = Merge( Merge( left, middle ), right );
+  _parent[_root] = -1;
+}
+
+
+
+// Walk: Walk down from the root, keeping track of the parity of the pending inversions along the way.  Under an odd number of inversions, a node's children
+// are swapped and its orientation is flipped.
+int
+OrderTree::Walk( const int pos ) const
+{
+  assert( pos >= 0 && pos < size() );
+
+  int node = _root;
+  int k = pos;
+  bool inverted = false;
+  while ( 1 ) {
+    inverted ^= _invert[node];
+    int left = inverted ? _right[node] : _left[node];
+    int left_size = left == -1 ? 0 : _size[left];
+    if ( k < left_size ) node = left;
+    else if ( k == left_size ) return ( _rc[node] ^ inverted ) ? ~node : node;
+    else {
+      k -= left_size + 1;
+      node = inverted ? _left[node] : _right[node];
+    }
+  }
+}
+
+
+
+// Position: Find the parity of the pending inversions above the node, then walk up from the node, adding up the sizes of everything to its left.
+int
+OrderTree::Position( const int contig_ID ) const
+{
+  assert( contig_ID >= 0 && contig_ID < (int) _in_tree.size() );
+  if ( !_in_tree[contig_ID] ) return -1;
+
+  // inverted: parity of the inversions at this node and above it.  These determine which of the node's children is on its left.
+  bool inverted = false;
+  for ( int node = contig_ID; node != -1; node = _parent[node] )
+    inverted ^= _invert[node];
+
+  int left = inverted ? _right[contig_ID] : _left[contig_ID];
+  int pos = left == -1 ? 0 : _size[left];
+
+  for ( int node = contig_ID; _parent[node] != -1; node = _parent[node] ) {
+    int parent = _parent[node];
+    inverted ^= _invert[node]; // now the parity at the parent
+    bool node_is_right = ( ( _right[parent] == node ) != inverted );
+    if ( node_is_right ) {
+      int parent_left = inverted ? _right[parent] : _left[parent];
+      pos += 1 + ( parent_left == -1 ? 0 : _size[parent_left] );
+    }
+  }
+
+  return pos;
+}
+
+
+
+// Flatten: Rebuild the flat vector, unless another thread just did.
+void
+OrderTree::Flatten() const
+{
+  lock_guard<mutex> lock( _flat_mutex );
+  if ( _flat_valid.load() ) return;
+
+  vector<int> & data = _flat;
+  data.clear();
+  data.reserve( size() );
+
+  // In-order traversal with an explicit stack of (node, inversion parity).
+  vector< pair<int,bool> > stack;
+  int node = _root;
+  bool inverted = false;
+  while ( node != -1 || !stack.empty() ) {
+    while ( node != -1 ) {
+      inverted ^= _invert[node];
+      stack.push_back( make_pair( node, inverted ) );
+      node = inverted ? _right[node] : _left[node];
+    }
+    node = stack.back().first;
+    inverted = stack.back().second;
+    stack.pop_back();
+    data.push_back( ( _rc[node] ^ inverted ) ? ~node : node );
+    node = inverted ? _left[node] : _right[node];
+  }
+
+  _flat_valid.store( true, memory_order_release );
+}
+
+
+
+void
+OrderTree::Push( const int node )
+{
+  if ( !_invert[node] ) return;
+  swap( _left[node], _right[node] );
+  _rc[node] ^= 1;
+  if ( _left [node] != -1 ) _invert[ _left [node] ] ^= 1;
+  if ( _right[node] != -1 ) _invert[ _right[node] ] ^= 1;
+  _invert[node] = 0;
+}
+
+
+
+void
+OrderTree::Update( const int node )
+{
+  _size[node] = 1;
+  if ( _left [node] != -1 ) { _size[node] += _size[ _left [node] ]; _parent[ _left [node] ] = node; }
+  if ( _right[node] != -1 ) { _size[node] += _size[ _right[node] ]; _parent[ _right[node] ] = node; }
+}
+
+
+
+void
+OrderTree::Split( const int node, const int N_left, int & left, int & right )
+{
+  if ( node == -1 ) { left = right = -1; return; }
+  Push( node );
+
+  int left_size = _left[node] == -1 ? 0 : _size[ _left[node] ];
+  if ( N_left <= left_size ) {
+    Split( _left[node], N_left, left, _left[node] );
+    right = node;
+  }
+  else {
+    Split( _right[node], N_left - left_size - 1, _right[node], right );
+    left = node;
+  }
+  Update( node );
+  if ( left  != -1 ) _parent[left ] = -1;
+  if ( right != -1 ) _parent[right] = -1;
+}
+
+
+
+int
+OrderTree::Merge( const int left, const int right )
+{
+  if ( left  == -1 ) return right;
+  if ( right == -1 ) return left;
+
+  if ( _priority[left] > _priority[right] ) {
+    Push( left );
+    _right[left] = Merge( _right[left], right );
+    Update( left );
+    return left;
+  }
+  else {
+    Push( right );
+    _left[right] = Merge( left, _left[right] );
+    Update( right );
+    return right;
+  }
+}
@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * OrderTree.h
+ *
+ * An OrderTree is the backing store for the sequence of contigs in a ContigOrdering.  It holds a sequence of distinct contig IDs in [0,N_contigs), each with
+ * an orientation, encoded as in ContigOrdering: contig x is x if forward and ~x if reverse-complemented.
+ *
+ * The sequence is kept in a treap keyed implicitly by position (each node stores the size of its subtree), so that inserting, removing, or moving contigs,
+ * finding the contig at a given position, and finding the position of a given contig all take O(log N) time.  Inverting a range of the sequence (reversing
+ * it and flipping the orientation of every contig in it) also takes O(log N) time: the inversion is marked on the root of the range's subtree and pushed down
+ * lazily.  Since each contig appears at most once, the tree's nodes are simply indexed by contig ID, which makes position lookup by contig ID easy.
+ *
+ * The priorities of the treap are a fixed hash of the contig IDs, so an OrderTree is deterministic and doesn't consume random numbers.
+ *
+ * For scoring, which reads the whole sequence over and over, data() gives the sequence as a flat vector.  This is rebuilt lazily, in O(N) time, the first
+ * time it's asked for after a modification; until then, at() walks the tree.
+ *
+ * Const functions don't modify the tree (pending inversions are taken into account on the way down, not pushed), and the flat vector is rebuilt under a
+ * lock, so an OrderTree can be read from several threads at once.
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _ORDER_TREE__H
+#define _ORDER_TREE__H
+
+
+#include <inttypes.h> // uint32_t
+#include <vector>
+#include <atomic>
+#include <mutex>
+using namespace std;
+
+
+
+class OrderTree
+{
+ public:
+
+  OrderTree( const int N_contigs = 0 );
+  OrderTree( const OrderTree & tree );
+  OrderTree & operator=( const OrderTree & tree );
+
+  // Make the sequence equal to data, in O(N) time.
+  void Assign( const vector<int> & data );
+  void Clear() { Assign( vector<int>() ); }
+
+  int size() const { return _root == -1 ? 0 : _size[_root]; }
+  bool contains( const int contig_ID ) const { return _in_tree[contig_ID]; }
+
+  // Insert the (encoded) contigs in data, in order, so that data[0] ends up at position pos.  pos may equal size().
+  void Insert( const int pos, const vector<int> & data );
+  // Remove the contig at position pos, and return its (encoded) value.
+  int Erase( const int pos );
+  // Invert the range [start,stop]: reverse it, and flip the orientation of each contig in it.
+  void Invert( const int start, const int stop );
+
+  // Return the (encoded) contig at position pos.  This is O(1) if the flat vector is up to date, and O(log N) otherwise.
+  int at( const int pos ) const { if ( _flat_valid.load( memory_order_acquire ) ) return _flat[pos]; return Walk( pos ); }
+  // Return the position of a contig, by its ID, or -1 if it isn't in the sequence.
+  int Position( const int contig_ID ) const;
+
+  // Return the whole (encoded) sequence as a flat vector.  The reference is valid until the next modification.
+  const vector<int> & data() const { if ( !_flat_valid.load( memory_order_acquire ) ) Flatten(); return _flat; }
+
+ private:
+
+  int Walk( const int pos ) const; // find the contig at position pos by walking down the tree
+  void Flatten() const; // rebuild _flat
+
+  void Push( const int node ); // push a pending inversion down to the node's children
+  void Update( const int node ); // recalculate the node's size, and fix its children's parent pointers
+  void Split( const int node, const int N_left, int & left, int & right ); // split off the first N_left nodes
+  int Merge( const int left, const int right );
+
+  int _root;
+  vector<int> _left, _right, _parent, _size;
+  vector<uint32_t> _priority;
+  vector<char> _rc; // the orientation of each contig, before any pending inversions above it
+  vector<char> _invert; // pending inversion of this node's whole subtree (including the node itself)
+  vector<char> _in_tree;
+
+  // The flat vector, and whether it's up to date.  Every modification clears _flat_valid.
+  mutable vector<int> _flat;
+  mutable atomic<bool> _flat_valid;
+  mutable mutex _flat_mutex;
+};
+
+
+#endif
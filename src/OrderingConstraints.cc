@@ -0,0 +1,273 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+// For documentation, see OrderingConstraints.h
+#include "OrderingConstraints.h"
+#include "ContigOrdering.h"
+
+
+#include <assert.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <algorithm> // stable_sort, reverse
+
+// Boost libraries
+#include <boost/algorithm/string.hpp> // trim, split
+#include <boost/filesystem.hpp>
+
+
+
+
+// Report a problem with a constraints file, and exit.
+static void
+ReportConstraintsFailure( const string & constraints_file, const int line_N, const string & line, const string & err_description )
+{
+  cerr << endl
+       << "ERROR: Parsing failure in Lachesis ordering constraints file!" << endl
+       << "FILE: " << constraints_file << endl;
+  if ( line_N > 0 ) cerr << "LINE " << line_N << ": '" << line << "'" << endl;
+  cerr << err_description << endl << endl;
+  exit(1);
+}
+
+
+
+
+OrderingConstraints::OrderingConstraints( const string & constraints_file, const set<int> & cluster, const vector<string> & contig_names )
+{
+  if ( !boost::filesystem::is_regular_file( constraints_file ) )
+    ReportConstraintsFailure( constraints_file, 0, "", "Can't find the file." );
+
+  // Map the names of the contigs in this group to their local IDs.
+  map<string, int> local_IDs;
+  int local_ID = 0;
+  for ( set<int>::const_iterator it = cluster.begin(); it != cluster.end(); ++it )
+    local_IDs[ contig_names.at(*it) ] = local_ID++;
+
+  ifstream in( constraints_file.c_str(), ios::in );
+  string line;
+  vector<string> tokens;
+  int line_N = 0;
+
+  while ( getline( in, line ) ) {
+    line_N++;
+    boost::trim( line );
+    if ( line.empty() || line[0] == '#' ) continue;
+
+    boost::split( tokens, line, boost::is_any_of(" \t"), boost::token_compress_on );
+    if ( tokens.size() != 3 ) ReportConstraintsFailure( constraints_file, line_N, line, "Each constraint has three fields: a type, and two contig names (or a contig name and an orientation)." );
+
+    const int N_contigs_in_line = ( tokens[0] == "orient" ? 1 : 2 );
+    int IDs[2] = { -1, -1 };
+    for ( int i = 0; i < N_contigs_in_line; i++ ) {
+      map<string, int>::const_iterator it = local_IDs.find( tokens[i+1] );
+      if ( it == local_IDs.end() ) ReportConstraintsFailure( constraints_file, line_N, line, "Contig '" + tokens[i+1] + "' isn't in this group." );
+      IDs[i] = it->second;
+    }
+
+    if ( tokens[0] == "pin" || tokens[0] == "forbid" ) {
+      if ( IDs[0] == IDs[1] ) ReportConstraintsFailure( constraints_file, line_N, line, "A contig can't be pinned to, or forbidden from, itself." );
+      if ( tokens[0] == "pin" ) {
+	if ( _pins.insert( Pair( IDs[0], IDs[1] ) ).second ) {
+	  _partners[ IDs[0] ].push_back( IDs[1] );
+	  _partners[ IDs[1] ].push_back( IDs[0] );
+	}
+	if ( _partners[ IDs[0] ].size() > 2 || _partners[ IDs[1] ].size() > 2 )
+	  ReportConstraintsFailure( constraints_file, line_N, line, "A contig can't be pinned to more than two others." );
+      }
+      else _forbidden.insert( Pair( IDs[0], IDs[1] ) );
+
+      if ( Pinned( IDs[0], IDs[1] ) && Forbidden( IDs[0], IDs[1] ) )
+	ReportConstraintsFailure( constraints_file, line_N, line, "These contigs are both pinned and forbidden." );
+    }
+
+    else if ( tokens[0] == "orient" ) {
+      if ( tokens[2] != "+" && tokens[2] != "-" ) ReportConstraintsFailure( constraints_file, line_N, line, "The orientation must be '+' or '-'." );
+      const int orientation = ( tokens[2] == "+" ? FW : RC );
+      if ( _orientations.count( IDs[0] ) && _orientations[ IDs[0] ] != orientation )
+	ReportConstraintsFailure( constraints_file, line_N, line, "This contig has already been given the other orientation." );
+      _orientations[ IDs[0] ] = orientation;
+    }
+
+    else ReportConstraintsFailure( constraints_file, line_N, line, "Unknown constraint type '" + tokens[0] + "' (must be pin, forbid, or orient.)" );
+  }
+
+  FindChains( constraints_file );
+
+  cout << "OrderingConstraints: Loaded " << _pins.size() << " pins, " << _forbidden.size() << " forbidden adjacencies, and " << _orientations.size()
+       << " fixed orientations from " << constraints_file << endl;
+}
+
+
+
+int
+OrderingConstraints::Orientation( const int c ) const
+{
+  map<int, int>::const_iterator it = _orientations.find(c);
+  return ( it == _orientations.end() ? -1 : it->second );
+}
+
+
+
+vector<int>
+OrderingConstraints::Contigs() const
+{
+  set<int> contigs;
+  for ( set< pair<int,int> >::const_iterator it = _pins.begin(); it != _pins.end(); ++it ) {
+    contigs.insert( it->first );
+    contigs.insert( it->second );
+  }
+  for ( set< pair<int,int> >::const_iterator it = _forbidden.begin(); it != _forbidden.end(); ++it ) {
+    contigs.insert( it->first );
+    contigs.insert( it->second );
+  }
+  for ( map<int, int>::const_iterator it = _orientations.begin(); it != _orientations.end(); ++it )
+    contigs.insert( it->first );
+
+  return vector<int>( contigs.begin(), contigs.end() );
+}
+
+
+
+// FindChains: Walk each chain of pinned contigs from one of its ends.  Any pinned contig that isn't reached this way is in a cycle.
+void
+OrderingConstraints::FindChains( const string & constraints_file )
+{
+  set<int> visited;
+
+  for ( map<int, vector<int> >::const_iterator it = _partners.begin(); it != _partners.end(); ++it ) {
+    if ( it->second.size() != 1 || visited.count( it->first ) ) continue; // not an end of a chain, or this chain was walked from its other end
+
+    vector<int> chain( 1, it->first );
+    int prev = -1, c = it->first;
+    while ( true ) {
+      visited.insert(c);
+      const vector<int> & partners = _partners.at(c);
+      int next = -1;
+      for ( size_t i = 0; i < partners.size(); i++ )
+	if ( partners[i] != prev ) next = partners[i];
+      if ( next == -1 ) break;
+      chain.push_back( next );
+      prev = c;
+      c = next;
+    }
+    _chains.push_back( chain );
+  }
+
+  if ( visited.size() != _partners.size() ) ReportConstraintsFailure( constraints_file, 0, "", "The pinned contigs form a cycle." );
+}
+
+
+
+void
+OrderingConstraints::ConstrainShreds( vector< vector<int> > & shreds ) const
+{
+  if ( shreds.empty() || empty() ) return;
+
+  // Find the chains of pinned contigs that aren't already contiguous, in either direction, in one shred.  Their contigs are pulled out of the shreds.
+  map<int, pair<int,int> > where; // contig ID -> ( shred, position in shred )
+  for ( size_t i = 0; i < shreds.size(); i++ )
+    for ( size_t j = 0; j < shreds[i].size(); j++ )
+      where[ shreds[i][j] ] = make_pair( i, j );
+
+  set<int> pulled;
+  vector< vector<int> > pulled_chains;
+  for ( size_t i = 0; i < _chains.size(); i++ ) {
+    const vector<int> & chain = _chains[i];
+    const int len = chain.size();
+
+    bool contiguous = false;
+    map<int, pair<int,int> >::const_iterator it = where.find( chain[0] );
+    if ( it != where.end() ) {
+      const vector<int> & shred = shreds[ it->second.first ];
+      const int pos = it->second.second, shred_len = shred.size();
+      bool fw = ( pos + len <= shred_len ), rc = ( pos - len + 1 >= 0 );
+      for ( int j = 0; j < len; j++ ) {
+	if ( fw && shred[pos+j] != chain[j] ) fw = false;
+	if ( rc && shred[pos-j] != chain[j] ) rc = false;
+      }
+      contiguous = fw || rc;
+    }
+
+    if ( contiguous ) continue;
+    pulled.insert( chain.begin(), chain.end() );
+    pulled_chains.push_back( chain );
+  }
+
+  // Cut the shreds at the pulled contigs and at the forbidden adjacencies.  Keep track of which pieces came from the trunk.
+  vector< vector<int> > pieces;
+  vector<bool> from_trunk;
+  for ( size_t i = 0; i < shreds.size(); i++ ) {
+    vector<int> piece;
+    for ( size_t j = 0; j <= shreds[i].size(); j++ ) {
+      const bool at_end = ( j == shreds[i].size() );
+      if ( at_end || pulled.count( shreds[i][j] ) || ( !piece.empty() && Forbidden( piece.back(), shreds[i][j] ) ) ) {
+	if ( !piece.empty() ) {
+	  pieces.push_back( piece );
+	  from_trunk.push_back( i == 0 );
+	}
+	piece.clear();
+      }
+      if ( !at_end && !pulled.count( shreds[i][j] ) ) piece.push_back( shreds[i][j] );
+    }
+  }
+
+  // The new trunk is the largest piece of the old trunk, or if the whole trunk was pulled, the largest piece of all.
+  int trunk_ID = -1;
+  for ( size_t i = 0; i < pieces.size(); i++ )
+    if ( from_trunk[i] && ( trunk_ID == -1 || pieces[i].size() > pieces[trunk_ID].size() ) ) trunk_ID = i;
+
+  vector< vector<int> > others;
+  for ( size_t i = 0; i < pieces.size(); i++ )
+    if ( (int) i != trunk_ID ) others.push_back( pieces[i] );
+  others.insert( others.end(), pulled_chains.begin(), pulled_chains.end() );
+
+  struct LongerShred { bool operator()( const vector<int> & a, const vector<int> & b ) const { return a.size() > b.size(); } };
+  stable_sort( others.begin(), others.end(), LongerShred() );
+
+  shreds.clear();
+  if ( trunk_ID != -1 ) shreds.push_back( pieces[trunk_ID] );
+  shreds.insert( shreds.end(), others.begin(), others.end() );
+}
+
+
+
+int
+OrderingConstraints::N_violations( const ContigOrdering & order ) const
+{
+  int N_violations = 0;
+
+  for ( set< pair<int,int> >::const_iterator it = _pins.begin(); it != _pins.end(); ++it ) {
+    const int pos1 = order.contig_pos( it->first ), pos2 = order.contig_pos( it->second );
+    if ( pos1 == -1 || pos2 == -1 || abs( pos1 - pos2 ) != 1 ) N_violations++;
+  }
+
+  for ( set< pair<int,int> >::const_iterator it = _forbidden.begin(); it != _forbidden.end(); ++it ) {
+    const int pos1 = order.contig_pos( it->first ), pos2 = order.contig_pos( it->second );
+    if ( pos1 != -1 && pos2 != -1 && abs( pos1 - pos2 ) == 1 ) N_violations++;
+  }
+
+  for ( map<int, int>::const_iterator it = _orientations.begin(); it != _orientations.end(); ++it ) {
+    const int pos = order.contig_pos( it->first );
+    if ( pos != -1 && (int) order.contig_rc( pos ) != it->second ) N_violations++;
+  }
+
+  return N_violations;
+}
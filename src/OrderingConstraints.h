@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * OrderingConstraints.h
+ *
+ * OrderingConstraints: A curator's constraints on the ordering of the contigs in one group, as read from the group's constraints file (see the INI parameter
+ * ORDER_CONSTRAINTS_DIR.)  Once they're given to a ChromLinkMatrix via SetConstraints(), the ordering algorithms honour them:
+ * FindSpanningTree() never uses a forbidden adjacency, and always uses a pinned one if it can; SmoothThornsInTree() doesn't undo either;
+ * ReinsertShreds() and InsertShreds() never make a forbidden adjacency or break up a pinned one, and always insert pinned contigs; and OrientContigs() gives
+ * each contig with a fixed orientation that orientation.  ChromLinkMatrix::ReorderIncrementally() uses them to re-optimize an existing ordering quickly.
+ *
+ * A constraints file has one constraint per line.  Blank lines, and lines starting with '#', are ignored.  Contigs are given by their names in the draft
+ * assembly, and must all be in the group.
+ *   pin <contig1> <contig2>      The two contigs must be adjacent in the ordering, in either order.
+ *   forbid <contig1> <contig2>   The two contigs must not be adjacent.
+ *   orient <contig> <+|->        The contig must be forward (+) or reverse-complemented (-) in the ordering.
+ * A contig can be pinned to at most two others, and the pins can't form a cycle, so the pinned contigs form chains.
+ *
+ * To move a contig from one group to another, edit main_results/clusters.by_name.txt instead, and rerun with DO_CLUSTERING = 0.
+ *
+ * Internally, contigs are identified by their local IDs in the group, as in a ChromLinkMatrix or ContigOrdering.
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _ORDERING_CONSTRAINTS__H
+#define _ORDERING_CONSTRAINTS__H
+
+#include "ContigOrdering.h"
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+using namespace std;
+
+
+
+
+class OrderingConstraints
+{
+ public:
+
+  // Constructor: no constraints.
+  OrderingConstraints() {}
+  // Constructor: Read a constraints file for a group, whose contigs have the global IDs in cluster (their local IDs are their indices in the set.)
+  // contig_names names all of the contigs in the draft assembly.
+  OrderingConstraints( const string & constraints_file, const set<int> & cluster, const vector<string> & contig_names );
+
+  bool empty() const { return _pins.empty() && _forbidden.empty() && _orientations.empty(); }
+  int N_constraints() const { return _pins.size() + _forbidden.size() + _orientations.size(); }
+
+  // Queries.  The contigs are given by local ID.
+  bool Pinned   ( const int c1, const int c2 ) const { return _pins     .count( Pair( c1, c2 ) ); }
+  bool Forbidden( const int c1, const int c2 ) const { return _forbidden.count( Pair( c1, c2 ) ); }
+  bool Pinned   ( const int c ) const { return _partners.count(c); } // is this contig pinned to any other?
+  int Orientation( const int c ) const; // FW or RC, or -1 if the orientation is free
+
+  // Contigs: All of the contigs named in any constraint, in increasing order.
+  vector<int> Contigs() const;
+
+  // ConstrainShreds: Make a set of shreds (see ChromLinkMatrix::ReinsertShreds) obey the constraints, so that inserting them with InsertShreds() will too.
+  // shreds[0] is taken to be the trunk.  Each chain of pinned contigs that isn't already contiguous in one shred is taken out of the shreds and made into a
+  // shred of its own, and the shreds are cut at each forbidden adjacency.  Afterwards shreds[0] is the largest piece of the trunk, and the other shreds are
+  // in decreasing order of size.
+  void ConstrainShreds( vector< vector<int> > & shreds ) const;
+
+  // N_violations: The number of constraints that this ordering violates.  A pin is violated if its contigs aren't adjacent (or aren't both in the ordering);
+  // a fixed orientation only applies if the contig is in the ordering.
+  int N_violations( const ContigOrdering & order ) const;
+
+ private:
+
+  static pair<int,int> Pair( const int c1, const int c2 ) { return c1 < c2 ? make_pair( c1, c2 ) : make_pair( c2, c1 ); }
+
+  // FindChains: Fill _chains from _partners, and check that the pins don't form a cycle.
+  void FindChains( const string & constraints_file );
+
+  set< pair<int,int> > _pins, _forbidden; // pairs of local contig IDs, with the lower ID first
+  map<int, int> _orientations; // local contig ID -> FW or RC
+  map<int, vector<int> > _partners; // local contig ID -> the contigs it's pinned to
+  vector< vector<int> > _chains; // each maximal chain of pinned contigs, in order along the chain
+};
+
+
+#endif
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+// For documentation, see ProgressJournal.h
+#include "ProgressJournal.h"
+
+// C libraries
+#include <assert.h>
+
+// STL declarations
+#include <iostream>
+#include <fstream>
+
+// Boost libraries
+#include <boost/filesystem.hpp>
+
+
+
+
+// Constructor.  If resume = true, load the steps already recorded in journal_file; otherwise clear journal_file.
+ProgressJournal::ProgressJournal( const string & journal_file, const bool resume )
+  : _journal_file( journal_file )
+{
+  if ( !resume ) {
+    boost::filesystem::remove( _journal_file );
+    return;
+  }
+
+  if ( !boost::filesystem::is_regular_file( _journal_file ) ) return;
+
+  ifstream in( _journal_file.c_str(), ios::in );
+  string line;
+  while ( getline( in, line ) ) {
+    size_t tab = line.find( '\t' );
+    if ( tab == string::npos ) continue; // malformed, or cut off by a crash
+    _done[ line.substr( 0, tab ) ] = line.substr( tab+1 );
+  }
+
+  cout << "ProgressJournal: RESUME = 1; found " << _done.size() << " completed steps in " << _journal_file << endl;
+}
+
+
+
+// Return true if this step was recorded as done with this fingerprint.
+bool
+ProgressJournal::Done( const string & step, const string & fingerprint ) const
+{
+  lock_guard<mutex> lock( _mutex );
+  map<string,string>::const_iterator it = _done.find( step );
+  return it != _done.end() && it->second == fingerprint;
+}
+
+
+
+// Record this step as done.  The line is flushed to disk immediately, so it survives if the run is killed later.
+void
+ProgressJournal::MarkDone( const string & step, const string & fingerprint )
+{
+  assert( step.find( '\t' ) == string::npos );
+  lock_guard<mutex> lock( _mutex );
+
+  ofstream out( _journal_file.c_str(), ios::out | ios::app );
+  out << step << '\t' << fingerprint << endl;
+  out.close();
+
+  _done[step] = fingerprint;
+}
@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * ProgressJournal.h
+ *
+ * A ProgressJournal is a small append-only record, kept at <OUTPUT_DIR>/progress.journal, of which steps of a Lachesis run have been completed.  A step is
+ * something like "clustering" or "ordering.group7".  Each step is recorded with a fingerprint of the inputs it was run on (see CacheManifest::Fingerprint),
+ * and it is only recorded after all of its output files have been completely written (and renamed into place.)
+ *
+ * If the INI parameter RESUME = 1, Lachesis reads the journal at startup and skips any step that was already completed with the same fingerprint.  So if a
+ * long run dies partway through ordering, rerunning it only costs the unfinished groups.  If RESUME = 0, the journal is cleared at startup and every step is
+ * run again (and journaled again.)
+ *
+ * Each line of the journal file has the form "<step>\t<fingerprint>".  A line cut off by a crash simply won't match, so its step will be redone.
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _PROGRESS_JOURNAL__H
+#define _PROGRESS_JOURNAL__H
+
+
+#include <map>
+#include <mutex>
+#include <string>
+using namespace std;
+
+
+
+
+class ProgressJournal
+{
+ public:
+
+  // Constructor.  If resume = true, load the steps already recorded in journal_file; otherwise clear journal_file.
+  ProgressJournal( const string & journal_file, const bool resume );
+
+  // Return true if this step was recorded as done with this fingerprint.
+  bool Done( const string & step, const string & fingerprint ) const;
+
+  // Record this step as done.  The line is flushed to disk immediately.  This may be called from several threads at once.
+  void MarkDone( const string & step, const string & fingerprint );
+
+ private:
+
+  string _journal_file;
+  map<string,string> _done; // step -> fingerprint; later lines for the same step override earlier ones
+  mutable mutex _mutex; // guards _done and the journal file
+};
+
+
+#endif
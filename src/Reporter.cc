@@ -136,7 +136,7 @@ Reporter::Reporter( const RunParams & run_params,
 		    const vector<ContigOrdering> & trunks,
 		    const vector<ContigOrdering> & orders )
   : _run_params( run_params ),
-    _true_mapping( run_params.LoadTrueMapping() ),
+    _true_mapping( _run_params.LoadTrueMapping() ), // shared with run_params, via the copy
     _N_contigs  ( NTargetsInSAM( run_params._SAM_files[0] ) ),
     _N_chroms   ( _true_mapping ? _true_mapping->NTargets() : -1 ),
     _N_clusters ( clusters.size() ),
@@ -215,7 +215,6 @@ Reporter::Reporter( const RunParams & run_params,
 
 Reporter::~Reporter()
 {
-  if ( _true_mapping ) delete _true_mapping;
   delete _data;
 }
 
@@ -22,12 +22,17 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <set>
 #include <fstream>
 #include <iostream>
+#include <thread> // hardware_concurrency
+#include <algorithm> // find
+#include <mutex>
+#include <future> // async
 
 
 // Boost libraries
-#include <boost/algorithm/string.hpp> // split
+#include <boost/algorithm/string.hpp> // split, trim, starts_with
 #include <boost/algorithm/string/join.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
@@ -122,14 +127,18 @@ RunParams::ParseIniFile( const string & ini_file )
   // This is the order in which RunParams expects to see the parameters.  It's also the order in which the parameters appear in the default INI files.
   // It's important to enforce the order because some parameters depend on earlier ones (e.g., SAM_DIR must be loaded so we know where to look for SAM_FILES.)
   // If you want to permanently add or remove any parameters, make sure to update N_keys as well as keys_order_array.
-  const int N_keys = 28;
+  const int N_keys = 42;
   const char * keys_order_array[] = { "SPECIES", "OUTPUT_DIR",
-				      "DRAFT_ASSEMBLY_FASTA", "SAM_DIR", "SAM_FILES", "RE_SITE_SEQ",
+				      "DRAFT_ASSEMBLY_FASTA", "SAM_DIR", "SAM_FILES", "RE_SITE_SEQ", "LIBRARIES_FILE",
 				      "USE_REFERENCE", "SIM_BIN_SIZE", "REF_ASSEMBLY_FASTA", "BLAST_FILE_HEAD",
-				      "DO_CLUSTERING", "DO_ORDERING", "DO_REPORTING", "OVERWRITE_GLM", "OVERWRITE_CLMS",
+				      "DO_CLUSTERING", "DO_ORDERING", "DO_REPORTING", "OVERWRITE_GLM", "OVERWRITE_CLMS", "RESUME", "THREADS", "MEMORY_BUDGET",
+				      "MISJOIN_WINDOW", "MISJOIN_MAX_RATIO",
 				      "CLUSTER_N", "CLUSTER_CONTIGS_WITH_CENS", "CLUSTER_MIN_RE_SITES", "CLUSTER_MAX_LINK_DENSITY",
-				      "CLUSTER_NONINFORMATIVE_RATIO", "CLUSTER_DRAW_HEATMAP", "CLUSTER_DRAW_DOTPLOT",
-				      "ORDER_MIN_N_RES_IN_TRUNK", "ORDER_MIN_N_RES_IN_SHREDS", "ORDER_DRAW_DOTPLOTS",
+				      "CLUSTER_NONINFORMATIVE_RATIO", "CLUSTER_BALANCE_ITERATIONS", "CLUSTER_BALANCE_TOLERANCE",
+				      "CLUSTER_DRAW_HEATMAP", "CLUSTER_DRAW_DOTPLOT",
+				      "ORDER_MIN_N_RES_IN_TRUNK", "ORDER_MIN_N_RES_IN_SHREDS", "ORDER_EXHAUSTIVE_INSERTION", "ORDER_BEAM_WIDTH",
+				      "ORDER_BOOTSTRAP_REPLICATES",
+				      "ORDER_CONSTRAINTS_DIR", "ORDER_INCREMENTAL", "ORDER_INCREMENTAL_WINDOW", "ORDER_DRAW_DOTPLOTS",
 				      "REPORT_EXCLUDED_GROUPS", "REPORT_QUALITY_FILTER", "REPORT_DRAW_HEATMAP" };
   const vector<string> keys_order( keys_order_array, keys_order_array + N_keys );
 
@@ -141,6 +150,38 @@ RunParams::ParseIniFile( const string & ini_file )
     else variable_N_values[key] = false;
   }
 
+  // Some keys were added after many INI files had already been written.  These keys are optional: if one is left out, its variable keeps the default value
+  // set here.  Optional keys that do appear must still appear in the proper order.
+  set<string> optional_keys;
+  optional_keys.insert( "LIBRARIES_FILE" );
+  optional_keys.insert( "RESUME" );
+  optional_keys.insert( "THREADS" );
+  optional_keys.insert( "MEMORY_BUDGET" );
+  optional_keys.insert( "MISJOIN_WINDOW" );
+  optional_keys.insert( "MISJOIN_MAX_RATIO" );
+  optional_keys.insert( "CLUSTER_BALANCE_ITERATIONS" );
+  optional_keys.insert( "CLUSTER_BALANCE_TOLERANCE" );
+  optional_keys.insert( "ORDER_EXHAUSTIVE_INSERTION" );
+  optional_keys.insert( "ORDER_BEAM_WIDTH" );
+  optional_keys.insert( "ORDER_BOOTSTRAP_REPLICATES" );
+  optional_keys.insert( "ORDER_CONSTRAINTS_DIR" );
+  optional_keys.insert( "ORDER_INCREMENTAL" );
+  optional_keys.insert( "ORDER_INCREMENTAL_WINDOW" );
+  _libraries_file = ".";
+  _resume = false;
+  _N_threads = 1;
+  _memory_budget_MB = 0;
+  _misjoin_window = 100000;
+  _misjoin_max_ratio = 0.2;
+  _cluster_balance_iterations = 0;
+  _cluster_balance_tolerance = 1e-4;
+  _order_exhaustive_insertion = false;
+  _order_beam_width = 0;
+  _order_bootstrap_replicates = 0;
+  _order_constraints_dir = ".";
+  _order_incremental = false;
+  _order_incremental_window = 3;
+
 
 
 
@@ -185,7 +226,10 @@ RunParams::ParseIniFile( const string & ini_file )
     if ( !variable_N_values.at(key) && tokens.size() != 3 )
       ReportParseFailure( "Key '" + key + "' should be followed by only one value, but multiple values are given." );
 
-    // Require the key to be the next key in the ordered list.
+    // Require the key to be the next key in the ordered list, skipping past any optional keys that have been left out.
+    while ( current_key_ID < N_keys && key != keys_order[current_key_ID] && optional_keys.count( keys_order[current_key_ID] ) ) current_key_ID++;
+    if ( current_key_ID == N_keys )
+      ReportParseFailure( "Key '" + key + "' appears too late in the INI file.\nMake sure not to change the order in which the keys appear in the INI file." );
     if ( key != keys_order[current_key_ID] )
       ReportParseFailure( "Key '" + key + "' appears too early in the INI file; we expect to see the key '" + keys_order[current_key_ID] + "' instead.\nMake sure not to change the order in which the keys appear in the INI file." );
     current_key_ID++;
@@ -233,6 +277,11 @@ RunParams::ParseIniFile( const string & ini_file )
       VerifySAMFileHeaders();
     }
     else if ( key == "RE_SITE_SEQ" ) _RE_site_seq = value;
+    else if ( key == "LIBRARIES_FILE" ) {
+      _libraries_file = value;
+      if ( value != "." && !boost::filesystem::is_regular_file( value ) )
+	ReportParseFailure( "Can't find file '" + value + "'." );
+    }
     else if ( key == "USE_REFERENCE" ) _use_ref = ConvertOrFail<bool>( value );
     else if ( key == "SIM_BIN_SIZE" ) {
       _sim_bin_size = ConvertOrFail<int>( value );
@@ -256,6 +305,25 @@ RunParams::ParseIniFile( const string & ini_file )
     else if ( key == "DO_REPORTING" )   _do_reporting   = ConvertOrFail<bool>( value );
     else if ( key == "OVERWRITE_GLM" )  _overwrite_GLM  = ConvertOrFail<bool>( value );
     else if ( key == "OVERWRITE_CLMS" ) _overwrite_CLMs = ConvertOrFail<bool> ( value );
+    else if ( key == "RESUME" )         _resume         = ConvertOrFail<bool>( value );
+    else if ( key == "THREADS" ) {
+      _N_threads = ConvertOrFail<int>( value );
+      if ( _N_threads < 0 ) ReportParseFailure( "THREADS must be at least 1 (or 0, meaning use all of the cores on this machine.)" );
+      if ( _N_threads == 0 ) _N_threads = max( 1u, thread::hardware_concurrency() );
+    }
+    else if ( key == "MEMORY_BUDGET" ) {
+      _memory_budget_MB = ConvertOrFail<int>( value );
+      if ( _memory_budget_MB < 0 ) ReportParseFailure( "MEMORY_BUDGET must be at least 0 (0 means load all link data in memory.)" );
+    }
+    else if ( key == "MISJOIN_WINDOW" ) {
+      _misjoin_window = ConvertOrFail<int>( value );
+      if ( _misjoin_window < 0 || ( _misjoin_window > 0 && _misjoin_window < 10000 ) )
+	ReportParseFailure( "MISJOIN_WINDOW must be at least 10000 (or 0, meaning don't look for misjoins.)" );
+    }
+    else if ( key == "MISJOIN_MAX_RATIO" ) {
+      _misjoin_max_ratio = ConvertOrFail<double>( value );
+      if ( _misjoin_max_ratio <= 0 || _misjoin_max_ratio >= 1 ) ReportParseFailure( "MISJOIN_MAX_RATIO must be between 0 and 1." );
+    }
     else if ( key == "CLUSTER_N" )                    _cluster_N                    = ConvertOrFail<int>   ( value );
     else if ( key == "CLUSTER_CONTIGS_WITH_CENS" ) {
       _cluster_CEN_contig_IDs.clear();
@@ -275,10 +343,36 @@ RunParams::ParseIniFile( const string & ini_file )
       if ( _cluster_noninformative_ratio != 0 && _cluster_noninformative_ratio <= 1 )
 	ReportParseFailure( "CLUSTER_NONINFORMATIVE_RATIO must either be 0 or >1." );
     }
+    else if ( key == "CLUSTER_BALANCE_ITERATIONS" ) {
+      _cluster_balance_iterations = ConvertOrFail<int>( value );
+      if ( _cluster_balance_iterations < 0 ) ReportParseFailure( "CLUSTER_BALANCE_ITERATIONS must be at least 0 (0 means don't balance the matrix.)" );
+    }
+    else if ( key == "CLUSTER_BALANCE_TOLERANCE" ) {
+      _cluster_balance_tolerance = ConvertOrFail<double>( value );
+      if ( _cluster_balance_tolerance <= 0 || _cluster_balance_tolerance >= 1 ) ReportParseFailure( "CLUSTER_BALANCE_TOLERANCE must be between 0 and 1." );
+    }
     else if ( key == "CLUSTER_DRAW_HEATMAP" )         _cluster_draw_heatmap         = ConvertOrFail<bool>  ( value );
     else if ( key == "CLUSTER_DRAW_DOTPLOT" )         _cluster_draw_dotplot         = ConvertOrFail<bool>  ( value );
     else if ( key == "ORDER_MIN_N_RES_IN_TRUNK" )     _order_min_N_REs_in_trunk     = ConvertOrFail<int>   ( value );
     else if ( key == "ORDER_MIN_N_RES_IN_SHREDS" )    _order_min_N_REs_in_shreds    = ConvertOrFail<int>   ( value );
+    else if ( key == "ORDER_EXHAUSTIVE_INSERTION" )   _order_exhaustive_insertion   = ConvertOrFail<bool>  ( value );
+    else if ( key == "ORDER_BEAM_WIDTH" ) {
+      _order_beam_width = ConvertOrFail<int>( value );
+      if ( _order_beam_width < 0 ) ReportParseFailure( "ORDER_BEAM_WIDTH must be at least 0 (0 means don't use beam search.)" );
+    }
+    else if ( key == "ORDER_BOOTSTRAP_REPLICATES" ) {
+      _order_bootstrap_replicates = ConvertOrFail<int>( value );
+      if ( _order_bootstrap_replicates < 0 ) ReportParseFailure( "ORDER_BOOTSTRAP_REPLICATES must be at least 0 (0 means don't bootstrap.)" );
+    }
+    else if ( key == "ORDER_CONSTRAINTS_DIR" ) {
+      _order_constraints_dir = value;
+      if ( value != "." && !boost::filesystem::is_directory( value ) ) ReportParseFailure( "Can't find directory '" + value + "'." );
+    }
+    else if ( key == "ORDER_INCREMENTAL" )            _order_incremental            = ConvertOrFail<bool>  ( value );
+    else if ( key == "ORDER_INCREMENTAL_WINDOW" ) {
+      _order_incremental_window = ConvertOrFail<int>( value );
+      if ( _order_incremental_window < 0 ) ReportParseFailure( "ORDER_INCREMENTAL_WINDOW must be at least 0." );
+    }
     else if ( key == "ORDER_DRAW_DOTPLOTS" )          _order_draw_dotplots          = ConvertOrFail<bool>  ( value );
     else if ( key == "REPORT_EXCLUDED_GROUPS" ) {
       _report_excluded_groups.clear();
@@ -308,6 +402,8 @@ RunParams::ParseIniFile( const string & ini_file )
   }
 
 
+  // Any keys left over at the end must be optional.
+  while ( current_key_ID < N_keys && optional_keys.count( keys_order[current_key_ID] ) ) current_key_ID++;
   assert( current_key_ID == N_keys );
 }
 
@@ -341,15 +437,16 @@ RunParams::LoadDraftContigNames() const
 
 
 // Get the filename that contains the number of restriction enzyme sites for each contig in the draft assembly.  This might require generating the file,
-// by calling the script CountMotifsInFasta.pl.
+// by calling the script CountMotifsInFasta.pl.  The sites are those of RE_site_seq, or of RE_SITE_SEQ if RE_site_seq is empty.
 string
-RunParams::DraftContigRESitesFilename() const
+RunParams::DraftContigRESitesFilename( const string & RE_site_seq ) const
 {
-  string RE_sites_file = _draft_assembly_fasta + ".counts_" + _RE_site_seq + ".txt";
+  const string & seq = RE_site_seq == "" ? _RE_site_seq : RE_site_seq;
+  string RE_sites_file = _draft_assembly_fasta + ".counts_" + seq + ".txt";
 
   // If this function hasn't already been run, the file may not exist, in which case the script CountMotifsInFasta.pl needs to be run.
   if ( !boost::filesystem::is_regular_file( RE_sites_file ) ) {
-    string cmd = "CountMotifsInFasta.pl " + _draft_assembly_fasta + " " + _RE_site_seq;
+    string cmd = "CountMotifsInFasta.pl " + _draft_assembly_fasta + " " + seq;
     system( cmd.c_str() );
     assert( boost::filesystem::is_regular_file( RE_sites_file ) ); // if this fails, the CountMotifsInFasta.pl script didn't run correctly
   }
@@ -359,32 +456,122 @@ RunParams::DraftContigRESitesFilename() const
 
 
 
-// Load a TrueMapping using the files in this RunParams object.
-// If _use_ref == false, returns a NULL pointer; otherwise returns a new object that must be 'delete'd later to save memory.
-TrueMapping *
-RunParams::LoadTrueMapping() const
+// Report a problem with the LIBRARIES_FILE, and exit.
+static void
+ReportLibrariesFailure( const string & libraries_file, const int line_N, const string & line, const string & err_description )
 {
-  if ( !_use_ref ) return NULL;
+  cerr << endl
+       << "ERROR: Parsing failure in Lachesis LIBRARIES_FILE!" << endl
+       << "FILE: " << libraries_file << endl;
+  if ( line_N > 0 ) cerr << "LINE " << line_N << ": '" << line << "'" << endl;
+  cerr << err_description << endl << endl;
+  exit(1);
+}
 
-  assert( !_SAM_files.empty() );
 
-  // Call these functions to fill the cache variables _ref_contig_names and _draft_contig_names, respectively.
-  LoadRefGenomeContigNames();
-  LoadDraftContigNames();
 
-  // Create a TrueMapping object, which records where the contigs are truly located on the reference.
+// Load the Hi-C libraries described in the LIBRARIES_FILE (see bin/INIs/test_case.ini for the format.)  If LIBRARIES_FILE = ., return the default
+// LinkLibraries, with every read pair in one library.  This might require generating RE sites files, via DraftContigRESitesFilename().
+LinkLibraries
+RunParams::LoadLinkLibraries() const
+{
+  LinkLibraries libraries;
+  if ( _libraries_file == "." ) return libraries;
+
+  cout << "RunParams is loading Hi-C libraries from " << _libraries_file << endl;
+  libraries.SetReferenceRESites( ParseTabDelimFile<int>( DraftContigRESitesFilename(), 1 ) );
+
+  ifstream in( _libraries_file.c_str(), ios::in );
+  string line;
+  vector<string> tokens;
+  int line_N = 0, N_libraries = 0;
+
+  while ( getline( in, line ) ) {
+    line_N++;
+    boost::trim( line );
+    if ( line.empty() || line[0] == '#' ) continue;
+
+    boost::split( tokens, line, boost::is_any_of(" \t"), boost::token_compress_on );
+    if ( tokens.size() < 4 )
+      ReportLibrariesFailure( _libraries_file, line_N, line, "Each library needs a name, a weight, an RE site sequence, and at least one SAM file or read group." );
+
+    double weight = 0;
+    try { weight = boost::lexical_cast<double>( tokens[1] ); }
+    catch ( boost::bad_lexical_cast & ) {}
+    if ( !( weight > 0 ) ) ReportLibrariesFailure( _libraries_file, line_N, line, "The weight '" + tokens[1] + "' isn't a positive number." );
+
+    // A library with the reference enzyme uses the reference RE sites, which LinkLibraries represents by an empty vector.
+    vector<int> RE_sites;
+    if ( tokens[2] != "." && tokens[2] != _RE_site_seq ) RE_sites = ParseTabDelimFile<int>( DraftContigRESitesFilename( tokens[2] ), 1 );
+
+    libraries.AddLibrary( tokens[0], weight, RE_sites );
+    for ( size_t i = 3; i < tokens.size(); i++ ) {
+      if ( boost::starts_with( tokens[i], "RG:" ) ) libraries.AssignReadGroup( tokens[i].substr(3), N_libraries );
+      else {
+	string SAM_file = _SAM_dir + "/" + tokens[i];
+	if ( find( _SAM_files.begin(), _SAM_files.end(), SAM_file ) == _SAM_files.end() )
+	  ReportLibrariesFailure( _libraries_file, line_N, line, "File '" + tokens[i] + "' isn't one of the SAM_FILES." );
+	libraries.AssignFile( SAM_file, N_libraries );
+      }
+    }
+    N_libraries++;
+  }
+
+  if ( N_libraries == 0 ) ReportLibrariesFailure( _libraries_file, 0, "", "No libraries are described." );
+
+  // Unless read groups are in play, every SAM file has to be in a library.  (With read groups, unassigned read pairs are caught as they're read.)
+  if ( !libraries.uses_read_groups() )
+    for ( size_t i = 0; i < _SAM_files.size(); i++ )
+      if ( libraries.FileLibrary( _SAM_files[i] ) == -1 )
+	ReportLibrariesFailure( _libraries_file, 0, "", "SAM file '" + _SAM_files[i] + "' isn't assigned to any library." );
+
+  return libraries;
+}
+
+
+
+// Get the RE sites files of the libraries in LIBRARIES_FILE with their own enzymes.  Lines that LoadLinkLibraries() would reject are skipped here.
+vector<string>
+RunParams::LibraryRESitesFilenames() const
+{
+  vector<string> RE_sites_files;
+  if ( _libraries_file == "." ) return RE_sites_files;
+
+  ifstream in( _libraries_file.c_str(), ios::in );
+  string line;
+  vector<string> tokens;
+  while ( getline( in, line ) ) {
+    boost::trim( line );
+    if ( line.empty() || line[0] == '#' ) continue;
+    boost::split( tokens, line, boost::is_any_of(" \t"), boost::token_compress_on );
+    if ( tokens.size() >= 4 && tokens[2] != "." && tokens[2] != _RE_site_seq ) RE_sites_files.push_back( DraftContigRESitesFilename( tokens[2] ) );
+  }
+
+  return RE_sites_files;
+}
+
+
+
+// BuildTrueMapping: Create a TrueMapping object, which records where the contigs are truly located on the reference.  This takes its inputs by value, and
+// touches nothing else, so it can run on a background thread while the RunParams is used elsewhere.
+static shared_ptr<const TrueMapping>
+BuildTrueMapping( const string species, const int sim_bin_size, const vector<string> draft_contig_names, const vector<string> ref_contig_names,
+		  const string BLAST_file_head, const string out_dir, const string SAM_file )
+{
   // If the draft assembly consists of simulated bins from the reference assembly, use a special constructor that deduces the true location of each bin.
-  // Otherwise, pass the BLAST file head into the constructor so it can use those alignments.
+  // Otherwise, pass the BLAST file head into the constructor so it can use those alignments.  That constructor caches what it parses in out_dir/cached_data,
+  // which a fresh run may not have made yet.
+  if ( sim_bin_size == 0 ) system( ( "mkdir -p " + out_dir + "/cached_data" ).c_str() );
 
   TrueMapping * mapping =
-    _sim_bin_size != 0 ?
-    new TrueMapping( _species, _sim_bin_size, _draft_contig_names, _ref_contig_names )
+    sim_bin_size != 0 ?
+    new TrueMapping( species, sim_bin_size, draft_contig_names, ref_contig_names )
     :
-    new TrueMapping( _species, _draft_contig_names, _ref_contig_names, _BLAST_file_head, _out_dir, _SAM_files[0] );
+    new TrueMapping( species, draft_contig_names, ref_contig_names, BLAST_file_head, out_dir, SAM_file );
 
 
   // Remove heterochromatic regions from the fly reference.
-  if ( _species == "fly" ) {
+  if ( species == "fly" ) {
     mapping->RemoveTarget( "2LHet" );
     mapping->RemoveTarget( "2RHet" );
     mapping->RemoveTarget( "3LHet" );
@@ -399,7 +586,61 @@ RunParams::LoadTrueMapping() const
     mapping->MergeTargets( "3L", "3R", "3" );
   }
 
-  return mapping;
+  return shared_ptr<const TrueMapping>( mapping );
+}
+
+
+
+// Load a TrueMapping using the files in this RunParams object.  If _use_ref == false, returns a NULL pointer.
+// The TrueMapping is only built on the first call, which can take a while; later calls return the cached object.
+const TrueMapping *
+RunParams::LoadTrueMapping() const
+{
+  if ( !_use_ref ) return NULL;
+
+  TrueMappingCache & cache = *_true_mapping_cache;
+  lock_guard<mutex> lock( cache.lock );
+  if ( cache.mapping ) return cache.mapping.get();
+
+  // If the TrueMapping is being built in the background, wait for it.  Otherwise, build it now.
+  if ( cache.build.valid() )
+    cache.mapping = cache.build.get();
+  else {
+    assert( !_SAM_files.empty() );
+
+    // Call these functions to fill the cache variables _ref_contig_names and _draft_contig_names, respectively.
+    LoadRefGenomeContigNames();
+    LoadDraftContigNames();
+
+    cache.mapping = BuildTrueMapping( _species, _sim_bin_size, _draft_contig_names, _ref_contig_names, _BLAST_file_head, _out_dir, _SAM_files[0] );
+  }
+
+  return cache.mapping.get();
+}
+
+
+
+// Start building the TrueMapping on a background thread, if there's a second core for it; LoadTrueMapping() waits for it.
+void
+RunParams::StartLoadingTrueMapping() const
+{
+  if ( !_use_ref ) return;
+
+  TrueMappingCache & cache = *_true_mapping_cache;
+  lock_guard<mutex> lock( cache.lock );
+  if ( cache.mapping || cache.build.valid() ) return;
+
+  // With only one core, or THREADS = 1, a background build would just compete with the calling thread for the CPU, so LoadTrueMapping() builds it instead.
+  if ( _N_threads < 2 || thread::hardware_concurrency() < 2 ) return;
+
+  assert( !_SAM_files.empty() );
+
+  // Fill the contig name caches on this thread, so the background thread never writes to this RunParams.  It gets its own copies of everything it reads.
+  LoadRefGenomeContigNames();
+  LoadDraftContigNames();
+
+  cache.build = async( launch::async, BuildTrueMapping, _species, _sim_bin_size, _draft_contig_names, _ref_contig_names,
+		       _BLAST_file_head, _out_dir, _SAM_files[0] ).share();
 }
 
 
@@ -33,9 +33,13 @@
 #define _RUN_PARAMS__H
 
 #include "TrueMapping.h"
+#include "LinkLibraries.h"
 
 #include <vector>
 #include <string>
+#include <memory> // shared_ptr
+#include <future> // shared_future
+#include <mutex>
 using namespace std;
 
 
@@ -44,7 +48,7 @@ class RunParams
 {
  public:
 
-  RunParams( const string & ini_file ) { ParseIniFile( ini_file ); }
+  RunParams( const string & ini_file ) : _true_mapping_cache( new TrueMappingCache ) { ParseIniFile( ini_file ); }
 
   void ParseIniFile( const string & ini_file );
 
@@ -56,12 +60,27 @@ class RunParams
   vector<string> * LoadDraftContigNames() const;
 
   // Get the filename that contains the number of restriction enzyme sites for each contig in the draft assembly.  This might require generating the file,
-  // by calling the script CountMotifsInFasta.pl.
-  string DraftContigRESitesFilename() const;
-
-  // Load a TrueMapping using the files in this RunParams object.
-  // If _use_ref == false, returns a NULL pointer; otherwise returns a new object that must be 'delete'd later to save memory.
-  TrueMapping * LoadTrueMapping() const;
+  // by calling the script CountMotifsInFasta.pl.  The sites are those of RE_site_seq, or of RE_SITE_SEQ if RE_site_seq is empty.
+  string DraftContigRESitesFilename( const string & RE_site_seq = "" ) const;
+
+  // Load the Hi-C libraries described in LIBRARIES_FILE.  If there's no LIBRARIES_FILE, return the default LinkLibraries (one library containing everything.)
+  LinkLibraries LoadLinkLibraries() const;
+  // The RE sites files used by the libraries in LIBRARIES_FILE whose enzymes differ from RE_SITE_SEQ, in the order of the libraries; empty if there's no
+  // LIBRARIES_FILE.  These are inputs to the link weights, so they go into the cache manifests.  This might require generating the files, as above.
+  vector<string> LibraryRESitesFilenames() const;
+
+  // Load a TrueMapping using the files in this RunParams object.  If _use_ref == false, returns a NULL pointer.
+  // After the first call, the TrueMapping is cached, and every later call (including calls on copies of this RunParams) returns the same object.  It's owned by
+  // the RunParams and its copies, so don't delete it; it's const, so it can be shared by all the stages and threads.
+  // If StartLoadingTrueMapping() was called, this waits for the background build to finish, instead of building the TrueMapping again.
+  const TrueMapping * LoadTrueMapping() const;
+
+  // Start building the TrueMapping on a background thread, and return at once.  Parsing the BLAST alignments takes a while, and doesn't depend on the Hi-C
+  // data, so a stage that needs the TrueMapping calls this first, reads its SAM files or cached data meanwhile, and calls LoadTrueMapping() once it needs the
+  // TrueMapping.  This does nothing if _use_ref == false, or if the TrueMapping has already been started or built.  It also does nothing if THREADS = 1 or
+  // the machine has only one core, where the build would only slow the calling thread down; then LoadTrueMapping() builds the TrueMapping when it's called.
+  // The background thread is separate from the THREADS pool, like the BackgroundWriter's.  Its messages may be interleaved with the calling thread's.
+  void StartLoadingTrueMapping() const;
 
   // Report the values of each parameter in this RunParams object (as they appeared in the ini file.)
   void PrintParams( ostream & out = cout ) const;
@@ -79,6 +98,7 @@ class RunParams
   string _SAM_dir; // directory containing SAM/BAM files
   vector<string> _SAM_files; // the set of SAM/BAM files
   string _RE_site_seq; // used in LoadDraftContigRESites(), which passes it to CountMotifsInFasta.pl
+  string _libraries_file; // describes the Hi-C libraries in the SAM files, for LoadLinkLibraries(); "." if there's none (optional; default ".")
 
   // Reference assembly files (optional).
   bool _use_ref;
@@ -88,15 +108,30 @@ class RunParams
   // Options for what steps of Lachesis to run.
   bool _do_clustering, _do_ordering, _do_reporting;
   bool _overwrite_GLM, _overwrite_CLMs;
+  bool _resume; // skip steps that the progress journal shows were already completed with the same inputs (optional; default 0)
+  int _N_threads; // size of the process-wide ThreadPool (optional; default 1)
+  int _memory_budget_MB; // if > 0, load link data out-of-core, buffering at most this many megabytes of links (optional; default 0)
+
+  // Parameters for misjoin detection (see MisjoinDetector.h.)
+  int _misjoin_window; // window length, in bp; 0 means don't look for misjoins (optional; default 100000)
+  double _misjoin_max_ratio; // highest ratio of observed to expected links that's flagged as a misjoin (optional; default 0.2)
 
   // Heuristic parameters for clustering.
   int _cluster_N, _cluster_min_RE_sites;
   vector<int> _cluster_CEN_contig_IDs;
   double _cluster_max_link_density, _cluster_noninformative_ratio;
+  int _cluster_balance_iterations; // if > 0, balance the GLM (see GenomeLinkMatrix::BalanceMatrix) in at most this many iterations (optional; default 0)
+  double _cluster_balance_tolerance; // convergence tolerance for balancing (optional; default 1e-4)
   bool _cluster_draw_heatmap, _cluster_draw_dotplot;
 
   // Heuristic parameters for ordering.
   int _order_min_N_REs_in_trunk, _order_min_N_REs_in_shreds;
+  bool _order_exhaustive_insertion; // if true, try every position for each shred, not just those next to contigs it shares links with (to check the shortcut)
+  int _order_beam_width; // 0: order with the spanning tree (MakeFullOrder); otherwise, by beam search (MakeBeamOrder) with this beam width
+  int _order_bootstrap_replicates; // number of bootstrap replicates used to find the support of each adjacency in the full orderings (0: none)
+  string _order_constraints_dir; // directory of curators' constraints files, group<i>.constraints (see OrderingConstraints.h), or "." for none
+  bool _order_incremental; // if true, re-optimize each group's existing ordering around the edited contigs instead of ordering from scratch
+  int _order_incremental_window; // how far the incremental mode looks for improvements around each edited contig
   bool _order_draw_dotplots;
 
   // Heuristic parameters for reporting.
@@ -132,6 +167,14 @@ class RunParams
   mutable vector<string> _ref_contig_names;   // filled by GetRefGenomeContigNames()
   mutable vector<string> _draft_contig_names; // filled by GetDraftContigNames()
 
+  // The TrueMapping cache.  It's made by the constructor, and copies of this RunParams share it, so they all load the same TrueMapping.
+  struct TrueMappingCache {
+    mutex lock; // only one thread starts or builds the TrueMapping; any others wait for it
+    shared_ptr<const TrueMapping> mapping; // filled by LoadTrueMapping()
+    shared_future< shared_ptr<const TrueMapping> > build; // the background build started by StartLoadingTrueMapping(), if any
+  };
+  shared_ptr<TrueMappingCache> _true_mapping_cache;
+
 };
 
 
@@ -0,0 +1,555 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * SimulateHiC.cc
+ *
+ * SimulateHiC: Make a synthetic Hi-C dataset that Lachesis can run on, for benchmarking at scales that the bundled test case can't reach.  The dataset is a
+ * function of the arguments alone - the same arguments give byte-identical files on any machine - so a run on it can be reproduced anywhere.
+ *
+ * The simulated genome consists of N_CHROMS chromosomes, tiled without gaps by N_CONTIGS contigs of the draft assembly.  The contig lengths are drawn from a
+ * log-normal distribution, and each contig is randomly oriented on its chromosome.  The contigs are listed in the draft assembly in random order.
+ * Each contig's sequence is random, and its RE sites are counted in that sequence, so the RE sites file is consistent with the FASTA if that is written too.
+ *
+ * Each of the N_LINKS read pairs is either:
+ * -- an intra-chromosomal link: the first read is placed uniformly on the genome, and the second read a distance d away on the same chromosome, where d is
+ *    drawn from a power law P(d) ~ d^-LINK_EXPONENT on [MIN_LINK_DIST, chromosome length].  (In real Hi-C data, the exponent is about 1.)
+ * -- with probability NOISE_FRACTION, a noise link: both reads are placed uniformly and independently on the genome, so most of these are inter-chromosomal.
+ * Each read is given a random strand and placed on the contig that contains it, with mapping quality 60.
+ *
+ * Syntax: SimulateHiC OUT_DIR=<dir> [ARG=value ...]
+ * Arguments (and defaults):
+ * OUT_DIR                  The directory to make the dataset in.  It's created if necessary.
+ * SEED = 1                 The seed of the random number generators.
+ * N_CHROMS = 20            Number of chromosomes in the genome.
+ * N_CONTIGS = 1000         Number of contigs in the draft assembly.  Must be at least N_CHROMS.
+ * N_LINKS = 1000000        Number of Hi-C read pairs.
+ * CONTIG_LEN_MEDIAN = 50000, CONTIG_LEN_SIGMA = 0.8
+ *                          The contig lengths are log-normally distributed, with this median and this standard deviation of the natural log of the length.
+ * MIN_CONTIG_LEN = 1000    Shorter contig lengths are raised to this.
+ * LINK_EXPONENT = 1        The exponent of the power-law link size distribution.
+ * MIN_LINK_DIST = 1000     The shortest intra-chromosomal link.
+ * NOISE_FRACTION = 0.1     The fraction of read pairs that are noise links.
+ * READ_LENGTH = 100        The length of each read.
+ * RE_SITE_SEQ = AAGCTT     The restriction site motif to count in each contig.
+ * WRITE_FASTA = 0          If 1, write the draft assembly's sequence.  Lachesis doesn't need it (it only reads the .names and RE sites files.)
+ * FORMAT = sam             The format of the read pairs: sam or bam.
+ * SORT = name              The order of the read pairs: name (the two reads of each pair are adjacent, as Lachesis requires) or coord (sorted by position,
+ *                          for other tools; the whole dataset is held in memory to sort it.)
+ *
+ * Output files, in OUT_DIR:
+ * draft/assembly.fasta.names, draft/assembly.fasta.counts_<RE_SITE_SEQ>.txt, draft/assembly.fasta (only if WRITE_FASTA = 1)
+ * ref/genome.fasta.names                   The chromosome names.  There's no reference FASTA: the true mapping (below) is given directly.
+ * SAMs/sim.sam or SAMs/sim.bam             The Hi-C read pairs, aligned to the draft assembly.
+ * out/cached_data/TrueMapping.assembly.txt The true position of each contig on the chromosomes, as TrueMapping reads it from its cache.
+ * sim.ini                                  An INI file for running Lachesis on the dataset, with OUTPUT_DIR = OUT_DIR/out and CLUSTER_N = N_CHROMS.
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+
+// C libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // strstr (in ParsedArgs.h)
+#include <stdint.h>
+#include <assert.h>
+#include <math.h>
+
+// STL declarations
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <algorithm> // upper_bound, sort, transform
+#include <random> // mt19937_64
+using namespace std;
+
+// Modules in ~/include
+#include "ParsedArgs.h"
+#include <sam.h> // samopen etc., to convert SAM to BAM
+
+// Boost includes
+#include <boost/filesystem.hpp>
+
+
+
+
+// The random number generators.  The standard library's distributions aren't specified exactly, so they can give different numbers on different platforms;
+// instead, the numbers are derived directly from mt19937_64, whose output is specified exactly.
+class SimRNG
+{
+ public:
+  // Each stream of random numbers has its own generator, so that e.g. changing N_LINKS doesn't change the draft assembly.
+  SimRNG( const uint64_t seed, const uint64_t stream ) : _gen( seed ^ ( stream * 0x9E3779B97F4A7C15ULL ) ) {}
+
+  uint64_t Bits() { return _gen(); }
+  // A uniform double in [0,1).
+  double Uniform() { return ( _gen() >> 11 ) * ( 1.0 / 9007199254740992.0 ); }
+  // A uniform integer in [0,n).  The bias is negligible for any n we use.
+  int64_t Int( const int64_t n ) { return _gen() % n; }
+  // A standard normal deviate, by the Box-Muller transform.
+  double Normal() { return sqrt( -2 * log( 1 - Uniform() ) ) * cos( 2 * M_PI * Uniform() ); }
+
+ private:
+  mt19937_64 _gen;
+};
+
+
+
+// A contig in the simulated genome.  The contigs are indexed in genome order (chromosome, then position.)
+struct SimContig {
+  int chrom;
+  int64_t start; // position on the genome (not the chromosome), so the contig containing any point can be found by binary search
+  int length;
+  bool rc; // true if the contig is reverse-complemented relative to its chromosome
+  int draft_ID; // the contig's ID in the draft assembly
+};
+
+
+
+// A Hi-C read pair, aligned to the draft assembly.
+struct SimPair {
+  int tid[2], pos[2]; // pos is 0-indexed
+  bool rev[2];
+};
+
+
+
+// A read, for sorting by position.
+struct SimRead {
+  int tid, pos;
+  uint32_t pair_ID; // 2 * pair ID + (0 or 1, for the first or second read)
+  bool operator<( const SimRead & r ) const {
+    if ( tid != r.tid ) return tid < r.tid;
+    if ( pos != r.pos ) return pos < r.pos;
+    return pair_ID < r.pair_ID;
+  }
+};
+
+
+
+
+
+// MakeContigs: Make the draft assembly's contigs, and lay them out on the chromosomes.  Also find the genome position at which each chromosome starts.
+vector<SimContig>
+MakeContigs( SimRNG & rng, const int N_chroms, const int N_contigs, const int len_median, const double len_sigma, const int min_len,
+	     vector<int64_t> & chrom_starts )
+{
+  // Decide how many contigs go on each chromosome.  The chromosomes' sizes vary by up to a factor of 3; each gets at least one contig.
+  vector<double> weights( N_chroms );
+  double total_weight = 0;
+  for ( int i = 0; i < N_chroms; i++ ) {
+    weights[i] = 0.5 + rng.Uniform();
+    total_weight += weights[i];
+  }
+
+  vector<int> N_on_chrom( N_chroms, 1 );
+  int N_assigned = N_chroms;
+  for ( int i = 0; i < N_chroms; i++ ) {
+    const int N = int( ( N_contigs - N_chroms ) * weights[i] / total_weight );
+    N_on_chrom[i] += N;
+    N_assigned += N;
+  }
+  for ( int i = 0; N_assigned < N_contigs; i = ( i + 1 ) % N_chroms, N_assigned++ ) // hand out the remainder from rounding down
+    N_on_chrom[i]++;
+
+
+  // Make the contigs, in genome order.
+  vector<SimContig> contigs;
+  contigs.reserve( N_contigs );
+  chrom_starts.clear();
+  int64_t pos = 0;
+
+  for ( int i = 0; i < N_chroms; i++ ) {
+    chrom_starts.push_back( pos );
+    for ( int j = 0; j < N_on_chrom[i]; j++ ) {
+      SimContig contig;
+      contig.chrom = i;
+      contig.start = pos;
+      contig.length = max( min_len, int( len_median * exp( len_sigma * rng.Normal() ) ) );
+      contig.rc = rng.Bits() & 1;
+      contig.draft_ID = -1;
+      contigs.push_back( contig );
+      pos += contig.length;
+    }
+  }
+  chrom_starts.push_back( pos ); // the end of the genome
+
+
+  // Shuffle the contigs' order in the draft assembly (Fisher-Yates.)
+  vector<int> draft_order( N_contigs );
+  for ( int i = 0; i < N_contigs; i++ ) draft_order[i] = i;
+  for ( int i = N_contigs - 1; i > 0; i-- ) swap( draft_order[i], draft_order[ rng.Int( i+1 ) ] );
+  for ( int i = 0; i < N_contigs; i++ ) contigs[ draft_order[i] ].draft_ID = i;
+
+  return contigs;
+}
+
+
+
+// LinkDistance: Draw a link distance from the power law P(d) ~ d^-alpha on [d_min, d_max], by inverting its cumulative distribution.
+int64_t
+LinkDistance( SimRNG & rng, const double alpha, const double d_min, const double d_max )
+{
+  const double u = rng.Uniform();
+  if ( fabs( alpha - 1 ) < 1e-9 ) return int64_t( d_min * pow( d_max / d_min, u ) );
+  const double a = pow( d_min, 1 - alpha ), b = pow( d_max, 1 - alpha );
+  return int64_t( pow( a + u * ( b - a ), 1 / ( 1 - alpha ) ) );
+}
+
+
+
+// PlaceRead: Find the contig containing a genome position, and place a read there on the draft assembly, with a random strand.
+void
+PlaceRead( SimRNG & rng, const vector<SimContig> & contigs, const int64_t genome_pos, const int read_len, int & tid, int & pos, bool & rev )
+{
+  // Find the last contig that starts at or before genome_pos.
+  int lo = 0, hi = contigs.size();
+  while ( hi - lo > 1 ) {
+    const int mid = ( lo + hi ) / 2;
+    if ( contigs[mid].start <= genome_pos ) lo = mid;
+    else hi = mid;
+  }
+  const SimContig & contig = contigs[lo];
+
+  int offset = genome_pos - contig.start;
+  if ( contig.rc ) offset = contig.length - 1 - offset;
+
+  tid = contig.draft_ID;
+  pos = max( 0, min( offset, contig.length - read_len ) );
+  rev = rng.Bits() & 1;
+}
+
+
+
+// MakePair: Make one Hi-C read pair.
+SimPair
+MakePair( SimRNG & rng, const vector<SimContig> & contigs, const vector<int64_t> & chrom_starts, const double alpha, const int min_link_dist,
+	  const double noise_fraction, const int read_len )
+{
+  const int64_t genome_len = chrom_starts.back();
+  int64_t pos1 = rng.Int( genome_len ), pos2;
+
+  if ( rng.Uniform() < noise_fraction ) pos2 = rng.Int( genome_len );
+
+  else {
+    // Find the chromosome of the first read, and place the second read on it.  If the link runs off one end of the chromosome, try the other direction; if
+    // it's too long for either, draw another distance.  (Links longer than the chromosome are impossible, so this always terminates.)
+    const int chrom = upper_bound( chrom_starts.begin(), chrom_starts.end(), pos1 ) - chrom_starts.begin() - 1;
+    const int64_t chrom_start = chrom_starts[chrom], chrom_end = chrom_starts[chrom+1];
+    const double d_max = max( double( min_link_dist ), double( chrom_end - chrom_start ) );
+
+    while ( true ) {
+      const int64_t d = LinkDistance( rng, alpha, min_link_dist, d_max );
+      const int64_t sign = ( rng.Bits() & 1 ) ? 1 : -1;
+      pos2 = pos1 + sign * d;
+      if ( pos2 >= chrom_start && pos2 < chrom_end ) break;
+      pos2 = pos1 - sign * d;
+      if ( pos2 >= chrom_start && pos2 < chrom_end ) break;
+      if ( chrom_end - chrom_start <= min_link_dist ) { pos2 = pos1; break; } // a chromosome that's shorter than any link: give up
+    }
+  }
+
+  SimPair pair;
+  PlaceRead( rng, contigs, pos1, read_len, pair.tid[0], pair.pos[0], pair.rev[0] );
+  PlaceRead( rng, contigs, pos2, read_len, pair.tid[1], pair.pos[1], pair.rev[1] );
+  return pair;
+}
+
+
+
+// WriteSAMRead: Write one read of a read pair as a line of a SAM file.
+void
+WriteSAMRead( ostream & out, const SimPair & pair, const uint32_t pair_ID, const int i, const vector<string> & contig_names, const int read_len )
+{
+  const int j = 1 - i; // the mate
+  int flag = 0x1 | ( i == 0 ? 0x40 : 0x80 );
+  if ( pair.rev[i] ) flag |= 0x10;
+  if ( pair.rev[j] ) flag |= 0x20;
+
+  out << 'p' << pair_ID << '\t' << flag << '\t' << contig_names[ pair.tid[i] ] << '\t' << pair.pos[i] + 1 << "\t60\t" << read_len << "M\t"
+      << ( pair.tid[i] == pair.tid[j] ? string( "=" ) : contig_names[ pair.tid[j] ] ) << '\t' << pair.pos[j] + 1 << "\t0\t*\t*\n";
+}
+
+
+
+// WriteContigSequences: Make a random sequence for each contig, and count the occurrences of the RE site motif in it (on the forward strand only, as
+// CountMotifsInFasta.pl does.)  If fasta_file isn't empty, also write the sequences to it.  Only one contig's sequence is in memory at a time.
+vector<int>
+WriteContigSequences( SimRNG & rng, const vector<int> & contig_lengths, const vector<string> & contig_names, const string & RE_site_seq,
+		      const string & fasta_file )
+{
+  static const char bases[4] = { 'A', 'C', 'G', 'T' };
+  const size_t motif_len = RE_site_seq.size();
+
+  ofstream fasta;
+  if ( !fasta_file.empty() ) fasta.open( fasta_file.c_str(), ios::out );
+
+  vector<int> RE_sites( contig_lengths.size(), 0 );
+  string seq;
+
+  for ( size_t i = 0; i < contig_lengths.size(); i++ ) {
+
+    // Each 64-bit random number gives 32 bases.
+    seq.resize( contig_lengths[i] );
+    for ( size_t j = 0; j < seq.size(); j += 32 ) {
+      uint64_t bits = rng.Bits();
+      for ( size_t k = j; k < j + 32 && k < seq.size(); k++, bits >>= 2 )
+	seq[k] = bases[ bits & 3 ];
+    }
+
+    for ( size_t pos = seq.find( RE_site_seq ); pos != string::npos; pos = seq.find( RE_site_seq, pos + motif_len ) )
+      RE_sites[i]++;
+
+    if ( fasta.is_open() ) {
+      fasta << '>' << contig_names[i] << '\n';
+      for ( size_t j = 0; j < seq.size(); j += 80 )
+	fasta << seq.substr( j, 80 ) << '\n';
+    }
+  }
+
+  return RE_sites;
+}
+
+
+
+// ConvertSAMToBAM: Convert a SAM file into a BAM file, as 'samtools view -b' would.
+void
+ConvertSAMToBAM( const string & SAM_file, const string & BAM_file )
+{
+  samfile_t * in = samopen( SAM_file.c_str(), "r", 0 );
+  if ( in == NULL || in->header == NULL ) {
+    cerr << "ERROR: SimulateHiC: Can't read SAM file " << SAM_file << endl;
+    exit(1);
+  }
+  samfile_t * out = samopen( BAM_file.c_str(), "wb", in->header );
+  if ( out == NULL ) {
+    cerr << "ERROR: SimulateHiC: Can't write BAM file " << BAM_file << endl;
+    exit(1);
+  }
+
+  bam1_t * b = bam_init1();
+  while ( samread( in, b ) >= 0 )
+    samwrite( out, b );
+  bam_destroy1( b );
+
+  samclose( out );
+  samclose( in );
+}
+
+
+
+
+
+int main( int argc, char * argv[] )
+{
+  ParsedArgs args = ParseArgs( argc, argv );
+  if ( argc == 1 ) {
+    cout << "Syntax: SimulateHiC OUT_DIR=<dir> [ARG=value ...]" << endl;
+    cout << "For the arguments, see SimulateHiC.cc." << endl;
+    return 1;
+  }
+  args.Require( "OUT_DIR" );
+  args.RequireOrDefault( "SEED", "1" );
+  args.RequireOrDefault( "N_CHROMS", "20" );
+  args.RequireOrDefault( "N_CONTIGS", "1000" );
+  args.RequireOrDefault( "N_LINKS", "1000000" );
+  args.RequireOrDefault( "CONTIG_LEN_MEDIAN", "50000" );
+  args.RequireOrDefault( "CONTIG_LEN_SIGMA", "0.8" );
+  args.RequireOrDefault( "MIN_CONTIG_LEN", "1000" );
+  args.RequireOrDefault( "LINK_EXPONENT", "1" );
+  args.RequireOrDefault( "MIN_LINK_DIST", "1000" );
+  args.RequireOrDefault( "NOISE_FRACTION", "0.1" );
+  args.RequireOrDefault( "READ_LENGTH", "100" );
+  args.RequireOrDefault( "RE_SITE_SEQ", "AAGCTT" );
+  args.RequireOrDefault( "WRITE_FASTA", "0" );
+  args.RequireOrDefault( "FORMAT", "sam" );
+  args.RequireOrDefault( "SORT", "name" );
+
+  const string out_dir = boost::filesystem::absolute( args["OUT_DIR"] ).string();
+  const uint64_t seed = args.ValueAsInt( "SEED" );
+  const int N_chroms = args.ValueAsInt( "N_CHROMS" );
+  const int N_contigs = args.ValueAsInt( "N_CONTIGS" );
+  const int64_t N_links = int64_t( args.ValueAsDouble( "N_LINKS" ) ); // may be more than 2^31
+  const int len_median = args.ValueAsInt( "CONTIG_LEN_MEDIAN" );
+  const double len_sigma = args.ValueAsDouble( "CONTIG_LEN_SIGMA" );
+  const int min_len = args.ValueAsInt( "MIN_CONTIG_LEN" );
+  const double alpha = args.ValueAsDouble( "LINK_EXPONENT" );
+  const int min_link_dist = args.ValueAsInt( "MIN_LINK_DIST" );
+  const double noise_fraction = args.ValueAsDouble( "NOISE_FRACTION" );
+  const int read_len = args.ValueAsInt( "READ_LENGTH" );
+  const string RE_site_seq = args["RE_SITE_SEQ"];
+  const bool write_fasta = args.ValueAsBool( "WRITE_FASTA" );
+  const string format = args["FORMAT"];
+  const string sort_order = args["SORT"];
+
+  // Sanity checks.
+  if ( N_chroms < 1 || N_contigs < N_chroms ) { cerr << "ERROR: SimulateHiC: Need 1 <= N_CHROMS <= N_CONTIGS" << endl; return 1; }
+  if ( N_links < 1 || N_links > 2000000000 ) { cerr << "ERROR: SimulateHiC: N_LINKS must be between 1 and 2e9" << endl; return 1; }
+  if ( min_len < read_len || read_len < 1 ) { cerr << "ERROR: SimulateHiC: Need 1 <= READ_LENGTH <= MIN_CONTIG_LEN" << endl; return 1; }
+  if ( min_link_dist < 1 ) { cerr << "ERROR: SimulateHiC: MIN_LINK_DIST must be positive" << endl; return 1; }
+  if ( noise_fraction < 0 || noise_fraction > 1 ) { cerr << "ERROR: SimulateHiC: NOISE_FRACTION must be between 0 and 1" << endl; return 1; }
+  if ( RE_site_seq.empty() || RE_site_seq.find_first_not_of( "ACGT" ) != string::npos ) {
+    cerr << "ERROR: SimulateHiC: RE_SITE_SEQ must be a sequence of A, C, G, and T" << endl;
+    return 1;
+  }
+  if ( format != "sam" && format != "bam" ) { cerr << "ERROR: SimulateHiC: FORMAT must be sam or bam" << endl; return 1; }
+  if ( sort_order != "name" && sort_order != "coord" ) { cerr << "ERROR: SimulateHiC: SORT must be name or coord" << endl; return 1; }
+
+  const string draft_fasta = out_dir + "/draft/assembly.fasta";
+  const string ref_fasta = out_dir + "/ref/genome.fasta";
+  const string SAM_dir = out_dir + "/SAMs";
+  const string Lachesis_out_dir = out_dir + "/out";
+  for ( const string & dir : { out_dir + "/draft", out_dir + "/ref", SAM_dir, Lachesis_out_dir + "/cached_data" } )
+    boost::filesystem::create_directories( dir );
+
+
+  // 1. Make the contigs and lay them out on the chromosomes.
+  cout << "SimulateHiC: Making " << N_contigs << " contigs on " << N_chroms << " chromosomes" << endl;
+  SimRNG layout_rng( seed, 0 );
+  vector<int64_t> chrom_starts;
+  const vector<SimContig> contigs = MakeContigs( layout_rng, N_chroms, N_contigs, len_median, len_sigma, min_len, chrom_starts );
+  cout << "SimulateHiC: Genome length = " << chrom_starts.back() << endl;
+
+  vector<string> contig_names( N_contigs ), chrom_names( N_chroms );
+  vector<int> contig_lengths( N_contigs );
+  for ( int i = 0; i < N_contigs; i++ ) {
+    contig_names[ contigs[i].draft_ID ] = "contig_" + to_string( contigs[i].draft_ID );
+    contig_lengths[ contigs[i].draft_ID ] = contigs[i].length;
+  }
+  for ( int i = 0; i < N_chroms; i++ ) chrom_names[i] = "chr" + to_string( i+1 );
+
+
+  // 2. Write the names files, the contig sequences (if requested), and the RE sites file.
+  {
+    ofstream draft_names( ( draft_fasta + ".names" ).c_str(), ios::out );
+    for ( int i = 0; i < N_contigs; i++ ) draft_names << contig_names[i] << '\n';
+    ofstream ref_names( ( ref_fasta + ".names" ).c_str(), ios::out );
+    for ( int i = 0; i < N_chroms; i++ ) ref_names << chrom_names[i] << '\n';
+  }
+
+  cout << "SimulateHiC: Counting RE sites" << ( write_fasta ? " and writing draft assembly sequence" : "" ) << endl;
+  SimRNG seq_rng( seed, 1 );
+  const vector<int> RE_sites = WriteContigSequences( seq_rng, contig_lengths, contig_names, RE_site_seq, write_fasta ? draft_fasta : "" );
+  {
+    ofstream RE_file( ( draft_fasta + ".counts_" + RE_site_seq + ".txt" ).c_str(), ios::out );
+    for ( int i = 0; i < N_contigs; i++ ) RE_file << contig_names[i] << '\t' << RE_sites[i] << '\n';
+  }
+
+
+  // 3. Write the true mapping, in the format of the cache file made by ParseBlastAlignmentFiles() in TextFileParsers.cc.  Every contig aligns perfectly.
+  {
+    ofstream TM_file( ( Lachesis_out_dir + "/cached_data/TrueMapping.assembly.txt" ).c_str(), ios::out );
+    TM_file << "# This file was created by SimulateHiC\n#\n";
+    TM_file << "# N assembly contigs = " << N_contigs << "\n# N reference contigs = " << N_chroms << "\n#\n";
+    TM_file << "# There is one row for each query, containing six numbers:\n";
+    TM_file << "# query_ID\tbest_target\tstart_on_target\tstop_on_target\tunique_alignability\ttarget_specificity\n";
+
+    vector<const SimContig *> by_draft_ID( N_contigs );
+    for ( int i = 0; i < N_contigs; i++ ) by_draft_ID[ contigs[i].draft_ID ] = &contigs[i];
+    for ( int i = 0; i < N_contigs; i++ ) {
+      const SimContig & c = *by_draft_ID[i];
+      const int64_t start = c.start - chrom_starts[c.chrom] + 1, stop = start + c.length - 1;
+      TM_file << i << '\t' << c.chrom << '\t' << ( c.rc ? stop : start ) << '\t' << ( c.rc ? start : stop ) << "\t1\t1\n";
+    }
+  }
+
+
+  // 4. Make the read pairs, and write them to a SAM file.
+  cout << "SimulateHiC: Making " << N_links << " Hi-C read pairs" << endl;
+  SimRNG link_rng( seed, 2 );
+  const string SAM_file = SAM_dir + "/sim.sam";
+  {
+    ofstream SAM( SAM_file.c_str(), ios::out );
+    SAM << "@HD\tVN:1.0\tSO:" << ( sort_order == "name" ? "queryname" : "coordinate" ) << '\n';
+    for ( int i = 0; i < N_contigs; i++ ) SAM << "@SQ\tSN:" << contig_names[i] << "\tLN:" << contig_lengths[i] << '\n';
+    SAM << "@PG\tID:SimulateHiC\tPN:SimulateHiC\n";
+
+    // Name-sorted: write each read pair as it's made.
+    if ( sort_order == "name" )
+      for ( int64_t i = 0; i < N_links; i++ ) {
+	const SimPair pair = MakePair( link_rng, contigs, chrom_starts, alpha, min_link_dist, noise_fraction, read_len );
+	WriteSAMRead( SAM, pair, i, 0, contig_names, read_len );
+	WriteSAMRead( SAM, pair, i, 1, contig_names, read_len );
+      }
+
+    // Coordinate-sorted: make all the read pairs, then sort their reads.  The pairs are made in the same order as above, so the two files have the same data.
+    else {
+      vector<SimPair> pairs( N_links );
+      vector<SimRead> reads( 2 * N_links );
+      for ( int64_t i = 0; i < N_links; i++ ) {
+	pairs[i] = MakePair( link_rng, contigs, chrom_starts, alpha, min_link_dist, noise_fraction, read_len );
+	for ( int j = 0; j < 2; j++ ) {
+	  SimRead read = { pairs[i].tid[j], pairs[i].pos[j], uint32_t( 2*i + j ) };
+	  reads[ 2*i + j ] = read;
+	}
+      }
+      sort( reads.begin(), reads.end() );
+      for ( size_t i = 0; i < reads.size(); i++ )
+	WriteSAMRead( SAM, pairs[ reads[i].pair_ID / 2 ], reads[i].pair_ID / 2, reads[i].pair_ID % 2, contig_names, read_len );
+    }
+  }
+
+  string SAM_name = "sim.sam";
+  if ( format == "bam" ) {
+    cout << "SimulateHiC: Converting to BAM" << endl;
+    ConvertSAMToBAM( SAM_file, SAM_dir + "/sim.bam" );
+    boost::filesystem::remove( SAM_file );
+    SAM_name = "sim.bam";
+  }
+
+
+  // 5. Write an INI file for running Lachesis on this dataset.  The heuristic parameters are as in test_case.ini.
+  {
+    ofstream ini( ( out_dir + "/sim.ini" ).c_str(), ios::out );
+    ini << "# Lachesis INI file for a dataset made by SimulateHiC with:";
+    for ( int i = 1; i < argc; i++ ) ini << ' ' << argv[i];
+    ini << "\n\n";
+    ini << "SPECIES = simulated\n";
+    ini << "OUTPUT_DIR = " << Lachesis_out_dir << '\n';
+    ini << "DRAFT_ASSEMBLY_FASTA = " << draft_fasta << '\n';
+    ini << "SAM_DIR = " << SAM_dir << '\n';
+    ini << "SAM_FILES = " << SAM_name << '\n';
+    ini << "RE_SITE_SEQ = " << RE_site_seq << '\n';
+    ini << "USE_REFERENCE = 1\n";
+    ini << "SIM_BIN_SIZE = 0\n";
+    ini << "REF_ASSEMBLY_FASTA = " << ref_fasta << '\n';
+    ini << "BLAST_FILE_HEAD = " << out_dir << "/draft/assembly\n";
+    ini << "DO_CLUSTERING = 1\nDO_ORDERING = 1\nDO_REPORTING = 1\n";
+    ini << "OVERWRITE_GLM = 0\nOVERWRITE_CLMS = 0\n";
+    ini << "CLUSTER_N = " << N_chroms << '\n';
+    ini << "CLUSTER_CONTIGS_WITH_CENS = -1\n";
+    ini << "CLUSTER_MIN_RE_SITES = 25\n";
+    ini << "CLUSTER_MAX_LINK_DENSITY = 2\n";
+    ini << "CLUSTER_NONINFORMATIVE_RATIO = 3\n";
+    ini << "CLUSTER_DRAW_HEATMAP = 0\nCLUSTER_DRAW_DOTPLOT = 0\n";
+    ini << "ORDER_MIN_N_RES_IN_TRUNK = 15\n";
+    ini << "ORDER_MIN_N_RES_IN_SHREDS = 15\n";
+    ini << "ORDER_DRAW_DOTPLOTS = 0\n";
+    ini << "REPORT_EXCLUDED_GROUPS = -1\n";
+    ini << "REPORT_QUALITY_FILTER = 1\n";
+    ini << "REPORT_DRAW_HEATMAP = 0\n";
+  }
+
+  cout << "SimulateHiC: Done!  To run Lachesis on this dataset: Lachesis " << out_dir << "/sim.ini" << endl;
+  return 0;
+}
@@ -34,8 +34,9 @@
 
 
 
+// The line buffer is per-thread, so that files can be parsed from several ThreadPool threads at once (e.g., when ChromLinkMatrix files are read in parallel.)
 static const unsigned LINE_LEN = 1000000;
-char LINE[LINE_LEN];
+static thread_local char LINE[LINE_LEN];
 
 
 
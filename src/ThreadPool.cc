@@ -0,0 +1,167 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+// For documentation, see ThreadPool.h
+#include "ThreadPool.h"
+
+// C libraries
+#include <assert.h>
+
+// STL declarations
+#include <atomic>
+#include <exception>
+#include <iostream>
+
+
+
+
+// Flag marking the pool's own worker threads.  Used by ParallelFor() to avoid nested parallelism.
+static thread_local bool in_worker = false;
+
+
+
+ThreadPool &
+ThreadPool::Global()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+
+
+void
+ThreadPool::SetNThreads( const int N )
+{
+  assert( N >= 1 );
+  assert( !InWorker() );
+  Global().Resize( N );
+}
+
+
+
+bool
+ThreadPool::InWorker()
+{
+  return in_worker;
+}
+
+
+
+// Resize: Stop all existing workers (after they finish the queued tasks), then start N-1 new ones.
+void
+ThreadPool::Resize( const int N )
+{
+  {
+    lock_guard<mutex> lock( _mutex );
+    _stop = true;
+  }
+  _cv.notify_all();
+  for ( size_t i = 0; i < _workers.size(); i++ )
+    _workers[i].join();
+  _workers.clear();
+
+  _stop = false;
+  for ( int i = 1; i < N; i++ )
+    _workers.push_back( thread( &ThreadPool::WorkerLoop, this ) );
+}
+
+
+
+void
+ThreadPool::WorkerLoop()
+{
+  in_worker = true;
+
+  while ( 1 ) {
+    packaged_task<void()> task;
+    {
+      unique_lock<mutex> lock( _mutex );
+      while ( !_stop && _tasks.empty() ) _cv.wait( lock );
+      if ( _tasks.empty() ) return; // _stop is set and there's nothing left to do
+      task = move( _tasks.front() );
+      _tasks.pop();
+    }
+    task();
+  }
+}
+
+
+
+// Submit: Queue a task to run on a worker thread.  If there are no worker threads, the task runs immediately on the calling thread.
+future<void>
+ThreadPool::Submit( const function<void()> & task )
+{
+  packaged_task<void()> pt( task );
+  future<void> result = pt.get_future();
+
+  if ( _workers.empty() ) {
+    pt();
+    return result;
+  }
+
+  {
+    lock_guard<mutex> lock( _mutex );
+    _tasks.push( move( pt ) );
+  }
+  _cv.notify_one();
+  return result;
+}
+
+
+
+// ParallelFor: Call body(i) for every i in [begin,end), using all of the pool's threads, and return when all calls are done.
+// Each thread (the calling thread plus up to N_threads()-1 workers) repeatedly claims the next unclaimed index until there are none left.
+void
+ThreadPool::ParallelFor( const int begin, const int end, const function<void(int)> & body )
+{
+  if ( end - begin <= 1 || _workers.empty() || InWorker() ) {
+    for ( int i = begin; i < end; i++ )
+      body(i);
+    return;
+  }
+
+  // If a call to body() throws, no more indices are claimed, so the other threads finish their current calls and stop.
+  atomic<int> next( begin );
+  const function<void()> claim_loop = [&next,end,&body]() {
+    try {
+      for ( int i = next++; i < end; i = next++ )
+	body(i);
+    }
+    catch ( ... ) {
+      next = end;
+      throw;
+    }
+  };
+
+  // Start helpers on the workers, then join in on the calling thread.
+  int N_helpers = min( (int) _workers.size(), end - begin - 1 );
+  vector< future<void> > helpers;
+  for ( int i = 0; i < N_helpers; i++ )
+    helpers.push_back( Submit( claim_loop ) );
+
+  // The helpers use this stack frame's locals, so wait for all of them to finish before returning or rethrowing, even if body() threw.
+  exception_ptr error;
+  try { claim_loop(); }
+  catch ( ... ) { error = current_exception(); }
+
+  for ( size_t i = 0; i < helpers.size(); i++ )
+    helpers[i].wait();
+  if ( error ) rethrow_exception( error );
+
+  // Rethrow the first exception from a helper, if any.
+  for ( size_t i = 0; i < helpers.size(); i++ )
+    helpers[i].get();
+}
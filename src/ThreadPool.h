@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// This software and its documentation are copyright (c) 2014-2015 by Joshua //
+// N. Burton and the University of Washington.  All rights are reserved.     //
+//                                                                           //
+// THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  //
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                //
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  //
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      //
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT //
+// OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  //
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+
+/**************************************************************************************************************************************************************
+ *
+ * ThreadPool.h
+ *
+ * The ThreadPool is the single, process-wide pool of worker threads that every stage of Lachesis uses for parallelism.  Its size is set once, at startup,
+ * from the INI parameter THREADS (see RunParams), by calling ThreadPool::SetNThreads().  Until then, and whenever THREADS = 1, everything runs serially on the
+ * calling thread, exactly as if there were no pool.
+ *
+ * There are two ways to use the pool:
+ *
+ * Submit(task): Queue a task to run on a worker thread.  Returns a future that can be waited on.
+ * ParallelFor(begin,end,body): Call body(i) for every i in [begin,end), spread across the workers and the calling thread.  Blocks until all calls are done.
+ *                              Indices are handed out one at a time, so iterations of very different cost (e.g., groups of different size) balance well.
+ *
+ * To avoid oversubscription (and deadlock), a ParallelFor that is called from inside a worker thread just runs serially on that worker.  So a parallel stage
+ * can call library code that itself uses ParallelFor, and the total number of busy threads never exceeds THREADS.
+ *
+ * The code that runs in parallel must be thread-safe.  In particular, output to cout from different threads may be interleaved.
+ *
+ *
+ *
+ * October 2026
+ *
+ *************************************************************************************************************************************************************/
+
+
+#ifndef _THREAD_POOL__H
+#define _THREAD_POOL__H
+
+
+#include <vector>
+#include <queue>
+#include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+using namespace std;
+
+
+
+
+class ThreadPool
+{
+ public:
+
+  // Global: The process-wide pool.
+  static ThreadPool & Global();
+
+  // SetNThreads: Set the number of threads in the global pool, counting the calling (main) thread.  N = 1 means no worker threads.
+  static void SetNThreads( const int N );
+
+  // The number of threads that ParallelFor() can keep busy, including the calling thread.
+  int N_threads() const { return _workers.size() + 1; }
+
+  // InWorker: Return true if the current thread is one of this process's pool threads.
+  static bool InWorker();
+
+  // Submit: Queue a task to run on a worker thread.  If there are no worker threads, the task runs immediately on the calling thread.
+  future<void> Submit( const function<void()> & task );
+
+  // ParallelFor: Call body(i) for every i in [begin,end), using all of the pool's threads, and return when all calls are done.
+  // If called from inside a worker thread, or if there's only one thread, this is a plain serial loop.
+  // If body() throws, no further indices are started; once every thread has stopped, the first exception (the calling thread's, if it threw) is rethrown.
+  void ParallelFor( const int begin, const int end, const function<void(int)> & body );
+
+  ~ThreadPool() { Resize( 1 ); }
+
+ private:
+
+  ThreadPool() : _stop( false ) {}
+  ThreadPool( const ThreadPool & );             // not copyable
+  ThreadPool & operator=( const ThreadPool & ); // not assignable
+
+  void Resize( const int N );
+  void WorkerLoop();
+
+  vector<thread> _workers;
+  queue< packaged_task<void()> > _tasks;
+  mutex _mutex;
+  condition_variable _cv;
+  bool _stop;
+};
+
+
+#endif
@@ -0,0 +1,329 @@
+#!/usr/bin/perl -w
+use strict;
+
+#############################################################################
+#                                                                           #
+# This software and its documentation are copyright (c) 2014-2015 by Joshua #
+# N. Burton and the University of Washington.  All rights are reserved.     #
+#                                                                           #
+# THIS SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS  #
+# OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF                #
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, AND NON-INFRINGEMENT.  #
+# IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY      #
+# CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT #
+# OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR  #
+# THE USE OR OTHER DEALINGS IN THE SOFTWARE.                                #
+#                                                                           #
+#############################################################################
+
+
+
+# PerfRegression.pl
+#
+# A performance regression harness for Lachesis.  Run Lachesis on one or more test cases several times each, and compare the wall time and peak memory of
+# each stage (as recorded by Lachesis in <OUTPUT_DIR>/stage_times.txt) to a baseline file.  Also check that the results - main_results/clusters.txt and
+# main_results/group*.ordering - are the same as in the baseline, so that a speedup can't silently change the results.
+#
+# By default, the only test case is the sample dataset, INIs/test_case.ini.  Larger synthetic test cases can be added with --simulate, which makes a
+# dataset with SimulateHiC (always the same dataset for the same arguments.)
+#
+# Each run starts from scratch: everything in OUTPUT_DIR is deleted first, except the true mapping in cached_data/, which Lachesis can't make itself.  Lachesis
+# also writes some files into its working directory (heatmap.txt, dotplot*.txt, clm.*.dotplot.txt); any file that a run adds there is deleted after it.
+# For each stage, the median wall time and median peak RSS over the runs are compared to the baseline.  A stage has regressed if it's slower than the
+# baseline by more than --time-tolerance (and by at least --min-seconds, to ignore noise in short stages), or if it uses more memory than the baseline by
+# more than --mem-tolerance.  The baseline's timings are only meaningful on the machine they were made on; use --update to make a new baseline.
+#
+# Run this from the directory that the INI files' paths are relative to (for the sample dataset, the Lachesis directory, where INIs/ is.)
+# 'make perf-check' does this.
+#
+# Exit status: 0 if there were no regressions and the results matched; 1 otherwise.
+#
+#
+# October 2026
+
+
+
+use Getopt::Long;
+use Digest::MD5;
+use File::Path qw(make_path remove_tree);
+
+
+
+my $lachesis = './Lachesis';
+my $simulate_HiC = './SimulateHiC';
+my @INIs;
+my @simulations;
+my $reps = 3;
+my $baseline_file = 'INIs/test_case.perf_baseline.txt';
+my $time_tolerance = 0.25;
+my $mem_tolerance = 0.10;
+my $min_seconds = 1;
+my $update = 0;
+
+my $syntax = "\nPerfRegression.pl: Check Lachesis for performance regressions and changed results, against a baseline.\n\n" .
+    "Syntax: $0 [options]\n" .
+    "  --lachesis <path>          the Lachesis executable (default: $lachesis)\n" .
+    "  --ini <INI-file>           a test case (may be given more than once; default: INIs/test_case.ini)\n" .
+    "  --simulate '<args>'        a synthetic test case, made by SimulateHiC with these arguments, e.g. 'N_CONTIGS=5000 N_LINKS=5000000'\n" .
+    "                             (may be given more than once)\n" .
+    "  --simulate-hic <path>      the SimulateHiC executable (default: $simulate_HiC)\n" .
+    "  --reps <N>                 the number of runs of each test case (default: $reps)\n" .
+    "  --baseline <file>          the baseline file (default: $baseline_file)\n" .
+    "  --time-tolerance <frac>    the allowed fractional increase in each stage's wall time (default: $time_tolerance)\n" .
+    "  --mem-tolerance <frac>     the allowed fractional increase in each stage's peak RSS (default: $mem_tolerance)\n" .
+    "  --min-seconds <sec>        ignore increases in wall time smaller than this (default: $min_seconds)\n" .
+    "  --update                   write the baseline file from these runs, instead of comparing to it\n\n";
+
+GetOptions( 'lachesis=s'       => \$lachesis,
+	    'ini=s'            => \@INIs,
+	    'simulate=s'       => \@simulations,
+	    'simulate-hic=s'   => \$simulate_HiC,
+	    'reps=i'           => \$reps,
+	    'baseline=s'       => \$baseline_file,
+	    'time-tolerance=f' => \$time_tolerance,
+	    'mem-tolerance=f'  => \$mem_tolerance,
+	    'min-seconds=f'    => \$min_seconds,
+	    'update'           => \$update ) or die $syntax;
+die $syntax if @ARGV || $reps < 1;
+die "$0: Can't find Lachesis executable `$lachesis`\n" unless -x $lachesis;
+@INIs = ( 'INIs/test_case.ini' ) unless @INIs || @simulations;
+
+
+
+
+################################
+#                              #
+#         SUBROUTINES          #
+#                              #
+################################
+
+
+# Return the median of a list of numbers.
+sub median(@) {
+    my @sorted = sort { $a <=> $b } @_;
+    return $sorted[ int( @sorted / 2 ) ];
+}
+
+
+# Read the value of a key from an INI file.
+sub INI_value($$) {
+    my ($INI,$key) = @_;
+    open INI, '<', $INI or die "$0: Can't open INI file `$INI`: $!\n";
+    while (<INI>) {
+	return $1 if /^\s*$key\s*=\s*(\S+)/;
+    }
+    close INI;
+    die "$0: INI file `$INI` has no $key\n";
+}
+
+
+# Delete everything in a Lachesis output directory, except the true mapping.
+sub clear_output_dir($) {
+    my ($out_dir) = @_;
+    return unless -d $out_dir;
+    opendir DIR, $out_dir or die "$0: Can't open directory `$out_dir`: $!\n";
+    my @files = grep { $_ ne '.' && $_ ne '..' } readdir DIR;
+    closedir DIR;
+    foreach my $file (@files) {
+	if ( $file eq 'cached_data' ) {
+	    opendir DIR, "$out_dir/cached_data" or die "$0: Can't open directory `$out_dir/cached_data`: $!\n";
+	    unlink map { "$out_dir/cached_data/$_" } grep { -f "$out_dir/cached_data/$_" && !/^TrueMapping\./ } readdir DIR;
+	    closedir DIR;
+	}
+	else { remove_tree( "$out_dir/$file" ); }
+    }
+}
+
+
+# List the plain files in a directory.
+sub plain_files($) {
+    my ($dir) = @_;
+    opendir DIR, $dir or die "$0: Can't open directory `$dir`: $!\n";
+    my @files = grep { -f "$dir/$_" } readdir DIR;
+    closedir DIR;
+    return @files;
+}
+
+
+# Read a stage_times.txt file into a list of [ stage, wall seconds, peak RSS in KB ].
+sub read_stage_times($) {
+    my ($file) = @_;
+    open TIMES, '<', $file or die "$0: Can't open `$file` (did Lachesis finish?): $!\n";
+    my @stages;
+    while (<TIMES>) {
+	next if /^#/;
+	chomp;
+	push @stages, [ split /\t/ ];
+    }
+    close TIMES;
+    return @stages;
+}
+
+
+# Find the MD5 checksum of each result file of a Lachesis run: main_results/clusters.txt and main_results/group*.ordering.
+sub result_checksums($) {
+    my ($out_dir) = @_;
+    my %checksums;
+    foreach my $file ( "$out_dir/main_results/clusters.txt", sort glob "$out_dir/main_results/group*.ordering" ) {
+	next unless -f $file;
+	open FILE, '<', $file or die "$0: Can't open `$file`: $!\n";
+	binmode FILE;
+	my ($name) = $file =~ m|([^/]+)$|;
+	$checksums{$name} = Digest::MD5->new->addfile(*FILE)->hexdigest;
+	close FILE;
+    }
+    return %checksums;
+}
+
+
+
+
+################################
+#                              #
+#     CONTROL STARTS HERE      #
+#                              #
+################################
+
+
+# Make the synthetic test cases.  Each one goes in its own directory under perf/, named by its arguments.
+my %case_INIs;
+my @cases;
+foreach my $INI (@INIs) {
+    die "$0: Can't find INI file `$INI`\n" unless -e $INI;
+    push @cases, $INI;
+    $case_INIs{$INI} = $INI;
+}
+foreach my $args (@simulations) {
+    die "$0: Can't find SimulateHiC executable `$simulate_HiC`\n" unless -x $simulate_HiC;
+    my $case = "sim[" . join( ',', split ' ', $args ) . "]";
+    ( my $dir = "perf/$case" ) =~ s/[^\w\/,.-]/_/g;
+    unless ( -e "$dir/sim.ini" ) {
+	make_path( 'perf' );
+	print localtime() . ": PerfRegression.pl: Making synthetic test case $case in $dir\n";
+	system( "$simulate_HiC OUT_DIR=$dir $args > $dir.log 2>&1" ) == 0 or die "$0: SimulateHiC failed; see $dir.log\n";
+    }
+    push @cases, $case;
+    $case_INIs{$case} = "$dir/sim.ini";
+}
+
+
+# Run each test case $reps times.
+my ( %times, %mems, %checksums ); # $times{$case}{$stage} = [ seconds from each run ]; $checksums{$case}{$file} = MD5
+my @stage_order;
+my $results_differ = 0;
+
+foreach my $case (@cases) {
+    my $INI = $case_INIs{$case};
+    my $out_dir = INI_value( $INI, 'OUTPUT_DIR' );
+
+    foreach my $rep ( 1 .. $reps ) {
+	print localtime() . ": PerfRegression.pl: Running $case ($rep of $reps)\n";
+	clear_output_dir( $out_dir );
+	make_path( $out_dir );
+	my %old_files = map { $_ => 1 } plain_files( '.' );
+	my $status = system( "$lachesis $INI > $out_dir.perf.log 2>&1" );
+	unlink grep { !$old_files{$_} } plain_files( '.' ); # the heatmaps and dotplots that Lachesis leaves in the working directory
+	die "$0: Lachesis failed on $INI; see $out_dir.perf.log\n" if $status != 0;
+
+	foreach my $stage ( read_stage_times( "$out_dir/stage_times.txt" ) ) {
+	    my ( $name, $seconds, $peak_KB ) = @$stage;
+	    push @stage_order, "$case\t$name" unless exists $times{$case}{$name};
+	    push @{ $times{$case}{$name} }, $seconds;
+	    push @{ $mems {$case}{$name} }, $peak_KB;
+	}
+
+	# The results must be the same in every run.
+	my %run_checksums = result_checksums( $out_dir );
+	die "$0: Lachesis made no results for $INI\n" unless %run_checksums;
+	if ( $rep == 1 ) { $checksums{$case} = \%run_checksums; next; }
+	foreach my $file ( sort keys %run_checksums ) {
+	    next if ( $checksums{$case}{$file} || '' ) eq $run_checksums{$file};
+	    print "RESULTS DIFFER: $case: $file is different in run $rep than in run 1\n";
+	    $results_differ = 1;
+	}
+    }
+}
+
+
+# If --update, write the new baseline and stop.
+if ( $update ) {
+    open BASELINE, '>', $baseline_file or die "$0: Can't write to baseline file `$baseline_file`: $!\n";
+    print BASELINE "# Performance baseline for bin/PerfRegression.pl, made " . localtime() . " with $reps run(s) per test case.\n";
+    print BASELINE "# The timings are only meaningful on the machine they were made on.  To remake this file, run PerfRegression.pl --update.\n";
+    print BASELINE "# time\t<test case>\t<stage>\t<median wall seconds>\t<median peak RSS in KB>\n";
+    print BASELINE "# result\t<test case>\t<file in main_results/>\t<MD5 checksum>\n";
+    foreach (@stage_order) {
+	my ( $case, $stage ) = split /\t/;
+	print BASELINE "time\t$case\t$stage\t", median( @{ $times{$case}{$stage} } ), "\t", median( @{ $mems{$case}{$stage} } ), "\n";
+    }
+    foreach my $case (@cases) {
+	print BASELINE "result\t$case\t$_\t$checksums{$case}{$_}\n" foreach sort keys %{ $checksums{$case} };
+    }
+    close BASELINE;
+    print localtime() . ": PerfRegression.pl: Wrote baseline file $baseline_file\n";
+    exit $results_differ;
+}
+
+
+# Read the baseline.
+my ( %base_times, %base_mems, %base_checksums );
+open BASELINE, '<', $baseline_file or die "$0: Can't open baseline file `$baseline_file` (use --update to make one): $!\n";
+while (<BASELINE>) {
+    next if /^#/;
+    chomp;
+    my ( $type, $case, @fields ) = split /\t/;
+    if ( $type eq 'time' ) {
+	$base_times{$case}{$fields[0]} = $fields[1];
+	$base_mems {$case}{$fields[0]} = $fields[2];
+    }
+    elsif ( $type eq 'result' ) { $base_checksums{$case}{$fields[0]} = $fields[1]; }
+}
+close BASELINE;
+
+
+# Compare the stages to the baseline.
+my $regressed = 0;
+printf "\n%-30s %-12s %12s %12s %8s %14s %14s %8s\n", 'TEST CASE', 'STAGE', 'BASE_SEC', 'SEC', 'CHANGE', 'BASE_PEAK_KB', 'PEAK_KB', 'CHANGE';
+foreach (@stage_order) {
+    my ( $case, $stage ) = split /\t/;
+    my $seconds = median( @{ $times{$case}{$stage} } );
+    my $peak_KB = median( @{ $mems {$case}{$stage} } );
+    unless ( exists $base_times{$case}{$stage} ) {
+	printf "%-30s %-12s %12s %12.2f %8s %14s %14d %8s\n", $case, $stage, '-', $seconds, '', '-', $peak_KB, '';
+	next;
+    }
+    my $base_seconds = $base_times{$case}{$stage};
+    my $base_peak_KB = $base_mems {$case}{$stage};
+    my $time_change = $base_seconds > 0 ? $seconds / $base_seconds - 1 : 0;
+    my $mem_change  = $base_peak_KB > 0 ? $peak_KB / $base_peak_KB - 1 : 0;
+
+    my @flags;
+    push @flags, 'SLOWER' if $time_change > $time_tolerance && $seconds - $base_seconds >= $min_seconds;
+    push @flags, 'MORE MEMORY' if $mem_change > $mem_tolerance;
+    $regressed = 1 if @flags;
+
+    printf "%-30s %-12s %12.2f %12.2f %+7.1f%% %14d %14d %+7.1f%% %s\n", $case, $stage, $base_seconds, $seconds, 100 * $time_change,
+    $base_peak_KB, $peak_KB, 100 * $mem_change, join( ', ', @flags );
+}
+print "\n";
+
+
+# Compare the results to the baseline.
+foreach my $case (@cases) {
+    unless ( exists $base_checksums{$case} ) {
+	print "NOTE: $case is not in the baseline, so its results weren't checked\n";
+	next;
+    }
+    my %files = map { $_ => 1 } ( keys %{ $base_checksums{$case} }, keys %{ $checksums{$case} } );
+    foreach my $file ( sort keys %files ) {
+	next if ( $base_checksums{$case}{$file} || '' ) eq ( $checksums{$case}{$file} || '' );
+	print "RESULTS DIFFER: $case: $file is ", ( exists $checksums{$case}{$file} ? ( exists $base_checksums{$case}{$file} ? 'different from the baseline' :
+												  'not in the baseline' ) : 'missing' ), "\n";
+	$results_differ = 1;
+    }
+}
+
+
+print "PerfRegression.pl: ", ( $regressed ? "PERFORMANCE REGRESSED" : "No performance regressions" ), "; ",
+    ( $results_differ ? "RESULTS CHANGED" : "results unchanged" ), "\n";
+exit( $regressed || $results_differ ? 1 : 0 );
@@ -83,3 +83,35 @@ double MemUsage( const bool VM )
    }
 }
 
+
+
+
+
+
+// Return the peak resident set size of this process in KB, since it started or since the last call to ResetPeakMemUsage().
+// Returns 0 if unable to read from /proc/self/status.
+double PeakMemUsage()
+{
+  std::ifstream status_stream( "/proc/self/status", std::ios_base::in );
+
+  // Look for the line "VmHWM:    1234 kB".
+  std::string key;
+  double peak_KB;
+  while ( status_stream >> key ) {
+    if ( key == "VmHWM:" && status_stream >> peak_KB ) return peak_KB;
+    status_stream.ignore( 1000000, '\n' );
+  }
+
+  return 0;
+}
+
+
+
+
+// Reset the peak resident set size reported by PeakMemUsage() to the current resident set size.
+// Writing "5" to /proc/self/clear_refs does this in Linux 4.0 or later; otherwise the write fails, and nothing happens.
+void ResetPeakMemUsage()
+{
+  std::ofstream clear_refs( "/proc/self/clear_refs", std::ios_base::out );
+  clear_refs << "5" << std::endl;
+}
@@ -19,6 +19,7 @@
  * TimeMem.h
  *
  * This module contains two functions: Time() and MemUsage().
+ * It also has PeakMemUsage() and ResetPeakMemUsage(), for measuring the peak memory of one part of a program.
  *
  *
  * Usage example:
@@ -46,4 +47,13 @@ string Time();
 double MemUsage( const bool VM = false );
 
 
+// Return the peak resident set size of this process in KB, since it started or since the last call to ResetPeakMemUsage().
+// Returns 0 if unable to read from /proc/self/status.
+double PeakMemUsage();
+
+// Reset the peak resident set size reported by PeakMemUsage() to the current resident set size.
+// This needs Linux 4.0 or later; otherwise it has no effect, and PeakMemUsage() keeps reporting the peak since the process started.
+void ResetPeakMemUsage();
+
+
 #endif